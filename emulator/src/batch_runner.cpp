@@ -0,0 +1,237 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#   include <unistd.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "batch_runner.h"
+#include "system.h"
+#include "ostime.h"
+#include "lua_script.h"
+#include "tinythread.h"
+
+
+void BatchRunner::addScript(const char *filename)
+{
+    Job job;
+    job.script = filename;
+    job.output = NULL;
+    job.pid = -1;
+    job.result = -1;
+    job.startTime = 0;
+    job.elapsed = 0;
+    jobs.push_back(job);
+}
+
+#ifdef _WIN32
+
+int BatchRunner::run()
+{
+    fprintf(stderr, "BATCH: Batch mode is not supported on this platform\n");
+    return 1;
+}
+
+#else
+
+int BatchRunner::run()
+{
+    if (jobs.empty()) {
+        fprintf(stderr, "BATCH: No scripts to run\n");
+        return 1;
+    }
+
+    /*
+     * Children must not share a file-backed flash image; their writes would
+     * land in the same MAP_SHARED mapping. They'd also fight over one GDB port.
+     */
+
+    if (!sys.opt_flashFilename.empty() || sys.opt_gdbServerPort) {
+        fprintf(stderr, "BATCH: Batch mode can't be used with -F or -P\n");
+        return 1;
+    }
+
+    unsigned limit = maxJobs ? maxJobs : tthread::thread::hardware_concurrency();
+    if (!limit)
+        limit = 1;
+
+    double batchStart = OSTime::clock();
+
+    // Format flash and install the launcher and games, once for everyone.
+    if (!sys.preinstall()) {
+        fprintf(stderr, "BATCH: Failed to prepare flash storage\n");
+        return 1;
+    }
+
+    // Anything still buffered would otherwise be printed again by each child
+    fflush(stdout);
+    fflush(stderr);
+
+    unsigned next = 0;
+    unsigned running = 0;
+    unsigned failures = 0;
+
+    while (next < jobs.size() || running) {
+
+        while (next < jobs.size() && running < limit) {
+            if (start(next)) {
+                running++;
+            } else {
+                failures++;
+            }
+            next++;
+        }
+
+        if (!running)
+            break;
+
+        int status;
+        int pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "BATCH: waitpid failed (%s)\n", strerror(errno));
+            return 1;
+        }
+
+        for (unsigned i = 0; i < jobs.size(); ++i) {
+            Job &job = jobs[i];
+            if (job.pid == pid) {
+                finish(job, status);
+                running--;
+                if (job.result)
+                    failures++;
+                break;
+            }
+        }
+    }
+
+    printf("BATCH: %u of %u scripts passed, %u at a time, in %.2f seconds\n",
+        unsigned(jobs.size()) - failures, unsigned(jobs.size()), limit,
+        OSTime::clock() - batchStart);
+    fflush(stdout);
+
+    return failures ? 1 : 0;
+}
+
+bool BatchRunner::start(unsigned index)
+{
+    /*
+     * Each child's stdout and stderr go to an anonymous temporary file,
+     * which we copy to our own stdout in one piece once the child exits.
+     * This keeps the logs from concurrent scripts from interleaving.
+     */
+
+    Job &job = jobs[index];
+
+    job.output = tmpfile();
+    if (!job.output) {
+        fprintf(stderr, "BATCH: [%s] can't create log file (%s)\n",
+            job.script.c_str(), strerror(errno));
+        return false;
+    }
+
+    job.startTime = OSTime::clock();
+    job.pid = fork();
+
+    if (job.pid < 0) {
+        fprintf(stderr, "BATCH: [%s] fork failed (%s)\n",
+            job.script.c_str(), strerror(errno));
+        fclose(job.output);
+        job.output = NULL;
+        return false;
+    }
+
+    if (job.pid == 0)
+        runChild(sys, job, index);
+
+    return true;
+}
+
+void BatchRunner::runChild(System &sys, Job &job, unsigned index)
+{
+    dup2(fileno(job.output), STDOUT_FILENO);
+    dup2(fileno(job.output), STDERR_FILENO);
+
+    // Scripts that want to vary their behavior per instance can read this
+    char indexStr[16];
+    snprintf(indexStr, sizeof indexStr, "%u", index);
+    setenv("SIFTULATOR_BATCH_INDEX", indexStr, 1);
+
+    int result;
+    {
+        LuaScript lua(sys);
+        result = lua.runFile(job.script.c_str());
+        sys.exit();
+    }
+
+    /*
+     * Skip static destructors and atexit handlers; those belong to the
+     * parent. Our only job is to make sure the log is complete.
+     */
+    fflush(stdout);
+    fflush(stderr);
+    _exit(result);
+}
+
+void BatchRunner::finish(Job &job, int status)
+{
+    job.elapsed = OSTime::clock() - job.startTime;
+
+    if (WIFEXITED(status))
+        job.result = WEXITSTATUS(status);
+    else
+        job.result = -1;
+
+    printf("BATCH: [%s] begin output\n", job.script.c_str());
+
+    char buf[4096];
+    size_t len;
+    rewind(job.output);
+    while ((len = fread(buf, 1, sizeof buf, job.output)) > 0)
+        fwrite(buf, 1, len, stdout);
+    fclose(job.output);
+    job.output = NULL;
+
+    if (WIFSIGNALED(status)) {
+        printf("BATCH: [%s] killed by signal %d after %.2f seconds\n",
+            job.script.c_str(), WTERMSIG(status), job.elapsed);
+    } else {
+        printf("BATCH: [%s] %s (exit code %d) after %.2f seconds\n",
+            job.script.c_str(), job.result ? "FAILED" : "passed",
+            job.result, job.elapsed);
+    }
+    fflush(stdout);
+}
+
+#endif  // !_WIN32
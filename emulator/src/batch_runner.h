@@ -0,0 +1,85 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * Headless batch mode: run many Lua test scripts, each in its own
+ * simulated System, while paying for flash setup only once.
+ *
+ * The emulator and the simulated master firmware are full of process-wide
+ * singletons, so each instance still needs an address space of its own.
+ * Instead of starting a fresh siftulator per test, we prepare the flash
+ * image once (launcher and any games installed) and fork() a child for
+ * each script. Children share that image, the SBT code, and everything
+ * else the parent set up, copy-on-write, and any number of children may
+ * run at once on separate cores.
+ */
+
+#ifndef _BATCH_RUNNER_H
+#define _BATCH_RUNNER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class System;
+
+
+class BatchRunner {
+ public:
+    BatchRunner(System &sys)
+        : sys(sys), maxJobs(0) {}
+
+    void addScript(const char *filename);
+
+    /// Number of scripts to run concurrently. Zero picks one per CPU.
+    void setMaxJobs(unsigned n) {
+        maxJobs = n;
+    }
+
+    /// Returns a process exit code: zero only if every script succeeded.
+    int run();
+
+ private:
+    struct Job {
+        std::string script;
+        FILE *output;
+        int pid;
+        int result;
+        double startTime;
+        double elapsed;
+    };
+
+    System &sys;
+    unsigned maxJobs;
+    std::vector<Job> jobs;
+
+    bool start(unsigned index);
+    void finish(Job &job, int status);
+    static void runChild(System &sys, Job &job, unsigned index);
+};
+
+#endif
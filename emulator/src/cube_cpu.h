@@ -42,6 +42,7 @@ namespace Cube {
 namespace CPU {
 
 struct em8051;
+struct dbt_cache;
 
 // Operation: returns number of ticks the operation should take
 typedef int FASTCALL (*em8051operation)(struct em8051 *aCPU, unsigned &PC, 
@@ -103,6 +104,7 @@ struct em8051
     unsigned wdtCounter;        // 24-bit watchdog counter
 
     void *callbackData;
+    struct dbt_cache *dbt;      // Runtime translation cache, only for firmware loaded from hex
 
     em8051operation op[256]; // function pointers to opcode handlers
     em8051decoder dec[256];  // opcode-to-string decoder handlers    
@@ -147,6 +149,13 @@ int em8051_load(struct em8051 *aCPU, const char *aFilename);
 // Switch to static binary translation mode
 void em8051_init_sbt(struct em8051 *aCPU);
 
+// Switch firmware loaded with em8051_load() to dynamic binary translation mode
+void em8051_init_dbt(struct em8051 *aCPU);
+void em8051_exit_dbt(struct em8051 *aCPU);
+
+// Discard translated code. Must be called after any write to mCodeMem.
+void em8051_invalidate_dbt(struct em8051 *aCPU);
+
 // Internal: Pushes a value into stack
 void em8051_push(struct em8051 *aCPU, int aValue);
 
@@ -166,6 +175,9 @@ typedef int FASTCALL (*sbt_block_t)(em8051 *);
 extern const uint8_t sbt_rom_data[];
 extern const sbt_block_t sbt_rom_code[];
 
+// Dynamically binary translated firmware; runs the block at mPC
+int FASTCALL dbt_block(em8051 *aCPU);
+
 enum EM8051_EXCEPTION
 {
     EXCEPTION_BREAK = 0,         // user-defined breakpoint (mBreakpoint) reached
@@ -121,7 +121,10 @@ static ALWAYS_INLINE void em8051_tick(em8051 *aCPU, unsigned numTicks,
             aCPU->mPreviousPC = pc;
 
             if (sbt) {
-                aCPU->mTickDelay = sbt_rom_code[pc](aCPU);
+                if (LIKELY(!aCPU->dbt))
+                    aCPU->mTickDelay = sbt_rom_code[pc](aCPU);
+                else
+                    aCPU->mTickDelay = dbt_block(aCPU);
             } else {
                 uint8_t opcode = aCPU->mCodeMem[pc];
                 uint8_t operand1 = aCPU->mCodeMem[(pc + 1) & PC_MASK];
@@ -0,0 +1,231 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/*
+ * Dynamic binary translation, for firmware loaded from a hex file.
+ *
+ * The built-in firmware is translated offline by firmware-sbt.py, which
+ * has the luxury of SDCC's listings to tell code from data. Here we only
+ * have the raw image, so we discover basic blocks lazily: the first time
+ * execution reaches an address, we decode the straight-line run starting
+ * there into a list of pre-resolved opcode handlers. After that, running
+ * the block is a tight loop over that list with no fetch or decode.
+ *
+ * Blocks obey the same contract as sbt_block_t, and they end by the same
+ * rules as in firmware-sbt.py, so from the point of view of the rest of
+ * the emulator (interrupt dispatch, tickFastSBT batching, the MDU) a
+ * translated custom firmware is indistinguishable from the built-in one.
+ *
+ * Since we don't know the branch targets ahead of time, a jump into the
+ * middle of an existing block just creates another, overlapping, block.
+ */
+
+#include <string.h>
+#include <vector>
+
+#include "cube_cpu.h"
+
+namespace Cube {
+namespace CPU {
+
+struct dbt_insn
+{
+    em8051operation fn;
+    uint8_t opcode;
+    uint8_t operand1;
+    uint8_t operand2;
+    bool last;
+};
+
+struct dbt_cache
+{
+    // Index of the first instruction in each block, plus one. Zero if untranslated.
+    uint32_t entry[CODE_SIZE];
+    std::vector<dbt_insn> insns;
+};
+
+// Long straight-line runs are split, to bound the cost of a translation
+static const unsigned DBT_MAX_BLOCK_INSNS = 64;
+
+// Flush everything if overlapping blocks ever add up to this much
+static const unsigned DBT_MAX_CACHED_INSNS = 256 * 1024;
+
+
+static bool dbt_is_sync_sfr(unsigned addr)
+{
+    /*
+     * SFR writes that need to "come back to earth" right away, so that
+     * other cubes and our tick-driven peripherals see them promptly.
+     * Keep this in sync with CodeGenerator.endsBlock() in firmware-sbt.py.
+     */
+
+    switch (addr) {
+    case 0x90:  // P1 (Neighbors)
+    case 0x94:  // P1DIR
+    case 0xDA:  // W2DAT (I2C)
+    case 0xE1:  // W2CON1
+    case 0xE2:  // W2CON0
+    case 0xE7:  // SPIRDAT (RF SPI)
+    case 0xAD:  // CLKLFCTRL (Power)
+    case 0xAF:  // WDSV
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool dbt_ends_block(uint8_t opcode, uint8_t operand1, uint8_t operand2)
+{
+    // AJMP and ACALL occupy every opcode with a low nibble of 1
+    if ((opcode & 0x1F) == 0x01 || (opcode & 0x1F) == 0x11)
+        return true;
+
+    switch (opcode) {
+
+    // Everything else that changes control flow
+    case 0x02:  // LJMP
+    case 0x10:  // JBC
+    case 0x12:  // LCALL
+    case 0x20:  // JB
+    case 0x22:  // RET
+    case 0x30:  // JNB
+    case 0x32:  // RETI
+    case 0x40:  // JC
+    case 0x50:  // JNC
+    case 0x60:  // JZ
+    case 0x70:  // JNZ
+    case 0x73:  // JMP @A+DPTR
+    case 0x80:  // SJMP
+    case 0xB4: case 0xB5: case 0xB6: case 0xB7:  // CJNE
+    case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+    case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+    case 0xD5:  // DJNZ direct
+    case 0xD8: case 0xD9: case 0xDA: case 0xDB:  // DJNZ Rn
+    case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+    case 0xA5:  // Illegal opcode; let it raise its exception alone
+        return true;
+
+    // MOV to a direct address
+    case 0x75:  // MOV direct, #imm
+    case 0x86: case 0x87:  // MOV direct, @Ri
+    case 0x88: case 0x89: case 0x8A: case 0x8B:  // MOV direct, Rn
+    case 0x8C: case 0x8D: case 0x8E: case 0x8F:
+    case 0xF5:  // MOV direct, A
+        return dbt_is_sync_sfr(operand1);
+
+    case 0x85:  // MOV direct, direct (destination is the second operand)
+        return dbt_is_sync_sfr(operand2);
+
+    default:
+        return false;
+    }
+}
+
+static void dbt_flush(dbt_cache *cache)
+{
+    memset(cache->entry, 0, sizeof cache->entry);
+    cache->insns.clear();
+}
+
+static NEVER_INLINE uint32_t dbt_translate(em8051 *aCPU, dbt_cache *cache, unsigned pc)
+{
+    if (cache->insns.size() >= DBT_MAX_CACHED_INSNS)
+        dbt_flush(cache);
+
+    uint32_t index = cache->insns.size() + 1;
+    unsigned addr = pc;
+
+    for (unsigned count = 1;; ++count) {
+        dbt_insn insn;
+        char disasm[64];
+
+        insn.opcode = aCPU->mCodeMem[addr];
+        insn.operand1 = aCPU->mCodeMem[(addr + 1) & PC_MASK];
+        insn.operand2 = aCPU->mCodeMem[(addr + 2) & PC_MASK];
+        insn.fn = aCPU->op[insn.opcode];
+
+        // The disassembler is the authority on instruction length
+        addr += aCPU->dec[insn.opcode](aCPU, addr, disasm);
+
+        insn.last = count == DBT_MAX_BLOCK_INSNS
+            || addr > PC_MASK   // Don't let a block wrap around the end of memory
+            || dbt_ends_block(insn.opcode, insn.operand1, insn.operand2);
+
+        cache->insns.push_back(insn);
+        if (insn.last)
+            break;
+    }
+
+    cache->entry[pc] = index;
+    return index;
+}
+
+int FASTCALL dbt_block(em8051 *aCPU)
+{
+    dbt_cache *cache = aCPU->dbt;
+    unsigned pc = aCPU->mPC;
+    unsigned clk = 0;
+
+    uint32_t index = cache->entry[pc];
+    if (UNLIKELY(!index))
+        index = dbt_translate(aCPU, cache, pc);
+
+    const dbt_insn *insn = &cache->insns[index - 1];
+    do {
+        clk += insn->fn(aCPU, pc, insn->opcode, insn->operand1, insn->operand2);
+    } while (!(insn++)->last);
+
+    aCPU->mPC = pc & PC_MASK;
+    return clk;
+}
+
+void em8051_init_dbt(em8051 *aCPU)
+{
+    if (!aCPU->dbt)
+        aCPU->dbt = new dbt_cache;
+    dbt_flush(aCPU->dbt);
+    aCPU->sbt = true;
+}
+
+void em8051_exit_dbt(em8051 *aCPU)
+{
+    if (aCPU->dbt) {
+        delete aCPU->dbt;
+        aCPU->dbt = NULL;
+        aCPU->sbt = false;
+    }
+}
+
+void em8051_invalidate_dbt(em8051 *aCPU)
+{
+    if (aCPU->dbt)
+        dbt_flush(aCPU->dbt);
+}
+
+
+};  // namespace CPU
+};  // namespace Cube
@@ -413,6 +413,8 @@ void mainview_editor_keys(CPU::em8051 *aCPU, int ch)
             else
                 memarea[memoffset + (memcursorpos / 2)] = (memarea[memoffset + (memcursorpos / 2)] & 0x0f) | (insert_value << 4);
             memcursorpos++;
+            if (memarea == aCPU->mCodeMem)
+                CPU::em8051_invalidate_dbt(aCPU);
         }
         if (focus == 1)
         {
@@ -42,6 +42,7 @@ bool Hardware::init(VirtualTime *masterTimer, const char *firmwareFile,
     prev_ctrl_port = 0;
     exceptionCount = 0;
     
+    CPU::em8051_exit_dbt(&cpu);
     memset(&cpu, 0, sizeof cpu);
     cpu.callbackData = this;
     cpu.vtime = masterTimer;
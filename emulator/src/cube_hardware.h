@@ -114,7 +114,10 @@ class Hardware {
     }
 
     ALWAYS_INLINE void tick(bool *cpuTicked=NULL) {
-        CPU::em8051_tick(&cpu, 1, cpu.sbt, cpu.mProfileData != NULL, Tracer::isEnabled(), cpu.mBreakpoint != 0, cpuTicked);
+        // Runtime-translated firmware is interpreted while tracing, to keep one trace line per instruction
+        bool isTracing = Tracer::isEnabled();
+        bool sbt = cpu.sbt && !(cpu.dbt && isTracing);
+        CPU::em8051_tick(&cpu, 1, sbt, cpu.mProfileData != NULL, isTracing, cpu.mBreakpoint != 0, cpuTicked);
         hardwareTick();
     }
 
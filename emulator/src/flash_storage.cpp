@@ -38,6 +38,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <string>
 #include "macros.h"
 #include "flash_device.h"
 #include "flash_storage.h"
@@ -86,6 +88,66 @@ bool FlashStorage::init(const char *filename)
     return true;
 }
 
+bool FlashStorage::initSnapshot(const char *filename, SnapshotRecord &snapshot)
+{
+    /*
+     * Restore from a snapshot by mapping it copy-on-write. Pages are only
+     * read in as they're touched, and nothing we write ever reaches the
+     * snapshot file, so any number of runs can start from the same one.
+     */
+
+    ASSERT(isInitialized == false);
+    isFileBacked = true;
+
+    if (!mapSnapshot(filename, snapshot))
+        return false;
+    if (!checkData()) {
+        unmapFile();
+        return false;
+    }
+
+    isInitialized = true;
+    return true;
+}
+
+bool FlashStorage::saveSnapshot(const char *filename, const SnapshotRecord &snapshot)
+{
+    /*
+     * Write to a temporary file first, so that a snapshot can be replaced
+     * even while it's still mapped by initSnapshot().
+     */
+
+    ASSERT(isInitialized == true);
+
+    std::string tempName = std::string(filename) + ".tmp";
+    FILE *f = fopen(tempName.c_str(), "wb");
+    if (!f) {
+        LOG(("FLASH: Can't create snapshot file '%s' (%s)\n",
+            tempName.c_str(), strerror(errno)));
+        return false;
+    }
+
+    bool success = fwrite(data, sizeof *data, 1, f) == 1 &&
+                   fwrite(&snapshot, sizeof snapshot, 1, f) == 1;
+    if (fclose(f))
+        success = false;
+
+#ifdef _WIN32
+    // Windows won't rename over an existing file
+    if (success)
+        remove(filename);
+#endif
+
+    if (!success || rename(tempName.c_str(), filename)) {
+        LOG(("FLASH: Error writing snapshot file '%s' (%s)\n",
+            filename, strerror(errno)));
+        remove(tempName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
 void FlashStorage::exit()
 {
     ASSERT(isInitialized == true);
@@ -309,6 +371,105 @@ bool FlashStorage::mapFile(const char *filename)
     return true;
 }
 
+bool FlashStorage::mapSnapshot(const char *filename, SnapshotRecord &snapshot)
+{
+#ifdef _WIN32
+
+    HANDLE fh = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        LOG(("FLASH: Can't open snapshot file '%s' (%08x)\n",
+            filename, (unsigned)GetLastError()));
+        return false;
+    }
+    fileHandle = (uintptr_t) fh;
+
+    LARGE_INTEGER size;
+    OVERLAPPED trailer;
+    DWORD bytesRead = 0;
+    memset(&trailer, 0, sizeof trailer);
+    trailer.Offset = sizeof *data;
+
+    if (!GetFileSizeEx(fh, &size) ||
+        size.QuadPart != (LONGLONG) (sizeof *data + sizeof snapshot) ||
+        !ReadFile(fh, &snapshot, sizeof snapshot, &bytesRead, &trailer) ||
+        bytesRead != sizeof snapshot) {
+        CloseHandle(fh);
+        LOG(("FLASH: File '%s' is not a snapshot\n", filename));
+        return false;
+    }
+
+#else
+
+    int fh = open(filename, O_RDONLY);
+    struct stat st;
+
+    if (fh < 0 || fstat(fh, &st)) {
+        if (fh >= 0)
+            close(fh);
+        LOG(("FLASH: Can't open snapshot file '%s' (%s)\n",
+            filename, strerror(errno)));
+        return false;
+    }
+    fileHandle = fh;
+
+    if ((uint64_t)st.st_size != (uint64_t) (sizeof *data + sizeof snapshot) ||
+        pread(fh, &snapshot, sizeof snapshot, sizeof *data) != (ssize_t) sizeof snapshot) {
+        close(fh);
+        LOG(("FLASH: File '%s' is not a snapshot\n", filename));
+        return false;
+    }
+
+#endif
+
+    if (snapshot.magic != SnapshotRecord::MAGIC ||
+        snapshot.version != SnapshotRecord::CURRENT_VERSION ||
+        snapshot.numCubes > arraysize(data->cubes)) {
+#ifdef _WIN32
+        CloseHandle(fh);
+#else
+        close(fh);
+#endif
+        LOG(("FLASH: Snapshot '%s' has an unsupported version\n", filename));
+        return false;
+    }
+
+#ifdef _WIN32
+
+    HANDLE mh = CreateFileMapping(fh, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mh == NULL) {
+        CloseHandle(fh);
+        LOG(("FLASH: Can't create mapping for snapshot '%s' (%08x)\n",
+            filename, (unsigned)GetLastError()));
+        return false;
+    }
+    mappingHandle = (uintptr_t) mh;
+
+    LPVOID mapping = MapViewOfFile(mh, FILE_MAP_COPY, 0, 0, sizeof *data);
+    if (mapping == NULL) {
+        CloseHandle(mh);
+        CloseHandle(fh);
+        LOG(("FLASH: Can't map view of snapshot '%s' (%08x)\n",
+            filename, (unsigned)GetLastError()));
+        return false;
+    }
+
+#else
+
+    void *mapping = mmap(NULL, sizeof *data, PROT_READ | PROT_WRITE, MAP_PRIVATE, fh, 0);
+    if (mapping == MAP_FAILED) {
+        close(fh);
+        LOG(("FLASH: Can't memory-map snapshot '%s' (%s)\n",
+            filename, strerror(errno)));
+        return false;
+    }
+
+#endif
+
+    data = (FileRecord*) mapping;
+    return true;
+}
+
 void FlashStorage::unmapFile()
 {
 #ifdef _WIN32
@@ -88,12 +88,28 @@ class FlashStorage {
         CubeRecord     cubes[_SYS_NUM_CUBE_SLOTS];
     };
 
+    /*
+     * A snapshot file is a complete FileRecord, followed by this trailer.
+     * The FileRecord portion is itself a valid storage file.
+     */
+    struct SnapshotRecord {
+        uint64_t    magic;
+        uint32_t    version;
+        uint32_t    numCubes;
+        uint64_t    clocks;
+
+        static const uint64_t MAGIC             = 0x504e537974666953LLU;
+        static const uint32_t CURRENT_VERSION   = 1;
+    };
+
     FileRecord *data;
 
     FlashStorage();
     ~FlashStorage();
 
     bool init(const char *filename=NULL);
+    bool initSnapshot(const char *filename, SnapshotRecord &snapshot);
+    bool saveSnapshot(const char *filename, const SnapshotRecord &snapshot);
     bool installLauncher(const char *filename=NULL);
     void exit();
 
@@ -104,6 +120,7 @@ class FlashStorage {
     uintptr_t mappingHandle;
 
     bool mapFile(const char *filename);
+    bool mapSnapshot(const char *filename, SnapshotRecord &snapshot);
     void unmapFile();
 
     void initData();
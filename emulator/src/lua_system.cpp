@@ -37,6 +37,7 @@ Lunar<LuaSystem>::RegType LuaSystem::methods[] = {
     LUNAR_DECLARE_METHOD(LuaSystem, init),
     LUNAR_DECLARE_METHOD(LuaSystem, start),
     LUNAR_DECLARE_METHOD(LuaSystem, exit),
+    LUNAR_DECLARE_METHOD(LuaSystem, saveSnapshot),
     LUNAR_DECLARE_METHOD(LuaSystem, setOptions),
     LUNAR_DECLARE_METHOD(LuaSystem, setTraceMode),
     LUNAR_DECLARE_METHOD(LuaSystem, setAssetLoaderBypass),
@@ -79,6 +80,15 @@ int LuaSystem::setOptions(lua_State *L)
     if (LuaScript::argMatch(L, "paintTrace"))
         sys->opt_paintTrace = lua_toboolean(L, -1);
 
+    if (LuaScript::argMatch(L, "codecLookahead"))
+        sys->opt_codecLookahead = lua_toboolean(L, -1);
+
+    if (LuaScript::argMatch(L, "radioStats"))
+        sys->opt_radioStats = lua_toboolean(L, -1);
+
+    if (LuaScript::argMatch(L, "radioWeighting"))
+        sys->opt_radioWeighting = lua_toboolean(L, -1);
+
     if (LuaScript::argMatch(L, "radioTrace"))
         sys->opt_radioTrace = lua_toboolean(L, -1);
 
@@ -88,12 +98,21 @@ int LuaSystem::setOptions(lua_State *L)
     if (LuaScript::argMatch(L, "svmFlashStats"))
         sys->opt_svmFlashStats = lua_toboolean(L, -1);
 
+    if (LuaScript::argMatch(L, "svmTranslate"))
+        sys->opt_svmTranslate = lua_toboolean(L, -1);
+
+    if (LuaScript::argMatch(L, "svmTranslateStats"))
+        sys->opt_svmTranslateStats = lua_toboolean(L, -1);
+
     if (LuaScript::argMatch(L, "svmStackMonitor"))
         sys->opt_svmStackMonitor = lua_toboolean(L, -1);
 
     if (LuaScript::argMatch(L, "noCubeReconnect"))
         sys->opt_noCubeReconnect = lua_toboolean(L, -1);
 
+    if (LuaScript::argMatch(L, "restoreSnapshot"))
+        sys->opt_restoreSnapshot = lua_tostring(L, -1);
+
     if (!LuaScript::argEnd(L))
         return 0;
 
@@ -171,3 +190,12 @@ int LuaSystem::exit(lua_State *L)
     sys->exit();
     return 0;
 }
+
+int LuaSystem::saveSnapshot(lua_State *L)
+{
+    if (!sys->saveSnapshot(luaL_checkstring(L, 1))) {
+        lua_pushfstring(L, "failed to save snapshot");
+        lua_error(L);
+    }
+    return 0;
+}
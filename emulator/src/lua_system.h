@@ -42,6 +42,7 @@ private:
     int init(lua_State *L);
     int start(lua_State *L);
     int exit(lua_State *L);
+    int saveSnapshot(lua_State *L);
     
     int setOptions(lua_State *L);
     int setTraceMode(lua_State *L);
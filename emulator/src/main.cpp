@@ -45,6 +45,7 @@
 #include "system.h"
 #include "ostime.h"
 #include "lua_script.h"
+#include "batch_runner.h"
 
 
 static void message(const char *fmt, ...);
@@ -59,6 +60,7 @@ static void usage()
      *  -f FIRMWARE.hex   Specify firmware image for cubes
      *  -p PROFILE.txt    Profile firmware execution (first cube only) to a text file
      *  -d                Launch firmware debugger (first cube only)
+     *  -i                Interpret cube firmware, rather than translating it at runtime
      *  -c                Continue executing on exception, rather than stopping the debugger.
      *  -R                Cube trace enabled at startup.
      */
@@ -78,15 +80,35 @@ static void usage()
             "  -l LAUNCHER.elf       Start the supplied binary as the system launcher\n"
             "\n"
             "  --headless            Run without graphics or sound output\n"
+            "  --batch NUM           Run every -e script headless in its own instance,\n"
+            "                        NUM at a time (0 = one per CPU)\n"
+            "  --codec-lookahead     Plan radio VRAM codes over a window of upcoming\n"
+            "                        words, rather than one word at a time\n"
             "  --lock-rotation       Lock rotation by default\n"
             "  --mute                Mute the Base's volume control by default\n"
             "  --paint-trace         Trace the state of the repaint controller\n"
+            "  --radio-stats         Dump per-cube radio bandwidth and latency statistics\n"
             "  --radio-trace         Trace all radio packet contents\n"
+            "  --radio-weighting     Give cubes with more pending work more radio packets\n"
             "  --radio-noise FLOAT   Simulated radio noise, arbitrary units.\n"     
+            "  --restore-snapshot FILE\n"
+            "                        Boot from a snapshot saved with --save-snapshot.\n"
+            "                        Not compatible with -F.\n"
+            "  --save-snapshot FILE  On exit, save all flash memory and the virtual\n"
+            "                        clock to FILE\n"
             "  --stdout FILENAME     Redirect output to FILENAME\n"
             "  --svm-trace           Trace SVM instruction execution\n"
             "  --svm-stack           Monitor SVM stack usage\n"
             "  --svm-flash-stats     Dump statistics about flash memory usage\n"
+            "  --svm-translate       Translate hot SVM code into basic blocks\n"
+            "  --svm-translate-stats Dump statistics about SVM block translation\n"
+            "  --svm-profile FILE    Sample SVM call stacks in virtual time, write to FILE\n"
+            "  --usb-port PORT       Expose the Base's USB pipes on a local TCP port,\n"
+            "                        for use with 'swiss --siftulator PORT'\n"
+            "  --usb-rate NUM        Virtual USB packets per millisecond (default 19,\n"
+            "                        USB full speed). 0 runs unthrottled.\n"
+            "  --vram-record FILE    Record each painted frame's VRAM changes to FILE,\n"
+            "                        for replay with the cubecodec benchmark\n"
             "  --waveout FILE.wav    Log all audio output to LOG.wav\n"
             "  --white-bg            Force the UI to use a plain white background\n"
             "  --window WxH          Initial window size (default 800x600)\n"
@@ -209,7 +231,9 @@ static int runScript(System &sys, const char *file)
 int main(int argc, char **argv)
 {
     System& sys = System::getInstance();
+    BatchRunner batch(sys);
     const char *scriptFile = NULL;
+    bool batchMode = false;
 
     // Attach an existing console, if it's already handy
     getConsole();
@@ -234,6 +258,11 @@ int main(int argc, char **argv)
             continue;
         }
 
+        if (!strcmp(arg, "-i")) {
+            sys.opt_cubeInterpret = true;
+            continue;
+        }
+
         if (!strcmp(arg, "-c")) {
             sys.opt_continueOnException = true;
             continue;
@@ -269,6 +298,26 @@ int main(int argc, char **argv)
             continue;
         }
 
+        if (!strcmp(arg, "--svm-translate")) {
+            sys.opt_svmTranslate = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--svm-translate-stats")) {
+            sys.opt_svmTranslateStats = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--radio-stats")) {
+            sys.opt_radioStats = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--radio-weighting")) {
+            sys.opt_radioWeighting = true;
+            continue;
+        }
+
         if (!strcmp(arg, "--radio-trace")) {
             sys.opt_radioTrace = true;
             continue;
@@ -278,12 +327,24 @@ int main(int argc, char **argv)
             sys.opt_paintTrace = true;
             continue;
         }
+
+        if (!strcmp(arg, "--codec-lookahead")) {
+            sys.opt_codecLookahead = true;
+            continue;
+        }
         
         if (!strcmp(arg, "--headless")) {
             sys.opt_headless = true;
             continue;
         }
 
+        if (!strcmp(arg, "--batch") && argv[c+1]) {
+            batchMode = true;
+            batch.setMaxJobs(atoi(argv[c+1]));
+            c++;
+            continue;
+        }
+
         if (!strcmp(arg, "--white-bg")) {
             sys.opt_whiteBackground = true;
             continue;
@@ -324,6 +385,30 @@ int main(int argc, char **argv)
             continue;
         }
 
+        if (!strcmp(arg, "--usb-port") && argv[c+1]) {
+            sys.opt_usbPort = atoi(argv[c+1]);
+            c++;
+            continue;
+        }
+
+        if (!strcmp(arg, "--usb-rate") && argv[c+1]) {
+            sys.opt_usbPacketsPerMs = atoi(argv[c+1]);
+            c++;
+            continue;
+        }
+
+        if (!strcmp(arg, "--svm-profile") && argv[c+1]) {
+            sys.opt_svmProfileFilename = argv[c+1];
+            c++;
+            continue;
+        }
+
+        if (!strcmp(arg, "--vram-record") && argv[c+1]) {
+            sys.opt_vramRecordFilename = argv[c+1];
+            c++;
+            continue;
+        }
+
         if (!strcmp(arg, "--waveout") && argv[c+1]) {
             sys.opt_waveoutFilename = argv[c+1];
             c++;
@@ -338,6 +423,19 @@ int main(int argc, char **argv)
 
         if (!strcmp(arg, "-e") && argv[c+1]) {
             scriptFile = argv[c+1];
+            batch.addScript(scriptFile);
+            c++;
+            continue;
+        }
+
+        if (!strcmp(arg, "--save-snapshot") && argv[c+1]) {
+            sys.opt_saveSnapshotOnExit = argv[c+1];
+            c++;
+            continue;
+        }
+
+        if (!strcmp(arg, "--restore-snapshot") && argv[c+1]) {
+            sys.opt_restoreSnapshot = argv[c+1];
             c++;
             continue;
         }
@@ -391,6 +489,17 @@ int main(int argc, char **argv)
         SystemMC::installGame(arg);
     }
 
+    if (!sys.opt_restoreSnapshot.empty() && !sys.opt_flashFilename.empty()) {
+        // The snapshot is mapped copy-on-write; there's no file to persist to
+        message("Error: --restore-snapshot can't be combined with -F");
+        return 1;
+    }
+
+    if (batchMode) {
+        sys.opt_headless = true;
+        return batch.run();
+    }
+
     return scriptFile ? runScript(sys, scriptFile) : run(sys);
 }
 
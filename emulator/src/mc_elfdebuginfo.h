@@ -28,18 +28,22 @@
 #define ELF_DEBUG_INFO_H
 
 #include "elfprogram.h"
+#include "tinythread.h"
 #include <vector>
 #include <map>
 #include <string>
 
 class ELFDebugInfo {
 public:
+    ELFDebugInfo() : symbolIndexValid(false) {}
+
     void clear();
     void init(const Elf::Program &program);
 
     std::string readString(const std::string &section, uint32_t offset) const;
     bool findNearestSymbol(uint32_t address, Elf::Symbol &symbol, std::string &name) const;
     std::string formatAddress(uint32_t address) const;
+    std::string functionName(uint32_t address) const;
     bool readROM(uint32_t address, uint8_t *buffer, uint32_t bytes) const;
 
 private:
@@ -50,10 +54,38 @@ private:
     sections_t sections;
     sectionMap_t sectionMap;
 
+    /*
+     * Sorted index of every symbol with a nonzero size, built on the first
+     * lookup after init(). Overlapping symbols are allowed; 'coverEnd' lets
+     * a lookup stop scanning backwards as soon as nothing earlier can
+     * contain the address. Names are read and demangled on demand.
+     */
+    struct SymbolEntry {
+        Elf::Symbol sym;
+        uint64_t coverEnd;          // Highest end address of this or any earlier entry
+        std::string name;
+        std::string demangledName;
+        bool hasName;
+        bool hasDemangledName;
+
+        static bool addressBefore(uint32_t address, const SymbolEntry &entry) {
+            return address < entry.sym.st_value;
+        }
+    };
+
+    typedef std::vector<SymbolEntry> symbolIndex_t;
+    mutable symbolIndex_t symbolIndex;
+    mutable bool symbolIndexValid;
+    mutable tthread::mutex symbolIndexMutex;
+
     static void demangle(std::string &name);
     std::string readString(const Elf::SectionHeader *SI, uint32_t offset) const;
     const Elf::SectionHeader *findSection(const std::string &name) const;
 
+    void buildSymbolIndex() const;
+    SymbolEntry *lookupSymbol(uint32_t address) const;
+    const std::string &demangledName(SymbolEntry *entry) const;
+
     bool copyProgramBytes(FlashMapSpan::ByteOffset byteOffset, uint8_t *dest, uint32_t length) const;
 };
 
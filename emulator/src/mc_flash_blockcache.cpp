@@ -25,6 +25,7 @@
  */
 
 #include "flash_blockcache.h"
+#include "flash_blockcache_policy.h"
 #include "svmdebugpipe.h"
 #include "svmmemory.h"
 #include "system.h"
@@ -62,6 +63,11 @@ void FlashBlock::countBlockMiss(uint32_t blockAddr)
     stats.periodic.blockMissCounts[blockNumber]++;
 }
 
+const char *FlashBlock::policyName()
+{
+    return FlashBlockPolicy::name();
+}
+
 bool FlashBlock::hotBlockSort(unsigned i, unsigned j) {
     return stats.periodic.blockMissCounts[j] < stats.periodic.blockMissCounts[i];
 }
@@ -82,7 +88,8 @@ void FlashBlock::dumpStats()
         return;
 
     double dt = tickDiff / (double) SysTime::sTicks(1);
-    uint32_t totalBytes = stats.periodic.blockMiss * BLOCK_SIZE;
+    uint32_t totalBytes = (stats.periodic.blockMiss +
+        stats.periodic.prefetchIssued) * BLOCK_SIZE;
     double effectiveMHZ = totalBytes / dt * bytesToMBits;
 
     /*
@@ -98,6 +105,24 @@ void FlashBlock::dumpStats()
         stats.periodic.blockMiss / dt,
         effectiveMHZ / flashBusMHZ * 100.0));
 
+    LOG(("FLASH: %u blocks, %s replacement, %6.2f%% miss rate\n",
+        NUM_CACHE_BLOCKS, policyName(),
+        stats.periodic.blockTotal
+            ? stats.periodic.blockMiss * 100.0 / stats.periodic.blockTotal
+            : 0.0));
+
+    /*
+     * Read-ahead effectiveness. "Useless" prefetches were evicted without
+     * ever being used; "redundant" ones found the block already cached.
+     */
+
+    LOG(("FLASH: %8.1f prefetch/s, %8.1f useful/s, "
+        "%8.1f useless/s, %8.1f redundant/s\n",
+        stats.periodic.prefetchIssued / dt,
+        stats.periodic.prefetchHit / dt,
+        stats.periodic.prefetchUseless / dt,
+        stats.periodic.prefetchRedundant / dt));
+
     /*
      * Log the N 'hottest' blocks; those with the most repeated misses.
      */
@@ -53,6 +53,7 @@ namespace RadioMC {
     static Buffer buf;
     static double bitErrorRates[MAX_RF_CHANNEL + 1];
     static SysTime::Ticks lastNoiseUpdate;
+    static SysTime::Ticks lastStatsDump;
 
     void trace();
     unsigned retryCount();
@@ -252,6 +253,7 @@ void SystemMC::doRadioPacket()
      */
 
     RadioMC::updateRadioNoise(sys->opt_radioNoise);
+    RadioManager::dumpStats();
 
     sys->getCubeSync().beginEventAt(radioPacketDeadline, mThreadRunning);
 
@@ -297,6 +299,50 @@ void SystemMC::doRadioPacket()
     }
 }
 
+void RadioManager::dumpStats()
+{
+    /*
+     * Once per second of virtual time, summarize how the scheduler
+     * divided our bandwidth: per-producer throughput, retries, and how
+     * long each one went between ACKs. Producers that didn't transmit
+     * during the interval are skipped.
+     */
+
+    if (!SystemMC::getSystem()->opt_radioStats)
+        return;
+
+    SysTime::Ticks now = SysTime::ticks();
+    SysTime::Ticks tickDiff = now - RadioMC::lastStatsDump;
+    if (tickDiff < SysTime::sTicks(1))
+        return;
+
+    double dt = tickDiff / (double) SysTime::sTicks(1);
+    double msPerTick = 1e3 / SysTime::sTicks(1);
+
+    LOG(("\nRADIO: %.2f s\n", dt));
+
+    for (unsigned id = 0; id < NUM_PRODUCERS; ++id) {
+        const ProducerStats &st = stats[id];
+        if (!st.packets)
+            continue;
+
+        char name[16];
+        if (id == CONNECTOR_ID)
+            snprintf(name, sizeof name, "connector");
+        else
+            snprintf(name, sizeof name, "cube %d", id);
+
+        LOG(("RADIO: %-9s %7.1f pkt/s %8.1f B/s %6.1f retry/s %4u timeouts, "
+            "ACK gap avg %6.2f ms max %7.2f ms\n",
+            name, st.packets / dt, st.bytes / dt, st.retries / dt, st.timeouts,
+            st.acks ? st.ackGapTotal * msPerTick / st.acks : 0.0,
+            st.ackGapMax * msPerTick));
+    }
+
+    memset(stats, 0, sizeof stats);
+    RadioMC::lastStatsDump = now;
+}
+
 void Radio::init()
 {
     RadioManager::enableRadio();
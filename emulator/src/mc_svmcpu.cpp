@@ -32,13 +32,18 @@
 #include "system.h"
 #include "system_mc.h"
 #include "svmmemory.h"
+#include "flash_blockcache.h"
+#include "systime.h"
+#include "ostime.h"
 
 #include <string.h>
+#include <stdlib.h>
 
 namespace SvmCpu {
 
 static reg_t regs[NUM_REGS];
 UserRegs userRegs;
+static bool inSVC;      // Is userRegs the authoritative copy of user state?
 
 
 /***************************************************************************
@@ -57,6 +62,10 @@ UserRegs userRegs;
  */
 static unsigned svmCyclesElapsed;
 
+static bool faultTaken;     // Set by emulateFault(), for translated blocks
+
+static void dumpTranslationStats();
+
 static void calculateElapsedTicks()
 {
     unsigned elapsed = svmCyclesElapsed;
@@ -64,6 +73,7 @@ static void calculateElapsedTicks()
         unsigned ticks = elapsed / MCTiming::CPU_RATE_NUMERATOR;
         svmCyclesElapsed = elapsed % MCTiming::CPU_RATE_NUMERATOR;
         SystemMC::elapseTicks(ticks);
+        dumpTranslationStats();
     }
 }
 
@@ -117,26 +127,38 @@ static inline void setNZ(int32_t result) {
     setZero(result == 0);
 }
 
+// Shift results without any flag side-effects.
+// Note: Intentionally truncates to 32-bit
+
+static inline uint32_t shiftLSL(reg_t a, reg_t b) {
+    return b < 32 ? a << b : 0;
+}
+
+static inline uint32_t shiftLSR(reg_t a, reg_t b) {
+    return (b < 32) ? (a >> b) : 0;
+}
+
+static inline uint32_t shiftASR(reg_t a, reg_t b) {
+    return (b < 32) ? ((int32_t)a >> b) : 0;
+}
+
 static inline reg_t opLSL(reg_t a, reg_t b) {
-    // Note: Intentionally truncates to 32-bit
     setCarry(b ? ((0x80000000 >> (b - 1)) & a) != 0 : 0);
-    uint32_t result = b < 32 ? a << b : 0;
+    uint32_t result = shiftLSL(a, b);
     setNZ(result);
     return result;
 }
 
 static inline reg_t opLSR(reg_t a, reg_t b) {
-    // Note: Intentionally truncates to 32-bit
     setCarry(b ? ((1 << (b - 1)) & a) != 0 : 0);
-    uint32_t result = (b < 32) ? (a >> b) : 0;
+    uint32_t result = shiftLSR(a, b);
     setNZ(result);
     return result;
 }
 
 static inline reg_t opASR(reg_t a, reg_t b) {
-    // Note: Intentionally truncates to 32-bit
     setCarry(b ? ((1 << (b - 1)) & a) != 0 : 0);
-    uint32_t result = (b < 32) ? ((int32_t)a >> b) : 0;
+    uint32_t result = shiftASR(a, b);
     setNZ(result);
     return result;
 }
@@ -249,14 +271,16 @@ static void restoreUserRegs()
     regs[11] = userRegs.irq.r11;
 }
 
-static void emulateSVC(uint16_t instr)
+static void emulateSVC(uint32_t instr)
 {
     reg_t nextInstruction = regs[REG_PC];    // already incremented in fetch()
     emulateEnterException(nextInstruction);
     saveUserRegs();
 
     uint8_t imm8 = instr & 0xff;
+    inSVC = true;
     SvmRuntime::svc(imm8);
+    inSVC = false;
 
     restoreUserRegs();
     emulateExitException();
@@ -278,6 +302,7 @@ static void emulateFault(FaultCode code)
      */
 
     reg_t nextInstruction = regs[REG_PC];    // already incremented in fetch()
+    faultTaken = true;
     emulateEnterException(nextInstruction);
     saveUserRegs();
 
@@ -294,7 +319,7 @@ static void emulateFault(FaultCode code)
  ***************************************************************************/
 
 // left shift
-static void emulateLSLImm(uint16_t inst)
+static void emulateLSLImm(uint32_t inst)
 {
     unsigned imm5 = (inst >> 6) & 0x1f;
     unsigned Rm = (inst >> 3) & 0x7;
@@ -303,7 +328,7 @@ static void emulateLSLImm(uint16_t inst)
     regs[Rd] = opLSL(regs[Rm], imm5);
 }
 
-static void emulateLSRImm(uint16_t inst)
+static void emulateLSRImm(uint32_t inst)
 {
     unsigned imm5 = (inst >> 6) & 0x1f;
     unsigned Rm = (inst >> 3) & 0x7;
@@ -315,7 +340,7 @@ static void emulateLSRImm(uint16_t inst)
     regs[Rd] = opLSR(regs[Rm], imm5);
 }
 
-static void emulateASRImm(uint16_t instr)
+static void emulateASRImm(uint32_t instr)
 {
     unsigned imm5 = (instr >> 6) & 0x1f;
     unsigned Rm = (instr >> 3) & 0x7;
@@ -327,7 +352,7 @@ static void emulateASRImm(uint16_t instr)
     regs[Rd] = opASR(regs[Rm], imm5);
 }
 
-static void emulateADDReg(uint16_t instr)
+static void emulateADDReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 6) & 0x7;
     unsigned Rn = (instr >> 3) & 0x7;
@@ -336,7 +361,7 @@ static void emulateADDReg(uint16_t instr)
     regs[Rd] = opADD(regs[Rn], regs[Rm], 0);
 }
 
-static void emulateSUBReg(uint16_t instr)
+static void emulateSUBReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 6) & 0x7;
     unsigned Rn = (instr >> 3) & 0x7;
@@ -345,7 +370,7 @@ static void emulateSUBReg(uint16_t instr)
     regs[Rd] = opADD(regs[Rn], ~regs[Rm], 1);
 }
 
-static void emulateADD3Imm(uint16_t instr)
+static void emulateADD3Imm(uint32_t instr)
 {
     reg_t imm3 = (instr >> 6) & 0x7;
     unsigned Rn = (instr >> 3) & 0x7;
@@ -354,7 +379,7 @@ static void emulateADD3Imm(uint16_t instr)
     regs[Rd] = opADD(regs[Rn], imm3, 0);
 }
 
-static void emulateSUB3Imm(uint16_t instr)
+static void emulateSUB3Imm(uint32_t instr)
 {
     reg_t imm3 = (instr >> 6) & 0x7;
     unsigned Rn = (instr >> 3) & 0x7;
@@ -363,7 +388,7 @@ static void emulateSUB3Imm(uint16_t instr)
     regs[Rd] = opADD(regs[Rn], ~imm3, 1);
 }
 
-static void emulateMovImm(uint16_t instr)
+static void emulateMovImm(uint32_t instr)
 {
     unsigned Rd = (instr >> 8) & 0x7;
     unsigned imm8 = instr & 0xff;
@@ -371,7 +396,7 @@ static void emulateMovImm(uint16_t instr)
     regs[Rd] = imm8;
 }
 
-static void emulateCmpImm(uint16_t instr)
+static void emulateCmpImm(uint32_t instr)
 {
     unsigned Rn = (instr >> 8) & 0x7;
     reg_t imm8 = instr & 0xff;
@@ -379,7 +404,7 @@ static void emulateCmpImm(uint16_t instr)
     reg_t result = opADD(regs[Rn], ~imm8, 1);
 }
 
-static void emulateADD8Imm(uint16_t instr)
+static void emulateADD8Imm(uint32_t instr)
 {
     unsigned Rdn = (instr >> 8) & 0x7;
     reg_t imm8 = instr & 0xff;
@@ -387,7 +412,7 @@ static void emulateADD8Imm(uint16_t instr)
     regs[Rdn] = opADD(regs[Rdn], imm8, 0);
 }
 
-static void emulateSUB8Imm(uint16_t instr)
+static void emulateSUB8Imm(uint32_t instr)
 {
     unsigned Rdn = (instr >> 8) & 0x7;
     reg_t imm8 = instr & 0xff;
@@ -399,7 +424,7 @@ static void emulateSUB8Imm(uint16_t instr)
 // D A T A   P R O C E S S I N G
 ///////////////////////////////////
 
-static void emulateANDReg(uint16_t instr)
+static void emulateANDReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -407,7 +432,7 @@ static void emulateANDReg(uint16_t instr)
     regs[Rdn] = opAND(regs[Rdn], regs[Rm]);
 }
 
-static void emulateEORReg(uint16_t instr)
+static void emulateEORReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -415,7 +440,7 @@ static void emulateEORReg(uint16_t instr)
     regs[Rdn] = opEOR(regs[Rdn], regs[Rm]);
 }
 
-static void emulateLSLReg(uint16_t instr)
+static void emulateLSLReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -424,7 +449,7 @@ static void emulateLSLReg(uint16_t instr)
     regs[Rdn] = opLSL(regs[Rdn], shift);
 }
 
-static void emulateLSRReg(uint16_t instr)
+static void emulateLSRReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -433,7 +458,7 @@ static void emulateLSRReg(uint16_t instr)
     regs[Rdn] = opLSR(regs[Rdn], shift);
 }
 
-static void emulateASRReg(uint16_t instr)
+static void emulateASRReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -442,7 +467,7 @@ static void emulateASRReg(uint16_t instr)
     regs[Rdn] = opASR(regs[Rdn], shift);
 }
 
-static void emulateADCReg(uint16_t instr)
+static void emulateADCReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -450,7 +475,7 @@ static void emulateADCReg(uint16_t instr)
     regs[Rdn] = opADD(regs[Rdn], regs[Rm], getCarry());
 }
 
-static void emulateSBCReg(uint16_t instr)
+static void emulateSBCReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -458,7 +483,7 @@ static void emulateSBCReg(uint16_t instr)
     regs[Rdn] = opADD(regs[Rdn], ~regs[Rm], getCarry());
 }
 
-static void emulateRORReg(uint16_t instr)
+static void emulateRORReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -466,7 +491,7 @@ static void emulateRORReg(uint16_t instr)
     regs[Rdn] = Intrinsic::ROR(regs[Rdn], regs[Rm]);
 }
 
-static void emulateTSTReg(uint16_t instr)
+static void emulateTSTReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -474,7 +499,7 @@ static void emulateTSTReg(uint16_t instr)
     opAND(regs[Rdn], regs[Rm]);
 }
 
-static void emulateRSBImm(uint16_t instr)
+static void emulateRSBImm(uint32_t instr)
 {
     unsigned Rn = (instr >> 3) & 0x7;
     unsigned Rd = instr & 0x7;
@@ -482,7 +507,7 @@ static void emulateRSBImm(uint16_t instr)
     regs[Rd] = opADD(~regs[Rn], 0, 1);
 }
 
-static void emulateCMPReg(uint16_t instr)
+static void emulateCMPReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -490,7 +515,7 @@ static void emulateCMPReg(uint16_t instr)
     opADD(regs[Rdn], ~regs[Rm], 1);
 }
 
-static void emulateCMNReg(uint16_t instr)
+static void emulateCMNReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -498,7 +523,7 @@ static void emulateCMNReg(uint16_t instr)
     opADD(regs[Rdn], regs[Rm], 0);
 }
 
-static void emulateORRReg(uint16_t instr)
+static void emulateORRReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -508,7 +533,7 @@ static void emulateORRReg(uint16_t instr)
     setNZ(result);
 }
 
-static void emulateMUL(uint16_t instr)
+static void emulateMUL(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -521,7 +546,7 @@ static void emulateMUL(uint16_t instr)
     setZero(result == 0);
 }
 
-static void emulateBICReg(uint16_t instr)
+static void emulateBICReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -529,7 +554,7 @@ static void emulateBICReg(uint16_t instr)
     regs[Rdn] = (uint32_t) (regs[Rdn] & ~(regs[Rm]));
 }
 
-static void emulateMVNReg(uint16_t instr)
+static void emulateMVNReg(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -541,7 +566,7 @@ static void emulateMVNReg(uint16_t instr)
 // M I S C   I N S T R U C T I O N S
 /////////////////////////////////////
 
-static void emulateSXTH(uint16_t instr)
+static void emulateSXTH(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -549,7 +574,7 @@ static void emulateSXTH(uint16_t instr)
     regs[Rdn] = (uint32_t) signExtend(regs[Rm], 16);
 }
 
-static void emulateSXTB(uint16_t instr)
+static void emulateSXTB(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -557,7 +582,7 @@ static void emulateSXTB(uint16_t instr)
     regs[Rdn] = (uint32_t) signExtend(regs[Rm], 8);
 }
 
-static void emulateUXTH(uint16_t instr)
+static void emulateUXTH(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -565,7 +590,7 @@ static void emulateUXTH(uint16_t instr)
     regs[Rdn] = regs[Rm] & 0xFFFF;
 }
 
-static void emulateUXTB(uint16_t instr)
+static void emulateUXTB(uint32_t instr)
 {
     unsigned Rm = (instr >> 3) & 0x7;
     unsigned Rdn = instr & 0x7;
@@ -573,7 +598,7 @@ static void emulateUXTB(uint16_t instr)
     regs[Rdn] = regs[Rm] & 0xFF;
 }
 
-static void emulateMOV(uint16_t instr)
+static void emulateMOV(uint32_t instr)
 {
     // Thumb T5 encoding, does not affect flags.
     // This subset does not support high register access.
@@ -589,7 +614,7 @@ static void emulateMOV(uint16_t instr)
 // B R A N C H I N G   I N S T R U C T I O N S
 ///////////////////////////////////////////////
 
-static void emulateB(uint16_t instr)
+static void emulateB(uint32_t instr)
 {
     reg_t oldPC = regs[REG_PC];
     reg_t newPC = branchTargetB(instr, oldPC);
@@ -602,7 +627,7 @@ static void emulateB(uint16_t instr)
 }
 
 
-static void emulateCondB(uint16_t instr)
+static void emulateCondB(uint32_t instr)
 {
     reg_t oldPC = regs[REG_PC];
     reg_t newPC = branchTargetCondB(instr, oldPC, regs[REG_CPSR]);
@@ -614,7 +639,7 @@ static void emulateCondB(uint16_t instr)
     }
 }
 
-static void emulateCBZ_CBNZ(uint16_t instr)
+static void emulateCBZ_CBNZ(uint32_t instr)
 {
     unsigned Rn = instr & 0x7;
     reg_t oldPC = regs[REG_PC];
@@ -632,7 +657,7 @@ static void emulateCBZ_CBNZ(uint16_t instr)
 // M E M O R Y  I N S T R U C T I O N S
 /////////////////////////////////////////
 
-static void emulateSTRSPImm(uint16_t instr)
+static void emulateSTRSPImm(uint32_t instr)
 {
     // encoding T2 only
     unsigned Rt = (instr >> 8) & 0x7;
@@ -649,7 +674,7 @@ static void emulateSTRSPImm(uint16_t instr)
     svmCyclesElapsed += MCTiming::CPU_LOAD_STORE;
 }
 
-static void emulateLDRSPImm(uint16_t instr)
+static void emulateLDRSPImm(uint32_t instr)
 {
     // encoding T2 only
     unsigned Rt = (instr >> 8) & 0x7;
@@ -666,7 +691,7 @@ static void emulateLDRSPImm(uint16_t instr)
     svmCyclesElapsed += MCTiming::CPU_LOAD_STORE;
 }
 
-static void emulateADDSpImm(uint16_t instr)
+static void emulateADDSpImm(uint32_t instr)
 {
     // encoding T1 only
     unsigned Rd = (instr >> 8) & 0x7;
@@ -698,7 +723,7 @@ static void emulateADDSpImm(uint16_t instr)
     regs[Rd] = SvmMemory::squashPhysicalAddr(regs[REG_SP]) + (imm8 << 2);
 }
 
-static void emulateLDRLitPool(uint16_t instr)
+static void emulateLDRLitPool(uint32_t instr)
 {
     unsigned Rt = (instr >> 8) & 0x7;
     unsigned imm8 = instr & 0xFF;
@@ -872,6 +897,168 @@ static void emulateCLZ(uint32_t instr)
 }
 
 
+/***************************************************************************
+ * Flag-free Variants
+ ***************************************************************************/
+
+/*
+ * Block translation substitutes these for the normal emulation functions
+ * when it can prove that an instruction's flag results are overwritten
+ * before anything reads them. Each one must produce exactly the same
+ * register result as its flag-setting counterpart.
+ */
+
+static void emulateLSLImmNF(uint32_t instr)
+{
+    unsigned imm5 = (instr >> 6) & 0x1f;
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = shiftLSL(regs[Rm], imm5);
+}
+
+static void emulateLSRImmNF(uint32_t instr)
+{
+    unsigned imm5 = (instr >> 6) & 0x1f;
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = shiftLSR(regs[Rm], imm5 ? imm5 : 32);
+}
+
+static void emulateASRImmNF(uint32_t instr)
+{
+    unsigned imm5 = (instr >> 6) & 0x1f;
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = shiftASR(regs[Rm], imm5 ? imm5 : 32);
+}
+
+static void emulateADDRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 6) & 0x7;
+    unsigned Rn = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = regs[Rn] + regs[Rm];
+}
+
+static void emulateSUBRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 6) & 0x7;
+    unsigned Rn = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = regs[Rn] + ~regs[Rm] + 1;
+}
+
+static void emulateADD3ImmNF(uint32_t instr)
+{
+    reg_t imm3 = (instr >> 6) & 0x7;
+    unsigned Rn = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = regs[Rn] + imm3;
+}
+
+static void emulateADD8ImmNF(uint32_t instr)
+{
+    unsigned Rdn = (instr >> 8) & 0x7;
+    reg_t imm8 = instr & 0xff;
+
+    regs[Rdn] = regs[Rdn] + imm8;
+}
+
+static void emulateSUB8ImmNF(uint32_t instr)
+{
+    unsigned Rdn = (instr >> 8) & 0x7;
+    reg_t imm8 = instr & 0xff;
+
+    regs[Rdn] = regs[Rdn] + ~imm8 + 1;
+}
+
+static void emulateANDRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = regs[Rdn] & regs[Rm];
+}
+
+static void emulateEORRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = regs[Rdn] ^ regs[Rm];
+}
+
+static void emulateLSLRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = shiftLSL(regs[Rdn], regs[Rm] & 0xff);
+}
+
+static void emulateLSRRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = shiftLSR(regs[Rdn], regs[Rm] & 0xff);
+}
+
+static void emulateASRRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = shiftASR(regs[Rdn], regs[Rm] & 0xff);
+}
+
+static void emulateADCRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = regs[Rdn] + regs[Rm] + (reg_t)getCarry();
+}
+
+static void emulateSBCRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = regs[Rdn] + ~regs[Rm] + (reg_t)getCarry();
+}
+
+static void emulateRSBImmNF(uint32_t instr)
+{
+    unsigned Rn = (instr >> 3) & 0x7;
+    unsigned Rd = instr & 0x7;
+
+    regs[Rd] = ~regs[Rn] + 1;
+}
+
+static void emulateORRRegNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = regs[Rdn] | regs[Rm];
+}
+
+static void emulateMULNF(uint32_t instr)
+{
+    unsigned Rm = (instr >> 3) & 0x7;
+    unsigned Rdn = instr & 0x7;
+
+    regs[Rdn] = (uint32_t) ((uint64_t)regs[Rdn] * (uint64_t)regs[Rm]);
+}
+
+
 /***************************************************************************
  * Instruction Dispatch
  ***************************************************************************/
@@ -941,7 +1128,33 @@ static uint16_t fetch()
     return *pc;
 }
 
-static void execute16(uint16_t instr)
+/*
+ * Decoded instructions are dispatched through a Handler. All emulation
+ * functions share this signature; 16-bit instructions are zero-extended.
+ */
+
+typedef void (*Handler)(uint32_t instr);
+
+static void emulateNop(uint32_t instr)
+{
+    // nothing to do
+}
+
+static void emulateInvalid16(uint32_t instr)
+{
+    // should never get here since we should only be executing validated instructions
+    LOG(("SVMCPU: invalid 16bit instruction: 0x%x\n", instr));
+    emulateFault(F_CPU_SIM);
+}
+
+static void emulateInvalid32(uint32_t instr)
+{
+    // should never get here since we should only be executing validated instructions
+    LOG(("SVMCPU: invalid 32bit instruction: 0x%x\n", instr));
+    emulateFault(F_CPU_SIM);
+}
+
+static Handler decode16(uint16_t instr)
 {
     if ((instr & AluMask) == AluTest) {
         // lsl, lsr, asr, add, sub, mov, cmp
@@ -949,158 +1162,482 @@ static void execute16(uint16_t instr)
         uint8_t prefix = (instr >> 11) & 0x7;
         switch (prefix) {
         case 0: // 0b000 - LSL
-            emulateLSLImm(instr);
-            return;
+            return emulateLSLImm;
         case 1: // 0b001 - LSR
-            emulateLSRImm(instr);
-            return;
+            return emulateLSRImm;
         case 2: // 0b010 - ASR
-            emulateASRImm(instr);
-            return;
+            return emulateASRImm;
         case 3: { // 0b011 - ADD/SUB reg/imm
             uint8_t subop = (instr >> 9) & 0x3;
             switch (subop) {
-            case 0:
-                emulateADDReg(instr);
-                return;
-            case 1:
-                emulateSUBReg(instr);
-                return;
-            case 2:
-                emulateADD3Imm(instr);
-                return;
-            case 3:
-                emulateADD8Imm(instr);
-                return;
+            case 0: return emulateADDReg;
+            case 1: return emulateSUBReg;
+            case 2: return emulateADD3Imm;
+            case 3: return emulateADD8Imm;
             }
         }
         case 4: // 0b100 - MOV
-            emulateMovImm(instr);
-            return;
+            return emulateMovImm;
         case 5: // 0b101
-            emulateCmpImm(instr);
-            return;
+            return emulateCmpImm;
         case 6: // 0b110 - ADD 8bit
-            emulateADD8Imm(instr);
-            return;
+            return emulateADD8Imm;
         case 7: // 0b111 - SUB 8bit
-            emulateSUB8Imm(instr);
-            return;
+            return emulateSUB8Imm;
         }
         ASSERT(0 && "unhandled ALU instruction!");
     }
     if ((instr & DataProcMask) == DataProcTest) {
         uint8_t opcode = (instr >> 6) & 0xf;
         switch (opcode) {
-        case 0:  emulateANDReg(instr); return;
-        case 1:  emulateEORReg(instr); return;
-        case 2:  emulateLSLReg(instr); return;
-        case 3:  emulateLSRReg(instr); return;
-        case 4:  emulateASRReg(instr); return;
-        case 5:  emulateADCReg(instr); return;
-        case 6:  emulateSBCReg(instr); return;
-        case 7:  emulateRORReg(instr); return;
-        case 8:  emulateTSTReg(instr); return;
-        case 9:  emulateRSBImm(instr); return;
-        case 10: emulateCMPReg(instr); return;
-        case 11: emulateCMNReg(instr); return;
-        case 12: emulateORRReg(instr); return;
-        case 13: emulateMUL(instr);    return;
-        case 14: emulateBICReg(instr); return;
-        case 15: emulateMVNReg(instr); return;
+        case 0:  return emulateANDReg;
+        case 1:  return emulateEORReg;
+        case 2:  return emulateLSLReg;
+        case 3:  return emulateLSRReg;
+        case 4:  return emulateASRReg;
+        case 5:  return emulateADCReg;
+        case 6:  return emulateSBCReg;
+        case 7:  return emulateRORReg;
+        case 8:  return emulateTSTReg;
+        case 9:  return emulateRSBImm;
+        case 10: return emulateCMPReg;
+        case 11: return emulateCMNReg;
+        case 12: return emulateORRReg;
+        case 13: return emulateMUL;
+        case 14: return emulateBICReg;
+        case 15: return emulateMVNReg;
         }
     }
     if ((instr & MiscMask) == MiscTest) {
         uint8_t opcode = (instr >> 5) & 0x7f;
         if ((opcode & 0x78) == 0x2) {   // bits [6:3] of opcode identify this group
             switch (opcode & 0x6) {     // bits [2:1] of the opcode identify the instr
-            case 0: emulateSXTH(instr); return;
-            case 1: emulateSXTB(instr); return;
-            case 2: emulateUXTH(instr); return;
-            case 3: emulateUXTB(instr); return;
+            case 0: return emulateSXTH;
+            case 1: return emulateSXTB;
+            case 2: return emulateUXTH;
+            case 3: return emulateUXTB;
             }
         }
     }
-    if ((instr & MovMask) == MovTest) {
-        emulateMOV(instr);
-        return;
-    }    
-    if ((instr & SvcMask) == SvcTest) {
-        emulateSVC(instr);
-        return;
-    }
-    if ((instr & PcRelLdrMask) == PcRelLdrTest) {
-        emulateLDRLitPool(instr);
-        return;
-    }
+    if ((instr & MovMask) == MovTest)
+        return emulateMOV;
+    if ((instr & SvcMask) == SvcTest)
+        return emulateSVC;
+    if ((instr & PcRelLdrMask) == PcRelLdrTest)
+        return emulateLDRLitPool;
     if ((instr & SpRelLdrStrMask) == SpRelLdrStrTest) {
         uint16_t isLoad = instr & (1 << 11);
         if (isLoad)
-            emulateLDRSPImm(instr);
+            return emulateLDRSPImm;
         else
-            emulateSTRSPImm(instr);
-        return;
-    }
-    if ((instr & SpRelAddMask) == SpRelAddTest) {
-        emulateADDSpImm(instr);
-        return;
-    }
-    if ((instr & UncondBranchMask) == UncondBranchTest) {
-        emulateB(instr);
-        return;
-    }
-    if ((instr & CompareBranchMask) == CompareBranchTest) {
-        emulateCBZ_CBNZ(instr);
-        return;
+            return emulateSTRSPImm;
     }
-    if ((instr & CondBranchMask) == CondBranchTest) {
-        emulateCondB(instr);
-        return;
+    if ((instr & SpRelAddMask) == SpRelAddTest)
+        return emulateADDSpImm;
+    if ((instr & UncondBranchMask) == UncondBranchTest)
+        return emulateB;
+    if ((instr & CompareBranchMask) == CompareBranchTest)
+        return emulateCBZ_CBNZ;
+    if ((instr & CondBranchMask) == CondBranchTest)
+        return emulateCondB;
+    if (instr == Nop)
+        return emulateNop;
+
+    return emulateInvalid16;
+}
+
+static Handler decode32(uint32_t instr)
+{
+    if ((instr & StrMask) == StrTest)
+        return emulateSTR;
+    if ((instr & StrBhMask) == StrBhTest)
+        return emulateSTRBH;
+    if ((instr & LdrBhMask) == LdrBhTest)
+        return emulateLDRBH;
+    if ((instr & LdrMask) == LdrTest)
+        return emulateLDR;
+    if ((instr & MovWtMask) == MovWtTest)
+        return emulateMOVWT;
+    if ((instr & DivMask) == DivTest)
+        return emulateDIV;
+    if ((instr & ClzMask) == ClzTest)
+        return emulateCLZ;
+
+    return emulateInvalid32;
+}
+
+static void step()
+{
+    /*
+     * Fetch, decode, and execute one instruction the slow way. Used for
+     * tracing, and for any PC that isn't covered by the decode cache.
+     */
+
+    uint16_t instr = fetch();
+    if (instructionSize(instr) == InstrBits16) {
+        decode16(instr)(instr);
+    } else {
+        uint16_t instrLow = fetch();
+        uint32_t instr32 = instr << 16 | instrLow;
+        decode32(instr32)(instr32);
     }
-    if (instr == Nop) {
-        // nothing to do
-        return;
+}
+
+
+/***************************************************************************
+ * Decode Cache
+ ***************************************************************************/
+
+/*
+ * All SVM code executes directly out of the FlashBlock cache, so we can
+ * cache decoded instructions in a parallel array with one entry per
+ * halfword of cache memory. Entries are decoded lazily, the first time
+ * they're executed, and an entire block's worth of entries is discarded
+ * whenever FlashBlock invalidates that block's code (at the same time
+ * it resets the block's validCodeBundles).
+ *
+ * A decoded entry already implies a valid, aligned PC and it holds the
+ * complete instruction, so the per-instruction fetch work is reduced to
+ * one table lookup.
+ */
+
+struct DecodedInstr {
+    Handler handler;        // NULL if not yet decoded
+    uint32_t instr;
+    uint16_t size;          // Instruction size in bytes
+    uint16_t cycles;        // Fetch cycles, pre-multiplied like svmCyclesElapsed
+};
+
+static const unsigned DECODES_PER_BLOCK = FlashBlock::BLOCK_SIZE / sizeof(uint16_t);
+static const uintptr_t DECODE_CACHE_BYTES = FlashBlock::NUM_CACHE_BLOCKS * FlashBlock::BLOCK_SIZE;
+static DecodedInstr decodeCache[FlashBlock::NUM_CACHE_BLOCKS * DECODES_PER_BLOCK];
+
+static NEVER_INLINE bool decodeEntry(DecodedInstr &d, uintptr_t offset, reg_t pcAddr)
+{
+    /*
+     * Fill in a decode cache entry for the instruction at 'offset' bytes
+     * into the cache, with physical address 'pcAddr'. Returns false if this
+     * instruction can't be cached, in which case the caller should use
+     * step() instead.
+     */
+
+    const uint16_t *pc = reinterpret_cast<const uint16_t*>(pcAddr);
+
+    // Same self-check as fetch(), but only once per decode.
+    DEBUG_ONLY({
+        SvmMemory::VirtAddr bundleVA = SvmRuntime::reconstructCodeAddr(pcAddr);
+        SvmMemory::PhysAddr pa;
+        FlashBlockRef ref;
+        bundleVA &= ~(Svm::BUNDLE_SIZE - 1);
+        ASSERT(SvmMemory::mapROCode(ref, bundleVA, pa));
+    });
+
+    uint16_t instr = pc[0];
+
+    if (instructionSize(instr) == InstrBits16) {
+        d.instr = instr;
+        d.size = sizeof(uint16_t);
+        d.cycles = MCTiming::CPU_FETCH;
+        d.handler = decode16(instr);
+        return true;
     }
 
-    // should never get here since we should only be executing validated instructions
-    LOG(("SVMCPU: invalid 16bit instruction: 0x%x\n", instr));
-    return emulateFault(F_CPU_SIM);
+    // Never cache a 32-bit instruction that would straddle two blocks
+    if ((offset & FlashBlock::BLOCK_MASK) == FlashBlock::BLOCK_SIZE - sizeof(uint16_t))
+        return false;
+
+    d.instr = instr << 16 | pc[1];
+    d.size = 2 * sizeof(uint16_t);
+    d.cycles = 2 * MCTiming::CPU_FETCH;
+    d.handler = decode32(d.instr);
+    return true;
 }
 
-static void execute32(uint32_t instr)
+
+/***************************************************************************
+ * Block Translation
+ ***************************************************************************/
+
+/*
+ * With opt_svmTranslate, basic blocks that are entered often enough get
+ * translated into a flat list of pre-decoded handlers which run back to
+ * back without returning to the dispatch loop. A translation ends at the
+ * first branch or SVC, at the end of its flash block, or after
+ * MAX_TRANSLATED_OPS instructions.
+ *
+ * Since the whole block is known up front, we can do two things the
+ * per-instruction loop can't:
+ *
+ *   - Fetch cycles for the whole block are added to svmCyclesElapsed in
+ *     one step on entry. Only the block's last instruction can be a branch
+ *     or SVC, so calculateElapsedTicks() still sees the same totals.
+ *
+ *   - Flag results that are completely overwritten by a later instruction
+ *     in the same block, with no reader in between, are dead. Those
+ *     instructions are swapped for flag-free variants, and dead compares
+ *     disappear entirely. Flags are always assumed live at block exit.
+ *
+ * If an instruction faults, or something outside the block (such as a
+ * debugger handling that fault) moves the PC, the block ends right there
+ * and the fetch cycles of the instructions it skipped are given back. The
+ * dispatch loop picks up from whatever the PC is now.
+ *
+ * One imprecision: a load/store fault in the middle of a block may stack
+ * an xPSR whose flags were never computed. Faults are fatal to the running
+ * program anyway, so this only matters for inspection in a debugger.
+ *
+ * Translations live alongside the decode cache, indexed by their starting
+ * halfword, and are discarded along with it. The code block we're running
+ * from is always held by SvmRuntime, so a translation can't be discarded
+ * out from under us except by the SVC that ends it.
+ */
+
+struct TranslatedOp {
+    Handler handler;
+    uint32_t instr;
+    reg_t nextPC;           // PC value the handler expects to see
+    unsigned cyclesAfter;   // Fetch cycles for the rest of the block
+};
+
+struct Translation {
+    unsigned numOps;
+    unsigned cycles;        // Total fetch cycles for the block
+    TranslatedOp ops[1];    // Variable length
+};
+
+struct TranslationStats {
+    SysTime::Ticks timestamp;
+    double translateSeconds;
+    unsigned translations;
+    unsigned translatedOps;
+    unsigned elidedFlags;
+    unsigned blockRuns;
+    unsigned blockOps;
+    unsigned interpretedOps;
+};
+
+static const uint32_t FLAG_V      = 1u << 28;
+static const uint32_t FLAG_C      = 1u << 29;
+static const uint32_t FLAG_Z      = 1u << 30;
+static const uint32_t FLAG_N      = 1u << 31;
+static const uint32_t FLAGS_NZ    = FLAG_N | FLAG_Z;
+static const uint32_t FLAGS_NZC   = FLAG_N | FLAG_Z | FLAG_C;
+static const uint32_t FLAGS_ALL   = FLAG_N | FLAG_Z | FLAG_C | FLAG_V;
+
+struct FlagEffect {
+    Handler handler;
+    Handler withoutFlags;   // Replacement if all written flags are dead
+    uint32_t reads;
+    uint32_t writes;
+};
+
+static const FlagEffect flagEffects[] = {
+    { emulateLSLImm,    emulateLSLImmNF,    0,          FLAGS_NZC },
+    { emulateLSRImm,    emulateLSRImmNF,    0,          FLAGS_NZC },
+    { emulateASRImm,    emulateASRImmNF,    0,          FLAGS_NZC },
+    { emulateADDReg,    emulateADDRegNF,    0,          FLAGS_ALL },
+    { emulateSUBReg,    emulateSUBRegNF,    0,          FLAGS_ALL },
+    { emulateADD3Imm,   emulateADD3ImmNF,   0,          FLAGS_ALL },
+    { emulateCmpImm,    emulateNop,         0,          FLAGS_ALL },
+    { emulateADD8Imm,   emulateADD8ImmNF,   0,          FLAGS_ALL },
+    { emulateSUB8Imm,   emulateSUB8ImmNF,   0,          FLAGS_ALL },
+    { emulateANDReg,    emulateANDRegNF,    0,          FLAGS_NZ },
+    { emulateEORReg,    emulateEORRegNF,    0,          FLAGS_NZ },
+    { emulateLSLReg,    emulateLSLRegNF,    0,          FLAGS_NZC },
+    { emulateLSRReg,    emulateLSRRegNF,    0,          FLAGS_NZC },
+    { emulateASRReg,    emulateASRRegNF,    0,          FLAGS_NZC },
+    { emulateADCReg,    emulateADCRegNF,    FLAG_C,     FLAGS_ALL },
+    { emulateSBCReg,    emulateSBCRegNF,    FLAG_C,     FLAGS_ALL },
+    { emulateTSTReg,    emulateNop,         0,          FLAGS_NZ },
+    { emulateRSBImm,    emulateRSBImmNF,    0,          FLAGS_ALL },
+    { emulateCMPReg,    emulateNop,         0,          FLAGS_ALL },
+    { emulateCMNReg,    emulateNop,         0,          FLAGS_ALL },
+    { emulateORRReg,    emulateORRRegNF,    0,          FLAGS_NZ },
+    { emulateMUL,       emulateMULNF,       0,          FLAGS_NZ },
+    { emulateCondB,     0,                  FLAGS_ALL,  0 },
+    { emulateSVC,       0,                  FLAGS_ALL,  FLAGS_ALL },
+};
+
+static const unsigned MAX_TRANSLATED_OPS = 64;
+static const unsigned HOT_BLOCK_THRESHOLD = 16;
+
+static Translation *translationCache[FlashBlock::NUM_CACHE_BLOCKS * DECODES_PER_BLOCK];
+static uint8_t blockHeat[FlashBlock::NUM_CACHE_BLOCKS * DECODES_PER_BLOCK];
+static TranslationStats translationStats;
+
+static void invalidateTranslations(unsigned blockID)
 {
-    if ((instr & StrMask) == StrTest) {
-        emulateSTR(instr);
-        return;
-    }
-    if ((instr & StrBhMask) == StrBhTest) {
-        emulateSTRBH(instr);
-        return;
+    unsigned base = blockID * DECODES_PER_BLOCK;
+
+    for (unsigned i = 0; i < DECODES_PER_BLOCK; ++i) {
+        Translation *&t = translationCache[base + i];
+        if (t) {
+            free(t);
+            t = 0;
+        }
     }
-    if ((instr & LdrBhMask) == LdrBhTest) {
-        emulateLDRBH(instr);
-        return;
+
+    memset(&blockHeat[base], 0, DECODES_PER_BLOCK);
+}
+
+static const FlagEffect *findFlagEffect(Handler h)
+{
+    for (unsigned i = 0; i < arraysize(flagEffects); ++i)
+        if (flagEffects[i].handler == h)
+            return &flagEffects[i];
+    return 0;
+}
+
+static bool endsTranslation(Handler h)
+{
+    return h == emulateB || h == emulateCondB ||
+           h == emulateCBZ_CBNZ || h == emulateSVC;
+}
+
+static NEVER_INLINE Translation *translate(uintptr_t offset)
+{
+    /*
+     * Translate the basic block starting 'offset' bytes into the cache,
+     * at the current PC. Returns NULL if not even one instruction could
+     * be translated; the caller will interpret it instead.
+     */
+
+    double startTime = OSTime::clock();
+
+    TranslatedOp ops[MAX_TRANSLATED_OPS];
+    unsigned numOps = 0;
+    unsigned cycles = 0;
+    uintptr_t blockEnd = (offset & ~(uintptr_t)FlashBlock::BLOCK_MASK) + FlashBlock::BLOCK_SIZE;
+    reg_t pc = regs[REG_PC];
+
+    while (numOps < MAX_TRANSLATED_OPS && offset < blockEnd) {
+        DecodedInstr &d = decodeCache[offset >> 1];
+        if (!d.handler && !decodeEntry(d, offset, pc))
+            break;
+        if (d.handler == emulateInvalid16 || d.handler == emulateInvalid32)
+            break;
+
+        offset += d.size;
+        pc += d.size;
+        cycles += d.cycles;
+
+        TranslatedOp &op = ops[numOps++];
+        op.handler = d.handler;
+        op.instr = d.instr;
+        op.nextPC = pc;
+        op.cyclesAfter = cycles;
+
+        if (endsTranslation(d.handler))
+            break;
     }
-    if ((instr & LdrMask) == LdrTest) {
-        emulateLDR(instr);
-        return;
+
+    if (!numOps)
+        return 0;
+
+    for (unsigned i = 0; i < numOps; ++i)
+        ops[i].cyclesAfter = cycles - ops[i].cyclesAfter;
+
+    /*
+     * Backwards liveness pass over the flags. Anything still live at the
+     * end of the block must be computed.
+     */
+
+    uint32_t live = FLAGS_ALL;
+    unsigned i = numOps;
+    while (i--) {
+        const FlagEffect *fx = findFlagEffect(ops[i].handler);
+        if (!fx)
+            continue;
+
+        if (fx->writes && fx->withoutFlags && !(fx->writes & live)) {
+            ops[i].handler = fx->withoutFlags;
+            translationStats.elidedFlags++;
+        } else {
+            live &= ~fx->writes;
+        }
+        live |= fx->reads;
     }
-    if ((instr & MovWtMask) == MovWtTest) {
-        emulateMOVWT(instr);
-        return;
+
+    Translation *t = static_cast<Translation*>(
+        malloc(sizeof(Translation) + (numOps - 1) * sizeof(TranslatedOp)));
+    if (!t)
+        return 0;
+
+    t->numOps = numOps;
+    t->cycles = cycles;
+    memcpy(t->ops, ops, numOps * sizeof(TranslatedOp));
+
+    translationStats.translations++;
+    translationStats.translatedOps += numOps;
+    translationStats.translateSeconds += OSTime::clock() - startTime;
+
+    return t;
+}
+
+static void runTranslation(const Translation *t)
+{
+    const TranslatedOp *op = t->ops;
+    const TranslatedOp *last = op + t->numOps - 1;
+
+    translationStats.blockRuns++;
+    translationStats.blockOps += t->numOps;
+    svmCyclesElapsed += t->cycles;
+    faultTaken = false;
+
+    for (; op != last; ++op) {
+        regs[REG_PC] = op->nextPC;
+        op->handler(op->instr);
+
+        if (UNLIKELY(faultTaken || regs[REG_PC] != op->nextPC)) {
+            // Stop here, without charging for the ops we didn't run
+            translationStats.blockOps -= last - op;
+            svmCyclesElapsed -= MIN(svmCyclesElapsed, op->cyclesAfter);
+            return;
+        }
     }
-    if ((instr & DivMask) == DivTest) {
-        emulateDIV(instr);
+
+    // Don't touch 't' after the last op; an SVC may have discarded it.
+    regs[REG_PC] = last->nextPC;
+    last->handler(last->instr);
+}
+
+static void dumpTranslationStats()
+{
+    /*
+     * Periodically log how much execution is covered by translated blocks,
+     * and what it's costing us to produce them.
+     */
+
+    static const SysTime::Ticks interval = SysTime::sTicks(1);
+
+    if (!SystemMC::getSystem()->opt_svmTranslateStats)
         return;
-    }
-    if ((instr & ClzMask) == ClzTest) {
-        emulateCLZ(instr);
+
+    TranslationStats &st = translationStats;
+    SysTime::Ticks now = SysTime::ticks();
+    SysTime::Ticks tickDiff = now - st.timestamp;
+    if (tickDiff < interval)
         return;
-    }
 
-    // should never get here since we should only be executing validated instructions
-    LOG(("SVMCPU: invalid 32bit instruction: 0x%x\n", instr));
-    return emulateFault(F_CPU_SIM);
+    double dt = tickDiff / (double) SysTime::sTicks(1);
+    double totalOps = (double)st.blockOps + st.interpretedOps;
+
+    LOG(("\nSVMCPU: %9.1f blocks/s, %10.1f instr/s, %6.2f%% translated, "
+        "%5.2f instr/block\n",
+        st.blockRuns / dt,
+        totalOps / dt,
+        totalOps ? st.blockOps / totalOps * 100.0 : 0.0,
+        st.blockRuns ? st.blockOps / (double)st.blockRuns : 0.0));
+
+    LOG(("SVMCPU: %6u translations, %7u instr, %6u flags elided, "
+        "%8.3f ms translating\n",
+        st.translations,
+        st.translatedOps,
+        st.elidedFlags,
+        st.translateSeconds * 1e3));
+
+    memset(&st, 0, sizeof st);
+    st.timestamp = now;
 }
 
 
@@ -1108,20 +1645,82 @@ static void execute32(uint32_t instr)
  * Public Functions
  ***************************************************************************/
 
+void invalidateDecodeCache(unsigned blockID)
+{
+    ASSERT(blockID < FlashBlock::NUM_CACHE_BLOCKS);
+    memset(&decodeCache[blockID * DECODES_PER_BLOCK], 0,
+        DECODES_PER_BLOCK * sizeof(DecodedInstr));
+    invalidateTranslations(blockID);
+}
+
+void getUserPCAndFP(reg_t &pc, reg_t &fp)
+{
+    // Usable at any point on the SVM thread, including from inside a
+    // syscall, where the live registers belong to the handler.
+
+    if (inSVC) {
+        pc = userRegs.hw.returnAddr;
+        fp = userRegs.irq.r11;
+    } else {
+        pc = regs[REG_PC];
+        fp = regs[REG_FP];
+    }
+}
+
 void run(reg_t sp, reg_t pc)
 {
     regs[REG_SP] = sp;
     regs[REG_PC] = pc;
 
+    const System *sys = SystemMC::getSystem();
+
+    /*
+     * Only count heat where a basic block can begin: at a branch target,
+     * after a block-ending instruction, or wherever a translation left off.
+     * Otherwise every PC inside a hot loop would become a translation head.
+     */
+    bool blockHead = true;
+
     for (;;) {
-        uint16_t instr = fetch();
-        if (instructionSize(instr) == InstrBits16) {
-            execute16(instr);
+        uintptr_t offset = FlashBlock::cacheOffset(regs[REG_PC]);
+
+        if (UNLIKELY(sys->opt_svmTrace || offset >= DECODE_CACHE_BYTES || (offset & 1))) {
+            step();
+            blockHead = true;
+            continue;
         }
-        else {
-            uint16_t instrLow = fetch();
-            execute32(instr << 16 | instrLow);
+
+        unsigned index = offset >> 1;
+
+        if (sys->opt_svmTranslate) {
+            Translation *&t = translationCache[index];
+            if (!t && blockHead && ++blockHeat[index] >= HOT_BLOCK_THRESHOLD) {
+                t = translate(offset);
+                if (!t)
+                    blockHeat[index] = 0;
+            }
+            if (t) {
+                runTranslation(t);
+                blockHead = true;
+                continue;
+            }
+            translationStats.interpretedOps++;
         }
+
+        DecodedInstr &d = decodeCache[index];
+        if (UNLIKELY(!d.handler) && !decodeEntry(d, offset, regs[REG_PC])) {
+            step();
+            blockHead = true;
+            continue;
+        }
+
+        reg_t nextPC = regs[REG_PC] + d.size;
+        svmCyclesElapsed += d.cycles;
+        regs[REG_PC] = nextPC;
+        d.handler(d.instr);
+
+        if (sys->opt_svmTranslate)
+            blockHead = regs[REG_PC] != nextPC || endsTranslation(d.handler);
     }
 }
 
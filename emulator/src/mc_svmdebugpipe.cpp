@@ -153,6 +153,11 @@ std::string SvmDebugPipe::formatAddress(void *address)
     return gELFDebugInfo.formatAddress(SvmMemory::physToVirtRAM((uint8_t*)address));
 }
 
+std::string SvmDebugPipe::functionName(uint32_t address)
+{
+    return gELFDebugInfo.functionName(address);
+}
+
 bool SvmDebugPipe::debuggerMsgAccept(SvmDebugPipe::DebuggerMsg &msg)
 {
     /*
@@ -0,0 +1,199 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <algorithm>
+#include "mc_svmprofiler.h"
+#include "svm.h"
+#include "svmcpu.h"
+#include "svmruntime.h"
+#include "svmmemory.h"
+#include "svmdebugpipe.h"
+
+uint64_t SvmProfiler::nextSample = uint64_t(-1);
+unsigned SvmProfiler::currentSyscall = SvmProfiler::NO_SYSCALL;
+std::string SvmProfiler::filename;
+SvmProfiler::counts_t SvmProfiler::stacks;
+SvmProfiler::counts_t SvmProfiler::syscalls;
+uint64_t SvmProfiler::totalSamples;
+uint64_t SvmProfiler::syscallSamples;
+uint64_t SvmProfiler::idleSamples;
+
+
+void SvmProfiler::start(const char *filename)
+{
+    SvmProfiler::filename = filename;
+    stacks.clear();
+    syscalls.clear();
+    totalSamples = 0;
+    syscallSamples = 0;
+    idleSamples = 0;
+
+    // Take the first sample as soon as the clock moves
+    nextSample = 0;
+}
+
+void SvmProfiler::sample(uint64_t ticks)
+{
+    /*
+     * Runs on the MC thread, from SystemMC::elapseTicks(). If more than
+     * one sample period went by in a single step (a long SVC, or the
+     * very first sample) the extra periods are charged to the same stack.
+     */
+
+    uint64_t count = 1;
+    if (nextSample) {
+        count += (ticks - nextSample) / SAMPLE_TICKS;
+        nextSample += count * SAMPLE_TICKS;
+    } else {
+        nextSample = ticks + SAMPLE_TICKS;
+    }
+
+    totalSamples += count;
+    record(count);
+}
+
+static SvmMemory::VirtAddr frameAddr(uint32_t fp)
+{
+    /*
+     * Saved frame pointers are squashed physical addresses, which are
+     * already virtual on 64-bit hosts but not on 32-bit ones. Accept
+     * either form.
+     */
+
+    SvmMemory::PhysAddr pa;
+    if (SvmMemory::mapRAM(SvmMemory::VirtAddr(fp), sizeof(Svm::CallFrame), pa))
+        return fp;
+    return SvmMemory::physToVirtRAM(Svm::reg_t(fp));
+}
+
+void SvmProfiler::record(uint64_t count)
+{
+    Svm::reg_t pc, fp;
+    SvmCpu::getUserPCAndFP(pc, fp);
+
+    // Nothing to attribute if no SVM code is resident
+    uint32_t pcVA = SvmRuntime::reconstructCodeAddr(pc);
+    if (!pcVA) {
+        idleSamples += count;
+        return;
+    }
+
+    // Innermost first. Return addresses point past the call instruction,
+    // so back up by one to stay inside the caller.
+    std::vector<std::string> frames;
+    frames.push_back(SvmDebugPipe::functionName(pcVA));
+
+    SvmMemory::VirtAddr fpVA = fp ? SvmMemory::physToVirtRAM(fp) : 0;
+    SvmMemory::PhysAddr fpPA;
+    while (frames.size() < MAX_DEPTH &&
+           SvmMemory::mapRAM(fpVA, sizeof(Svm::CallFrame), fpPA)) {
+        Svm::CallFrame *frame = reinterpret_cast<Svm::CallFrame*>(fpPA);
+        if (frame->pc)
+            frames.push_back(SvmDebugPipe::functionName(frame->pc - 1));
+        fpVA = frame->fp ? frameAddr(frame->fp) : 0;
+    }
+
+    std::string key;
+    for (unsigned i = frames.size(); i; --i) {
+        if (!key.empty())
+            key += ';';
+        key += frames[i - 1];
+    }
+
+    if (currentSyscall != NO_SYSCALL) {
+        const char *name = SvmRuntime::syscallName(currentSyscall);
+        char buf[32];
+        if (!name) {
+            snprintf(buf, sizeof buf, "_SYS_%u", currentSyscall);
+            name = buf;
+        }
+        key += ';';
+        key += name;
+        syscalls[name] += count;
+        syscallSamples += count;
+    }
+
+    stacks[key] += count;
+}
+
+void SvmProfiler::logTop(const char *title, const counts_t &counts, unsigned limit)
+{
+    std::vector<std::pair<uint64_t, std::string> > sorted;
+    for (counts_t::const_iterator I = counts.begin(), E = counts.end(); I != E; ++I)
+        sorted.push_back(std::make_pair(I->second, I->first));
+    std::sort(sorted.rbegin(), sorted.rend());
+
+    LOG(("PROFILE: %s\n", title));
+    for (unsigned i = 0; i < sorted.size() && i < limit; ++i)
+        LOG(("PROFILE: %10llu %6.2f%%  %s\n",
+            (unsigned long long) sorted[i].first,
+            sorted[i].first * 100.0 / totalSamples,
+            sorted[i].second.c_str()));
+}
+
+void SvmProfiler::finish()
+{
+    if (filename.empty())
+        return;
+
+    // Stop sampling
+    nextSample = uint64_t(-1);
+
+    FILE *f = fopen(filename.c_str(), "w");
+    if (f) {
+        for (counts_t::iterator I = stacks.begin(), E = stacks.end(); I != E; ++I)
+            fprintf(f, "%s %llu\n", I->first.c_str(), (unsigned long long) I->second);
+        fclose(f);
+    } else {
+        LOG(("PROFILE: Can't write profile to '%s' (%s)\n",
+            filename.c_str(), strerror(errno)));
+    }
+
+    if (totalSamples) {
+        LOG(("PROFILE: %llu samples at %u Hz virtual time, %.2f%% in syscalls, "
+            "%.2f%% with no SVM code\n",
+            (unsigned long long) totalSamples, SAMPLE_HZ,
+            syscallSamples * 100.0 / totalSamples,
+            idleSamples * 100.0 / totalSamples));
+
+        // Self time, by innermost frame
+        counts_t leaves;
+        for (counts_t::iterator I = stacks.begin(), E = stacks.end(); I != E; ++I) {
+            std::string::size_type sep = I->first.rfind(';');
+            leaves[sep == std::string::npos ? I->first : I->first.substr(sep + 1)] += I->second;
+        }
+
+        logTop("Top functions (self):", leaves, 15);
+        if (syscallSamples)
+            logTop("Top syscalls:", syscalls, 15);
+    }
+
+    filename.clear();
+}
@@ -0,0 +1,95 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MC_SVM_PROFILER_H
+#define MC_SVM_PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include "macros.h"
+#include "mc_timing.h"
+
+
+/**
+ * Sampling profiler for SVM code, driven by virtual time.
+ *
+ * At a fixed interval of simulated ticks, we record the call stack of
+ * the running game. Because samples are taken on the emulated clock
+ * rather than wall-clock time, results are independent of host speed
+ * and repeatable from run to run.
+ *
+ * Time spent inside a syscall is charged to a leaf frame named after
+ * the syscall, so firmware work shows up underneath the game code that
+ * requested it. Results are written in the "collapsed stack" text format
+ * used by flame graph tools: one line per unique stack, frames separated
+ * by semicolons from outermost to innermost, followed by a sample count.
+ */
+
+class SvmProfiler {
+public:
+    static const unsigned SAMPLE_HZ = 1000;
+    static const unsigned SAMPLE_TICKS = MCTiming::TICK_HZ / SAMPLE_HZ;
+    static const unsigned MAX_DEPTH = 64;
+
+    static void start(const char *filename);
+    static void finish();
+
+    // Called by SystemMC each time the virtual clock advances
+    static ALWAYS_INLINE void elapsed(uint64_t ticks) {
+        if (UNLIKELY(ticks >= nextSample))
+            sample(ticks);
+    }
+
+    // Called by SvmRuntime around each syscall handler
+    static ALWAYS_INLINE void enterSyscall(unsigned num) {
+        currentSyscall = num;
+    }
+    static ALWAYS_INLINE void exitSyscall() {
+        currentSyscall = NO_SYSCALL;
+    }
+
+private:
+    static const unsigned NO_SYSCALL = unsigned(-1);
+
+    typedef std::map<std::string, uint64_t> counts_t;
+
+    static uint64_t nextSample;
+    static unsigned currentSyscall;
+    static std::string filename;
+
+    static counts_t stacks;
+    static counts_t syscalls;
+    static uint64_t totalSamples;
+    static uint64_t syscallSamples;
+    static uint64_t idleSamples;
+
+    static void sample(uint64_t ticks);
+    static void record(uint64_t count);
+    static void logTop(const char *title, const counts_t &counts, unsigned limit);
+};
+
+#endif
@@ -0,0 +1,352 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Must be before other headers
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   define WINVER WindowsXP
+#   define _WIN32_WINNT 0x502
+#   include <windows.h>
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#   define SHUT_RDWR SD_BOTH
+#else
+#   include <sys/types.h>
+#   include <sys/socket.h>
+#   include <sys/select.h>
+#   include <netinet/tcp.h>
+#   include <netinet/in.h>
+#   include <netdb.h>
+#   include <unistd.h>
+#   define closesocket(_s) close(_s)
+#endif
+
+#include "mc_usbdevice.h"
+#include "mc_timing.h"
+#include "system_mc.h"
+#include "usbprotocol.h"
+#include "tasks.h"
+#include "macros.h"
+#include "tinythread.h"
+#include "ostime.h"
+#include <string.h>
+#include <deque>
+
+/*
+ * Packets from the host wait here until the UsbOUT task picks them up.
+ * When the queue is full, the server thread stops reading from the
+ * socket, pushing back on the host just like a NAK'ed OUT endpoint.
+ */
+static const unsigned RX_QUEUE_DEPTH = 32;
+
+static tthread::thread *serverThread;
+static volatile bool running;
+static int serverPort;
+
+static tthread::mutex rxLock;
+static tthread::condition_variable rxSpace;
+static std::deque<USBProtocolMsg> rxQueue;
+
+static tthread::mutex txLock;
+static volatile int clientFD = -1;     // Written under txLock
+
+// Bus pacing, in SysTime ticks. Only touched on the MC thread.
+static SysTime::Ticks busTicksPerPacket;
+static SysTime::Ticks nextBusTick;
+
+
+static bool waitReadable(int fd)
+{
+    fd_set rfds;
+    struct timeval pollInterval = { 0, 100000 };  // 100ms
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    return select(fd + 1, &rfds, NULL, NULL, &pollInterval) > 0;
+}
+
+static bool waitWritable(int fd, double seconds)
+{
+    fd_set wfds;
+    struct timeval timeout;
+    timeout.tv_sec = long(seconds);
+    timeout.tv_usec = long((seconds - timeout.tv_sec) * 1e6);
+
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    return select(fd + 1, NULL, &wfds, NULL, &timeout) > 0;
+}
+
+static bool sendAll(int fd, const uint8_t *bytes, unsigned len, unsigned timeoutMillis)
+{
+    /*
+     * Send a whole frame, waiting at most 'timeoutMillis' for a host that
+     * has stopped reading. If we give up partway through a frame, the
+     * stream can't be resynchronized, so we shut the connection down and
+     * let the server thread clean up after it.
+     */
+
+    double deadline = OSTime::clock() + timeoutMillis * 1e-3;
+    bool started = false;
+
+    while (len) {
+        double remaining = MAX(0.0, deadline - OSTime::clock());
+        if (!waitWritable(fd, remaining)) {
+            if (started)
+                shutdown(fd, SHUT_RDWR);
+            return false;
+        }
+
+        int ret = send(fd, (const char *) bytes, len, 0);
+        if (ret <= 0)
+            return false;
+        started = true;
+        bytes += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+static void enqueuePacket(const uint8_t *bytes, unsigned len)
+{
+    tthread::lock_guard<tthread::mutex> guard(rxLock);
+
+    while (running && rxQueue.size() >= RX_QUEUE_DEPTH)
+        rxSpace.wait(rxLock);
+
+    rxQueue.push_back(USBProtocolMsg());
+    USBProtocolMsg &m = rxQueue.back();
+    memcpy(m.bytes, bytes, len);
+    m.len = len;
+
+    Tasks::trigger(Tasks::UsbOUT);
+}
+
+static void serveClient(int fd)
+{
+    /*
+     * Reassemble framed packets from the stream. Each frame is a length
+     * byte followed by that many bytes of packet data.
+     */
+
+    uint8_t buffer[4096];
+    unsigned fill = 0;
+
+    while (running) {
+        if (!waitReadable(fd))
+            continue;
+
+        int ret = recv(fd, (char *) buffer + fill, sizeof buffer - fill, 0);
+        if (ret <= 0)
+            return;
+        fill += ret;
+
+        unsigned offset = 0;
+        while (offset < fill) {
+            unsigned len = buffer[offset];
+            if (len > UsbDevice::MAX_PACKET) {
+                LOG(("USB: Protocol error, packet length %d\n", len));
+                return;
+            }
+            if (offset + 1 + len > fill)
+                break;
+            enqueuePacket(buffer + offset + 1, len);
+            offset += 1 + len;
+        }
+
+        fill -= offset;
+        memmove(buffer, buffer + offset, fill);
+    }
+}
+
+static void serverThreadFn(void *)
+{
+    #ifdef _WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+    #endif
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(serverPort);
+
+    int listenFD = socket(AF_INET, SOCK_STREAM, 0);
+
+    unsigned long arg = 1;
+    setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, (const char *)&arg, sizeof arg);
+
+    if (bind(listenFD, (struct sockaddr *)&addr, sizeof addr) < 0 ||
+        listen(listenFD, 1) < 0) {
+        LOG(("USB: Can't listen on port %d\n", serverPort));
+        closesocket(listenFD);
+        return;
+    }
+
+    LOG(("USB: Listening on port %d. Connect with "
+        "\"swiss --siftulator %d\"\n", serverPort, serverPort));
+
+    while (running) {
+        if (!waitReadable(listenFD))
+            continue;
+
+        int fd = accept(listenFD, NULL, NULL);
+        if (fd < 0)
+            break;
+
+        #ifdef SO_NOSIGPIPE
+            arg = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &arg, sizeof arg);
+        #endif
+        arg = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&arg, sizeof arg);
+
+        txLock.lock();
+        clientFD = fd;
+        txLock.unlock();
+
+        LOG(("USB: Host connected\n"));
+        serveClient(fd);
+        LOG(("USB: Host disconnected\n"));
+
+        txLock.lock();
+        clientFD = -1;
+        closesocket(fd);
+        txLock.unlock();
+
+        rxLock.lock();
+        rxQueue.clear();
+        rxSpace.notify_all();
+        rxLock.unlock();
+    }
+
+    closesocket(listenFD);
+}
+
+static void waitForBus()
+{
+    /*
+     * Packets in both directions share the bus. If the next slot is
+     * still in the future, let virtual time pass until it arrives, as
+     * the firmware would while it waits on real hardware.
+     */
+
+    if (!busTicksPerPacket)
+        return;
+
+    SysTime::Ticks now = SysTime::ticks();
+    while (now < nextBusTick) {
+        SystemMC::elapseTicks(1 + (nextBusTick - now) / SysTime::hzTicks(MCTiming::TICK_HZ));
+        now = SysTime::ticks();
+    }
+
+    nextBusTick = now + busTicksPerPacket;
+}
+
+void UsbDevice::start(int port, unsigned packetsPerMs)
+{
+    ASSERT(running == false);
+    ASSERT(serverThread == NULL);
+
+    serverPort = port;
+    busTicksPerPacket = packetsPerMs ? SysTime::msTicks(1) / packetsPerMs : 0;
+    nextBusTick = 0;
+
+    running = true;
+    serverThread = new tthread::thread(serverThreadFn, 0);
+}
+
+void UsbDevice::stop()
+{
+    if (!serverThread)
+        return;
+
+    rxLock.lock();
+    running = false;
+    rxSpace.notify_all();
+    rxLock.unlock();
+
+    serverThread->join();
+    delete serverThread;
+    serverThread = NULL;
+}
+
+bool UsbDevice::isConnected()
+{
+    return clientFD >= 0;
+}
+
+SysTime::Ticks UsbDevice::lastINActivity()
+{
+    // A connected host is always polling our IN endpoint
+    return isConnected() ? SysTime::ticks() : 0;
+}
+
+void UsbDevice::handleOUTData()
+{
+    USBProtocolMsg m;
+    bool more;
+
+    rxLock.lock();
+    if (rxQueue.empty()) {
+        rxLock.unlock();
+        return;
+    }
+    m = rxQueue.front();
+    rxQueue.pop_front();
+    more = !rxQueue.empty();
+    rxSpace.notify_all();
+    rxLock.unlock();
+
+    waitForBus();
+    USBProtocol::dispatch(m);
+
+    if (more)
+        Tasks::trigger(Tasks::UsbOUT);
+}
+
+int UsbDevice::write(const uint8_t *buf, unsigned len, unsigned timeoutMillis)
+{
+    ASSERT(len <= MAX_PACKET);
+
+    if (!isConnected())
+        return -1;
+
+    waitForBus();
+
+    uint8_t frame[1 + MAX_PACKET];
+    frame[0] = len;
+    memcpy(frame + 1, buf, len);
+
+    tthread::lock_guard<tthread::mutex> guard(txLock);
+    if (clientFD < 0 || !sendAll(clientFD, frame, len + 1, timeoutMillis))
+        return -1;
+
+    // Like a completed IN transfer on hardware, let the next one go out
+    Tasks::trigger(Tasks::UsbIN);
+    return len;
+}
@@ -0,0 +1,73 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Simulated USB device. This stands in for the hardware UsbDevice,
+ * exposing the Base's bulk IN and OUT pipes on a local TCP port.
+ *
+ * Each packet is framed on the stream as one length byte followed by
+ * up to 64 bytes of payload, in either direction. 'swiss --siftulator'
+ * speaks the same framing.
+ */
+
+#ifndef MC_USBDEVICE_H
+#define MC_USBDEVICE_H
+
+#include <stdint.h>
+#include "systime.h"
+
+
+class UsbDevice {
+public:
+    static const unsigned MAX_PACKET = 64;
+
+    // USB full-speed bulk throughput, in 64-byte packets per 1 ms frame
+    static const unsigned FULL_SPEED_PACKETS_PER_MS = 19;
+
+    /*
+     * Start listening on the given TCP port. Packets in both directions
+     * share one simulated bus, limited to 'packetsPerMs' in virtual time.
+     * Zero means unthrottled.
+     */
+    static void start(int port, unsigned packetsPerMs);
+    static void stop();
+
+    static bool isConnected();
+
+    // Handler for the UsbOUT task. Runs on the MC thread.
+    static void handleOUTData();
+
+    /*
+     * Send one IN packet to the host. Runs on the MC thread. Returns -1
+     * if there's no host, or if it doesn't accept the packet within
+     * 'timeoutMillis' of real time.
+     */
+    static int write(const uint8_t *buf, unsigned len, unsigned timeoutMillis = 0xffffffff);
+
+    static SysTime::Ticks lastINActivity();
+};
+
+#endif
@@ -0,0 +1,124 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "mc_vramrecorder.h"
+#include "vram.h"
+
+FILE *VRAMRecorder::file;
+SysTime::Ticks VRAMRecorder::lastTimestamp;
+VRAMRecorder::Shadow VRAMRecorder::shadows[_SYS_NUM_CUBE_SLOTS];
+unsigned VRAMRecorder::numFrames;
+
+
+void VRAMRecorder::start(const char *filename)
+{
+    file = fopen(filename, "wb");
+    if (!file) {
+        LOG(("VRAM: Can't open recording file '%s' (%s)\n",
+            filename, strerror(errno)));
+        return;
+    }
+
+    static const char magic[] = "TCVRAM01";
+    fwrite(magic, 8, 1, file);
+
+    memset(shadows, 0, sizeof shadows);
+    lastTimestamp = SysTime::ticks();
+    numFrames = 0;
+}
+
+void VRAMRecorder::finish()
+{
+    if (!file)
+        return;
+
+    fclose(file);
+    file = NULL;
+    LOG(("VRAM: Recorded %u frames\n", numFrames));
+}
+
+void VRAMRecorder::putVarint(uint32_t value)
+{
+    while (value >= 0x80) {
+        fputc(0x80 | (value & 0x7F), file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+void VRAMRecorder::record(unsigned cubeID, const _SYSVideoBuffer *vbuf)
+{
+    ASSERT(cubeID < _SYS_NUM_CUBE_SLOTS);
+    Shadow &shadow = shadows[cubeID];
+
+    uint8_t flags = 0;
+    if (shadow.vbuf != vbuf) {
+        shadow.vbuf = vbuf;
+        flags |= FULL;
+    }
+
+    // Collect changed words, updating the shadow as we go
+    uint16_t addrs[_SYS_VRAM_WORDS];
+    unsigned count = 0;
+
+    for (uint16_t addr = 0; addr < _SYS_VRAM_WORDS; ++addr) {
+        uint16_t word = VRAM::peek(*vbuf, addr);
+        bool dirty = (flags & FULL) || word != shadow.words[addr] ||
+            (vbuf->cm1[addr >> 5] & VRAM::maskCM1(addr));
+
+        if (dirty) {
+            shadow.words[addr] = word;
+            addrs[count++] = addr;
+        }
+    }
+
+    SysTime::Ticks now = SysTime::ticks();
+    putVarint(now - lastTimestamp);
+    lastTimestamp = now;
+
+    uint32_t lock = vbuf->lock;
+    fputc(cubeID, file);
+    fputc(flags, file);
+    fputc(lock & 0xFF, file);
+    fputc((lock >> 8) & 0xFF, file);
+    fputc((lock >> 16) & 0xFF, file);
+    fputc(lock >> 24, file);
+
+    putVarint(count);
+    int prev = -1;
+    for (unsigned i = 0; i < count; ++i) {
+        uint16_t addr = addrs[i];
+        uint16_t word = shadow.words[addr];
+        putVarint(addr - prev - 1);
+        fputc(word & 0xFF, file);
+        fputc(word >> 8, file);
+        prev = addr;
+    }
+
+    numFrames++;
+}
@@ -0,0 +1,89 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MC_VRAM_RECORDER_H
+#define MC_VRAM_RECORDER_H
+
+#include <stdio.h>
+#include <sifteo/abi.h>
+#include "macros.h"
+#include "systime.h"
+
+
+/**
+ * Records the VRAM changes behind every painted frame, for offline
+ * benchmarking of the radio codec (see test/firmware/master/cubecodec).
+ *
+ * Each time PaintControl hands a frame to the radio, we note which
+ * words the codec is about to send: anything that differs from our
+ * shadow copy of that cube's VRAM, plus anything marked in the cm1
+ * change map. The first frame after a VideoBuffer is attached records
+ * all of VRAM, since attaching marks the whole buffer as changed.
+ *
+ * File format: the magic string "TCVRAM01", then one record per frame,
+ * with all multi-byte fixed-width fields little-endian:
+ *
+ *    varint    SysTime ticks (ns) since the previous record
+ *    uint8     Cube ID
+ *    uint8     Flags (FULL = VRAM was reattached, resend everything)
+ *    uint32    Lock map (1 bit per 16 words) at the time of paint
+ *    varint    Number of changed words
+ *    For each changed word, in ascending address order:
+ *       varint    Address delta (addr - previous addr - 1, starting at -1)
+ *       uint16    New value
+ *
+ * Varints are unsigned LEB128.
+ */
+
+class VRAMRecorder {
+public:
+    static const uint8_t FULL = 1 << 0;
+
+    static void start(const char *filename);
+    static void finish();
+
+    // Called by PaintControl when a frame is about to be flushed over the radio
+    static ALWAYS_INLINE void paint(unsigned cubeID, const _SYSVideoBuffer *vbuf) {
+        if (UNLIKELY(file != NULL))
+            record(cubeID, vbuf);
+    }
+
+private:
+    struct Shadow {
+        const _SYSVideoBuffer *vbuf;
+        uint16_t words[_SYS_VRAM_WORDS];
+    };
+
+    static FILE *file;
+    static SysTime::Ticks lastTimestamp;
+    static Shadow shadows[_SYS_NUM_CUBE_SLOTS];
+    static unsigned numFrames;
+
+    static void record(unsigned cubeID, const _SYSVideoBuffer *vbuf);
+    static void putVarint(uint32_t value);
+};
+
+#endif
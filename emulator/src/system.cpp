@@ -29,6 +29,7 @@
 #include "system.h"
 #include "cube_debug.h"
 #include "mc_gdbserver.h"
+#include "mc_usbdevice.h"
 
 
 System::System()
@@ -40,17 +41,27 @@ System::System()
         opt_continueOnException(false),
         opt_turbo(false),
         opt_lockRotationByDefault(false),
+        opt_radioStats(false),
+        opt_radioWeighting(false),
         opt_noCubeReconnect(false),
         opt_flushLogs(false),
         opt_paintTrace(false),
+        opt_codecLookahead(false),
         opt_svmTrace(false),
         opt_svmFlashStats(false),
+        opt_svmTranslate(false),
+        opt_svmTranslateStats(false),
         opt_gdbServerPort(0),
+        opt_usbPort(0),
+        opt_usbPacketsPerMs(UsbDevice::FULL_SPEED_PACKETS_PER_MS),
         opt_cube0Debug(false),
+        opt_cubeInterpret(false),
         opt_mute(false),
         opt_radioNoise(0),
         mIsInitialized(false),
-        mIsStarted(false)
+        mIsStarted(false),
+        mIsFlashPrepared(false),
+        mRestoredClocks(0)
         {}
 
 
@@ -59,7 +70,9 @@ bool System::init()
     if (mIsInitialized)
         return true;
 
-    if (!flash.init(opt_flashFilename.empty() ? NULL : opt_flashFilename.c_str()))
+    if (mIsFlashPrepared)
+        mIsFlashPrepared = false;
+    else if (!initFlash())
         return false;
 
     if (!sc.init(this))
@@ -69,11 +82,58 @@ bool System::init()
         return false;
 
     time.init();
+    time.clocks = mRestoredClocks;
 
     mIsInitialized = true;
     return true;
 }
 
+bool System::preinstall()
+{
+    if (mIsInitialized || mIsFlashPrepared)
+        return false;
+
+    if (!initFlash())
+        return false;
+    mIsFlashPrepared = true;
+
+    return smc.preinstall(this);
+}
+
+bool System::initFlash()
+{
+    mRestoredClocks = 0;
+
+    if (opt_restoreSnapshot.empty())
+        return flash.init(opt_flashFilename.empty() ? NULL : opt_flashFilename.c_str());
+
+    FlashStorage::SnapshotRecord snapshot;
+    if (!flash.initSnapshot(opt_restoreSnapshot.c_str(), snapshot))
+        return false;
+
+    opt_numCubes = snapshot.numCubes;
+    mRestoredClocks = snapshot.clocks;
+    return true;
+}
+
+bool System::saveSnapshot(const char *filename)
+{
+    if (!mIsInitialized)
+        return false;
+
+    // Nothing may touch flash while we copy it
+    stopThreads();
+
+    FlashStorage::SnapshotRecord snapshot;
+    memset(&snapshot, 0, sizeof snapshot);
+    snapshot.magic = FlashStorage::SnapshotRecord::MAGIC;
+    snapshot.version = FlashStorage::SnapshotRecord::CURRENT_VERSION;
+    snapshot.numCubes = opt_numCubes;
+    snapshot.clocks = time.clocks;
+
+    return flash.saveSnapshot(filename, snapshot);
+}
+
 void System::setNumCubes(unsigned n)
 {
     sc.setNumCubes(n);
@@ -121,26 +181,41 @@ void System::start()
 
     if (opt_gdbServerPort)
         GDBServer::start(opt_gdbServerPort);
+
+    if (opt_usbPort)
+        UsbDevice::start(opt_usbPort, opt_usbPacketsPerMs);
+}
+
+void System::stopThreads()
+{
+    if (!mIsStarted)
+        return;
+
+    if (opt_gdbServerPort)
+        GDBServer::stop();
+
+    if (opt_usbPort)
+        UsbDevice::stop();
+
+    smc.stop();
+    sc.stop();
+
+    mIsStarted = false;
 }
 
 void System::exit()
 {
     if (!mIsInitialized)
         return;
-    mIsInitialized = false;
 
-    if (mIsStarted) {
-        if (opt_gdbServerPort)
-            GDBServer::stop();
+    stopThreads();
 
-        smc.stop();
-        sc.stop();
-
-        mIsStarted = false;
-    }
+    if (!opt_saveSnapshotOnExit.empty())
+        saveSnapshot(opt_saveSnapshotOnExit.c_str());
 
     smc.exit();
     sc.exit();
     flash.exit();
     tracer.close();
+    mIsInitialized = false;
 }
@@ -63,6 +63,10 @@ class System {
     std::string opt_flashFilename;
     std::string opt_launcherFilename;
     std::string opt_waveoutFilename;
+    std::string opt_svmProfileFilename;
+    std::string opt_vramRecordFilename;
+    std::string opt_restoreSnapshot;
+    std::string opt_saveSnapshotOnExit;
 
     // UI options
     bool opt_whiteBackground;
@@ -74,30 +78,63 @@ class System {
     bool opt_turbo;
     bool opt_lockRotationByDefault;
     bool opt_radioTrace;
+    bool opt_radioStats;
+    bool opt_radioWeighting;
     bool opt_traceEnabledAtStartup;
     bool opt_noCubeReconnect;
     bool opt_flushLogs;
 
     // Master firmware debug options
     bool opt_paintTrace;
+    bool opt_codecLookahead;
 
     // SVM options
     bool opt_svmTrace;
     bool opt_svmFlashStats;
+    bool opt_svmTranslate;
+    bool opt_svmTranslateStats;
     bool opt_svmStackMonitor;
     unsigned opt_gdbServerPort;
 
+    // Virtual USB; TCP port (0 = disabled) and bus rate in packets per ms
+    unsigned opt_usbPort;
+    unsigned opt_usbPacketsPerMs;
+
     // Debug options, applicable to cube 0 only
     bool opt_cube0Debug;
     std::string opt_cube0Profile;
 
+    // Interpret custom cube firmware, instead of translating it at runtime
+    bool opt_cubeInterpret;
+
     // Other options
     bool opt_mute;
     double opt_radioNoise;
 
     bool init();
+
+    /**
+     * Optional, prior to init(): set up flash storage, and install the
+     * launcher and any queued games right away on the calling thread
+     * instead of when the MC first starts. Used by batch mode, so that
+     * every forked instance starts from the same prepared flash image.
+     */
+    bool preinstall();
+
     void start();
     void exit();
+
+    /**
+     * Save flash storage for the Base and all cubes, the virtual clock,
+     * and the number of cubes. No live CPU, SVM or RAM state is saved.
+     * If we're running, the simulation is stopped first, and it stays
+     * stopped. A later start() doesn't resume: the Base reboots from
+     * flash and restarts from the launcher.
+     *
+     * Restoring (via opt_restoreSnapshot, prior to init) maps the file
+     * copy-on-write, then boots the Base and cubes from that storage.
+     */
+    bool saveSnapshot(const char *filename);
     void setNumCubes(unsigned n);
     void resetCube(unsigned id);
     void fullResetCube(unsigned id);
@@ -121,6 +158,11 @@ class System {
     
     bool mIsInitialized;
     bool mIsStarted;
+    bool mIsFlashPrepared;
+    uint64_t mRestoredClocks;
+
+    bool initFlash();
+    void stopThreads();
 
     SystemCubes sc;
     SystemMC smc;
@@ -121,6 +121,14 @@ bool SystemCubes::initCube(unsigned id)
         return false;
 
     sys->cubes[id].cpu.id = id;
+
+    /*
+     * Custom firmware is translated at runtime, unless we need to watch it
+     * one instruction at a time with the debugger or profiler.
+     */
+    if (firmware && !sys->opt_cubeInterpret &&
+        !(id == 0 && (sys->opt_cube0Debug || !sys->opt_cube0Profile.empty())))
+        Cube::CPU::em8051_init_dbt(&sys->cubes[id].cpu);
     
     if (id == 0 && !sys->opt_cube0Profile.empty()) {
         Cube::CPU::profile_data *pd;
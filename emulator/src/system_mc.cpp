@@ -45,7 +45,10 @@
 #include "svmloader.h"
 #include "svmcpu.h"
 #include "svmruntime.h"
+#include "mc_svmprofiler.h"
+#include "mc_vramrecorder.h"
 #include "cube.h"
+#include "cubecodec.h"
 #include "protocol.h"
 #include "tasks.h"
 #include "mc_timing.h"
@@ -74,6 +77,15 @@ bool SystemMC::init(System *sys)
             sys->opt_waveoutFilename.c_str()));
     }
 
+    if (!sys->opt_svmProfileFilename.empty())
+        SvmProfiler::start(sys->opt_svmProfileFilename.c_str());
+
+    if (!sys->opt_vramRecordFilename.empty())
+        VRAMRecorder::start(sys->opt_vramRecordFilename.c_str());
+
+    CubeCodec::lookahead = sys->opt_codecLookahead;
+    RadioManager::weighted = sys->opt_radioWeighting;
+
     FlashStack::init();
     SysInfo::init();
     Crc32::init();
@@ -111,9 +123,29 @@ void SystemMC::exit()
         AudioOutDevice::stop();
 
     waveOut.close();
+    SvmProfiler::finish();
+    VRAMRecorder::finish();
+}
+
+bool SystemMC::preinstall(System *sys)
+{
+    /*
+     * Runs on the caller's thread, before the MC exists. That's only safe
+     * because autoInstall() uses stealth I/O exclusively, so nothing here
+     * tries to elapse simulated time.
+     */
+
+    this->sys = sys;
+    instance = this;
+
+    FlashStack::init();
+    Crc32::init();
+
+    mPreinstalled = autoInstall();
+    return mPreinstalled;
 }
 
-void SystemMC::autoInstall()
+bool SystemMC::autoInstall()
 {
     // Use stealth flash I/O, for speed
     FlashDevice::setStealthIO(1);
@@ -128,7 +160,8 @@ void SystemMC::autoInstall()
 
     // Install a launcher
     const char *launcher = sys->opt_launcherFilename.empty() ? NULL : sys->opt_launcherFilename.c_str();
-    if (sys->flash.installLauncher(launcher)) {
+    bool success = sys->flash.installLauncher(launcher);
+    if (success) {
 
         /*
          * Install any ELF data that we've previously queued.
@@ -149,6 +182,7 @@ void SystemMC::autoInstall()
     }
 
     FlashDevice::setStealthIO(-1);
+    return success;
 }
 
 void SystemMC::pairCube(unsigned cubeID, unsigned pairingID)
@@ -201,7 +235,10 @@ void SystemMC::threadFn(void *param)
      * Emulator magic: Automatically install games and pair cubes
      */
 
-    instance->autoInstall();
+    if (instance->mPreinstalled)
+        instance->mPreinstalled = false;
+    else
+        instance->autoInstall();
 
     for (unsigned i = 0; i < instance->sys->opt_numCubes; i++) {
         /*
@@ -285,6 +322,7 @@ void SystemMC::elapseTicks(unsigned n)
     SystemMC *self = instance;
 
     self->ticks += n;
+    SvmProfiler::elapsed(self->ticks);
 
     // Asynchronous exit
     if (!self->mThreadRunning)
@@ -334,5 +372,7 @@ void SystemMC::exit(int result)
      */
 
     getSystem()->stopCubesOnly();
+    SvmProfiler::finish();
+    VRAMRecorder::finish();
     ::exit(result);
 }
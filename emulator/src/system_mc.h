@@ -48,6 +48,9 @@ class SystemMC {
     bool init(System *sys);
     void exit();
 
+    /// Install the launcher and queued games now, ahead of init() and start().
+    bool preinstall(System *sys);
+
     void start();
     void stop();
 
@@ -90,7 +93,7 @@ class SystemMC {
  private:
     static void threadFn(void *);
     void doRadioPacket();
-    void autoInstall();
+    bool autoInstall();
     void pairCube(unsigned cubeID, unsigned pairingID);
 
     Cube::Hardware *getCubeForAddress(const RadioAddress *addr);
@@ -112,6 +115,7 @@ class SystemMC {
     
     tthread::thread *mThread;
     bool mThreadRunning;
+    bool mPreinstalled;
     jmp_buf mThreadExitJmp;
 };
 
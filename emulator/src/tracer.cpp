@@ -41,21 +41,20 @@ void Tracer::setEnabled(bool b)
             textTraceFile = fopen("trace.txt", "w");
         }
 
-        if (!vcdTraceFile) {
-            vcdTraceFile = fopen("trace.vcd", "w");
-            if (vcdTraceFile)
-                vcd.writeHeader(vcdTraceFile);
-        }
-            
-        enabled = textTraceFile && vcdTraceFile;
+        // Binary VCD trace, convert with tools/trace2vcd.py
+        if (!vcdTrace.isOpen() && vcdTrace.open("trace.bvcd"))
+            vcd.writeHeader(vcdTrace);
+
+        enabled = textTraceFile && vcdTrace.isOpen();
         if (!enabled)
             fprintf(stderr, "Tracer: Error opening output file(s)!\n");
 
     } else {
         enabled = false;
 
-        fflush(textTraceFile);
-        fflush(vcdTraceFile);
+        if (textTraceFile)
+            fflush(textTraceFile);
+        vcdTrace.flush();
     }
 }
 
@@ -68,10 +67,7 @@ void Tracer::close()
         textTraceFile = NULL;
     }
 
-    if (vcdTraceFile) {
-        fclose(vcdTraceFile);
-        vcdTraceFile = NULL;
-    }
+    vcdTrace.close();
 }
 
 void Tracer::logWork(const Cube::CPU::em8051 *cpu)
@@ -42,7 +42,7 @@
 class Tracer {
  public:
     Tracer()
-        : epochIsSet(false), textTraceFile(NULL), vcdTraceFile(NULL) {}
+        : epochIsSet(false), textTraceFile(NULL) {}
 
     VCDWriter vcd;
      
@@ -51,7 +51,7 @@ class Tracer {
 
     ALWAYS_INLINE void tick(const VirtualTime &vtime) {
         if (isEnabled())
-            vcd.writeTick(vcdTraceFile, getLocalClock(vtime));
+            vcd.writeTick(vcdTrace, getLocalClock(vtime));
     }
 
     ALWAYS_INLINE static bool isEnabled() {
@@ -167,7 +167,7 @@ class Tracer {
     uint64_t epoch;
 
     FILE *textTraceFile;
-    FILE *vcdTraceFile;
+    TraceStream vcdTrace;
     
     uint64_t getLocalClock(const VirtualTime &vtime)
     {
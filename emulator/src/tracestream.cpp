@@ -0,0 +1,158 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <vector>
+#include "tracestream.h"
+#include "fastlz.h"
+
+
+bool TraceStream::open(const char *filename)
+{
+    ASSERT(!isOpen());
+
+    file = fopen(filename, "wb");
+    if (!file)
+        return false;
+
+    static const char magic[] = "TCTRACE1";
+    fwrite(magic, 8, 1, file);
+
+    chunks = new Chunk[NUM_CHUNKS];
+    head = tail = 0;
+    fillData = chunks[0].data;
+    fill = 0;
+    running = true;
+    thread = new tthread::thread(threadFn, this);
+
+    return true;
+}
+
+void TraceStream::close()
+{
+    if (!isOpen())
+        return;
+
+    // The writer thread drains every published chunk before exiting
+    flush();
+    running = false;
+    thread->join();
+    delete thread;
+    thread = NULL;
+
+    delete[] chunks;
+    chunks = NULL;
+
+    fclose(file);
+    file = NULL;
+}
+
+void TraceStream::flush()
+{
+    if (isOpen() && fill)
+        nextChunk();
+}
+
+void TraceStream::putBytes(const void *bytes, unsigned len)
+{
+    const uint8_t *p = (const uint8_t *) bytes;
+    while (len--)
+        putByte(*(p++));
+}
+
+void TraceStream::nextChunk()
+{
+    /*
+     * Publish the current chunk, then wait for a free one. If the writer
+     * thread can't keep up we stall the simulation rather than drop data.
+     */
+
+    chunks[tail].length = fill;
+    unsigned next = (tail + 1) % NUM_CHUNKS;
+
+    while (next == head)
+        tthread::this_thread::yield();
+
+    // Chunk contents must be visible before the writer sees the new tail
+    __sync_synchronize();
+    tail = next;
+    fillData = chunks[next].data;
+    fill = 0;
+}
+
+void TraceStream::writeChunk(const Chunk &chunk)
+{
+    /*
+     * FastLZ needs at least 16 bytes of input, and up to 5% of slack in
+     * the output. Blocks that don't shrink are stored as-is, marked by a
+     * compressed length of zero.
+     */
+
+    std::vector<uint8_t> compressed(chunk.length + chunk.length / 16 + 66);
+    unsigned compressedLen = 0;
+
+    if (chunk.length >= 16) {
+        compressedLen = fastlz_compress_level(1, chunk.data, chunk.length, &compressed[0]);
+        if (compressedLen >= chunk.length)
+            compressedLen = 0;
+    }
+
+    uint8_t hdr[8];
+    for (unsigned i = 0; i < 4; ++i) {
+        hdr[i] = chunk.length >> (i * 8);
+        hdr[i + 4] = compressedLen >> (i * 8);
+    }
+
+    fwrite(hdr, sizeof hdr, 1, file);
+    if (compressedLen)
+        fwrite(&compressed[0], compressedLen, 1, file);
+    else
+        fwrite(chunk.data, chunk.length, 1, file);
+}
+
+void TraceStream::threadFn(void *param)
+{
+    TraceStream *self = (TraceStream*) param;
+
+    for (;;) {
+        // Sample 'running' before 'tail', so we can't miss a final chunk
+        bool running = self->running;
+        __sync_synchronize();
+
+        if (self->head == self->tail) {
+            if (!running)
+                break;
+            tthread::this_thread::sleep_for(tthread::chrono::milliseconds(5));
+            continue;
+        }
+
+        __sync_synchronize();
+        self->writeChunk(self->chunks[self->head]);
+        __sync_synchronize();
+        self->head = (self->head + 1) % NUM_CHUNKS;
+    }
+
+    fflush(self->file);
+}
@@ -0,0 +1,113 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo Thundercracker simulator
+ * Micah Elizabeth Scott <micah@misc.name>
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Compressed binary output stream for trace data.
+ *
+ * The simulation thread appends bytes to fixed-size chunks. Full chunks
+ * are handed to a background thread through a single-producer
+ * single-consumer ring, where they're compressed with FastLZ and written
+ * to disk. The simulation thread never touches the file or the compressor.
+ *
+ * File layout: the magic string "TCTRACE1", followed by any number of
+ * blocks. Each block is a little-endian uint32 uncompressed length, a
+ * uint32 compressed length, then that many bytes of FastLZ data. A
+ * compressed length of zero means the block is stored uncompressed.
+ * Concatenating the decompressed blocks yields the original byte stream.
+ */
+
+#ifndef _TRACESTREAM_H
+#define _TRACESTREAM_H
+
+#include <stdio.h>
+#include "macros.h"
+#include "tinythread.h"
+
+
+class TraceStream {
+public:
+    TraceStream()
+        : file(NULL), chunks(NULL), thread(NULL) {}
+
+    bool open(const char *filename);
+    void close();
+
+    bool isOpen() const {
+        return file != NULL;
+    }
+
+    /// Hand any partially filled chunk to the writer thread.
+    void flush();
+
+    ALWAYS_INLINE void putByte(uint8_t byte) {
+        if (UNLIKELY(fill == CHUNK_SIZE))
+            nextChunk();
+        fillData[fill++] = byte;
+    }
+
+    /// Unsigned LEB128: seven bits per byte, high bit set on all but the last.
+    ALWAYS_INLINE void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            putByte(0x80 | (value & 0x7F));
+            value >>= 7;
+        }
+        putByte(value);
+    }
+
+    void putBytes(const void *bytes, unsigned len);
+
+private:
+    static const unsigned CHUNK_SIZE = 256 * 1024;
+    static const unsigned NUM_CHUNKS = 16;
+
+    struct Chunk {
+        unsigned length;
+        uint8_t data[CHUNK_SIZE];
+    };
+
+    FILE *file;
+    Chunk *chunks;
+    tthread::thread *thread;
+
+    /*
+     * Chunks in [head, tail) belong to the writer thread. Chunk 'tail'
+     * is being filled by the simulation thread, up to 'fill' bytes.
+     * Each index is only ever written by one side.
+     */
+    volatile unsigned head;
+    volatile unsigned tail;
+    volatile bool running;
+
+    // Simulation thread only: the chunk at 'tail', and its length so far
+    uint8_t *fillData;
+    unsigned fill;
+
+    void nextChunk();
+    void writeChunk(const Chunk &chunk);
+    static void threadFn(void *param);
+};
+
+#endif
@@ -45,45 +45,73 @@ void VCDWriter::setNamePrefix(const std::string prefix)
 
 void VCDWriter::define(const std::string name, void *var, unsigned numBits, unsigned firstBit)
 {
-    std::string identifier = createIdentifier(sources.size());
-    identifiers.push_back(identifier);
-    
-    SignalSource s(var, numBits, firstBit);
-    sources.push_back(s);
+    unsigned id = sources.size();
+    sources.push_back(SignalSource(numBits, firstBit));
 
-    defs << "$var reg " << numBits << " " << identifier << " " << namePrefix << name;
+    unsigned total = numBits + firstBit;
+    unsigned size = total <= 8 ? 1 : total <= 16 ? 2 : total <= 32 ? 4 : 8;
+
+    unsigned w = 0;
+    while (w < words.size() && !(words[w].var == var && words[w].size == size))
+        w++;
+    if (w == words.size())
+        words.push_back(SourceWord(var, size));
+    words[w].signals.push_back(id);
+
+    defs << "$var reg " << numBits << " " << createIdentifier(id) << " " << namePrefix << name;
     if (numBits > 1)
         defs << "[" << (numBits - 1) << ":0]";
     defs << " $end\n";
 }
 
-void VCDWriter::writeHeader(FILE *f)
+void VCDWriter::writeHeader(TraceStream &out)
 {
-    fprintf(f, "$timescale\n  %"PRIu64" fs\n$end\n%s$enddefinitions $end\n",
-        ((uint64_t)1e15) / VirtualTime::HZ, defs.str().c_str());
+    char timescale[64];
+    snprintf(timescale, sizeof timescale, "$timescale\n  %"PRIu64" fs\n$end\n",
+        ((uint64_t)1e15) / VirtualTime::HZ);
+
+    std::string header = timescale + defs.str() + "$enddefinitions $end\n";
+
+    out.putVarint(header.size());
+    out.putBytes(header.data(), header.size());
+
+    // Clock deltas restart from zero, and every signal gets an initial value
+    currentTick = 0;
+    needFullDump = true;
+    for (unsigned id = 0; id < sources.size(); id++)
+        sources[id].value = -1;
 }
 
-void VCDWriter::writeTick(FILE *f, uint64_t clock)
+bool VCDWriter::writeWord(TraceStream &out, uint64_t clock,
+    const SourceWord &word, bool tickStarted)
 {
-    for (unsigned id = 0; id < sources.size(); id++) {
+    /*
+     * One of our source words changed. Find out which of its signals
+     * actually changed value, and write them. Returns 'true' if anything
+     * was written.
+     */
+
+    bool written = false;
+
+    for (unsigned i = 0, e = word.signals.size(); i != e; ++i) {
+        unsigned id = word.signals[i];
         SignalSource &source = sources[id];
-        uint64_t newValue = source.sample();
-        
+        uint64_t newValue = source.extract(word.value);
+
         if (newValue != source.value) {
-            if (clock != currentTick) {
-                fprintf(f, "#%"PRIu64"\n", clock);
+            if (!tickStarted && !written) {
+                out.putVarint(clock - currentTick);
                 currentTick = clock;
             }
-            
-            if (source.numBits > 1)
-                fprintf(f, "b");
-            for (int bit = source.numBits - 1; bit >= 0; bit--)
-                fprintf(f, "%u", (unsigned)((newValue >> bit) & 1));
-            fprintf(f, " %s\n", identifiers[id].c_str());            
 
+            out.putVarint(id + 1);
+            out.putVarint(newValue);
             source.value = newValue;
+            written = true;
         }
     }
+
+    return written;
 }
 
 std::string VCDWriter::createIdentifier(unsigned id)
@@ -25,11 +25,19 @@
  */
 
 /*
- * Object for writing Verilog Value Change Dump (VCD) files, a common interchange
- * format for digital logic simulation traces.
+ * Object for writing Verilog Value Change Dump (VCD) traces, a common
+ * interchange format for digital logic simulation traces.
  *
  * For simplicity, we define signals in terms of existing memory variables.
- * Every defined signal is polled once per clock tick. (We never said this would be fast...)
+ * Signals that share a variable are grouped, and each distinct variable is
+ * compared against its last value once per clock tick. Only when a variable
+ * changes do we break it back down into signals.
+ *
+ * Changes are written in a compact binary form to a TraceStream. The
+ * stream starts with the length-prefixed VCD header text. After that,
+ * each tick with changes is a varint clock delta followed by
+ * (signal ID + 1, value) varint pairs, terminated by a zero.
+ * tools/trace2vcd.py turns this back into a standard VCD file.
  */
 
 #ifndef _VCDWRITER_H
@@ -42,56 +50,83 @@
 
 #include "macros.h"
 #include "vtime.h"
+#include "tracestream.h"
 
 
 class VCDWriter {
 public:
     VCDWriter()
-        : currentTick(-1) {}
+        : currentTick(0), needFullDump(true) {}
 
     void enterScope(const std::string scope);
     void leaveScope();
     void setNamePrefix(const std::string prefix);
     void define(const std::string name, void *var, unsigned numBits=1, unsigned firstBit=0);
 
-    void writeHeader(FILE *f);
-    void writeTick(FILE *f, uint64_t clock);
+    void writeHeader(TraceStream &out);
+
+    ALWAYS_INLINE void writeTick(TraceStream &out, uint64_t clock)
+    {
+        bool changed = false;
+
+        for (unsigned i = 0, e = words.size(); i != e; ++i) {
+            SourceWord &word = words[i];
+            uint64_t raw = word.sample();
+            if (raw != word.value || UNLIKELY(needFullDump)) {
+                word.value = raw;
+                changed |= writeWord(out, clock, word, changed);
+            }
+        }
+
+        if (changed)
+            out.putByte(0);
+        needFullDump = false;
+    }
 
 private:
-    struct SignalSource {
-        SignalSource(void *var, unsigned numBits, unsigned firstBit)
-            : value(-1), var(var), numBits(numBits), firstBit(firstBit) {};
+    // One distinct piece of memory that one or more signals sample
+    struct SourceWord {
+        SourceWord(void *var, unsigned size)
+            : value(0), var(var), size(size) {}
 
-        uint64_t sample()
+        ALWAYS_INLINE uint64_t sample()
         {
-            uint64_t s;
-            uint8_t total = numBits + firstBit;
-
-            if (total <= 8)
-                s = *(uint8_t*)var;
-            else if (total <= 16)
-                s = *(uint16_t*)var;
-            else if (total <= 32)
-                s = *(uint32_t*)var;
-            else
-                s = *(uint64_t*)var;
-
-            return (s >> firstBit) & ((1 << numBits) - 1);
+            switch (size) {
+            case 1:  return *(uint8_t*)var;
+            case 2:  return *(uint16_t*)var;
+            case 4:  return *(uint32_t*)var;
+            default: return *(uint64_t*)var;
+            }
         }
 
         uint64_t value;
-
         void *var;
+        unsigned size;
+        std::vector<unsigned> signals;
+    };
+
+    struct SignalSource {
+        SignalSource(unsigned numBits, unsigned firstBit)
+            : value(-1), numBits(numBits), firstBit(firstBit) {};
+
+        uint64_t extract(uint64_t raw) const
+        {
+            return (raw >> firstBit) & ((uint64_t(1) << numBits) - 1);
+        }
+
+        uint64_t value;
         uint8_t numBits;
         uint8_t firstBit;
     };
 
+    std::vector<SourceWord> words;
     std::vector<SignalSource> sources;
-    std::vector<std::string> identifiers;
     std::string namePrefix;
     std::stringstream defs;
     uint64_t currentTick;
-    
+    bool needFullDump;
+
+    bool writeWord(TraceStream &out, uint64_t clock, const SourceWord &word, bool tickStarted);
     std::string createIdentifier(unsigned id);
 };
 
@@ -227,6 +227,34 @@ bool AssetLoader::needFlashPacket(_SYSCubeID id)
     return false;
 }
 
+#ifdef SIFTEO_SIMULATOR
+
+unsigned AssetLoader::pendingFlashBytes(_SYSCubeID id)
+{
+    /*
+     * How much data is waiting to go out to this cube? Used only as a
+     * scheduling hint by RadioManager, so unlike needFlashPacket() this
+     * doesn't care whether the cube has room for the data yet.
+     */
+
+    ASSERT(userLoader);
+    ASSERT(id < _SYS_NUM_CUBE_SLOTS);
+    _SYSCubeIDVector bit = Intrinsic::LZ(id);
+    ASSERT(bit & activeCubes);
+
+    unsigned bytes = (bit & resetPendingCubes) ? 1 : 0;
+
+    _SYSAssetLoaderCube *lc = AssetUtil::mapLoaderCube(userLoader, id);
+    if (lc) {
+        AssetFIFO fifo(*lc);
+        bytes += fifo.readAvailable();
+    }
+
+    return bytes;
+}
+
+#endif  // SIFTEO_SIMULATOR
+
 bool AssetLoader::needFullACK(_SYSCubeID id)
 {
     /*
@@ -67,6 +67,9 @@ public:
 
     // Cube radio ISR entry points
     static bool needFlashPacket(_SYSCubeID id);
+#ifdef SIFTEO_SIMULATOR
+    static unsigned pendingFlashBytes(_SYSCubeID id);
+#endif
     static bool needFullACK(_SYSCubeID id);
     static void produceFlashPacket(_SYSCubeID id, PacketBuffer &buf);
     static void ackReset(_SYSCubeID id);
@@ -28,6 +28,7 @@
 #include "audiochannel.h"
 #include <limits.h>
 #include "audiomixer.h"
+#include <string.h>
 
 #ifdef SIFTEO_SIMULATOR
 #   include "mc_audiovisdata.h"
@@ -107,51 +108,74 @@ bool AudioChannelSlot::mixAudio(int *buffer, uint32_t numFrames)
             }
         }
 
-        // Compute the next sample
-        if (buffer) {
-            int sample;
-
-            if (!fractional) {
-                // Offset is aligned with an asset sample
-                sample = samples.getSample(index, mod);
-
-            } else {
-                // At all other times, we use linear interpolation between two samples.
-
-                int next;
-
-                if (LIKELY(index + 1 < loopEnd)) {
-                    // Fast path for linear interpolation between two adjacent samples
-                    next = samples.getSamplePair(index, mod, sample);
+        if (!buffer) {
+            // Not outputting audio; just advance to the next output sample
+            localOffset += latchedIncrement;
+            continue;
+        }
 
-                } else if (state & STATE_LOOP) {
-                    // Next sample is on the other side of the loop
-                    sample = samples.getSample(index, mod);
-                    next = samples.getSample(loopStart, mod);
+        if (UNLIKELY(index + 1 >= loopEnd)) {
+            /*
+             * Last sample before the loop point. Interpolation can't use a
+             * contiguous span here, so handle this one frame on its own.
+             */
 
-                } else {
-                    // Not looping. Next sample is an implied zero.
-                    sample = samples.getSample(index, mod);
-                    next = 0;
-                }
+            int sample = samples.getSample(index, mod);
 
+            if (fractional) {
+                // Next sample is on the other side of the loop, or an implied zero
+                int next = (state & STATE_LOOP) ? samples.getSample(loopStart, mod) : 0;
                 sample += ((next - sample) * int(fractional)) >> SAMPLE_FRAC_SIZE;
             }
 
-            // Mix volume
             sample = (sample * latchedVolume) >> _SYS_AUDIO_MAX_VOLUME_LOG2;
 
             #ifdef SIFTEO_SIMULATOR
                 MCAudioVisData::writeChannelSample(AudioMixer::instance.channelID(this), sample);
             #endif
 
-            // Mix into buffer (No need to clamp yet)
-            *buffer += sample;
-            buffer++;
+            *(buffer++) += sample;
+            localOffset += latchedIncrement;
+            continue;
         }
 
-        // Advance to the next output sample
-        localOffset += latchedIncrement;
+        /*
+         * Common case: mix as many frames as we can from one contiguous
+         * span of buffered samples, without crossing the loop point.
+         * Every frame in the run needs both its sample and the one after.
+         */
+
+        unsigned avail;
+        const int16_t *src = samples.getSpan(index, mod, avail);
+        avail = MIN(avail, loopEnd - index);
+
+        uint32_t limit = (avail - 1) << SAMPLE_FRAC_SIZE;
+        unsigned count = numFrames;
+        if (latchedIncrement) {
+            uint32_t reachable = (limit - fractional + latchedIncrement - 1) / latchedIncrement;
+            count = MIN(count, reachable);
+        }
+        ASSERT(count > 0);
+
+        #ifdef SIFTEO_SIMULATOR
+            // Keep this channel's output separate, for the visualizer
+            int scratch[AudioMixer::BLOCK_FRAMES];
+            count = MIN(count, arraysize(scratch));
+            memset(scratch, 0, count * sizeof scratch[0]);
+            AudioMixSpan::mix(scratch, src, fractional, latchedIncrement, count, latchedVolume);
+
+            unsigned channelID = AudioMixer::instance.channelID(this);
+            for (unsigned i = 0; i != count; ++i) {
+                MCAudioVisData::writeChannelSample(channelID, scratch[i]);
+                buffer[i] += scratch[i];
+            }
+        #else
+            AudioMixSpan::mix(buffer, src, fractional, latchedIncrement, count, latchedVolume);
+        #endif
+
+        buffer += count;
+        localOffset += uint64_t(count) * latchedIncrement;
+        numFrames -= count - 1;
 
     } while (--numFrames);
 
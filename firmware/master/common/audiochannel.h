@@ -30,10 +30,7 @@
 #include <stdint.h>
 #include "machine.h"
 #include "audiosampledata.h"
-
-// Fixed-point math offsets
-#define SAMPLE_FRAC_SIZE 12
-#define SAMPLE_FRAC_MASK ((1 << SAMPLE_FRAC_SIZE) - 1)
+#include "audiomixspan.h"
 
 class AudioChannelSlot {
 public:
@@ -254,7 +254,7 @@ void AudioMixer::pullAudio()
      * mixing one sample at a time.
      */
 
-    int blockBuffer[32];
+    int blockBuffer[BLOCK_FRAMES];
     unsigned samplesLeft = output.writeAvailable();
 
     #ifdef SIFTEO_SIMULATOR
@@ -37,6 +37,7 @@ class AudioMixer
 public:
     // Global sample rate for mixing and audio output
     static const unsigned SAMPLE_HZ = 16000;
+    static const unsigned BLOCK_FRAMES = 32;    // Largest block handed to each channel
 
     // Type and size for output buffer, between mixer and audio device
     typedef RingBuffer<1024, int16_t> OutputBuffer;
@@ -0,0 +1,117 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AUDIOMIXSPAN_H_
+#define AUDIOMIXSPAN_H_
+
+#include <stdint.h>
+#include <sifteo/abi.h>
+#include "macros.h"
+
+#if defined(SIFTEO_SIMULATOR) && defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+// Fixed-point math offsets
+#define SAMPLE_FRAC_SIZE 12
+#define SAMPLE_FRAC_MASK ((1 << SAMPLE_FRAC_SIZE) - 1)
+
+/*
+ * Inner loops for block-oriented mixing.
+ *
+ * Each of these takes a run of decoded 16-bit samples which are already
+ * contiguous in memory, resamples them, applies a channel volume, and
+ * accumulates into the mixer's 32-bit block buffer. All per-sample
+ * bookkeeping (buffer refills, loop points) has been hoisted out by the
+ * caller, which guarantees that every sample these loops touch is valid.
+ */
+
+namespace AudioMixSpan {
+
+    /*
+     * General case: linear interpolation at any fixed-point rate.
+     *
+     * 'pos' is a SAMPLE_FRAC_SIZE fixed-point offset from src[0]. Reads
+     * up to src[((pos + (count - 1) * increment) >> SAMPLE_FRAC_SIZE) + 1].
+     */
+    static ALWAYS_INLINE void mixResampled(int *dest, const int16_t *src,
+        uint32_t pos, uint32_t increment, unsigned count, int volume)
+    {
+        ASSERT(count > 0);
+        do {
+            const int16_t *p = src + (pos >> SAMPLE_FRAC_SIZE);
+            int fractional = pos & SAMPLE_FRAC_MASK;
+            int sample = p[0];
+
+            sample += ((p[1] - sample) * fractional) >> SAMPLE_FRAC_SIZE;
+            *(dest++) += (sample * volume) >> _SYS_AUDIO_MAX_VOLUME_LOG2;
+            pos += increment;
+        } while (--count);
+    }
+
+    /*
+     * Fast case: playing at exactly the mixer's rate, aligned with the
+     * source samples. No interpolation, so this is a straight multiply and
+     * accumulate. On the simulator's host it's done eight samples at a time.
+     */
+    static ALWAYS_INLINE void mixAligned(int *dest, const int16_t *src,
+        unsigned count, int volume)
+    {
+        ASSERT(volume >= 0 && volume <= _SYS_AUDIO_MAX_VOLUME);
+
+        #if defined(SIFTEO_SIMULATOR) && defined(__SSE2__)
+            const __m128i v = _mm_set1_epi16(volume);
+
+            for (; count >= 8; count -= 8, src += 8, dest += 8) {
+                // Exact 16x16 -> 32 bit products, from the low and high halves
+                __m128i s = _mm_loadu_si128((const __m128i *) src);
+                __m128i lo = _mm_mullo_epi16(s, v);
+                __m128i hi = _mm_mulhi_epi16(s, v);
+                __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), _SYS_AUDIO_MAX_VOLUME_LOG2);
+                __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), _SYS_AUDIO_MAX_VOLUME_LOG2);
+
+                __m128i *d = (__m128i *) dest;
+                _mm_storeu_si128(d, _mm_add_epi32(_mm_loadu_si128(d), p0));
+                _mm_storeu_si128(d + 1, _mm_add_epi32(_mm_loadu_si128(d + 1), p1));
+            }
+        #endif
+
+        for (; count; --count)
+            *(dest++) += (*(src++) * volume) >> _SYS_AUDIO_MAX_VOLUME_LOG2;
+    }
+
+    // Pick the fastest kernel that applies
+    static ALWAYS_INLINE void mix(int *dest, const int16_t *src,
+        uint32_t pos, uint32_t increment, unsigned count, int volume)
+    {
+        if (increment == (1 << SAMPLE_FRAC_SIZE) && (pos & SAMPLE_FRAC_MASK) == 0)
+            mixAligned(dest, src + (pos >> SAMPLE_FRAC_SIZE), count, volume);
+        else
+            mixResampled(dest, src, pos, increment, count, volume);
+    }
+
+} // namespace AudioMixSpan
+
+#endif // AUDIOMIXSPAN_H_
@@ -25,6 +25,7 @@
  
 #include "audiosampledata.h"
 #include "svmmemory.h"
+#include "flash_prefetch.h"
 #include <algorithm>
 
 #define LGPFX "AudioSampleData: "
@@ -57,6 +58,8 @@ void AudioSampleData::fetchBlockPCM(uint32_t sampleNum, const _SYSAudioModule &m
     // Must be aligned to one half of the buffer
     ASSERT((sampleNum & HALF_BUFFER_MASK) == 0);
 
+    FlashPrefetchScope prefetch(FlashPrefetch::S_AUDIO);
+
     int16_t *dest = &samples[sampleNum & FULL_BUFFER_MASK];
     ASSERT(dest + HALF_BUFFER <= &samples[FULL_BUFFER]);
 
@@ -65,6 +68,7 @@ void AudioSampleData::fetchBlockPCM(uint32_t sampleNum, const _SYSAudioModule &m
 
     FlashBlockRef ref;
     SvmMemory::copyROData(ref, pa, va, HALF_BUFFER * sizeof(int16_t));
+    samples[FULL_BUFFER] = samples[0];
 
     // Update state (Ignore snapshots)
     state.sampleNum = sampleNum + HALF_BUFFER;
@@ -89,6 +93,7 @@ void AudioSampleData::fetchBlockADPCM(uint32_t sampleNum, const _SYSAudioModule
     dec.load(stateSampleNum ? state.adpcm : adpcmIC);
 
     FlashBlockRef ref;
+    FlashPrefetchScope prefetch(FlashPrefetch::S_AUDIO);
 
     // Are we not decoding contiguously? May need to loop so we can skip forward.
     while (1) {
@@ -128,12 +133,23 @@ void AudioSampleData::fetchBlockADPCM(uint32_t sampleNum, const _SYSAudioModule
                 return;
             }
 
-            STATIC_ASSERT(HALF_BUFFER <= 16);
-            ASSERT(chunk <= 8);
+            ASSERT(chunk <= HALF_BUFFER / NYBBLES_PER_BYTE);
             ASSERT(chunk > 0);
 
-            switch (chunk) {
-                case 8: dec.decodeByte(pa, dest);
+            // Decode in batches of eight bytes, then finish up the remainder
+            uint32_t remainder = chunk;
+            for (; remainder >= 8; remainder -= 8) {
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+                dec.decodeByte(pa, dest);
+            }
+
+            switch (remainder) {
                 case 7: dec.decodeByte(pa, dest);
                 case 6: dec.decodeByte(pa, dest);
                 case 5: dec.decodeByte(pa, dest);
@@ -150,6 +166,8 @@ void AudioSampleData::fetchBlockADPCM(uint32_t sampleNum, const _SYSAudioModule
             va += chunk;
         }
     
+        samples[FULL_BUFFER] = samples[0];
+
         // Next block...
         unsigned beginningOfBlock = stateSampleNum;
         stateSampleNum += HALF_BUFFER;
@@ -56,30 +56,46 @@ public:
         return samples[sampleNum & FULL_BUFFER_MASK];
     }
 
-    // Optimized accessor for a pair of samples (sampleNum, sampleNum + 1)
-    int ALWAYS_INLINE getSamplePair(unsigned sampleNum, const _SYSAudioModule &mod, int &sample)
+    /*
+     * Span accessor, for block mixing. Makes sure both sampleNum and
+     * sampleNum + 1 are buffered, and returns a pointer to sampleNum.
+     * 'count' receives the number of samples, starting at sampleNum, that
+     * may be read contiguously through that pointer. It's always at least 2.
+     */
+    ALWAYS_INLINE const int16_t *getSpan(unsigned sampleNum, const _SYSAudioModule &mod, unsigned &count)
     {
         unsigned nextSample = sampleNum + 1;
         ASSERT(nextSample < maxNumSamples(mod));
         ASSERT((state.sampleNum & HALF_BUFFER_MASK) == 0);
 
-        unsigned diff = state.sampleNum - (nextSample + 1);
-        if (UNLIKELY(diff >= FULL_BUFFER))
+        if (UNLIKELY(state.sampleNum - (sampleNum + 1) >= FULL_BUFFER))
+            fetchBlock(sampleNum & ~HALF_BUFFER_MASK, mod);
+        if (UNLIKELY(state.sampleNum - (nextSample + 1) >= FULL_BUFFER))
             fetchBlock(nextSample & ~HALF_BUFFER_MASK, mod);
 
-        sample = samples[sampleNum & FULL_BUFFER_MASK];
-        return samples[nextSample & FULL_BUFFER_MASK];
+        // Valid samples, or the physical end of the ring (plus its guard sample)
+        unsigned slot = sampleNum & FULL_BUFFER_MASK;
+        count = MIN(state.sampleNum - sampleNum, FULL_BUFFER + 1 - slot);
+        ASSERT(count >= 2);
+
+        return &samples[slot];
     }
 
 private:
     static const unsigned NYBBLES_PER_BYTE = 2;
 
-    static const unsigned FULL_BUFFER = 32;                 // Must be a power of two
+    /*
+     * Must be a power of two. Spans for the block mixer end where the
+     * buffered samples do, so a 32-sample ring would split every block
+     * into 4-5 spans; at 64 it's about 2.5 (test/firmware/master/audiomix).
+     */
+    static const unsigned FULL_BUFFER = 64;
     static const unsigned HALF_BUFFER = FULL_BUFFER / 2;
     static const unsigned FULL_BUFFER_MASK = FULL_BUFFER - 1;
     static const unsigned HALF_BUFFER_MASK = HALF_BUFFER - 1;
 
-    int16_t samples[FULL_BUFFER];
+    // One extra guard sample mirrors samples[0], so spans can read across the wrap
+    int16_t samples[FULL_BUFFER + 1];
 
     uint32_t autoSnapshotPoint;
 
@@ -334,6 +334,39 @@ bool CubeSlot::radioProduce(PacketTransmission &tx, SysTime::Ticks now)
     return true;
 }
 
+#ifdef SIFTEO_SIMULATOR
+
+unsigned CubeSlot::radioWorkload() const
+{
+    /*
+     * Rough estimate of how many packets' worth of work this cube has
+     * queued up, used by RadioManager to weight its schedule. Called in
+     * ISR context, once per scheduling round.
+     */
+
+    _SYSCubeIDVector cv = bit();
+    unsigned work = 0;
+
+    // Each cm16 bit covers 16 words of VRAM, about one packet's worth
+    if (vbuf && !(CubeSlots::vramPaused & cv))
+        work += Intrinsic::POPCOUNT(vbuf->cm16);
+
+    // Userspace is blocked on us, or a frame is still rendering
+    if (CubeSlots::waitingOnCubes & cv)
+        work += 2;
+    if (paintControl.hasPendingFrames())
+        work++;
+
+    if (AssetLoader::getActiveCubes() & cv) {
+        unsigned bytes = AssetLoader::pendingFlashBytes(id());
+        work += (bytes + PacketBuffer::MAX_LEN - 1) / PacketBuffer::MAX_LEN;
+    }
+
+    return work;
+}
+
+#endif  // SIFTEO_SIMULATOR
+
 void CubeSlot::radioEmptyAcknowledge()
 {
     ackOptional = false;
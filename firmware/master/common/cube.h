@@ -57,6 +57,9 @@ class CubeSlot {
     void radioAcknowledge(const PacketBuffer &packet);
     void radioEmptyAcknowledge();
     void radioTimeout();
+#ifdef SIFTEO_SIMULATOR
+    unsigned radioWorkload() const;
+#endif
 
     // System connect/disconnect handlers (ISR context)
     void connect(SysLFS::Key cubeRecord, const RadioAddress &addr, const RF_ACKType &fullACK);
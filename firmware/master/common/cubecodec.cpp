@@ -24,6 +24,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <protocol.h>
 #include "machine.h"
 #include "cubecodec.h"
@@ -33,6 +34,9 @@
 
 using namespace Intrinsic;
 
+#ifdef SIFTEO_SIMULATOR
+bool CubeCodec::lookahead;
+#endif
 uint16_t CubeCodec::exemptionBegin;
 uint16_t CubeCodec::exemptionEnd;
 
@@ -76,6 +80,12 @@ bool CubeCodec::encodeVRAM(PacketBuffer &buf, _SYSVideoBuffer *vb)
     // Emit buffered bits from the previous packet
     txBits.flush(buf);
 
+#ifdef SIFTEO_SIMULATOR
+    // Simulator-only alternative to the encoder below
+    if (vb && lookahead) {
+        flushed = encodeVRAMLookahead(buf, vb);
+    } else
+#endif
     if (vb) {
         /*
          * Clear the lock exemption range. This tracks words that, despite
@@ -159,6 +169,369 @@ bool CubeCodec::encodeVRAM(PacketBuffer &buf, _SYSVideoBuffer *vb)
     return flushed;
 }
 
+#ifdef SIFTEO_SIMULATOR
+
+/*
+ * Lookahead encoder.
+ *
+ * We gather a window of upcoming changed words, along with any unchanged
+ * words in short gaps between them, then choose codes for the whole
+ * window by finding the shortest path through every possible choice for
+ * every word. This lets us make choices the greedy encoder can't see:
+ * picking a sample that extends the current run rather than starting a
+ * new one, or re-sending a few unchanged words as part of a run instead
+ * of spending a skip code to step over them.
+ *
+ * Like the exemption range, this state is only used during a single
+ * encodeVRAM() and is shared by all cubes. It's over 1.5 kB, so this
+ * encoder is only built into Siftulator, where it's an option.
+ */
+
+namespace {
+    // Words in the planning window, including gap fillers
+    const unsigned LA_NODES = 32;
+
+    // Only fill gaps that a short skip code could have covered
+    const unsigned LA_MAX_FILL = 8;
+
+    // Choices near the end of a full window are provisional; we replan them
+    // next time around, knowing what comes after.
+    const unsigned LA_MARGIN = 8;
+
+    // Per-word choices: delta from sample 0-3, literal, or skip (fillers only)
+    const unsigned LA_LITERAL = 4;
+    const unsigned LA_SKIP = 5;
+    const unsigned LA_OPTIONS = 6;
+
+    // Run lengths are tracked up to the point where their cost stops changing
+    const unsigned LA_RUNS = 7;
+    const unsigned LA_STATES = LA_OPTIONS * LA_RUNS;
+    const uint16_t LA_NONE = 0xFFFF;
+
+    struct LookaheadNode {
+        uint16_t addr;
+        uint16_t data;
+        uint8_t jumpBits;       // Cost of the address change before this word, if any
+        bool dirty;             // Must be sent. Clean words are optional fillers.
+        uint8_t d[4];           // Delta code for each sample, or 0xFF if unusable
+    };
+
+    LookaheadNode laNodes[LA_NODES];
+    bool laComplete;            // Window holds every remaining changed word
+    uint8_t laChoice[LA_NODES];
+    uint8_t laBack[LA_NODES][LA_STATES];
+
+    // Words that are safe to sample: sent, or about to be sent, in this packet
+    uint32_t laSent[_SYS_VRAM_WORDS / 32];
+
+    unsigned dsBits(unsigned d) {
+        return d == RF_VRAM_DIFF_BASE ? 4 : 8;
+    }
+
+    // Cost of flushDSRuns(false) with 'runs' pending
+    unsigned flushBits(unsigned runs) {
+        return runs == 0 ? 0 : runs <= 4 ? 4 : 12;
+    }
+
+    // Cost of flushDSRuns(true), which re-emits the last code after the run
+    unsigned flushSafeBits(unsigned runs, unsigned d) {
+        return runs == 0 ? 0 : runs == 1 ? dsBits(d) : (runs <= 5 ? 4 : 12) + dsBits(d);
+    }
+}
+
+bool CubeCodec::encodeVRAMLookahead(PacketBuffer &buf, _SYSVideoBuffer *vb)
+{
+    bool flushed = false;
+
+    memset(laSent, 0, sizeof laSent);
+
+    while (!buf.isFull()) {
+        unsigned count = lookaheadWindow(vb, flushed);
+        if (!count)
+            break;
+
+        lookaheadPlan(count);
+        if (!lookaheadSend(buf, vb, count, flushed))
+            break;
+    }
+
+    return flushed;
+}
+
+unsigned CubeCodec::lookaheadWindow(_SYSVideoBuffer *vb, bool &flushed)
+{
+    /*
+     * Collect changed words in the same order encodeVRAM() would send
+     * them, without clearing anything from the change map yet. Short gaps
+     * of unchanged and unlocked words are included as optional fillers.
+     *
+     * For each word, we also precompute the delta code against each
+     * sample point. Samples must be unchanged and unlocked, or they must
+     * be sent earlier in this same packet.
+     */
+
+    static const uint8_t offsets[] = {
+        RF_VRAM_SAMPLE_0, RF_VRAM_SAMPLE_1, RF_VRAM_SAMPLE_2, RF_VRAM_SAMPLE_3
+    };
+
+    unsigned count = 0;
+    uint16_t pos = codePtr;
+    uint32_t cm16 = vb->cm16;
+
+    laComplete = false;
+
+    while (cm16) {
+        uint32_t idx32 = CLZ(cm16) >> 1;
+        uint32_t blockMask = ROR(0x3FFFFFFF, idx32 << 1);
+        uint32_t cm1 = vb->cm1[idx32];
+        cm16 &= blockMask;
+
+        if (!cm1) {
+            // Nothing left in this block, same as the greedy encoder
+            vb->cm16 &= blockMask;
+            if (!vb->cm16)
+                flushed = true;
+            continue;
+        }
+
+        while (cm1) {
+            uint32_t idx1 = CLZ(cm1);
+            uint16_t addr = (idx32 << 5) | idx1;
+            uint16_t gap = (addr - pos) & _SYS_VRAM_WORD_MASK;
+            uint8_t jumpBits = 0;
+            cm1 &= ROR(0x7FFFFFFF, idx1);
+
+            if (gap) {
+                bool fill = gap <= LA_MAX_FILL && count + gap < LA_NODES;
+                for (unsigned i = 0; fill && i < gap; ++i) {
+                    uint16_t w = (pos + i) & _SYS_VRAM_WORD_MASK;
+                    fill = !(vb->lock & VRAM::maskCM16(w)) &&
+                           !(VRAM::selectCM1(*vb, w) & VRAM::maskCM1(w));
+                }
+                if (!fill)
+                    jumpBits = gap <= 8 ? 8 : 16;
+            }
+
+            if (count + (jumpBits ? 0 : gap) >= LA_NODES)
+                return count;
+
+            for (uint16_t w = jumpBits ? addr : pos;; w = (w + 1) & _SYS_VRAM_WORD_MASK) {
+                LookaheadNode &n = laNodes[count++];
+
+                n.addr = w;
+                n.data = VRAM::peek(*vb, w);
+                n.dirty = w == addr;
+                n.jumpBits = n.dirty ? jumpBits : 0;
+
+                for (unsigned s = 0; s < arraysize(offsets); ++s) {
+                    uint16_t ptr = (w - offsets[s]) & _SYS_VRAM_WORD_MASK;
+                    uint16_t sample = VRAM::peek(*vb, ptr);
+                    n.d[s] = 0xFF;
+
+                    if (((vb->lock & VRAM::maskCM16(ptr)) ||
+                         (VRAM::selectCM1(*vb, ptr) & VRAM::maskCM1(ptr))) &&
+                        !(laSent[ptr >> 5] & VRAM::maskCM1(ptr)))
+                        continue;
+
+                    if ((sample & 0x0101) != (n.data & 0x0101))
+                        continue;
+
+                    unsigned d = _SYS_INVERSE_TILE77(n.data) - _SYS_INVERSE_TILE77(sample)
+                        + RF_VRAM_DIFF_BASE;
+                    if (d < 0x10)
+                        n.d[s] = d;
+                }
+
+                if (n.dirty) {
+                    laSent[w >> 5] |= VRAM::maskCM1(w);
+                    break;
+                }
+            }
+
+            pos = (addr + 1) & _SYS_VRAM_WORD_MASK;
+        }
+    }
+
+    laComplete = true;
+    return count;
+}
+
+void CubeCodec::lookaheadPlan(unsigned count)
+{
+    /*
+     * Shortest path over (choice, run length) states, measured in bits.
+     * Run codes are charged when the run ends, according to which kind of
+     * flushDSRuns() the next code will perform.
+     */
+
+    uint16_t cost[2][LA_STATES];
+    uint8_t prevS[LA_OPTIONS], prevD[LA_OPTIONS];
+    uint16_t *prevCost = cost[0];
+    uint16_t *nextCost = cost[1];
+
+    // Start from the codec's current state, as if it were a literal
+    // (no run extension possible) or a delta code with pending runs.
+
+    for (unsigned i = 0; i < LA_STATES; ++i)
+        prevCost[i] = LA_NONE;
+    prevS[LA_LITERAL] = prevD[LA_LITERAL] = 0xFF;
+    if (codeS < 4 && codeD < 0x10) {
+        prevS[codeS] = codeS;
+        prevD[codeS] = codeD;
+        prevCost[codeS * LA_RUNS + MIN(codeRuns, LA_RUNS - 1)] = 0;
+    } else {
+        prevCost[LA_LITERAL * LA_RUNS] = 0;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        const LookaheadNode &n = laNodes[i];
+        bool lit16 = (n.data & 0x0101) != 0;
+        uint8_t *back = laBack[i];
+
+        for (unsigned j = 0; j < LA_STATES; ++j)
+            nextCost[j] = LA_NONE;
+
+        for (unsigned p = 0; p < LA_STATES; ++p) {
+            if (prevCost[p] == LA_NONE)
+                continue;
+
+            unsigned po = p / LA_RUNS;
+            unsigned runs = p % LA_RUNS;
+            bool afterSkip = po == LA_SKIP;
+            unsigned base = prevCost[p];
+            unsigned safe = base + flushSafeBits(runs, prevD[po]);
+            unsigned unsafe = base + flushBits(runs);
+
+            if (n.jumpBits)
+                safe = unsafe = safe + n.jumpBits;
+            else if (afterSkip)
+                safe = unsafe = base;
+
+            for (unsigned s = 0; s < 4; ++s) {
+                unsigned d = n.d[s];
+                if (d == 0xFF)
+                    continue;
+
+                unsigned c, r = 0;
+                if (!n.jumpBits && !afterSkip && prevS[po] == s && prevD[po] == d) {
+                    c = base;
+                    r = MIN(runs + 1, LA_RUNS - 1);
+                } else {
+                    c = unsafe + dsBits(d);
+                }
+
+                unsigned next = s * LA_RUNS + r;
+                if (c < nextCost[next]) {
+                    nextCost[next] = c;
+                    back[next] = p;
+                }
+            }
+
+            if (n.dirty) {
+                unsigned c = lit16 ? safe + 24 : unsafe + 16;
+                unsigned next = LA_LITERAL * LA_RUNS;
+                if (c < nextCost[next]) {
+                    nextCost[next] = c;
+                    back[next] = p;
+                }
+            } else {
+                unsigned c = afterSkip ? base : safe + 8;
+                unsigned next = LA_SKIP * LA_RUNS;
+                if (c < nextCost[next]) {
+                    nextCost[next] = c;
+                    back[next] = p;
+                }
+            }
+        }
+
+        for (unsigned s = 0; s < 4; ++s) {
+            prevS[s] = s;
+            prevD[s] = n.d[s];
+        }
+        prevS[LA_LITERAL] = 0;
+        prevD[LA_LITERAL] = RF_VRAM_DIFF_BASE;
+        prevS[LA_SKIP] = prevD[LA_SKIP] = 0xFF;
+
+        uint16_t *t = prevCost;
+        prevCost = nextCost;
+        nextCost = t;
+    }
+
+    // The last word is always a changed word; pick the cheapest way to finish.
+
+    unsigned best = 0;
+    unsigned bestCost = (unsigned) -1;
+    for (unsigned p = 0; p < LA_STATES; ++p) {
+        if (prevCost[p] == LA_NONE)
+            continue;
+        unsigned c = prevCost[p] + flushBits(p % LA_RUNS);
+        if (c < bestCost) {
+            bestCost = c;
+            best = p;
+        }
+    }
+
+    for (unsigned i = count; i--;) {
+        laChoice[i] = best / LA_RUNS;
+        best = laBack[i][best];
+    }
+}
+
+bool CubeCodec::lookaheadSend(PacketBuffer &buf, _SYSVideoBuffer *vb, unsigned count, bool &flushed)
+{
+    /*
+     * Emit the planned codes, using the same primitives as the greedy
+     * encoder. Returns false if we filled the packet first.
+     */
+
+    ASSERT(laComplete || count > LA_MARGIN);
+    unsigned limit = laComplete ? count : count - LA_MARGIN;
+
+    // Words we aren't sending yet can't be used as samples
+    for (unsigned i = limit; i < count; ++i)
+        if (laNodes[i].dirty)
+            laSent[laNodes[i].addr >> 5] &= ~VRAM::maskCM1(laNodes[i].addr);
+
+    for (unsigned i = 0; i < limit; ++i) {
+        const LookaheadNode &n = laNodes[i];
+        unsigned choice = laChoice[i];
+
+        if (choice == LA_SKIP)
+            continue;
+
+        if (!encodeVRAMAddr(buf, n.addr))
+            return false;
+
+        if (choice == LA_LITERAL) {
+            if (!encodeVRAMData(buf, n.data))
+                return false;
+        } else {
+            if (buf.isFull())
+                return false;
+            encodeDS(n.d[choice], choice);
+            txBits.flush(buf);
+        }
+
+        if (n.dirty) {
+            uint32_t idx32 = n.addr >> 5;
+            uint32_t &cm1 = VRAM::selectCM1(*vb, n.addr);
+            cm1 &= ~VRAM::maskCM1(n.addr);
+            if (!cm1) {
+                vb->cm16 &= ROR(0x3FFFFFFF, idx32 << 1);
+                if (!vb->cm16)
+                    flushed = true;
+            }
+        }
+
+        if (buf.isFull())
+            return false;
+    }
+
+    return true;
+}
+
+#endif  // SIFTEO_SIMULATOR
+
 bool CubeCodec::encodeVRAMAddr(PacketBuffer &buf, uint16_t addr)
 {
     ASSERT(addr < _SYS_VRAM_WORDS);
@@ -110,6 +110,16 @@ class BitBuffer {
 
 class CubeCodec {
  public:
+#ifdef SIFTEO_SIMULATOR
+    /*
+     * Selects the lookahead VRAM encoder. Instead of choosing each word's
+     * code on its own, it plans a short window of upcoming words at once,
+     * picking the cheapest combination of codes. The wire format is
+     * unchanged; this only trades encoder CPU time for radio bandwidth.
+     */
+    static bool lookahead;
+#endif
+
     ALWAYS_INLINE void stateReset() { 
         codePtr = 0;
         codeS = -1;
@@ -173,6 +183,13 @@ class CubeCodec {
 
     void encodeDS(uint8_t d, uint8_t s);
     void flushDSRuns(bool rleSafe);
+
+#ifdef SIFTEO_SIMULATOR
+    bool encodeVRAMLookahead(PacketBuffer &buf, _SYSVideoBuffer *vb);
+    unsigned lookaheadWindow(_SYSVideoBuffer *vb, bool &flushed);
+    void lookaheadPlan(unsigned count);
+    bool lookaheadSend(PacketBuffer &buf, _SYSVideoBuffer *vb, unsigned count, bool &flushed);
+#endif
 };
 
 #endif
@@ -24,29 +24,41 @@
  */
 
 #include "flash_blockcache.h"
+#include "flash_blockcache_policy.h"
+#include "flash_prefetch.h"
 #include "flash_device.h"
 #include "flash_lfs.h"
 #include "svmdebugger.h"
 #include "faultlogger.h"
+#include "svmcpu.h"
 #include <string.h>
 
 uint8_t FlashBlock::mem[NUM_CACHE_BLOCKS][BLOCK_SIZE] BLOCK_ALIGN;
 FlashBlock FlashBlock::instances[NUM_CACHE_BLOCKS];
 uint8_t FlashBlock::validCodeBundles[NUM_CACHE_BLOCKS];
-unsigned FlashBlock::latestStamp;
+uint8_t FlashBlock::hashBuckets[NUM_HASH_BUCKETS];
 
 
 void FlashBlock::init()
 {
+    STATIC_ASSERT((NUM_CACHE_BLOCKS & (NUM_CACHE_BLOCKS - 1)) == 0);
+    STATIC_ASSERT(NUM_CACHE_BLOCKS <= 128);
+    STATIC_ASSERT(sizeof(FlashBlock) == 8);
+
     // All blocks start out with no valid data
     for (unsigned i = 0; i < NUM_CACHE_BLOCKS; ++i) {
         instances[i].address = INVALID_ADDRESS;
+        instances[i].hashNext = NO_BLOCK;
+        instances[i].prefetched = 0;
 
         // We explicitly store the ID of each block,
         // so that id() and getData() can be as fast as possible.
         instances[i].idByte = i;
     }
 
+    memset(hashBuckets, NO_BLOCK, sizeof hashBuckets);
+    FlashBlockPolicy::init();
+
     FLASHLAYER_STATS_ONLY(resetStats());
 }
 
@@ -61,22 +73,33 @@ void FlashBlock::get(FlashBlockRef &ref, uint32_t blockAddr, unsigned flags)
     } else if (FlashBlock *cached = lookupBlock(blockAddr)) {
         // Cache layer 2: Block exists elsewhere in the cache
         FLASHLAYER_STATS_ONLY(stats.periodic.blockHitOther++);
+        FlashPrefetch::observe(blockAddr);
+
+        if (cached->prefetched) {
+            FLASHLAYER_STATS_ONLY(stats.periodic.prefetchHit++);
+            cached->prefetched = 0;
+        }
+
         ref.set(cached);
 
     } else {
         // Cache miss. Find a free block and reload it. Reset the lazy
         // code validator.
 
+        FlashPrefetch::observe(blockAddr);
+
         FlashBlock *recycled = recycleBlock(blockAddr);
         ASSERT(recycled->refCount == 0);
         ASSERT(recycled >= &instances[0] && recycled < &instances[NUM_CACHE_BLOCKS]);
 
         recycled->load(blockAddr, flags);
+        FLASHLAYER_STATS_ONLY(if (!flags) countBlockMiss(blockAddr));
+        FlashBlockPolicy::insert(recycled);
         ref.set(recycled);
     }
-    
-    // Update this block's access stamp (See recycleBlock)
-    ref->stamp = ++latestStamp;
+
+    // Let the replacement policy know this block is still in use
+    FlashBlockPolicy::touch(&*ref);
 
     FLASHLAYER_STATS_ONLY(stats.periodic.blockTotal++);
     FLASHLAYER_STATS_ONLY(dumpStats());
@@ -104,8 +127,9 @@ void FlashBlock::anonymous(FlashBlockRef &ref)
     ASSERT(recycled >= &instances[0] && recycled < &instances[NUM_CACHE_BLOCKS]);
 
     // This ensures nobody else will ref the same block.
-    recycled->address = INVALID_ADDRESS;
-    recycled->validCodeBundles[recycled->id()] = 0;
+    recycled->setAddress(INVALID_ADDRESS);
+    recycled->invalidateCode();
+    FlashBlockPolicy::insert(recycled);
 
     ref.set(recycled);
     ASSERT(recycled->refCount == 1);
@@ -124,73 +148,86 @@ void FlashBlock::anonymous(FlashBlockRef &ref, uint8_t fillByte)
 ALWAYS_INLINE FlashBlock *FlashBlock::lookupBlock(uint32_t blockAddr)
 {
     /*
-     * This is a compromise between a fully associative and a set-associative
-     * cache. We can't usefully be set-associative with a small N, because
-     * our N would need to be at least as large as the worst-case number of
-     * referenced blocks.
-     *
-     * So instead, we'll still be a fully associative cache, but we use
-     * the address as a hint for which cache bucket to start in. We strongly
-     * prefer to place blocks in this cached address, but we don't require
-     * it (in case the preferred location is referenced or very recently
-     * accessed).
+     * Every block with a valid address is on exactly one hash chain,
+     * selected by the low bits of its block number. There are as many
+     * buckets as cache blocks, and sequential flash blocks land in
+     * different buckets, so chains are nearly always zero or one blocks
+     * long.
      */
 
     ASSERT((blockAddr & BLOCK_MASK) == 0);
-    FlashBlock *ptr = &instances[(blockAddr >> BLOCK_SIZE_LOG2) % NUM_CACHE_BLOCKS];
-    unsigned count = NUM_CACHE_BLOCKS;
+    unsigned id = hashBuckets[hashBucket(blockAddr)];
 
-    do {
+    while (id != NO_BLOCK) {
+        FlashBlock *ptr = &instances[id];
         if (ptr->address == blockAddr)
             return ptr;
-        if (++ptr == &instances[NUM_CACHE_BLOCKS])
-            ptr = &instances[0];
-    } while (--count);
+        id = ptr->hashNext;
+    }
 
     return 0;
 }
 
+FlashBlock *FlashBlock::takeVictim()
+{
+    /*
+     * Ask the FlashBlockPolicy for an unreferenced block to reuse.
+     * Returns NULL if there are none.
+     */
+
+    FlashBlock *ptr = FlashBlockPolicy::victim();
+
+    if (ptr && ptr->prefetched) {
+        // Prefetched, but nobody ever asked for it
+        FLASHLAYER_STATS_ONLY(stats.periodic.prefetchUseless++);
+        ptr->prefetched = 0;
+    }
+
+    return ptr;
+}
+
 FlashBlock *FlashBlock::recycleBlock(uint32_t blockAddr)
 {
     /*
      * Look for a block we can recycle, in order to service a cache miss.
-     * To maintain the hash property of our cache, we strongly prefer to
-     * recycle the block which is directly mapped to the requested address.
-     *
-     * We opt to skip to the next block if the preferred block is referenced,
-     * or if it was used recently. (Its stamp is recent).
+     * Which block that is, is entirely up to the FlashBlockPolicy; the only
+     * hard requirement is that it must not be referenced.
      */
 
-    // First pass: Look for something both unreferenced and stale
-    {
-        FlashBlock *ptr = &instances[(blockAddr >> BLOCK_SIZE_LOG2) % NUM_CACHE_BLOCKS];
-        unsigned count = NUM_CACHE_BLOCKS;
-        const unsigned ageThreshold = NUM_CACHE_BLOCKS * 2;
-        unsigned localLatestStamp = latestStamp;
-
-        do {
-            if (ptr->refCount == 0 && (ptr->address == INVALID_ADDRESS
-                    || ptr->getAge(localLatestStamp) >= ageThreshold))
-                return ptr;
-            if (++ptr == &instances[NUM_CACHE_BLOCKS])
-                ptr = &instances[0];
-        } while (--count);
-    }
+    FlashBlock *ptr = takeVictim();
+    if (ptr)
+        return ptr;
+
+    FaultLogger::internalError(FaultLogger::F_OUT_OF_CACHE_BLOCKS);
+}
+
+void FlashBlock::setAddress(uint32_t blockAddr)
+{
+    /*
+     * Change this block's address, keeping the hash chains up to date.
+     * Anonymous blocks aren't on any chain.
+     */
+
+    if (address == blockAddr)
+        return;
 
-    // Second pass: Give up on finding a stale block, just look for anything unreferenced
-    {
-        FlashBlock *ptr = &instances[(blockAddr >> BLOCK_SIZE_LOG2) % NUM_CACHE_BLOCKS];
-        unsigned count = NUM_CACHE_BLOCKS;
-
-        do {
-            if (ptr->refCount == 0)
-                return ptr;
-            if (++ptr == &instances[NUM_CACHE_BLOCKS])
-                ptr = &instances[0];
-        } while (--count);
+    if (address != INVALID_ADDRESS) {
+        uint8_t *link = &hashBuckets[hashBucket(address)];
+        while (*link != idByte) {
+            ASSERT(*link != NO_BLOCK);
+            link = &instances[*link].hashNext;
+        }
+        *link = hashNext;
+        hashNext = NO_BLOCK;
     }
 
-    FaultLogger::internalError(FaultLogger::F_OUT_OF_CACHE_BLOCKS);
+    address = blockAddr;
+
+    if (blockAddr != INVALID_ADDRESS) {
+        uint8_t &head = hashBuckets[hashBucket(blockAddr)];
+        hashNext = head;
+        head = idByte;
+    }
 }
 
 void FlashBlock::load(uint32_t blockAddr, unsigned flags)
@@ -203,8 +240,8 @@ void FlashBlock::load(uint32_t blockAddr, unsigned flags)
     ASSERT(blockAddr != INVALID_ADDRESS);
     ASSERT((blockAddr & (BLOCK_SIZE - 1)) == 0);
 
-    validCodeBundles[id()] = 0;
-    address = blockAddr;
+    invalidateCode();
+    setAddress(blockAddr);
 
     uint8_t *data = getData();
     ASSERT(isAddrValid(reinterpret_cast<uintptr_t>(data)));
@@ -213,7 +250,6 @@ void FlashBlock::load(uint32_t blockAddr, unsigned flags)
     if (LIKELY(!flags)) {
         // Normal cache miss; fetch from hardware
         FlashDevice::read(blockAddr, data, BLOCK_SIZE);
-        FLASHLAYER_STATS_ONLY(countBlockMiss(blockAddr));
 
     } else if (flags & F_ABORT_TRAP) {
         // Create a _SYS_abort() trap page. Any address in this page will cause
@@ -243,6 +279,20 @@ void FlashBlock::load(uint32_t blockAddr, unsigned flags)
     SvmDebugger::patchFlashBlock(blockAddr, data);
 }
 
+void FlashBlock::invalidateCode()
+{
+    /*
+     * The contents of this block are changing. Reset the lazy code
+     * validator, plus any simulator state derived from the old code.
+     */
+
+    validCodeBundles[id()] = 0;
+
+    #ifdef SIFTEO_SIMULATOR
+    SvmCpu::invalidateDecodeCache(id());
+    #endif
+}
+
 void FlashBlockWriter::beginBlock(uint32_t blockAddr)
 {
     if (ref.isHeld() && ref->getAddress() == blockAddr) {
@@ -269,7 +319,7 @@ void FlashBlockWriter::beginBlock(const FlashBlockRef &r)
     ASSERT(ref.isHeld());
 
     // Prepare to write
-    ref->validCodeBundles[ref->id()] = 0;
+    ref->invalidateCode();
 }
 
 void FlashBlockWriter::beginBlock()
@@ -333,7 +383,9 @@ void FlashBlock::invalidateBlock(unsigned flags)
             load(address, flags);
     } else {
         // Nobody's using this block, quietly mark it as invalid / anonymous
-        address = INVALID_ADDRESS;
+        setAddress(INVALID_ADDRESS);
+        prefetched = 0;
+        FlashBlockPolicy::discard(this);
     }
 }
 
@@ -389,28 +441,47 @@ void FlashBlockWriter::relocate(uint32_t blockAddr)
     // Same as commitBlock() if we aren't moving.
     if (block->address != blockAddr) {
 
-        // Invalidate any blocks we're replacing. They must be unref'ed.
-        for (unsigned idx = 0; idx < FlashBlock::NUM_CACHE_BLOCKS; idx++) {
-            FlashBlock *b = &FlashBlock::instances[idx];
-            if (b->address == blockAddr) {
-
-                if (b->refCount != 0) {
-                    LOG(("FLASH: Serious Error! Detected an attempt to relocate "
-                        "anonymous block over referenced block. Did someone "
-                        "delete a volume which still had outstanding references?\n"));
-                    ASSERT(0);
-                }
+        // Invalidate any block we're replacing. It must be unref'ed.
+        if (FlashBlock *b = FlashBlock::lookupBlock(blockAddr)) {
 
-                b->address = FlashBlock::INVALID_ADDRESS;
+            if (b->refCount != 0) {
+                LOG(("FLASH: Serious Error! Detected an attempt to relocate "
+                    "anonymous block over referenced block. Did someone "
+                    "delete a volume which still had outstanding references?\n"));
+                ASSERT(0);
             }
+
+            b->setAddress(FlashBlock::INVALID_ADDRESS);
+            FlashBlockPolicy::discard(b);
         }
 
         // Replace this block's address in the cache.
-        block->address = blockAddr;
+        block->setAddress(blockAddr);
     }
 }
 
 void FlashBlock::preload(uint32_t blockAddr)
 {
-    // XXX: Implement me
+    /*
+     * Speculatively load a block ahead of demand, without holding any
+     * reference to it. This is a hint only; if the block is already
+     * cached, or every block is in use, we do nothing.
+     */
+
+    ASSERT((blockAddr & BLOCK_MASK) == 0);
+
+    if (lookupBlock(blockAddr)) {
+        FLASHLAYER_STATS_ONLY(stats.periodic.prefetchRedundant++);
+        return;
+    }
+
+    FlashBlock *recycled = takeVictim();
+    if (!recycled)
+        return;
+
+    recycled->load(blockAddr);
+    recycled->prefetched = 1;
+    FlashBlockPolicy::insert(recycled);
+
+    FLASHLAYER_STATS_ONLY(stats.periodic.prefetchIssued++);
 }
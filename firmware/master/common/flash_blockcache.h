@@ -47,6 +47,24 @@
 #  define FLASHLAYER_STATS_ONLY(x)
 #endif
 
+/*
+ * Compile-time cache tuning. The number of cache blocks must be a power of
+ * two, no larger than 128. The replacement policies are implemented in
+ * flash_blockcache_policy.cpp.
+ */
+
+#define FLASH_POLICY_LRU        1
+#define FLASH_POLICY_CLOCK      2
+#define FLASH_POLICY_2Q         3
+
+#ifndef FLASH_BLOCKCACHE_BLOCKS
+#define FLASH_BLOCKCACHE_BLOCKS 64
+#endif
+
+#ifndef FLASH_BLOCKCACHE_POLICY
+#define FLASH_BLOCKCACHE_POLICY FLASH_POLICY_LRU
+#endif
+
 class FlashBlockRef;
 class FlashBlockWriter;
 
@@ -58,8 +76,9 @@ class FlashBlockWriter;
 class FlashBlock
 {
 public:
-    // Cache layout (Preferably a power of two)
-    static const unsigned NUM_CACHE_BLOCKS = 64;    // 16 kB of cache
+    // Cache layout (Must be a power of two). Default is 16 kB of cache.
+    static const unsigned NUM_CACHE_BLOCKS = FLASH_BLOCKCACHE_BLOCKS;
+    static const unsigned NUM_HASH_BUCKETS = NUM_CACHE_BLOCKS;
     static const unsigned MAX_REFCOUNT = NUM_CACHE_BLOCKS;
 
     // Block size (Must be a power of two)
@@ -83,10 +102,14 @@ private:
 
     // Keep this packed and power-of-two length
     uint32_t address;
-    uint16_t stamp;
+    uint8_t hashNext;       // Next block ID in the same hash bucket
+    uint8_t prefetched;     // Loaded by preload(), not yet used
     uint8_t refCount;
     uint8_t idByte;
 
+    // End of a hash chain
+    static const uint8_t NO_BLOCK = 0xFF;
+
     struct FlashStats {
         unsigned globalRefcount;
         SysTime::Ticks timestamp;
@@ -97,6 +120,10 @@ private:
             unsigned blockHitOther;
             unsigned blockMiss;
             unsigned blockTotal;
+            unsigned prefetchIssued;
+            unsigned prefetchHit;
+            unsigned prefetchUseless;
+            unsigned prefetchRedundant;
 
             // Should be last, for efficiency. This is large!
             uint32_t blockMissCounts[FlashDevice::CAPACITY / BLOCK_SIZE];
@@ -107,16 +134,27 @@ private:
 
     static uint8_t mem[NUM_CACHE_BLOCKS][BLOCK_SIZE] SECTION(".blockcache");
     static FlashBlock instances[NUM_CACHE_BLOCKS];
-    static unsigned latestStamp;
+
+    // Heads of each hash chain, indexed by hashBucket(address)
+    static uint8_t hashBuckets[NUM_HASH_BUCKETS];
 
     // Stored out-of-line, to keep the main FlashBlock length a power-of-two
     static uint8_t validCodeBundles[NUM_CACHE_BLOCKS];
 
 public:
+    ALWAYS_INLINE static FlashBlock *fromID(unsigned id) {
+        ASSERT(id < NUM_CACHE_BLOCKS);
+        return &instances[id];
+    }
+
     ALWAYS_INLINE unsigned id() const {
         return idByte;
     }
 
+    ALWAYS_INLINE bool isReferenced() const {
+        return refCount != 0;
+    }
+
     ALWAYS_INLINE uint32_t getAddress() const {
         return address;
     }
@@ -153,8 +191,15 @@ public:
 
 #ifdef SIFTEO_SIMULATOR
     static bool isAddrValid(uintptr_t pa);
+
+    // Byte offset of a physical address from the start of cache memory
+    static ALWAYS_INLINE uintptr_t cacheOffset(uintptr_t pa) {
+        return pa - reinterpret_cast<uintptr_t>(&mem[0][0]);
+    }
+
     static void resetStats();
     static void dumpStats();
+    static const char *policyName();
     static bool hotBlockSort(unsigned i, unsigned j);
     static void countBlockMiss(uint32_t blockAddr);
     void verify();
@@ -200,11 +245,14 @@ private:
         })
     }
     
-    ALWAYS_INLINE unsigned getAge(unsigned latest) {
-        return uint16_t(latest - stamp);
+    static ALWAYS_INLINE unsigned hashBucket(uint32_t blockAddr) {
+        return (blockAddr >> BLOCK_SIZE_LOG2) & (NUM_HASH_BUCKETS - 1);
     }
 
+    void setAddress(uint32_t blockAddr);
+    void invalidateCode();
     static FlashBlock *lookupBlock(uint32_t blockAddr);
+    static FlashBlock *takeVictim();
     static FlashBlock *recycleBlock(uint32_t blockAddr);
     void load(uint32_t blockAddr, unsigned flags = 0);
 };
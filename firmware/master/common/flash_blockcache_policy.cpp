@@ -0,0 +1,270 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "flash_blockcache_policy.h"
+
+
+void FlashBlockList::pushHead(Links &l, unsigned id)
+{
+    l.prev[id] = NONE;
+    l.next[id] = head;
+    if (head == NONE)
+        tail = id;
+    else
+        l.prev[head] = id;
+    head = id;
+    count++;
+}
+
+void FlashBlockList::pushTail(Links &l, unsigned id)
+{
+    l.next[id] = NONE;
+    l.prev[id] = tail;
+    if (tail == NONE)
+        head = id;
+    else
+        l.next[tail] = id;
+    tail = id;
+    count++;
+}
+
+void FlashBlockList::remove(Links &l, unsigned id)
+{
+    ASSERT(count > 0);
+
+    unsigned p = l.prev[id];
+    unsigned n = l.next[id];
+
+    if (p == NONE)
+        head = n;
+    else
+        l.next[p] = n;
+
+    if (n == NONE)
+        tail = p;
+    else
+        l.prev[n] = p;
+
+    count--;
+}
+
+FlashBlock *FlashBlockList::oldestUnreferenced(const Links &l) const
+{
+    for (unsigned id = tail; id != NONE; id = l.prev[id]) {
+        FlashBlock *b = FlashBlock::fromID(id);
+        if (!b->isReferenced())
+            return b;
+    }
+    return 0;
+}
+
+
+#if FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_LRU
+
+FlashBlockList::Links FlashBlockLRU::links;
+FlashBlockList FlashBlockLRU::list;
+
+void FlashBlockLRU::init()
+{
+    list.init();
+    for (unsigned i = 0; i < FlashBlock::NUM_CACHE_BLOCKS; ++i)
+        list.pushHead(links, i);
+}
+
+void FlashBlockLRU::touch(FlashBlock *b)
+{
+    unsigned id = b->id();
+    if (list.head != id) {
+        list.remove(links, id);
+        list.pushHead(links, id);
+    }
+}
+
+void FlashBlockLRU::insert(FlashBlock *b)
+{
+    touch(b);
+}
+
+void FlashBlockLRU::discard(FlashBlock *b)
+{
+    unsigned id = b->id();
+    list.remove(links, id);
+    list.pushTail(links, id);
+}
+
+FlashBlock *FlashBlockLRU::victim()
+{
+    return list.oldestUnreferenced(links);
+}
+
+#endif  // FLASH_POLICY_LRU
+
+
+#if FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_CLOCK
+
+uint8_t FlashBlockClock::refBits[FlashBlock::NUM_CACHE_BLOCKS];
+uint8_t FlashBlockClock::hand;
+
+void FlashBlockClock::init()
+{
+    memset(refBits, 0, sizeof refBits);
+    hand = 0;
+}
+
+void FlashBlockClock::touch(FlashBlock *b)
+{
+    refBits[b->id()] = 1;
+}
+
+void FlashBlockClock::insert(FlashBlock *b)
+{
+    refBits[b->id()] = 1;
+}
+
+void FlashBlockClock::discard(FlashBlock *b)
+{
+    refBits[b->id()] = 0;
+}
+
+FlashBlock *FlashBlockClock::victim()
+{
+    /*
+     * Two full sweeps are always enough: the first clears every reference
+     * bit it passes, so the second stops at the first unreferenced block.
+     */
+
+    unsigned h = hand;
+
+    for (unsigned count = FlashBlock::NUM_CACHE_BLOCKS * 2; count; --count) {
+        FlashBlock *b = FlashBlock::fromID(h);
+        h = (h + 1) % FlashBlock::NUM_CACHE_BLOCKS;
+
+        if (b->isReferenced())
+            continue;
+
+        uint8_t &bit = refBits[b->id()];
+        if (bit) {
+            bit = 0;
+            continue;
+        }
+
+        hand = h;
+        return b;
+    }
+
+    hand = h;
+    return 0;
+}
+
+#endif  // FLASH_POLICY_CLOCK
+
+
+#if FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_2Q
+
+FlashBlockList::Links FlashBlockTwoQueue::links;
+FlashBlockList FlashBlockTwoQueue::queues[2];
+uint8_t FlashBlockTwoQueue::queueOf[FlashBlock::NUM_CACHE_BLOCKS];
+uint32_t FlashBlockTwoQueue::ghosts[NUM_GHOSTS];
+uint8_t FlashBlockTwoQueue::nextGhost;
+
+void FlashBlockTwoQueue::init()
+{
+    queues[Q_IN].init();
+    queues[Q_MAIN].init();
+
+    for (unsigned i = 0; i < FlashBlock::NUM_CACHE_BLOCKS; ++i) {
+        queues[Q_IN].pushHead(links, i);
+        queueOf[i] = Q_IN;
+    }
+
+    for (unsigned i = 0; i < NUM_GHOSTS; ++i)
+        ghosts[i] = FlashBlock::INVALID_ADDRESS;
+    nextGhost = 0;
+}
+
+void FlashBlockTwoQueue::move(unsigned id, Queue q)
+{
+    queues[queueOf[id]].remove(links, id);
+    queues[q].pushHead(links, id);
+    queueOf[id] = q;
+}
+
+bool FlashBlockTwoQueue::isGhost(uint32_t address)
+{
+    for (unsigned i = 0; i < NUM_GHOSTS; ++i)
+        if (ghosts[i] == address)
+            return true;
+    return false;
+}
+
+void FlashBlockTwoQueue::touch(FlashBlock *b)
+{
+    // Hits during probation don't count; they're usually correlated
+    // references to the same block, not evidence of reuse.
+
+    unsigned id = b->id();
+    if (queueOf[id] == Q_MAIN && queues[Q_MAIN].head != id)
+        move(id, Q_MAIN);
+}
+
+void FlashBlockTwoQueue::insert(FlashBlock *b)
+{
+    uint32_t address = b->getAddress();
+    bool reused = address != FlashBlock::INVALID_ADDRESS && isGhost(address);
+    move(b->id(), reused ? Q_MAIN : Q_IN);
+}
+
+void FlashBlockTwoQueue::discard(FlashBlock *b)
+{
+    unsigned id = b->id();
+    queues[queueOf[id]].remove(links, id);
+    queues[Q_IN].pushTail(links, id);
+    queueOf[id] = Q_IN;
+}
+
+FlashBlock *FlashBlockTwoQueue::victim()
+{
+    /*
+     * Evict from probation while it's over its target size, otherwise
+     * from the main queue. Either way, fall back on the other queue if
+     * every block on the preferred one is referenced.
+     */
+
+    Queue first = queues[Q_IN].count > IN_TARGET ? Q_IN : Q_MAIN;
+    Queue second = first == Q_IN ? Q_MAIN : Q_IN;
+
+    FlashBlock *b = queues[first].oldestUnreferenced(links);
+    if (!b)
+        b = queues[second].oldestUnreferenced(links);
+
+    if (b && queueOf[b->id()] == Q_IN && !b->isAnonymous()) {
+        ghosts[nextGhost] = b->getAddress();
+        nextGhost = (nextGhost + 1) % NUM_GHOSTS;
+    }
+
+    return b;
+}
+
+#endif  // FLASH_POLICY_2Q
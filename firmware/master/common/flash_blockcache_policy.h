@@ -0,0 +1,174 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Replacement policies for the FlashBlock cache.
+ *
+ * Exactly one policy is compiled in, selected with FLASH_BLOCKCACHE_POLICY
+ * (see flash_blockcache.h). Every policy is a class with the same set of
+ * static members, which FlashBlock calls through the FlashBlockPolicy
+ * typedef:
+ *
+ *   init()         All blocks are empty. Called once, from FlashBlock::init().
+ *   touch(b)       Block 'b' was accessed via FlashBlock::get().
+ *   insert(b)      Block 'b' was just filled with new contents.
+ *   discard(b)     Block 'b' no longer holds anything useful. Prefer
+ *                  to recycle it before any block that does.
+ *   victim()       Pick an unreferenced block to recycle, or NULL if
+ *                  every block is referenced.
+ *
+ * Policies only track block IDs. They never look at block contents, and
+ * the only FlashBlock state they may inspect is the address and reference
+ * count.
+ */
+
+#ifndef FLASH_BLOCKCACHE_POLICY_H_
+#define FLASH_BLOCKCACHE_POLICY_H_
+
+#include "flash_blockcache.h"
+
+
+/**
+ * Intrusive doubly-linked list of cache block IDs. Several lists may share
+ * one Links table, as long as each block is on at most one list at a time.
+ * The head is the most recently inserted end.
+ */
+class FlashBlockList
+{
+public:
+    static const uint8_t NONE = 0xFF;
+
+    struct Links {
+        uint8_t prev[FlashBlock::NUM_CACHE_BLOCKS];
+        uint8_t next[FlashBlock::NUM_CACHE_BLOCKS];
+    };
+
+    uint8_t head;
+    uint8_t tail;
+    uint8_t count;
+
+    void init() {
+        head = tail = NONE;
+        count = 0;
+    }
+
+    void pushHead(Links &l, unsigned id);
+    void pushTail(Links &l, unsigned id);
+    void remove(Links &l, unsigned id);
+
+    /// Oldest unreferenced block on this list, or NULL
+    FlashBlock *oldestUnreferenced(const Links &l) const;
+};
+
+
+/**
+ * Exact least-recently-used replacement.
+ */
+class FlashBlockLRU
+{
+public:
+    static void init();
+    static void touch(FlashBlock *b);
+    static void insert(FlashBlock *b);
+    static void discard(FlashBlock *b);
+    static FlashBlock *victim();
+    static const char *name() { return "LRU"; }
+
+private:
+    static FlashBlockList::Links links;
+    static FlashBlockList list;
+};
+
+
+/**
+ * CLOCK (second-chance) replacement. A single reference bit per block, and
+ * a hand that sweeps around the cache looking for a block whose bit is clear.
+ */
+class FlashBlockClock
+{
+public:
+    static void init();
+    static void touch(FlashBlock *b);
+    static void insert(FlashBlock *b);
+    static void discard(FlashBlock *b);
+    static FlashBlock *victim();
+    static const char *name() { return "CLOCK"; }
+
+private:
+    static uint8_t refBits[FlashBlock::NUM_CACHE_BLOCKS];
+    static uint8_t hand;
+};
+
+
+/**
+ * Simplified 2Q replacement (Johnson & Shasha, 1994).
+ *
+ * Blocks enter a short FIFO probation queue (A1in). Only blocks that come
+ * back soon after being evicted from probation, as remembered by a small
+ * ring of ghost addresses (A1out), move into the main LRU queue (Am). This
+ * keeps one-shot streaming reads, like asset data, from flushing out code
+ * and metadata that is used over and over.
+ */
+class FlashBlockTwoQueue
+{
+public:
+    static void init();
+    static void touch(FlashBlock *b);
+    static void insert(FlashBlock *b);
+    static void discard(FlashBlock *b);
+    static FlashBlock *victim();
+    static const char *name() { return "2Q"; }
+
+private:
+    static const unsigned IN_TARGET = FlashBlock::NUM_CACHE_BLOCKS / 4;
+    static const unsigned NUM_GHOSTS = FlashBlock::NUM_CACHE_BLOCKS / 2;
+
+    enum Queue {
+        Q_IN,
+        Q_MAIN,
+    };
+
+    static FlashBlockList::Links links;
+    static FlashBlockList queues[2];
+    static uint8_t queueOf[FlashBlock::NUM_CACHE_BLOCKS];
+    static uint32_t ghosts[NUM_GHOSTS];
+    static uint8_t nextGhost;
+
+    static bool isGhost(uint32_t address);
+    static void move(unsigned id, Queue q);
+};
+
+
+#if FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_LRU
+    typedef FlashBlockLRU FlashBlockPolicy;
+#elif FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_CLOCK
+    typedef FlashBlockClock FlashBlockPolicy;
+#elif FLASH_BLOCKCACHE_POLICY == FLASH_POLICY_2Q
+    typedef FlashBlockTwoQueue FlashBlockPolicy;
+#else
+#   error Unknown FLASH_BLOCKCACHE_POLICY
+#endif
+
+#endif
@@ -30,6 +30,7 @@
 #include "crc.h"
 
 FlashLFS FlashLFSCache::instances[SIZE];
+FlashLFSKeyIndex FlashLFSCache::keyIndexes[SIZE];
 uint8_t FlashLFSCache::lastUsed = 0;
 
 
@@ -86,6 +87,21 @@ uint32_t LFS::indexBlockAddr(FlashVolume vol, unsigned row)
         - (row + 1) * FlashBlock::BLOCK_SIZE;
 }
 
+uint32_t LFS::readAndComputeCRC(unsigned address, uint8_t *buffer, unsigned size)
+{
+    /*
+     * Read 'size' bytes of object data directly into 'buffer', and return
+     * the CRC we'd expect to find in that object's index record.
+     */
+
+    FlashDevice::read(address, buffer, size);
+
+    CrcStream cs;
+    cs.reset();
+    cs.addBytes(buffer, size);
+    return cs.get(FlashLFSIndexRecord::SIZE_UNIT);
+}
+
 FlashLFSVolumeHeader *FlashLFSVolumeHeader::fromVolume(FlashBlockRef &ref, FlashVolume vol)
 {
     /*
@@ -474,6 +490,9 @@ void FlashLFS::initWithVolumeVector(FlashVolume parent, FlashLFSVolumeVector::Se
 
     volumes.sort(si);
 
+    if (keyIndex)
+        keyIndex->clear();
+
     unsigned index = volumes.numSlotsInUse;
     lastSequenceNumber = index ? si.slots[index - 1] : 0;
 
@@ -516,6 +535,109 @@ bool FlashLFS::newVolume(unsigned volLimit)
     return true;
 }
 
+const FlashLFSKeyIndex::Entry *FlashLFSKeyIndex::find(unsigned key) const
+{
+    for (unsigned i = 0; i < numEntries; ++i)
+        if (entries[i].key == key)
+            return &entries[i];
+    return 0;
+}
+
+void FlashLFSKeyIndex::update(unsigned key, unsigned address, unsigned sizeInBytes, unsigned crc)
+{
+    /*
+     * Remember a new location for 'key', replacing any existing entry.
+     * If the table is full, evict entries in round-robin order.
+     */
+
+    ASSERT(FlashLFSIndexRecord::isKeyAllowed(key));
+    ASSERT(FlashLFSIndexRecord::isSizeAllowed(sizeInBytes));
+
+    Entry *entry = const_cast<Entry*>(find(key));
+
+    if (!entry) {
+        if (numEntries < NUM_ENTRIES) {
+            entry = &entries[numEntries++];
+        } else {
+            entry = &entries[nextVictim];
+            nextVictim = (nextVictim + 1) % NUM_ENTRIES;
+        }
+    }
+
+    entry->address = address;
+    entry->key = key;
+    entry->sizeInUnits = sizeInBytes >> FlashLFSIndexRecord::SIZE_SHIFT;
+    entry->crc = crc;
+}
+
+void FlashLFSKeyIndex::removeVolume(FlashVolume vol)
+{
+    /*
+     * Forget every entry that points into 'vol'. Must be called
+     * before the volume is deleted, while we still know where it was.
+     */
+
+    uint32_t begin = vol.block.address();
+    uint32_t end = begin + FlashMapBlock::BLOCK_SIZE;
+
+    for (unsigned i = 0; i < numEntries;) {
+        if (entries[i].address >= begin && entries[i].address < end)
+            entries[i] = entries[--numEntries];
+        else
+            i++;
+    }
+
+    if (nextVictim >= numEntries)
+        nextVictim = 0;
+}
+
+bool FlashLFS::readObject(unsigned key, uint8_t *buffer, unsigned bufferSize, unsigned &size)
+{
+    /*
+     * Find the newest copy of 'key' which has a valid CRC, and read it
+     * into 'buffer'. On success, 'size' is set to the number of bytes read.
+     *
+     * As with FlashLFSObjectIter::readAndCheck(), the entire object
+     * (excepting any trailing 0xFF padding) must fit in the buffer,
+     * or we'll see a CRC failure.
+     */
+
+    ASSERT(isValid());
+    ASSERT(FlashLFSIndexRecord::isKeyAllowed(key));
+
+    // Fast path: the key index already knows where the newest record is
+    const FlashLFSKeyIndex::Entry *entry = keyIndex ? keyIndex->find(key) : 0;
+    if (entry) {
+        size = MIN(entry->getSizeInBytes(), bufferSize);
+        if (entry->checkCRC(LFS::readAndComputeCRC(entry->address, buffer, size)))
+            return true;
+    }
+
+    /*
+     * Slow path: search the index blocks. We only add the result to the
+     * key index if it's the newest record for this key. An older record
+     * may still be obsoleted by one that's being written right now.
+     */
+
+    FlashLFSObjectIter iter(*this);
+    bool newest = true;
+
+    while (iter.previous(FlashLFSKeyQuery(key))) {
+        const FlashLFSIndexRecord *record = iter.record();
+        size = MIN(record->getSizeInBytes(), bufferSize);
+
+        if (iter.readAndCheck(buffer, size)) {
+            if (newest && !entry && keyIndex)
+                keyIndex->update(key, iter.address(), record->getSizeInBytes(), record->getCRC());
+            return true;
+        }
+
+        newest = false;
+    }
+
+    return false;
+}
+
 FlashLFS &FlashLFSCache::get(FlashVolume parent)
 {
     ASSERT(lastUsed < SIZE);
@@ -531,6 +653,7 @@ FlashLFS &FlashLFSCache::get(FlashVolume parent)
     // Cache miss
     lastUsed = (lastUsed + 1) % SIZE;
     FlashLFS &lfs = instances[lastUsed];
+    lfs.keyIndex = &keyIndexes[lastUsed];
     lfs.init(parent);
     ASSERT(lfs.isMatchFor(parent));
     return lfs;
@@ -733,6 +856,10 @@ bool FlashLFSObjectAllocator::allocInVolumeRow(FlashVolume vol,
     // Finish writing the record
     newRecord->init(key, size, crc);
 
+    // This is now the newest copy of 'key', even before its data is written
+    if (lfs.keyIndex)
+        lfs.keyIndex->update(key, addr, size, crc);
+
     // Write to the meta-index's FlashLFSKeyFilter for this row.
     if (!hdr->test(row, key)) {
         writer.beginBlock(&*hdrRef);
@@ -764,14 +891,7 @@ bool FlashLFSObjectIter::readAndCheck(uint8_t *buffer, unsigned size) const
      * multiple of our SIZE_UNIT.
      */
 
-    FlashDevice::read(address(), buffer, size);
-
-    CrcStream cs;
-    cs.reset();
-    cs.addBytes(buffer, size);
-    uint32_t crc = cs.get(FlashLFSIndexRecord::SIZE_UNIT);
-
-    return record()->checkCRC(crc);
+    return record()->checkCRC(LFS::readAndComputeCRC(address(), buffer, size));
 }
 
 bool FlashLFSObjectIter::readAndCheckCRCOnly(uint32_t &crc) const
@@ -1107,6 +1227,8 @@ bool FlashLFS::deleteGarbageVolumes(const VolumeIndexVector &volumesToKeep, unsi
     for (unsigned i = 0; i < numSlotsInUse; ++i) {
         if (!volumesToKeep.test(i)) {
             FlashVolume &vol = volumes.slots[i];
+            if (keyIndex)
+                keyIndex->removeVolume(vol);
             vol.deleteSingleWithoutInvalidate();
             volumes.slots[i].block.setInvalid();
             foundGarbage = true;
@@ -87,6 +87,7 @@ namespace LFS {
     uint8_t computeCheckByte(uint8_t a, uint8_t b);
     bool isEmpty(const uint8_t *bytes, unsigned count);
     uint32_t indexBlockAddr(FlashVolume vol, unsigned row);
+    uint32_t readAndComputeCRC(unsigned address, uint8_t *buffer, unsigned size);
 };
 
 
@@ -304,8 +305,12 @@ public:
         return size;
     }
 
+    ALWAYS_INLINE unsigned getCRC() const {
+        return crc[0] | (crc[1] << 8);
+    }
+
     ALWAYS_INLINE bool checkCRC(unsigned reference) const {
-        return !(((crc[0] | (crc[1] << 8)) ^ reference) & 0xFFFF);
+        return !((getCRC() ^ reference) & 0xFFFF);
     }
 
     ALWAYS_INLINE static bool isKeyAllowed(unsigned key) {
@@ -578,6 +583,64 @@ public:
 };
 
 
+/**
+ * FlashLFSKeyIndex is a small RAM cache which remembers where the newest
+ * record for a key lives, so that reading an object doesn't have to walk
+ * backwards through index blocks every time.
+ *
+ * Each entry holds the object's flash address, size, and expected CRC.
+ * Entries are created lazily, when a search finds that the newest record
+ * for a key is intact, and they're replaced any time FlashLFSObjectAllocator
+ * writes a newer record for the same key.
+ *
+ * Object data is written after its index record, so an entry may describe
+ * an object whose data isn't finished yet. Readers must check the CRC, and
+ * fall back on a normal search if it doesn't match. That fallback never
+ * replaces the entry, so we'll keep pointing at the newest record once its
+ * data is complete.
+ *
+ * This is a tiny fully-associative table with round-robin replacement.
+ * Missing an entry is always safe, it just costs us a full search. To keep
+ * temporary FlashLFS instances small, only the ones owned by FlashLFSCache
+ * have a key index.
+ */
+class FlashLFSKeyIndex
+{
+public:
+    static const unsigned NUM_ENTRIES = 32;
+
+    struct Entry {
+        uint32_t address;
+        uint8_t key;
+        uint8_t sizeInUnits;
+        uint16_t crc;
+
+        ALWAYS_INLINE unsigned getSizeInBytes() const {
+            return sizeInUnits << FlashLFSIndexRecord::SIZE_SHIFT;
+        }
+
+        ALWAYS_INLINE bool checkCRC(unsigned reference) const {
+            return !((crc ^ reference) & 0xFFFF);
+        }
+    };
+
+    FlashLFSKeyIndex() : numEntries(0), nextVictim(0) {}
+
+    ALWAYS_INLINE void clear() {
+        numEntries = 0;
+    }
+
+    const Entry *find(unsigned key) const;
+    void update(unsigned key, unsigned address, unsigned sizeInBytes, unsigned crc);
+    void removeVolume(FlashVolume vol);
+
+private:
+    Entry entries[NUM_ENTRIES];
+    uint8_t numEntries;
+    uint8_t nextVictim;
+};
+
+
 /**
  * Represents the in-memory state associated with a single LFS.
  *
@@ -592,7 +655,8 @@ class FlashLFS
 public:
     FlashLFS()
         : lastSequenceNumber(INVALID_LSN),
-          parent(FlashMapBlock::invalid())
+          parent(FlashMapBlock::invalid()),
+          keyIndex(0)
     {}
 
     void init(FlashVolume parent);
@@ -609,8 +673,13 @@ public:
     // Collect only local garbage on volumes owned by this LFS
     bool collectLocalGarbage();
 
+    // Read the newest intact copy of an object, using our key index if we can
+    bool readObject(unsigned key, uint8_t *buffer, unsigned bufferSize, unsigned &size);
+
     ALWAYS_INLINE void invalidate() {
         lastSequenceNumber = INVALID_LSN;
+        if (keyIndex)
+            keyIndex->clear();
     }
 
     ALWAYS_INLINE bool isValid() {
@@ -624,6 +693,7 @@ public:
     uint32_t lastSequenceNumber;
     FlashVolume parent;
     FlashLFSVolumeVector volumes;
+    FlashLFSKeyIndex *keyIndex;         // Optional
 
 private:
     typedef BitVector<FlashLFSVolumeVector::MAX_VOLUMES> VolumeIndexVector;
@@ -656,6 +726,7 @@ public:
     static FlashLFS instances[SIZE];
 
 private:
+    static FlashLFSKeyIndex keyIndexes[SIZE];
     static uint8_t lastUsed;
 };
 
@@ -35,6 +35,7 @@
 #include "machine.h"
 #include "bits.h"
 #include "flash_blockcache.h"
+#include "flash_prefetch.h"
 #include "flash_device.h"
 
 
@@ -360,7 +361,7 @@ ALWAYS_INLINE bool FlashMapSpan::preloadBlock(ByteOffset byteOffset) const
     FlashAddr flashAddr;
 
     if (offsetToFlashAddr(byteOffset, flashAddr)) {
-        FlashBlock::preload(flashAddr);
+        FlashPrefetch::request(flashAddr);
         return true;
     }
 
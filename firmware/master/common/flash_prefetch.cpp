@@ -0,0 +1,135 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "flash_prefetch.h"
+#include "flash_blockcache.h"
+#include "flash_device.h"
+#include "tasks.h"
+
+uint8_t FlashPrefetch::source;
+uint8_t FlashPrefetch::nextStream;
+uint8_t FlashPrefetch::queueHead;
+uint8_t FlashPrefetch::queueTail;
+FlashPrefetch::Stream FlashPrefetch::streams[NUM_STREAMS];
+uint32_t FlashPrefetch::queue[QUEUE_SIZE];
+
+
+void FlashPrefetch::train(uint32_t blockAddr)
+{
+    /*
+     * Match this access against the stream table. Streams belong to one
+     * Source, and they follow one fixed stride. Repeated accesses to the
+     * block a stream is already on tell us nothing new.
+     */
+
+    const int32_t maxDelta = MAX_STRIDE * FlashBlock::BLOCK_SIZE;
+    Stream *nearest = 0;
+
+    for (unsigned i = 0; i < NUM_STREAMS; ++i) {
+        Stream &s = streams[i];
+        if (s.source != source)
+            continue;
+
+        if (s.lastAddr == blockAddr)
+            return;
+
+        int32_t delta = blockAddr - s.lastAddr;
+
+        if (s.stride && delta == s.stride) {
+            // Continuing an established stride
+
+            s.lastAddr = blockAddr;
+            if (s.confidence < 0xFF)
+                s.confidence++;
+
+            if (s.confidence == CONFIDENT) {
+                // Just became confident. Fill the whole window.
+                for (unsigned d = 1; d <= DEPTH; ++d)
+                    enqueue(blockAddr, s.stride, d);
+            } else if (s.confidence > CONFIDENT) {
+                // Earlier blocks in the window were already queued.
+                enqueue(blockAddr, s.stride, DEPTH);
+            }
+            return;
+        }
+
+        if (!nearest && delta >= -maxDelta && delta <= maxDelta)
+            nearest = &s;
+    }
+
+    if (nearest) {
+        // Close to an existing stream; retrain it with a new stride
+        nearest->stride = blockAddr - nearest->lastAddr;
+        nearest->lastAddr = blockAddr;
+        nearest->confidence = 0;
+        return;
+    }
+
+    // Nothing nearby. Start a new stream, replacing streams round-robin.
+    Stream &s = streams[nextStream];
+    nextStream = (nextStream + 1) % NUM_STREAMS;
+
+    s.lastAddr = blockAddr;
+    s.stride = 0;
+    s.source = source;
+    s.confidence = 0;
+}
+
+void FlashPrefetch::enqueue(uint32_t lastAddr, int32_t stride, unsigned distance)
+{
+    int64_t addr = int64_t(lastAddr) + int64_t(stride) * distance;
+    if (addr < 0 || addr >= FlashDevice::CAPACITY)
+        return;
+
+    // Drop the request if the queue is full. The stream will ask again.
+    unsigned tail = queueTail;
+    unsigned nextTail = (tail + 1) & (QUEUE_SIZE - 1);
+    if (nextTail == queueHead)
+        return;
+
+    queue[tail] = addr;
+    queueTail = nextTail;
+
+    Tasks::trigger(Tasks::FlashPrefetch);
+}
+
+void FlashPrefetch::request(uint32_t addr)
+{
+    enqueue(addr & ~FlashBlock::BLOCK_MASK, 0, 0);
+}
+
+void FlashPrefetch::task()
+{
+    /*
+     * Issue everything in the queue. Blocks that are already cached by the
+     * time we get here are skipped cheaply by preload().
+     */
+
+    while (queueHead != queueTail) {
+        uint32_t addr = queue[queueHead];
+        queueHead = (queueHead + 1) & (QUEUE_SIZE - 1);
+        FlashBlock::preload(addr);
+    }
+}
@@ -0,0 +1,124 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Read-ahead for the FlashBlock cache.
+ *
+ * Callers that tend to walk through flash in order (code, asset images,
+ * audio samples, bulk RO data copies) open a FlashPrefetchScope around
+ * their accesses. Every block FlashBlock::get() fetches inside a scope is
+ * fed to a small table of stream detectors. Once a stream has moved by
+ * the same stride a few times in a row, we queue up the next blocks along
+ * that stride, and the FlashPrefetch task loads them with
+ * FlashBlock::preload().
+ *
+ * The task runs at low priority from Tasks::work(), so most of the reads
+ * happen while userspace is already blocked waiting on paint or finish.
+ */
+
+#ifndef FLASH_PREFETCH_H_
+#define FLASH_PREFETCH_H_
+
+#include "macros.h"
+#include <stdint.h>
+
+class FlashPrefetchScope;
+
+
+class FlashPrefetch
+{
+public:
+    /// Who is doing the reading. Streams are never shared between sources.
+    enum Source {
+        S_NONE = 0,
+        S_CODE,
+        S_RODATA,
+        S_IMAGE,
+        S_AUDIO,
+    };
+
+    /// Called by FlashBlock::get() for every block it looks up or loads
+    static ALWAYS_INLINE void observe(uint32_t blockAddr) {
+        if (source != S_NONE)
+            train(blockAddr);
+    }
+
+    /// Explicitly queue an asynchronous prefetch of any flash address
+    static void request(uint32_t addr);
+
+    /// Task handler, issues queued prefetches
+    static void task();
+
+private:
+    friend class FlashPrefetchScope;
+
+    static const unsigned NUM_STREAMS = 8;
+    static const unsigned QUEUE_SIZE = 8;       // Power of two
+    static const unsigned MAX_STRIDE = 4;       // In blocks
+    static const unsigned CONFIDENT = 2;        // Matching strides before we act
+    static const unsigned DEPTH = 2;            // How many strides to read ahead
+
+    struct Stream {
+        uint32_t lastAddr;
+        int32_t stride;         // In bytes, multiple of the block size
+        uint8_t source;
+        uint8_t confidence;
+    };
+
+    static uint8_t source;
+    static uint8_t nextStream;
+    static uint8_t queueHead;
+    static uint8_t queueTail;
+    static Stream streams[NUM_STREAMS];
+    static uint32_t queue[QUEUE_SIZE];
+
+    static void train(uint32_t blockAddr);
+    static void enqueue(uint32_t lastAddr, int32_t stride, unsigned distance);
+};
+
+
+/**
+ * Marks the accesses made during this object's lifetime as coming from
+ * one prefetch Source. Scopes nest; the outermost one wins, so that (for
+ * example) image decoding isn't mistaken for generic RO data copies.
+ */
+
+class FlashPrefetchScope {
+public:
+    FlashPrefetchScope(FlashPrefetch::Source s) : saved(FlashPrefetch::source) {
+        if (saved == FlashPrefetch::S_NONE)
+            FlashPrefetch::source = s;
+    }
+
+    ~FlashPrefetchScope() {
+        FlashPrefetch::source = saved;
+    }
+
+private:
+    uint8_t saved;
+};
+
+
+#endif
@@ -284,6 +284,7 @@ bool FlashBlockRecycler::next(FlashMapBlock &block, EraseCount &eraseCount)
 
     block = vol.block;
     block.erase();
+    FlashVolumeDirectory::remove(vol);
     eraseCount = 1 + hdr->getEraseCount(ref, vol.block, 0, numMapEntries);
     return true;
 }
@@ -27,6 +27,7 @@
 #include "flash_stack.h"
 #include "flash_blockcache.h"
 #include "flash_lfs.h"
+#include "flash_volume.h"
 #include "flash_syslfs.h"
 #include "flash_eraselog.h"
 #include "flash_recycler.h"
@@ -38,6 +39,7 @@ void FlashStack::init()
     FlashDevice::init();
     FlashBlock::init();
     FlashLFSCache::invalidate();
+    FlashVolumeDirectory::invalidate();
 }
 
 
@@ -45,6 +47,7 @@ void FlashStack::invalidateCache(unsigned flags)
 {
     FlashBlock::invalidate(flags);
     FlashLFSCache::invalidate();
+    FlashVolumeDirectory::invalidate();
 }
 
 
@@ -41,14 +41,10 @@ int SysLFS::read(Key k, uint8_t *buffer, unsigned bufferSize)
     ASSERT(FlashLFSIndexRecord::isKeyAllowed(k));
 
     FlashLFS &lfs = SysLFS::get();
-    FlashLFSObjectIter iter(lfs);
+    unsigned size;
 
-    while (iter.previous(FlashLFSKeyQuery(k))) {
-        unsigned size = iter.record()->getSizeInBytes();
-        size = MIN(size, bufferSize);
-        if (iter.readAndCheck(buffer, size))
-            return size;
-    }
+    if (lfs.readObject(k, buffer, bufferSize, size))
+        return size;
 
     return _SYS_ENOENT;
 }
@@ -91,6 +91,10 @@ bool FlashVolume::isValid() const
 
 unsigned FlashVolume::getType() const
 {
+    unsigned type;
+    if (FlashVolumeDirectory::getType(*this, type))
+        return type;
+
     ASSERT(isValid());
     FlashBlockRef ref;
     FlashVolumeHeader *hdr = FlashVolumeHeader::get(ref, block);
@@ -100,6 +104,10 @@ unsigned FlashVolume::getType() const
 
 FlashVolume FlashVolume::getParent() const
 {
+    FlashMapBlock parent;
+    if (FlashVolumeDirectory::getParent(*this, parent))
+        return parent;
+
     ASSERT(isValid());
     FlashBlockRef ref;
     FlashVolumeHeader *hdr = FlashVolumeHeader::get(ref, block);
@@ -169,6 +177,8 @@ void FlashVolume::deleteSingleWithoutInvalidate() const
     FlashBlockWriter writer(ref);
     hdr->type = T_DELETED;
     hdr->typeCopy = T_DELETED;
+
+    FlashVolumeDirectory::setType(*this, T_DELETED);
 }
 
 void FlashVolume::deleteTree() const
@@ -242,31 +252,115 @@ void FlashVolume::deleteEverything()
     SysLFS::invalidateClients();
 }
 
-bool FlashVolumeIter::next(FlashVolume &vol)
+FlashMapBlock::Set FlashVolumeDirectory::headers;
+uint16_t FlashVolumeDirectory::types[FlashMapBlock::NUM_BLOCKS];
+uint8_t FlashVolumeDirectory::parents[FlashMapBlock::NUM_BLOCKS];
+bool FlashVolumeDirectory::valid = false;
+
+void FlashVolumeDirectory::build()
 {
-    unsigned index;
+    /*
+     * Find every volume the slow way, by probing each block on the device
+     * for a valid header. Blocks belonging to a volume we've already found
+     * are skipped; headers always have the lowest index in their volume.
+     */
 
-    ASSERT(initialized == true);
+    FlashMapBlock::Set remaining;
+    remaining.mark();
+    headers.clear();
 
+    unsigned index;
     while (remaining.clearFirst(index)) {
-        FlashVolume v(FlashMapBlock::fromIndex(index));
-
-        if (v.isValid()) {
-            FlashBlockRef ref;
-            FlashVolumeHeader *hdr = FlashVolumeHeader::get(ref, v.block);
-            ASSERT(hdr->isHeaderValid());
-            const FlashMap *map = hdr->getMap();
-
-            // Don't visit any future blocks that are part of this volume
-            for (unsigned I = 0, E = hdr->numMapEntries(); I != E; ++I) {
-                FlashMapBlock block = map->blocks[I];
-                if (block.isValid())
-                    block.clear(remaining);
-            }
+        FlashVolume vol(FlashMapBlock::fromIndex(index));
+        if (!vol.isValid())
+            continue;
 
-            vol = v;
-            return true;
+        FlashBlockRef ref;
+        FlashVolumeHeader *hdr = FlashVolumeHeader::get(ref, vol.block);
+        ASSERT(hdr->isHeaderValid());
+        const FlashMap *map = hdr->getMap();
+
+        for (unsigned I = 0, E = hdr->numMapEntries(); I != E; ++I) {
+            FlashMapBlock block = map->blocks[I];
+            if (block.isValid())
+                block.clear(remaining);
         }
+
+        vol.block.mark(headers);
+        types[index] = hdr->type;
+        parents[index] = hdr->parentBlock;
+    }
+
+    valid = true;
+}
+
+void FlashVolumeDirectory::add(FlashVolume vol, unsigned type, FlashMapBlock parent)
+{
+    ASSERT(vol.block.isValid());
+
+    unsigned index = vol.block.index();
+    vol.block.mark(headers);
+    types[index] = type;
+    parents[index] = parent.code;
+}
+
+void FlashVolumeDirectory::setType(FlashVolume vol, unsigned type)
+{
+    if (contains(vol))
+        types[vol.block.index()] = type;
+}
+
+void FlashVolumeDirectory::remove(FlashVolume vol)
+{
+    // Called by the recycler after it erases a volume's header block
+    vol.block.clear(headers);
+}
+
+bool FlashVolumeDirectory::getType(FlashVolume vol, unsigned &type)
+{
+    if (!contains(vol))
+        return false;
+
+    type = types[vol.block.index()];
+    return true;
+}
+
+bool FlashVolumeDirectory::getParent(FlashVolume vol, FlashMapBlock &parent)
+{
+    if (!contains(vol))
+        return false;
+
+    parent.code = parents[vol.block.index()];
+    return true;
+}
+
+const FlashMapBlock::Set &FlashVolumeDirectory::getHeaders()
+{
+    if (!valid)
+        build();
+    return headers;
+}
+
+void FlashVolumeIter::begin()
+{
+    DEBUG_ONLY(initialized = true);
+    remaining = FlashVolumeDirectory::getHeaders();
+}
+
+bool FlashVolumeIter::next(FlashVolume &vol)
+{
+    /*
+     * Every block in the directory is a valid volume header, so
+     * iteration doesn't need to touch flash at all.
+     */
+
+    unsigned index;
+
+    ASSERT(initialized == true);
+
+    if (remaining.clearFirst(index)) {
+        vol = FlashMapBlock::fromIndex(index);
+        return true;
     }
 
     return false;
@@ -301,6 +395,7 @@ bool FlashVolumeWriter::begin(FlashBlockRecycler &recycler,
     // Finish writing
     writer.commitBlock();
     ASSERT(volume.isValid());
+    FlashVolumeDirectory::add(volume, FlashVolume::T_INCOMPLETE, parent.block);
 
     return count == numMapEntries;
 }
@@ -447,6 +542,7 @@ void FlashVolumeWriter::commit()
     FlashBlockWriter writer(ref);
     hdr->setType(type);
     writer.commitBlock();
+    FlashVolumeDirectory::setType(volume, type);
 
     ASSERT(volume.isValid());
 
@@ -176,10 +176,7 @@ class FlashVolumeIter
 {
 public:
     /// Reset the iterator back to the beginning of the sequence
-    void begin() {
-        DEBUG_ONLY(initialized = true);
-        remaining.mark();
-    }
+    void begin();
 
     /// Returns 'true' iff another FlashVolume can be found.
     bool next(FlashVolume &vol);
@@ -189,6 +186,47 @@ private:
     DEBUG_ONLY(bool initialized;)
 };
 
+/**
+ * The volume directory is a RAM copy of the volume headers' most frequently
+ * used contents: which FlashMapBlocks hold a header, and each volume's type
+ * and parent. FlashVolumeIter walks this directory instead of probing every
+ * block on the device, and getType()/getParent() can answer without a trip
+ * through the block cache.
+ *
+ * The directory is built by a full scan the first time it's needed, then
+ * kept up to date by FlashVolumeWriter, volume deletion, and the block
+ * recycler. Anything that modifies flash behind the Volume layer's back
+ * must call invalidate(), so the directory gets rebuilt.
+ */
+class FlashVolumeDirectory
+{
+public:
+    static void invalidate() {
+        valid = false;
+    }
+
+    static void add(FlashVolume vol, unsigned type, FlashMapBlock parent);
+    static void setType(FlashVolume vol, unsigned type);
+    static void remove(FlashVolume vol);
+
+    static bool getType(FlashVolume vol, unsigned &type);
+    static bool getParent(FlashVolume vol, FlashMapBlock &parent);
+
+    static const FlashMapBlock::Set &getHeaders();
+
+private:
+    static FlashMapBlock::Set headers;
+    static uint16_t types[FlashMapBlock::NUM_BLOCKS];
+    static uint8_t parents[FlashMapBlock::NUM_BLOCKS];
+    static bool valid;
+
+    static ALWAYS_INLINE bool contains(FlashVolume vol) {
+        return valid && vol.block.isValid() && vol.block.test(headers);
+    }
+
+    static void build();
+};
+
 /**
  * A FlashVolumeWriter keeps track of the multi-step process of writing
  * a volume for the first time.
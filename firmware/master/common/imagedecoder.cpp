@@ -27,6 +27,7 @@
 #include "cube.h"
 #include "assetutil.h"
 #include "vram.h"
+#include "flash_prefetch.h"
 
 
 bool ImageDecoder::init(const _SYSAssetImage *userPtr)
@@ -90,6 +91,8 @@ uint16_t ImageDecoder::getBlockMask() const
 
 int ImageDecoder::tile(unsigned x, unsigned y, unsigned frame)
 {
+    FlashPrefetchScope prefetch(FlashPrefetch::S_IMAGE);
+
     if (x >= header.width || y >= header.height || frame >= header.frames)
         return NO_TILE;
 
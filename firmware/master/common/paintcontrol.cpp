@@ -35,9 +35,12 @@
 #ifdef SIFTEO_SIMULATOR
 #   include "system.h"
 #   include "system_mc.h"
+#   include "mc_vramrecorder.h"
 #   define PAINT_LOG(_x)    do { if (SystemMC::getSystem()->opt_paintTrace) { LOG(_x); }} while (0)
+#   define VRAM_RECORD(_cube, _vbuf)    VRAMRecorder::paint((_cube)->id(), (_vbuf))
 #else
 #   define PAINT_LOG(_x)
+#   define VRAM_RECORD(_cube, _vbuf)
 #endif
 
 #define LOG_PREFIX  "PAINT[%d]: %6u.%03us [+%4ums] pend=%-3d flags=%08x[%c%c%c%c%c] vf=%02x[%c%c] ack=%02x lock=%08x cm16=%08x  "
@@ -277,6 +280,7 @@ void PaintControl::triggerPaint(CubeSlot *cube, SysTime::Ticks now)
         }
 
         // Unleash the radio codec!
+        VRAM_RECORD(cube, vbuf);
         VRAM::unlock(*vbuf);
     }
 
@@ -85,6 +85,11 @@ class PaintControl {
     void ackFrames(CubeSlot *cube, int32_t count);
     bool vramFlushed(CubeSlot *cube);
 
+    // Are we waiting for the cube to finish rendering?
+    bool ALWAYS_INLINE hasPendingFrames() const {
+        return pendingFrames > 0;
+    }
+
  private:
     SysTime::Ticks paintTimestamp;      // Last user call to _SYS_paint()
     SysTime::Ticks asyncTimestamp;      // TOGGLE, TRIGGER_ON_FLUSH, entering CONTINUOUS mode
@@ -41,6 +41,13 @@ bool RadioManager::enabled;
 uint8_t RadioManager::nextPID;
 uint32_t RadioManager::schedule[RadioManager::PID_COUNT];
 uint32_t RadioManager::nextSchedule[RadioManager::PID_COUNT];
+#ifdef SIFTEO_SIMULATOR
+bool RadioManager::weighted;
+uint8_t RadioManager::credits[RadioManager::NUM_PRODUCERS];
+uint32_t RadioManager::overdue;
+SysTime::Ticks RadioManager::lastAck[RadioManager::NUM_PRODUCERS];
+RadioManager::ProducerStats RadioManager::stats[RadioManager::NUM_PRODUCERS];
+#endif
 _SYSPseudoRandomState RadioManager::prngISR;
 RFSpectrumModel RadioManager::rfSpectrumModel;
 
@@ -94,6 +101,18 @@ void RadioManager::produce(PacketTransmission &tx)
      * This way, we reduce our chances of using up a producer we
      * would really need to use later on in the cycle.
      *
+     * Plain round-robin gives a cube with a screenful of dirty VRAM
+     * the same share as an idle cube that only needs a ping. So in the
+     * simulator, when 'weighted' is set, beginRound() hands every producer
+     * a number of credits at the start of each round, based on how much
+     * work it has pending. This stays out of hardware builds until it has
+     * been measured against plain round-robin. A producer that
+     * transmits with credits to spare goes back into the *current*
+     * schedule, in the queue for the PID it just used, so the collision
+     * rule above still holds. Every producer still gets at least one
+     * opportunity per round. Within the queue we pick from, producers
+     * that are overdue for an ACK go first.
+     *
      * This is clearly not a globally optimal algorithm, but it should
      * yield an optimal-enough solution in all cases, and it needs
      * to be efficient enough to run on every radio ISR :)
@@ -162,6 +181,7 @@ void RadioManager::produce(PacketTransmission &tx)
                     added &= ~s;
                 }
                 schedule[0] |= added;
+                RADIO_STATS_ONLY(beginRound(activeMask, added, now);)
                 continue;
             }
 
@@ -188,8 +208,13 @@ void RadioManager::produce(PacketTransmission &tx)
          * and re-add it in its new location, if applicable.
          */
 
-        ASSERT(schedule[foundPID]);
-        unsigned producer = Intrinsic::CLZ(schedule[foundPID]);
+        uint32_t queue = schedule[foundPID];
+        ASSERT(queue);
+        #ifdef SIFTEO_SIMULATOR
+            if (queue & overdue)
+                queue &= overdue;
+        #endif
+        unsigned producer = Intrinsic::CLZ(queue);
         ASSERT(producer < NUM_PRODUCERS);
         uint32_t producerBit = Intrinsic::LZ(producer);
 
@@ -198,7 +223,17 @@ void RadioManager::produce(PacketTransmission &tx)
 
         // Does this producer even want to transmit right now?
         if (dispatchProduce(producer, tx, now)) {
-            nextSchedule[thisPID] |= producerBit;
+            #ifdef SIFTEO_SIMULATOR
+            if (credits[producer] > 1) {
+                credits[producer]--;
+                schedule[thisPID] |= producerBit;
+            } else
+            #endif
+                nextSchedule[thisPID] |= producerBit;
+            RADIO_STATS_ONLY({
+                stats[producer].packets++;
+                stats[producer].bytes += tx.packet.len;
+            })
             nextPID = (thisPID + 1) & PID_MASK;
             currentProducer = producer;
             return;
@@ -209,20 +244,86 @@ void RadioManager::produce(PacketTransmission &tx)
     }
 }
 
+#ifdef SIFTEO_SIMULATOR
+
+void RadioManager::beginRound(uint32_t activeMask, uint32_t added, SysTime::Ticks now)
+{
+    /*
+     * Hand out transmit credits for the next round. Each producer gets
+     * one, plus extra for pending work. CubeConnector only ever needs one.
+     *
+     * Producers 'added' to the schedule this round have just connected.
+     * Their ACK clock starts now, rather than at whatever ACK a previous
+     * cube in the same slot got, so they aren't born overdue. ACK times
+     * are tracked even without weighting, for --radio-stats.
+     */
+
+    const SysTime::Ticks deadline = SysTime::msTicks(ACK_DEADLINE_MS);
+    uint32_t late = 0;
+
+    while (added) {
+        unsigned id = Intrinsic::CLZ(added);
+        added ^= Intrinsic::LZ(id);
+        lastAck[id] = now;
+    }
+
+    if (!weighted)
+        return;
+
+    credits[CONNECTOR_ID] = 1;
+    activeMask &= ~Intrinsic::LZ(CONNECTOR_ID);
+
+    while (activeMask) {
+        unsigned id = Intrinsic::CLZ(activeMask);
+        activeMask ^= Intrinsic::LZ(id);
+
+        unsigned work = CubeSlot::getInstance(id).radioWorkload();
+        if (now - lastAck[id] > deadline) {
+            late |= Intrinsic::LZ(id);
+            work++;
+        }
+
+        credits[id] = 1 + MIN(work, MAX_CREDITS - 1);
+    }
+
+    overdue = late;
+}
+
+void RadioManager::acknowledged(unsigned id, unsigned retries)
+{
+    ASSERT(id < NUM_PRODUCERS);
+    SysTime::Ticks now = SysTime::ticks();
+    ProducerStats &st = stats[id];
+
+    if (lastAck[id]) {
+        SysTime::Ticks gap = now - lastAck[id];
+        st.ackGapTotal += gap;
+        st.ackGapMax = MAX(st.ackGapMax, gap);
+    }
+    st.acks++;
+    st.retries += retries;
+
+    lastAck[id] = now;
+    overdue &= ~Intrinsic::LZ(id);
+}
+
+#endif  // SIFTEO_SIMULATOR
+
 void RadioManager::ackWithPacket(const PacketBuffer &packet, unsigned retries)
 {
 //    dispatchAcknowledge(currentProducer, packet, retries);
     RADIO_UART_STR("\r\nack ");
     RADIO_UART_HEX(currentProducer);
 
-    if (currentProducer == CONNECTOR_ID)
-        return CubeConnector::radioAcknowledge(packet);
-
     if (currentProducer >= NUM_PRODUCERS) {
         ASSERT(currentProducer == DUMMY_ID);
         return;
     }
 
+    RADIO_STATS_ONLY(acknowledged(currentProducer, retries);)
+    if (currentProducer == CONNECTOR_ID)
+        return CubeConnector::radioAcknowledge(packet);
+
     CubeSlot &slot = CubeSlot::getInstance(currentProducer);
     processRetries(slot, retries);
     if (slot.isSysConnected())
@@ -234,14 +335,15 @@ void RadioManager::ackEmpty(unsigned retries)
     RADIO_UART_STR("\r\nack0 ");
     RADIO_UART_HEX(currentProducer);
 
-    if (currentProducer == CONNECTOR_ID)
-        return CubeConnector::radioEmptyAcknowledge();
-
-   if (currentProducer >= NUM_PRODUCERS) {
+    if (currentProducer >= NUM_PRODUCERS) {
         ASSERT(currentProducer == DUMMY_ID);
         return;
     }
 
+    RADIO_STATS_ONLY(acknowledged(currentProducer, retries);)
+    if (currentProducer == CONNECTOR_ID)
+        return CubeConnector::radioEmptyAcknowledge();
+
     CubeSlot &slot = CubeSlot::getInstance(currentProducer);
 
     processRetries(slot, retries);
@@ -254,14 +356,15 @@ void RadioManager::timeout()
     RADIO_UART_STR("\r\nTIMEOUT ");
     RADIO_UART_HEX(currentProducer);
 
-    if (currentProducer == CONNECTOR_ID)
-        return CubeConnector::radioTimeout();
-
     if (currentProducer >= NUM_PRODUCERS) {
         ASSERT(currentProducer == DUMMY_ID);
         return;
     }
 
+    RADIO_STATS_ONLY(stats[currentProducer].timeouts++;)
+    if (currentProducer == CONNECTOR_ID)
+        return CubeConnector::radioTimeout();
+
     CubeSlot &slot = CubeSlot::getInstance(currentProducer);
     if (slot.isSysConnected())
         slot.radioTimeout();
@@ -34,6 +34,12 @@
 #include "systime.h"
 #include "rfspectrum.h"
 
+#ifdef SIFTEO_SIMULATOR
+#  define RADIO_STATS_ONLY(x)  x
+#else
+#  define RADIO_STATS_ONLY(x)
+#endif
+
 class CubeSlot;
 class RadioManager;
 
@@ -254,6 +260,32 @@ class RadioManager {
      */
     static _SYSPseudoRandomState prngISR;
 
+#ifdef SIFTEO_SIMULATOR
+    /**
+     * Weight the schedule by each cube's pending work, rather than using
+     * plain round-robin. Simulator-only, and off by default, until it has
+     * been measured on hardware. Set from --radio-weighting.
+     */
+    static bool weighted;
+
+    /**
+     * Per-producer counters, for validating the scheduler in simulation.
+     * Reset each time they're dumped.
+     */
+    struct ProducerStats {
+        uint32_t packets;               // Transmit opportunities used
+        uint32_t bytes;                 // Payload bytes in those packets
+        uint32_t acks;                  // Packets acknowledged
+        uint32_t retries;               // Retransmissions before those ACKs
+        uint32_t timeouts;              // Packets that ran out of retries
+        SysTime::Ticks ackGapTotal;     // Sum of the intervals between ACKs
+        SysTime::Ticks ackGapMax;       // Longest interval between ACKs
+    };
+
+    // Periodically log per-cube bandwidth and latency, if enabled
+    static void dumpStats();
+#endif
+
  private:
 
     /*
@@ -296,7 +328,25 @@ class RadioManager {
     // Priority queues for each PID value
     static uint32_t schedule[PID_COUNT];
     static uint32_t nextSchedule[PID_COUNT];
-    
+
+#ifdef SIFTEO_SIMULATOR
+    /*
+     * When 'weighted', producers with more pending work get up to
+     * MAX_CREDITS transmit opportunities per scheduling round. Producers
+     * that haven't been acknowledged within ACK_DEADLINE_MS are marked
+     * 'overdue', and picked first from whichever queue we're taking from.
+     */
+    static const unsigned MAX_CREDITS = 4;
+    static const unsigned ACK_DEADLINE_MS = 50;
+    static uint8_t credits[NUM_PRODUCERS];
+    static uint32_t overdue;
+    static SysTime::Ticks lastAck[NUM_PRODUCERS];
+    static ProducerStats stats[NUM_PRODUCERS];
+
+    static void beginRound(uint32_t activeMask, uint32_t added, SysTime::Ticks now);
+    static void acknowledged(unsigned id, unsigned retries);
+#endif
+
     // Dispatch to a paritcular producer, by ID
     static ALWAYS_INLINE bool dispatchProduce(unsigned id, PacketTransmission &tx, SysTime::Ticks now);
 };
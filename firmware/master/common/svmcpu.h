@@ -60,6 +60,14 @@ namespace SvmCpu {
 
     void run(reg_t sp, reg_t pc) SVM_RUN_ATTRS;
 
+#ifdef SIFTEO_SIMULATOR
+    // Discard decoded instructions for one FlashBlock cache slot
+    void invalidateDecodeCache(unsigned blockID);
+
+    // Current user-mode PC and frame pointer, for sampling profilers
+    void getUserPCAndFP(reg_t &pc, reg_t &fp);
+#endif
+
     // Registers that get saved to the stack automatically by hardware
     struct HwContext {
         reg_t r0;
@@ -136,6 +136,7 @@ public:
 #ifdef SIFTEO_SIMULATOR
     static std::string formatAddress(uint32_t address);
     static std::string formatAddress(void *address);
+    static std::string functionName(uint32_t address);
 #endif
 };
 
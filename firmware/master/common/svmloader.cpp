@@ -31,6 +31,7 @@
 #include "svm.h"
 #include "svmmemory.h"
 #include "svmfastlz.h"
+#include "svmpagedlz.h"
 #include "svmdebugpipe.h"
 #include "svmclock.h"
 #include "radio.h"
@@ -107,6 +108,10 @@ bool SvmLoader::loadRWData(const Elf::Program &program)
         case _SYS_ELF_PT_LOAD_FASTLZ:
             return SvmFastLZ::decompressL1(ref, destPA, destLen, srcVA, srcLen);
 
+        // Compressed with block-aligned LZ4-style pages
+        case _SYS_ELF_PT_LOAD_PAGEDLZ:
+            return SvmPagedLZ::decompress(ref, destPA, destLen, srcVA, srcLen);
+
         default:
             return false;
     }
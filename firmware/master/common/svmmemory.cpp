@@ -25,6 +25,7 @@
 
 #include "svm.h"
 #include "svmmemory.h"
+#include "flash_prefetch.h"
 
 using namespace Svm;
 
@@ -130,6 +131,8 @@ bool SvmMemory::copyROData(FlashBlockRef &ref,
         return true;
     }
 
+    FlashPrefetchScope prefetch(FlashPrefetch::S_RODATA);
+
     STATIC_ASSERT(arraysize(flashSeg) == 2);
     return flashSeg[0].copyBytes(ref, src - SEGMENT_0_VA, dest, length) ||
            flashSeg[1].copyBytes(ref, src - SEGMENT_1_VA, dest, length);
@@ -0,0 +1,135 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "svmpagedlz.h"
+
+
+/**
+ * Read the extension bytes for a length nibble of 15. Returns false
+ * if the page ends first.
+ */
+static ALWAYS_INLINE bool readLength(const uint8_t *&ip,
+    const uint8_t *ipLimit, unsigned &len)
+{
+    unsigned byte;
+    do {
+        if (UNLIKELY(ip == ipLimit))
+            return false;
+        byte = *(ip++);
+        len += byte;
+    } while (byte == 0xFF);
+    return true;
+}
+
+
+bool SvmPagedLZ::decompress(FlashBlockRef &ref, SvmMemory::PhysAddr dest,
+    uint32_t &destLen, SvmMemory::VirtAddr src, uint32_t srcLen)
+{
+    uint8_t *op = dest;
+    const uint8_t *opLimit = op + destLen;
+
+    while (srcLen) {
+        /*
+         * mapROData() never maps past the end of a flash block,
+         * so this gives us exactly one page.
+         */
+
+        uint32_t pageLen = srcLen;
+        SvmMemory::PhysAddr page;
+        if (!SvmMemory::mapROData(ref, src, pageLen, page))
+            return false;
+
+        src += pageLen;
+        srcLen -= pageLen;
+
+        unsigned payloadLen = page[0];
+        if (UNLIKELY(payloadLen >= pageLen))
+            return false;
+
+        const uint8_t *ip = page + 1;
+        if (!decompressPage(ip, ip + payloadLen, dest, op, opLimit))
+            return false;
+    }
+
+    ASSERT(unsigned(op - dest) <= destLen);
+    destLen = op - dest;
+    return true;
+}
+
+
+bool SvmPagedLZ::decompressPage(const uint8_t *ip, const uint8_t *ipLimit,
+    const uint8_t *destBase, uint8_t *&op, const uint8_t *opLimit)
+{
+    while (ip != ipLimit) {
+        unsigned token = *(ip++);
+
+        // Literals
+        unsigned len = token >> 4;
+        if (len == 15 && !readLength(ip, ipLimit, len))
+            return false;
+
+        if (UNLIKELY(len > unsigned(ipLimit - ip) || len > unsigned(opLimit - op)))
+            return false;
+
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        // Literals at the end of a page have no match
+        if (ip == ipLimit)
+            break;
+
+        // Match
+        if (UNLIKELY(ipLimit - ip < 2))
+            return false;
+        unsigned offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        len = token & 15;
+        if (len == 15 && !readLength(ip, ipLimit, len))
+            return false;
+        len += 4;
+
+        if (UNLIKELY(offset == 0 || offset > unsigned(op - destBase)
+            || len > unsigned(opLimit - op)))
+            return false;
+
+        /*
+         * An overlapping match repeats the last 'offset' bytes. Copy in
+         * chunks no larger than the distance back to 'r', which doubles
+         * each time. A match that doesn't overlap takes one pass.
+         */
+
+        const uint8_t *r = op - offset;
+        do {
+            unsigned chunk = MIN(len, unsigned(op - r));
+            memcpy(op, r, chunk);
+            op += chunk;
+            len -= chunk;
+        } while (len);
+    }
+
+    return true;
+}
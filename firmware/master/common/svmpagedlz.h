@@ -0,0 +1,82 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Thundercracker firmware
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SVM_PAGEDLZ_H
+#define SVM_PAGEDLZ_H
+
+#include "macros.h"
+#include "svmmemory.h"
+
+
+/**
+ * Decoder for the paged LZ format used by _SYS_ELF_PT_LOAD_PAGEDLZ.
+ *
+ * This is designed to decompress RWDATA quickly at launch. The compressed
+ * stream is divided into pages that line up with flash blocks: the first
+ * page ends at the first block boundary after the start of the stream,
+ * every page after that is exactly one block, and the last page ends with
+ * the stream. Each page begins with a one-byte count of the payload bytes
+ * that follow. Anything after the payload is padding.
+ *
+ * The payload is a series of LZ4-style sequences, which never cross a page
+ * boundary. A token byte holds the literal length in its high nibble and
+ * the match length minus 4 in its low nibble. A nibble of 15 is followed
+ * by extension bytes, each added to the length, continuing as long as the
+ * byte is 255. Next come the literals, then a 16-bit little-endian match
+ * offset, then any match length extension bytes. A sequence that ends its
+ * page right after the literals has no match.
+ *
+ * Since no sequence crosses a page, we can decode directly out of each
+ * cached flash block, and literal runs and matches are plain memcpy()s.
+ */
+
+class SvmPagedLZ {
+public:
+
+    /**
+     * Decompress paged LZ data from virtual memory.
+     *
+     * Decodes exactly 'srcLen' bytes of data from 'src'.
+     * Writes at most 'destLen' bytes to 'dest'. Returns the number
+     * of bytes actually decompressed via 'destLen'.
+     *
+     * On memory mapping failure or malformed data, returns false.
+     * On success, returns true.
+     *
+     * This function is guaranteed not to crash or write out of bounds,
+     * even if the input data is corrupt or malicious.
+     */
+    static bool decompress(FlashBlockRef &ref, SvmMemory::PhysAddr dest,
+        uint32_t &destLen, SvmMemory::VirtAddr src, uint32_t srcLen);
+
+private:
+    SvmPagedLZ();    // Do not implement
+
+    static bool decompressPage(const uint8_t *ip, const uint8_t *ipLimit,
+        const uint8_t *destBase, uint8_t *&op, const uint8_t *opLimit);
+};
+
+
+#endif // SVM_PAGEDLZ_H
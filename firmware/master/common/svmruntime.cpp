@@ -25,6 +25,7 @@
 
 #include "svmruntime.h"
 #include "flash_blockcache.h"
+#include "flash_prefetch.h"
 #include "svm.h"
 #include "svmmemory.h"
 #include "svmdebugpipe.h"
@@ -38,6 +39,13 @@
 #include <math.h>
 #include <sifteo/abi.h>
 
+#ifdef SIFTEO_SIMULATOR
+#   include "mc_svmprofiler.h"
+#   define PROFILER_ONLY(x)    x
+#else
+#   define PROFILER_ONLY(x)
+#endif
+
 typedef uint64_t (*SvmSyscall)(reg_t p0, reg_t p1, reg_t p2, reg_t p3,
                                reg_t p4, reg_t p5, reg_t p6, reg_t p7);
 
@@ -418,6 +426,15 @@ ALWAYS_INLINE void SvmRuntime::validate(reg_t address)
     SvmCpu::setReg(9, reinterpret_cast<reg_t>(brw));
 }
 
+#ifdef SIFTEO_SIMULATOR
+const char *SvmRuntime::syscallName(unsigned num)
+{
+    if (num < arraysize(SyscallNames))
+        return SyscallNames[num];
+    return 0;
+}
+#endif
+
 void SvmRuntime::syscall(unsigned num)
 {
     // syscall calling convention: 8 params, as provided by r0-r7,
@@ -448,11 +465,15 @@ void SvmRuntime::syscall(unsigned num)
             reinterpret_cast<void*>(SvmCpu::reg(7))));
     });
 
+    PROFILER_ONLY(SvmProfiler::enterSyscall(num));
+
     uint64_t result = fn(SvmCpu::reg(0), SvmCpu::reg(1),
                          SvmCpu::reg(2), SvmCpu::reg(3),
                          SvmCpu::reg(4), SvmCpu::reg(5),
                          SvmCpu::reg(6), SvmCpu::reg(7));
 
+    PROFILER_ONLY(SvmProfiler::exitSyscall());
+
     uint32_t result0 = result;
     uint32_t result1 = result >> 32;
 
@@ -549,6 +570,7 @@ reg_t SvmRuntime::mapSP(reg_t addr)
 
 void SvmRuntime::branch(reg_t addr)
 {
+    FlashPrefetchScope prefetch(FlashPrefetch::S_CODE);
     SvmMemory::PhysAddr pa;
     if (SvmMemory::mapROCode(codeBlock, addr, pa))
         SvmCpu::setReg(REG_PC, reinterpret_cast<reg_t>(pa));
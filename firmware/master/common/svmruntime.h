@@ -65,6 +65,11 @@ public:
     // Modify the program counter
     static void branch(reg_t addr);
 
+#ifdef SIFTEO_SIMULATOR
+    // Name of a syscall number, or NULL if it isn't in the table
+    static const char *syscallName(unsigned num);
+#endif
+
     /**
      * Call Event::Dispatch() on our way out of the next syscall(). Events can't
      * be dispatched while we're in syscalls, since the internal call() we
@@ -188,7 +188,8 @@ int32_t _SYS_fs_objectRead(unsigned key, uint8_t *buffer,
      * Search for the requested object in the index.
      *
      * Traverse backwards from the newest to the oldest, returning
-     * the first instance of this key which has a valid CRC.
+     * the first instance of this key which has a valid CRC. The LFS
+     * key index usually lets us skip straight to the newest copy.
      *
      * Note that we use the userspace buffer to CRC the object,
      * obviating the need for any separate buffer space. This means
@@ -198,14 +199,10 @@ int32_t _SYS_fs_objectRead(unsigned key, uint8_t *buffer,
      */
 
     FlashLFS &lfs = FlashLFSCache::get(parentVol);
-    FlashLFSObjectIter iter(lfs);
+    unsigned size;
 
-    while (iter.previous(FlashLFSKeyQuery(key))) {
-        unsigned size = iter.record()->getSizeInBytes();
-        size = MIN(size, bufferSize);
-        if (iter.readAndCheck(buffer, size))
-            return size;
-    }
+    if (lfs.readObject(key, buffer, bufferSize, size))
+        return size;
 
     return 0;
 }
@@ -37,9 +37,12 @@
 #include "batterylevel.h"
 #include "volume.h"
 #include "btprotocol.h"
+#include "flash_prefetch.h"
+#include "usbprotocol.h"
 
 #ifdef SIFTEO_SIMULATOR
 #   include "mc_timing.h"
+#   include "mc_usbdevice.h"
 #   include "system_mc.h"
 #   include "system.h"
 #   include "batterylevel.h"
@@ -63,14 +66,14 @@ ALWAYS_INLINE void Tasks::taskInvoke(unsigned id)
 {
     switch (id) {
 
+        case Tasks::UsbOUT:             return UsbDevice::handleOUTData();
+        case Tasks::UsbIN:              return USBProtocol::inTask();
+
     #ifndef SIFTEO_SIMULATOR
         #if BOARD != BOARD_TEST_JIG
         case Tasks::PowerManager:       return PowerManager::vbusDebounce();
         #endif
 
-        case Tasks::UsbOUT:             return UsbDevice::handleOUTData();
-        case Tasks::UsbIN:              return USBProtocol::inTask();
-
         #if (BOARD == BOARD_TEST_JIG && !defined(BOOTLOADER))
         case Tasks::TestJig:            return TestJig::task();
         #endif
@@ -85,6 +88,7 @@ ALWAYS_INLINE void Tasks::taskInvoke(unsigned id)
         case Tasks::Heartbeat:          return heartbeatTask();
         case Tasks::FaultLogger:        return FaultLogger::task();
         case Tasks::BluetoothProtocol:  return BTProtocol::task();
+        case Tasks::FlashPrefetch:      return FlashPrefetch::task();
     #endif
 
     #if !defined(SIFTEO_SIMULATOR) && defined(HAVE_NRF8001) && !defined(BOOTLOADER)
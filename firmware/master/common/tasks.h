@@ -71,6 +71,7 @@ public:
         BluetoothProtocol,
         Heartbeat,
         UsbIN,
+        FlashPrefetch,
         Profiler,
         TestJig,
         FactoryTest
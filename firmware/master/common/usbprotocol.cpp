@@ -29,7 +29,9 @@
 #include "macros.h"
 #include "event.h"
 
-#ifndef SIFTEO_SIMULATOR
+#ifdef SIFTEO_SIMULATOR
+#include "mc_usbdevice.h"
+#else
 #include "usb/usbdevice.h"
 #include "hardware.h"
 #include "factorytest.h"
@@ -92,12 +94,10 @@ void USBProtocol::requestUserINPacket()
      * Should only be called in task or syscall context.
      */
 
-#ifndef SIFTEO_SIMULATOR
     // ensure someone's likely to be there listening to us
     if (SysTime::ticks() - UsbDevice::lastINActivity() > SysTime::msTicks(250)) {
         return;
     }
-#endif
 
     UsbQueue &queue = USBProtocol::instance.userSendQueue;
     if (queue.hasQueue() && !queue.empty()) {
@@ -117,9 +117,7 @@ void USBProtocol::requestUserINPacket()
 
         // timeout here should leave some headroom for system watchdog,
         // which is currently 3 seconds.
-#ifndef SIFTEO_SIMULATOR
-        UsbDevice::write(buf, pkt->length + sizeof pkt->type, 1000);
-#endif
+        UsbDevice::write(buf, length + sizeof pkt->type, 1000);
         return Event::setBasePending(Event::PID_BASE_USB_WRITE_AVAILABLE);
     }
 }
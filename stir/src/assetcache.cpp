@@ -0,0 +1,341 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "assetcache.h"
+#include "logger.h"
+
+#ifdef _WIN32
+#   include <direct.h>
+#   include <process.h>
+#   define mkdir(_path, _mode)   _mkdir(_path)
+#   define getpid               _getpid
+#else
+#   include <unistd.h>
+#endif
+
+#define STRINGIFY(_x)   #_x
+#define TOSTRING(_x)    STRINGIFY(_x)
+
+namespace Stir {
+
+const char AssetCache::MAGIC[8] = { 'S', 'T', 'I', 'R', 'C', 'A', 'C', 'H' };
+
+
+AssetCache::Key::Key(const char *type)
+    : h1(0xcbf29ce484222325ULL), h2(0x6a09e667f3bcc908ULL)
+{
+    add(std::string(type));
+    add(FORMAT_VERSION);
+#ifdef SDK_VERSION
+    add(std::string(TOSTRING(SDK_VERSION)));
+#endif
+}
+
+void AssetCache::Key::add(const void *data, size_t length)
+{
+    /*
+     * Two independent 64-bit lanes: FNV-1a, and a multiply/xorshift hash
+     * with a different structure, so that a collision in one is very
+     * unlikely to also be a collision in the other.
+     */
+
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+
+    while (length--) {
+        uint8_t byte = *(p++);
+
+        h1 = (h1 ^ byte) * 0x100000001b3ULL;
+
+        h2 = (h2 + byte) * 0x9e3779b97f4a7c15ULL;
+        h2 ^= h2 >> 29;
+    }
+}
+
+void AssetCache::Key::add(uint32_t value)
+{
+    uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8),
+                         uint8_t(value >> 16), uint8_t(value >> 24) };
+    add(bytes, sizeof bytes);
+}
+
+void AssetCache::Key::add(double value)
+{
+    add(&value, sizeof value);
+}
+
+void AssetCache::Key::add(const std::string &value)
+{
+    // Length first, so that concatenated strings can't alias
+    add(uint32_t(value.size()));
+    add(value.data(), value.size());
+}
+
+std::string AssetCache::Key::str() const
+{
+    char buf[33];
+    snprintf(buf, sizeof buf, "%016llx%016llx",
+        (unsigned long long) h1, (unsigned long long) h2);
+    return buf;
+}
+
+void AssetCache::Record::put(uint32_t value)
+{
+    data.push_back(uint8_t(value));
+    data.push_back(uint8_t(value >> 8));
+    data.push_back(uint8_t(value >> 16));
+    data.push_back(uint8_t(value >> 24));
+}
+
+void AssetCache::Record::put(double value)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), p, p + sizeof value);
+}
+
+void AssetCache::Record::put(const std::string &value)
+{
+    put(uint32_t(value.size()));
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+void AssetCache::Record::put(const std::vector<uint8_t> &value)
+{
+    put(uint32_t(value.size()));
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+void AssetCache::Record::put(const std::vector<uint16_t> &value)
+{
+    put(uint32_t(value.size()));
+    for (unsigned i = 0; i < value.size(); i++) {
+        data.push_back(uint8_t(value[i]));
+        data.push_back(uint8_t(value[i] >> 8));
+    }
+}
+
+bool AssetCache::Record::claim(size_t length)
+{
+    if (valid && length <= data.size() - pos)
+        return true;
+
+    valid = false;
+    return false;
+}
+
+uint32_t AssetCache::Record::getU32()
+{
+    if (!claim(4))
+        return 0;
+
+    const uint8_t *p = &data[pos];
+    pos += 4;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+double AssetCache::Record::getDouble()
+{
+    double value = 0;
+    if (claim(sizeof value)) {
+        memcpy(&value, &data[pos], sizeof value);
+        pos += sizeof value;
+    }
+    return value;
+}
+
+void AssetCache::Record::get(std::string &value)
+{
+    uint32_t size = getU32();
+    value.clear();
+    if (claim(size)) {
+        value.assign(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+    }
+}
+
+void AssetCache::Record::get(std::vector<uint8_t> &value)
+{
+    uint32_t size = getU32();
+    value.clear();
+    if (claim(size)) {
+        value.assign(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+    }
+}
+
+void AssetCache::Record::get(std::vector<uint16_t> &value)
+{
+    uint32_t size = getU32();
+    value.clear();
+    if (size <= (data.size() - pos) / 2 && claim(size * 2)) {
+        value.resize(size);
+        for (unsigned i = 0; i < size; i++, pos += 2)
+            value[i] = data[pos] | (data[pos + 1] << 8);
+    } else {
+        valid = false;
+    }
+}
+
+bool AssetCache::setDirectory(const char *dir, Logger &log)
+{
+    std::string path(dir);
+
+    // Canonicalize away any trailing separator
+    while (path.size() > 1 && (path[path.size() - 1] == '/' || path[path.size() - 1] == '\\'))
+        path.erase(path.size() - 1);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 && mkdir(path.c_str(), 0777) != 0) {
+        log.error("Can't create cache directory '%s': %s", dir, strerror(errno));
+        return false;
+    }
+
+    mDir = path;
+    return true;
+}
+
+std::string AssetCache::path(const Key &key) const
+{
+    return mDir + "/" + key.str();
+}
+
+bool AssetCache::load(const Key &key, Record &rec)
+{
+    /*
+     * Any problem with the file at all is just a miss. We'll overwrite
+     * it with a fresh copy once we've redone the work.
+     */
+
+    rec = Record();
+
+    if (!isEnabled())
+        return false;
+
+    FILE *f = fopen(path(key).c_str(), "rb");
+    if (f) {
+        char magic[sizeof MAGIC];
+        char keyStr[32];
+        uint8_t header[8];
+
+        if (fread(magic, sizeof magic, 1, f) == 1 &&
+            fread(keyStr, sizeof keyStr, 1, f) == 1 &&
+            fread(header, sizeof header, 1, f) == 1 &&
+            !memcmp(magic, MAGIC, sizeof magic) &&
+            key.str() == std::string(keyStr, sizeof keyStr)) {
+
+            Record h;
+            h.data.assign(header, header + sizeof header);
+            uint32_t version = h.getU32();
+            uint32_t size = h.getU32();
+
+            if (version == FORMAT_VERSION) {
+                rec.data.resize(size);
+                if (!size || fread(&rec.data[0], size, 1, f) == 1) {
+                    // Must be exactly the right size, too
+                    if (fgetc(f) == EOF) {
+                        fclose(f);
+                        tthread::lock_guard<tthread::mutex> guard(mMutex);
+                        hits++;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        fclose(f);
+    }
+
+    rec = Record();
+    tthread::lock_guard<tthread::mutex> guard(mMutex);
+    misses++;
+    return false;
+}
+
+void AssetCache::store(const Key &key, const Record &rec)
+{
+    /*
+     * Write to a temporary file first, then move it into place, so that
+     * an interrupted build or a concurrent stir never leaves a partial
+     * entry behind. Failing to write the cache is never fatal.
+     */
+
+    if (!isEnabled())
+        return;
+
+    unsigned tempID;
+    {
+        tthread::lock_guard<tthread::mutex> guard(mMutex);
+        tempID = nextTemp++;
+    }
+
+    std::string dest = path(key);
+    char suffix[32];
+    snprintf(suffix, sizeof suffix, ".tmp%d-%u", (int) getpid(), tempID);
+    std::string temp = dest + suffix;
+
+    FILE *f = fopen(temp.c_str(), "wb");
+    if (!f)
+        return;
+
+    Record h;
+    h.put(FORMAT_VERSION);
+    h.put(uint32_t(rec.data.size()));
+    std::string keyStr = key.str();
+
+    bool success =
+        fwrite(MAGIC, sizeof MAGIC, 1, f) == 1 &&
+        fwrite(keyStr.data(), keyStr.size(), 1, f) == 1 &&
+        fwrite(&h.data[0], h.data.size(), 1, f) == 1 &&
+        (rec.data.empty() || fwrite(&rec.data[0], rec.data.size(), 1, f) == 1);
+
+    success = (fclose(f) == 0) && success;
+
+    if (success && rename(temp.c_str(), dest.c_str()) != 0) {
+        // Windows won't rename over an existing file
+        remove(dest.c_str());
+        success = rename(temp.c_str(), dest.c_str()) == 0;
+    }
+
+    if (!success)
+        remove(temp.c_str());
+}
+
+void AssetCache::logStats(Logger &log) const
+{
+    if (!isEnabled())
+        return;
+
+    log.heading("Cache");
+    log.infoBegin("Asset cache");
+    log.infoLine("%d entries reused, %d rebuilt (%s)", hits, misses, mDir.c_str());
+    log.infoEnd();
+}
+
+
+};  // namespace Stir
@@ -0,0 +1,156 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _ASSETCACHE_H
+#define _ASSETCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "tinythread.h"
+
+namespace Stir {
+
+class Logger;
+
+
+/*
+ * AssetCache --
+ *
+ *    Optional on-disk cache for the expensive parts of an asset build:
+ *    optimized tile pools, DUB-compressed images, and encoded audio.
+ *
+ *    Entries are content-addressed. Each one is stored under a hash of
+ *    everything that went into producing it, including the cache format
+ *    and the SDK version, so a stale entry is never found rather than
+ *    needing to be invalidated. Nothing is ever deleted; it's safe to
+ *    remove the whole directory at any time.
+ *
+ *    load() and store() may be called from any thread.
+ */
+
+class AssetCache {
+ public:
+
+    /*
+     * Key --
+     *
+     *    A 128-bit hash, built incrementally from the inputs of one
+     *    cached operation. The 'type' string keeps different kinds of
+     *    entries from ever colliding with each other.
+     */
+
+    class Key {
+     public:
+        Key(const char *type);
+
+        void add(const void *data, size_t length);
+        void add(uint32_t value);
+        void add(double value);
+        void add(const std::string &value);
+
+        std::string str() const;
+
+     private:
+        uint64_t h1, h2;
+    };
+
+    /*
+     * Record --
+     *
+     *    Serialized contents of one cache entry. Values are written in
+     *    order with put(), and read back in the same order with get().
+     *    Reads past the end fail softly, leaving the record invalid.
+     */
+
+    class Record {
+     public:
+        Record() : pos(0), valid(true) {}
+
+        void put(uint32_t value);
+        void put(double value);
+        void put(const std::string &value);
+        void put(const std::vector<uint8_t> &value);
+        void put(const std::vector<uint16_t> &value);
+
+        uint32_t getU32();
+        double getDouble();
+        void get(std::string &value);
+        void get(std::vector<uint8_t> &value);
+        void get(std::vector<uint16_t> &value);
+
+        // True if every get() so far succeeded
+        bool isValid() const {
+            return valid;
+        }
+
+        // Valid, and nothing is left over
+        bool isComplete() const {
+            return valid && pos == data.size();
+        }
+
+     private:
+        friend class AssetCache;
+
+        std::vector<uint8_t> data;
+        size_t pos;
+        bool valid;
+
+        bool claim(size_t length);
+    };
+
+    AssetCache() : hits(0), misses(0), nextTemp(0) {}
+
+    // The cache is disabled until it has a directory
+    bool setDirectory(const char *dir, Logger &log);
+
+    bool isEnabled() const {
+        return !mDir.empty();
+    }
+
+    bool load(const Key &key, Record &rec);
+    void store(const Key &key, const Record &rec);
+
+    void logStats(Logger &log) const;
+
+ private:
+    // Bump this when anything changes how cached results are produced
+    static const uint32_t FORMAT_VERSION = 1;
+    static const char MAGIC[8];
+
+    std::string mDir;
+    tthread::mutex mMutex;
+    unsigned hits, misses;
+    unsigned nextTemp;
+
+    std::string path(const Key &key) const;
+};
+
+
+};  // namespace Stir
+
+#endif
@@ -140,13 +140,9 @@ void CIELab::initialize(void)
 }
 
 ColorReducer::ColorReducer()
-    : newestLUTStamp(1)
-{
-    for (unsigned v = 0; v < LUT_SIZE; v++) {
-        colorMSE[v] = DBL_MAX;
-        inverseLUTStamps[v] = 0;
-    }
-}
+    : inverseLUT(LUT_SIZE), inverseLUTStamps(LUT_SIZE, 0),
+      colorMSE(LUT_SIZE, DBL_MAX), newestLUTStamp(1)
+    {}
 
 void ColorReducer::reduce(Logger *log, unsigned minColors)
 {
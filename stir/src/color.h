@@ -256,9 +256,10 @@ class ColorReducer {
     std::vector<RGB565> colors;
     std::vector<box> boxes;
     std::list<unsigned> boxQueue;
-    uint16_t inverseLUT[LUT_SIZE];
-    uint32_t inverseLUTStamps[LUT_SIZE];
-    double colorMSE[LUT_SIZE];
+    // Large tables live on the heap, to keep worker thread stacks small
+    std::vector<uint16_t> inverseLUT;
+    std::vector<uint32_t> inverseLUTStamps;
+    std::vector<double> colorMSE;
     uint32_t newestLUTStamp;
 
     bool splitBox(box &b);
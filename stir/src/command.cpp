@@ -29,10 +29,12 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "tile.h"
 #include "script.h"
+#include "threadpool.h"
 
 #define STRINGIFY(_x)   #_x
 #define TOSTRING(_x)    STRINGIFY(_x)
@@ -55,6 +57,8 @@ static void usage()
             "  -o FILE.cpp   Generate a C++ source file with your asset data\n"
             "  -o FILE.h     Generate a C++ header with metadata for your assets\n"
             "  -o FILE.html  Generate a proofing sheet for your assets, in HTML format\n"
+            "  -j THREADS    Number of threads to use (default: one per CPU)\n"
+            "  -c DIR        Reuse results from previous builds, cached in DIR\n"
             "  VAR=VALUE     Define a script variable, prior to parsing the script\n"
             "\n"
             "Sifteo SDK (" TOSTRING(SDK_VERSION) ")\n"
@@ -95,6 +99,27 @@ int main(int argc, char **argv)
             }
         }
 
+        if (!strcmp(arg, "-j") && argv[c+1]) {
+            int threads = atoi(argv[c+1]);
+            if (threads > 0) {
+                Stir::ThreadPool::setDefaultSize(threads);
+                c++;
+                continue;
+            } else {
+                log.error("Invalid thread count: '%s'", argv[c+1]);
+                return 1;
+            }
+        }
+
+        if (!strcmp(arg, "-c") && argv[c+1]) {
+            if (script.setCacheDirectory(argv[c+1])) {
+                c++;
+                continue;
+            } else {
+                return 1;
+            }
+        }
+
         if (arg[0] == '-') {
             log.error("Unrecognized option: '%s'", arg);
             return 1;
@@ -26,7 +26,6 @@
 
 #include "cppwriter.h"
 #include "audioencoder.h"
-#include "wavedecoder.h"
 #include <assert.h>
 #include "sifteo/abi.h"
 
@@ -125,8 +124,8 @@ void CPPWriter::writeArray(const std::vector<uint16_t> &data)
     mStream << "\n";
 }
 
-CPPSourceWriter::CPPSourceWriter(Logger &log, const char *filename)
-    : CPPWriter(log, filename), nextGroupOrdinal(0) {}
+CPPSourceWriter::CPPSourceWriter(Logger &log, const char *filename, AssetCache &cache)
+    : CPPWriter(log, filename), nextGroupOrdinal(0), mCache(cache) {}
 
 bool CPPSourceWriter::writeGroup(const Group &group)
 {
@@ -174,7 +173,7 @@ bool CPPSourceWriter::writeGroup(const Group &group)
     }
 
     mLog.infoBegin("Encoding images");
-    for (std::set<Image*>::iterator i = group.getImages().begin();
+    for (Group::ImageSet::const_iterator i = group.getImages().begin();
          i != group.getImages().end(); i++) {
         Image* image = *i;
         if (!image->inList()) {
@@ -191,40 +190,10 @@ bool CPPSourceWriter::writeSound(const Sound &sound)
     AudioEncoder *enc = AudioEncoder::create(sound.getEncode());
     assert(enc != 0);
 
-    std::vector<uint8_t> raw;
-    std::vector<uint8_t> data;
-
-    std::string filepath = sound.getFile();
-    unsigned sz = filepath.size();
-
-    /*
-     * If the sample rate has not been explicitly specified in assets.lua,
-     * and we have a WAV file, default to its native sample rate.
-     *
-     * Otherwise, use the standard 16kHz sample rate.
-     */
-    uint32_t sampleRate = sound.getSampleRate();
-
-    if (sz >= 4 && filepath.substr(sz - 4) == ".wav") {
-        uint32_t waveNativeSampleRate;
-        if (!WaveDecoder::loadFile(raw, waveNativeSampleRate, filepath, mLog))
-            return false;
-
-        if (sampleRate == Sound::UNSPECIFIED_SAMPLE_RATE) {
-            sampleRate = waveNativeSampleRate;
-        }
-    }
-    else {
-        LodePNG::loadFile(raw, filepath);
-    }
-
-    if (sampleRate == Sound::UNSPECIFIED_SAMPLE_RATE) {
-        sampleRate = Sound::STANDARD_SAMPLE_RATE;
-    }
-
-    uint32_t numSamples = raw.size() / sizeof(int16_t);
-
-    enc->encode(raw, data);
+    // Already encoded by Script::run()
+    const std::vector<uint8_t> &data = sound.getData();
+    uint32_t sampleRate = sound.getEncodedSampleRate();
+    uint32_t numSamples = sound.getNumSamples();
 
     mLog.infoLineWithLabel(sound.getName().c_str(),
         "%7.02f kiB, %s (%s)",
@@ -360,10 +329,10 @@ void CPPSourceWriter::writeImage(const Image &image, bool writeDecl, bool writeA
     }
     
     // Try to compress the asset, if it isn't explicitly flat.
-    if (autoFormat) {
+    if (image.isCompressible()) {
         std::vector<uint16_t> data;
         std::string format;
-        if (image.encodeDUB(data, mLog, format)) {
+        if (image.encodeDUB(data, mLog, format, &mCache)) {
             if (writeAsset) {
                 mStream <<
                     indent << "/* format   */ " << format << ",\n" <<
@@ -599,7 +568,7 @@ void CPPHeaderWriter::writeGroup(const Group &group)
         mStream << "extern Sifteo::AssetGroup " << group.getName() << ";\n";
     }
 
-    for (std::set<Image*>::iterator i = group.getImages().begin();
+    for (Group::ImageSet::const_iterator i = group.getImages().begin();
          i != group.getImages().end(); i++) {
         Image *image = *i;
         if (!image->inList()) {
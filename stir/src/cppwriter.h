@@ -33,6 +33,7 @@
 #include "tile.h"
 #include "script.h"
 #include "logger.h"
+#include "assetcache.h"
 
 namespace Stir {
 
@@ -72,7 +73,7 @@ class CPPWriter {
 
 class CPPSourceWriter : public CPPWriter {
  public:
-    CPPSourceWriter(Logger &log, const char *filename);
+    CPPSourceWriter(Logger &log, const char *filename, AssetCache &cache);
     bool writeGroup(const Group &group);
     bool writeSound(const Sound &sound);
     void writeTrackerShared(const Tracker &tracker);
@@ -83,6 +84,7 @@ class CPPSourceWriter : public CPPWriter {
     void writeImage(const Image &image, bool writeDecl=true, bool writeAsset=true, bool writeData=true);
 
     unsigned nextGroupOrdinal;
+    AssetCache &mCache;
 };
 
 
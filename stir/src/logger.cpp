@@ -163,4 +163,116 @@ void ConsoleLogger::setMinLabelWidth(unsigned width)
     mLabelWidth = std::max(mLabelWidth, width);
 }
 
+static std::string formatString(const char *fmt, va_list ap)
+{
+    char line[1024];
+    vsnprintf(line, sizeof line, fmt, ap);
+    line[sizeof line - 1] = 0;
+    return line;
+}
+
+BufferedLogger::Entry &BufferedLogger::add(Entry::Type type)
+{
+    mEntries.push_back(Entry());
+    Entry &e = mEntries.back();
+    e.type = type;
+    e.width = 0;
+    return e;
+}
+
+void BufferedLogger::heading(const char *name)
+{
+    add(Entry::HEADING).text = name;
+}
+
+void BufferedLogger::taskBegin(const char *name)
+{
+    add(Entry::TASK_BEGIN).text = name;
+}
+
+void BufferedLogger::taskProgress(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+
+    if (mEntries.empty() || mEntries.back().type != Entry::TASK_PROGRESS)
+        add(Entry::TASK_PROGRESS);
+    mEntries.back().text = formatString(fmt, ap);
+
+    va_end(ap);
+}
+
+void BufferedLogger::taskEnd()
+{
+    add(Entry::TASK_END);
+}
+
+void BufferedLogger::infoBegin(const char *name)
+{
+    add(Entry::INFO_BEGIN).text = name;
+}
+
+void BufferedLogger::infoLine(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    add(Entry::INFO_LINE).text = formatString(fmt, ap);
+    va_end(ap);
+}
+
+void BufferedLogger::infoLineWithLabel(const char *label, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    Entry &e = add(Entry::INFO_LINE_WITH_LABEL);
+    e.label = label;
+    e.text = formatString(fmt, ap);
+    va_end(ap);
+}
+
+void BufferedLogger::infoEnd()
+{
+    add(Entry::INFO_END);
+}
+
+void BufferedLogger::error(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    add(Entry::ERROR_MESSAGE).text = formatString(fmt, ap);
+    va_end(ap);
+}
+
+void BufferedLogger::setMinLabelWidth(unsigned width)
+{
+    add(Entry::MIN_LABEL_WIDTH).width = width;
+}
+
+void BufferedLogger::replay(Logger &log)
+{
+    for (unsigned i = 0; i < mEntries.size(); i++) {
+        const Entry &e = mEntries[i];
+        const char *text = e.text.c_str();
+
+        switch (e.type) {
+        case Entry::HEADING:                log.heading(text); break;
+        case Entry::TASK_BEGIN:             log.taskBegin(text); break;
+        case Entry::TASK_PROGRESS:          log.taskProgress("%s", text); break;
+        case Entry::TASK_END:               log.taskEnd(); break;
+        case Entry::INFO_BEGIN:             log.infoBegin(text); break;
+        case Entry::INFO_LINE:              log.infoLine("%s", text); break;
+        case Entry::INFO_LINE_WITH_LABEL:   log.infoLineWithLabel(e.label.c_str(), "%s", text); break;
+        case Entry::INFO_END:               log.infoEnd(); break;
+        case Entry::ERROR_MESSAGE:          log.error("%s", text); break;
+        case Entry::MIN_LABEL_WIDTH:        log.setMinLabelWidth(e.width); break;
+        }
+    }
+
+    mEntries.clear();
+}
+
 };  // namespace Stir
@@ -28,6 +28,7 @@
 #define _LOGGER_H
 
 #include <string>
+#include <vector>
 
 namespace Stir {
 
@@ -81,6 +82,62 @@ class ConsoleLogger : public Logger {
     std::string mLastProgressLine;
 };
 
+
+/*
+ * BufferedLogger --
+ *
+ *    Records everything logged to it, for replay into another Logger
+ *    later. Lets work run concurrently while its output still comes
+ *    out in the same order as it would from a serial run.
+ *
+ *    Consecutive progress updates are coalesced, keeping only the last.
+ */
+
+class BufferedLogger : public Logger {
+ public:
+    virtual void heading(const char *name);
+
+    virtual void taskBegin(const char *name);
+    virtual void taskProgress(const char *fmt, ...);
+    virtual void taskEnd();
+
+    virtual void infoBegin(const char *name);
+    virtual void infoLine(const char *fmt, ...);
+    virtual void infoLineWithLabel(const char *label, const char *fmt, ...);
+    virtual void infoEnd();
+
+    virtual void error(const char *fmt, ...);
+
+    virtual void setMinLabelWidth(unsigned width);
+
+    // Send everything to 'log', and forget it
+    void replay(Logger &log);
+
+ private:
+    struct Entry {
+        enum Type {
+            HEADING,
+            TASK_BEGIN,
+            TASK_PROGRESS,
+            TASK_END,
+            INFO_BEGIN,
+            INFO_LINE,
+            INFO_LINE_WITH_LABEL,
+            INFO_END,
+            ERROR_MESSAGE,
+            MIN_LABEL_WIDTH,
+        } type;
+
+        std::string label;
+        std::string text;
+        unsigned width;
+    };
+
+    std::vector<Entry> mEntries;
+
+    Entry &add(Entry::Type type);
+};
+
 };  // namespace Stir
 
 #endif
@@ -152,7 +152,7 @@ void ProofWriter::writeGroup(const Group &group)
     if (!group.isFixed())
         tileRange(0, group.getPool().size(), Tile::SIZE, 96);
 
-    for (std::set<Image*>::iterator i = group.getImages().begin();
+    for (Group::ImageSet::const_iterator i = group.getImages().begin();
          i != group.getImages().end(); i++) {
 
         Image *image = *i;
@@ -36,6 +36,8 @@
 #include "audioencoder.h"
 #include "dubencoder.h"
 #include "tracker.h"
+#include "wavedecoder.h"
+#include "threadpool.h"
 
 namespace Stir {
 
@@ -69,6 +71,85 @@ Lunar<Tracker>::RegType Tracker::methods[] = {
     {0,0}
 };
 
+
+/*
+ * Script::CompileJob --
+ *
+ *    All the work we can do before writing any output, as independent
+ *    tasks: optimizing and encoding each group, encoding each sound,
+ *    and then (once the groups' tile indices are final) compressing
+ *    each image.
+ *
+ *    Every task logs to its own BufferedLogger. run() replays them in
+ *    script order, at the same point a serial build would have logged.
+ */
+
+class Script::CompileJob : public ThreadPool::Job {
+private:
+    Script &script;
+    std::vector<Group*> groups;
+    std::vector<Sound*> sounds;
+    std::vector<Image*> images;
+    bool compressingImages;
+
+public:
+    CompileJob(Script &s)
+        : script(s),
+          groups(s.groups.begin(), s.groups.end()),
+          sounds(s.sounds.begin(), s.sounds.end()),
+          compressingImages(false),
+          groupLogs(groups.size()), soundLogs(sounds.size()),
+          groupOK(groups.size()), soundOK(sounds.size()) {}
+
+    // Results, in script order
+    std::vector<BufferedLogger> groupLogs;
+    std::vector<BufferedLogger> soundLogs;
+
+    // Not vector<bool>, since each element is written by a different thread
+    std::vector<uint8_t> groupOK;
+    std::vector<uint8_t> soundOK;
+
+    void compile()
+    {
+        ThreadPool &pool = ThreadPool::instance();
+
+        compressingImages = false;
+        pool.run(*this, groups.size() + sounds.size());
+
+        for (unsigned i = 0; i < groups.size(); i++) {
+            if (!groupOK[i])
+                continue;
+
+            const Group::ImageSet &set = groups[i]->getImages();
+            for (Group::ImageSet::const_iterator j = set.begin(); j != set.end(); j++)
+                if ((*j)->isCompressible())
+                    images.push_back(*j);
+        }
+
+        compressingImages = true;
+        pool.run(*this, images.size());
+    }
+
+    virtual void run(unsigned index)
+    {
+        if (compressingImages) {
+            images[index]->compressDUB(&script.cache);
+        } else if (index < groups.size()) {
+            groupOK[index] = script.optimizeGroup(*groups[index], groupLogs[index]);
+        } else {
+            index -= groups.size();
+            soundOK[index] = sounds[index]->encode(soundLogs[index], &script.cache);
+        }
+    }
+};
+
+unsigned Script::newSequence()
+{
+    // Script objects are only created while running Lua, on one thread
+    static unsigned next = 0;
+    return next++;
+}
+
 Script::Script(Logger &l)
     : log(l), anyOutputs(false), outputHeader(NULL),
       outputSource(NULL), outputProof(NULL)
@@ -104,25 +185,19 @@ bool Script::run(const char *filename)
 
     ProofWriter proof(log, outputProof);
     CPPHeaderWriter header(log, outputHeader);
-    CPPSourceWriter source(log, outputSource);
+    CPPSourceWriter source(log, outputSource, cache);
+
+    CompileJob job(*this);
+    job.compile();
 
-    for (std::set<Group*>::iterator i = groups.begin(); i != groups.end(); i++) {
+    unsigned groupIndex = 0;
+    for (std::set<Group*, ScriptOrder>::iterator i = groups.begin(); i != groups.end(); i++, groupIndex++) {
         Group *group = *i;
-        TilePool &pool = group->getPool();
 
         log.heading(group->getName().c_str());
-        pool.optimize(log);
-
-        if (!group->isFixed()) {
-            if (pool.size() > pool.MAX_SIZE) {
-                log.error("Error: Group '%s' with %d tiles is too large (%.02f%% of %d-tile slot)",
-                    group->getName().c_str(), pool.size(), pool.size() * (100.0 / pool.MAX_SIZE),
-                    pool.MAX_SIZE);
-                return false;
-            }
-
-            pool.encode(group->getLoadstream(), &log);
-        }
+        job.groupLogs[groupIndex].replay(log);
+        if (!job.groupOK[groupIndex])
+            return false;
 
         proof.writeGroup(*group);
         header.writeGroup(*group);
@@ -140,10 +215,13 @@ bool Script::run(const char *filename)
         log.heading("Audio");
         log.infoBegin("Sound compression");
 
-        for (std::set<Sound*>::iterator i = sounds.begin(); i != sounds.end(); i++) {
+        unsigned soundIndex = 0;
+        for (std::set<Sound*, ScriptOrder>::iterator i = sounds.begin(); i != sounds.end(); i++, soundIndex++) {
             Sound *sound = *i;
             header.writeSound(*sound);
-            if (!source.writeSound(*sound))
+
+            job.soundLogs[soundIndex].replay(log);
+            if (!job.soundOK[soundIndex] || !source.writeSound(*sound))
                 return false;
         }
 
@@ -154,7 +232,7 @@ bool Script::run(const char *filename)
         log.heading("Tracker");
 
         log.infoBegin("Parsing modules");
-        for (std::set<Tracker*>::iterator i = trackers.begin(); i != trackers.end(); i++) {
+        for (std::set<Tracker*, ScriptOrder>::iterator i = trackers.begin(); i != trackers.end(); i++) {
             Tracker *tracker = *i;
 
             if(!tracker->loader.load(tracker->getFile().c_str(), log)) {
@@ -175,10 +253,10 @@ bool Script::run(const char *filename)
         }
         log.infoEnd();
 
-        XmTrackerLoader::deduplicate(trackers, log);
+        XmTrackerLoader::deduplicate(std::vector<Tracker*>(trackers.begin(), trackers.end()), log);
 
         source.writeTrackerShared(**trackers.begin());
-        for (std::set<Tracker*>::iterator i = trackers.begin(); i != trackers.end(); i++) {
+        for (std::set<Tracker*, ScriptOrder>::iterator i = trackers.begin(); i != trackers.end(); i++) {
             Tracker *tracker = *i;
 
             header.writeTracker(*tracker);
@@ -187,6 +265,8 @@ bool Script::run(const char *filename)
 
     }
 
+    cache.logStats(log);
+
     proof.close();
     header.close();
     source.close();
@@ -194,6 +274,84 @@ bool Script::run(const char *filename)
     return true;
 }
 
+AssetCache::Key Script::groupKey(Group &group)
+{
+    AssetCache::Key key("group");
+    key.add(uint32_t(group.isFixed()));
+    group.getPool().fingerprint(key);
+    return key;
+}
+
+bool Script::optimizeGroup(Group &group, Logger &log)
+{
+    /*
+     * Optimize and encode one group's tiles, or reuse the results from
+     * a previous build. May run on any thread.
+     */
+
+    TilePool &pool = group.getPool();
+
+    // Must be computed before optimizing, which modifies the pool
+    AssetCache::Key key = groupKey(group);
+
+    if (restoreGroup(group, key, log))
+        return true;
+
+    pool.optimize(log);
+
+    if (!group.isFixed()) {
+        if (pool.size() > pool.MAX_SIZE) {
+            log.error("Error: Group '%s' with %d tiles is too large (%.02f%% of %d-tile slot)",
+                group.getName().c_str(), pool.size(), pool.size() * (100.0 / pool.MAX_SIZE),
+                pool.MAX_SIZE);
+            return false;
+        }
+
+        pool.encode(group.getLoadstream(), &log);
+    }
+
+    saveGroup(group, key);
+    return true;
+}
+
+bool Script::restoreGroup(Group &group, const AssetCache::Key &key, Logger &log)
+{
+    // Try to skip optimizing and encoding a group we've seen before
+
+    AssetCache::Record rec;
+    if (!cache.isEnabled() || !cache.load(key, rec))
+        return false;
+
+    TilePool &pool = group.getPool();
+    std::vector<uint8_t> loadstream;
+
+    if (!pool.restore(rec))
+        return false;
+    rec.get(loadstream);
+    if (!rec.isComplete())
+        return false;
+
+    group.getLoadstream() = loadstream;
+
+    log.taskBegin("Reusing cached tiles");
+    log.taskProgress("%d tiles (%d bytes in loadstream)",
+        pool.size(), (int) loadstream.size());
+    log.taskEnd();
+
+    return true;
+}
+
+void Script::saveGroup(Group &group, const AssetCache::Key &key)
+{
+    if (!cache.isEnabled())
+        return;
+
+    AssetCache::Record rec;
+    group.getPool().save(rec);
+    rec.put(group.getLoadstream());
+    cache.store(key, rec);
+}
+
 bool Script::luaRunFile(const char *filename)
 {
     int s = luaL_loadfile(L, filename);
@@ -460,6 +618,7 @@ bool Script::collectList(const char* name, int tableStackIndex) {
 }
 
 Group::Group(lua_State *L)
+    : mSequence(Script::newSequence())
 {
     if (!Script::argBegin(L, className))
         return;
@@ -525,6 +684,11 @@ void Group::setDefault(lua_State *L)
     lua_setglobal(L, GLOBAL_DEFGROUP);
 }
 
+void Group::addImage(Image *i)
+{
+    mImages.insert(i);
+}
+
 Group *Group::getDefault(lua_State *L)
 {
     lua_getglobal(L, GLOBAL_DEFGROUP);
@@ -533,7 +697,8 @@ Group *Group::getDefault(lua_State *L)
     return obj;
 }
 
-Image::Image(lua_State *L) : mInList(false)
+Image::Image(lua_State *L)
+    : mInList(false), mSequence(Script::newSequence())
 {
     if (!Script::argBegin(L, className))
         return;
@@ -702,43 +867,119 @@ void Image::encodeFlat(std::vector<uint16_t> &data) const
     }
 }
 
-bool Image::encodeDUB(std::vector<uint16_t> &data, Logger &log, std::string &format) const
+bool Image::isCompressible() const
+{
+    // Everything except pinned, flat, and trivial single-tile images
+
+    if (isPinned() || isFlat() || mGrids.empty())
+        return false;
+
+    return !(mGrids.size() == 1 && mGrids[0].width() == 1 && mGrids[0].height() == 1);
+}
+
+void Image::compressDUB(AssetCache *cache) const
 {
     // Compressed image, encoded using the DUB codec.
-    
-    DUBEncoder encoder( mImages.getWidth() / Tile::SIZE,
-                        mImages.getHeight() / Tile::SIZE,
-                        mImages.getFrames() );
+
+    unsigned width = mImages.getWidth() / Tile::SIZE;
+    unsigned height = mImages.getHeight() / Tile::SIZE;
+    unsigned frames = mImages.getFrames();
 
     std::vector<uint16_t> tiles;
     encodeFlat(tiles);
 
+    /*
+     * The encoder only sees tile indices, so that's all we need to key
+     * the cache on. Images which share a layout share an entry.
+     */
+
+    AssetCache::Key key("dub");
+    key.add(uint32_t(width));
+    key.add(uint32_t(height));
+    key.add(uint32_t(frames));
+    key.add(&tiles[0], tiles.size() * sizeof tiles[0]);
+
+    DUBResult &r = mDUB;
+    AssetCache::Record rec;
+
+    if (cache && cache->load(key, rec)) {
+        r.type = rec.getU32();
+        r.tileCount = rec.getU32();
+        r.words = rec.getU32();
+        r.ratio = rec.getDouble();
+        rec.get(r.data);
+        rec.get(r.format);
+
+        r.valid = rec.isComplete() && r.type <= DUBResult::COMPRESSED;
+        if (r.valid)
+            return;
+    }
+
+    DUBEncoder encoder(width, height, frames);
     encoder.encodeTiles(tiles);
-    
-    // Too large to encode correctly?
+
+    r.tileCount = encoder.getTileCount();
+    r.words = encoder.getCompressedWords();
+    r.ratio = encoder.getRatio();
+    r.data.clear();
+    r.format.clear();
+
     if (encoder.isTooLarge()) {
+        r.type = DUBResult::TOO_LARGE;
+    } else if (encoder.getRatio() < 10.0f) {
+        // Not compressible enough to bother
+        r.type = DUBResult::NOT_COMPRESSIBLE;
+    } else {
+        r.type = DUBResult::COMPRESSED;
+        encoder.getResult(r.data);
+        r.format = encoder.isIndex16() ? "_SYS_AIF_DUB_I16" : "_SYS_AIF_DUB_I8";
+    }
+
+    r.valid = true;
+
+    if (cache) {
+        rec = AssetCache::Record();
+        rec.put(r.type);
+        rec.put(r.tileCount);
+        rec.put(r.words);
+        rec.put(r.ratio);
+        rec.put(r.data);
+        rec.put(r.format);
+        cache->store(key, rec);
+    }
+}
+
+bool Image::encodeDUB(std::vector<uint16_t> &data, Logger &log, std::string &format,
+                      AssetCache *cache) const
+{
+    // Compress now, unless that's already been done
+    if (!mDUB.valid)
+        compressDUB(cache);
+
+    switch (mDUB.type) {
+
+    case DUBResult::TOO_LARGE:
         log.infoLineWithLabel(getName().c_str(),
-            "%4d tiles,      (too large for compression codec)",
-            encoder.getTileCount());
+            "%4d tiles,      (too large for compression codec)", mDUB.tileCount);
         return false;
-    }
 
-    // Not compressible enough to bother?
-    if (encoder.getRatio() < 10.0f) {
+    case DUBResult::NOT_COMPRESSIBLE:
         log.infoLineWithLabel(getName().c_str(),
-            "%4d tiles,      (not compressible)",
-            encoder.getTileCount());
+            "%4d tiles,      (not compressible)", mDUB.tileCount);
         return false;
-    }
-    
-    encoder.logStats(getName(), log);
-    encoder.getResult(data);
-    format = encoder.isIndex16() ? "_SYS_AIF_DUB_I16" : "_SYS_AIF_DUB_I8";
 
-    return true;
+    default:
+        log.infoLineWithLabel(getName().c_str(),
+            "%4d tiles, %4d words, % 5.01f%% compression",
+            mDUB.tileCount, mDUB.words, mDUB.ratio);
+        data = mDUB.data;
+        format = mDUB.format;
+        return true;
+    }
 }
 
 Sound::Sound(lua_State *L)
+    : mSequence(Script::newSequence()), mEncodedSampleRate(0), mNumSamples(0)
 {
     if (!Script::argBegin(L, className))
         return;
@@ -796,7 +1037,91 @@ Sound::Sound(lua_State *L)
         luaL_error(L, "Invalid audio encoding parameters");
 }
 
+bool Sound::encode(Logger &log, AssetCache *cache)
+{
+    AudioEncoder *enc = AudioEncoder::create(getEncode());
+    assert(enc != 0);
+
+    std::vector<uint8_t> raw;
+    std::string filepath = getFile();
+    unsigned sz = filepath.size();
+    bool isWave = sz >= 4 && filepath.substr(sz - 4) == ".wav";
+
+    /*
+     * Encoding is keyed on the file's contents rather than its name, so
+     * we have to read it either way. That's cheap next to the encoder.
+     */
+
+    AssetCache::Key key("audio");
+    AssetCache::Record rec;
+
+    if (cache && cache->isEnabled()) {
+        std::vector<uint8_t> contents;
+        LodePNG::loadFile(contents, filepath);
+
+        key.add(contents.empty() ? NULL : &contents[0], contents.size());
+        key.add(uint32_t(isWave));
+        key.add(std::string(enc->getName()));
+        key.add(uint32_t(getSampleRate()));
+
+        if (!contents.empty() && cache->load(key, rec)) {
+            mEncodedSampleRate = rec.getU32();
+            mNumSamples = rec.getU32();
+            rec.get(mData);
+            if (rec.isComplete() && !mData.empty()) {
+                delete enc;
+                return true;
+            }
+        }
+    }
+
+    /*
+     * If the sample rate has not been explicitly specified in assets.lua,
+     * and we have a WAV file, default to its native sample rate.
+     *
+     * Otherwise, use the standard 16kHz sample rate.
+     */
+    uint32_t sampleRate = getSampleRate();
+
+    if (isWave) {
+        uint32_t waveNativeSampleRate;
+        if (!WaveDecoder::loadFile(raw, waveNativeSampleRate, filepath, log)) {
+            delete enc;
+            return false;
+        }
+
+        if (sampleRate == UNSPECIFIED_SAMPLE_RATE) {
+            sampleRate = waveNativeSampleRate;
+        }
+    }
+    else {
+        LodePNG::loadFile(raw, filepath);
+    }
+
+    if (sampleRate == UNSPECIFIED_SAMPLE_RATE) {
+        sampleRate = STANDARD_SAMPLE_RATE;
+    }
+
+    mEncodedSampleRate = sampleRate;
+    mNumSamples = raw.size() / sizeof(int16_t);
+
+    mData.clear();
+    enc->encode(raw, mData);
+    delete enc;
+
+    if (!mData.empty() && cache) {
+        rec = AssetCache::Record();
+        rec.put(mEncodedSampleRate);
+        rec.put(mNumSamples);
+        rec.put(mData);
+        cache->store(key, rec);
+    }
+
+    return true;
+}
+
 Tracker::Tracker(lua_State *L)
+    : mSequence(Script::newSequence())
 {
     if (!Script::argBegin(L, className))
         return;
@@ -42,6 +42,7 @@ extern "C" {
 #include "imagestack.h"
 #include "sifteo/abi.h"
 #include "tracker.h"
+#include "assetcache.h"
 
 #include <iostream>
 
@@ -54,6 +55,22 @@ class Sound;
 class Tracker;
 
 
+/*
+ * ScriptOrder --
+ *
+ *    Orders script objects by when they were created. Everything we
+ *    collect from a script is kept in this order, so that our output
+ *    doesn't depend on where objects happen to land in memory.
+ */
+
+struct ScriptOrder {
+    template <typename T>
+    bool operator() (const T *a, const T *b) const {
+        return a->getSequence() < b->getSequence();
+    }
+};
+
+
 /*
  * Script --
  *
@@ -72,6 +89,13 @@ public:
     bool addOutput(const char *filename);
     void setVariable(const char *key, const char *value);
 
+    bool setCacheDirectory(const char *dir) {
+        return cache.setDirectory(dir, log);
+    }
+
+    // Creation order for script objects, see ScriptOrder
+    static unsigned newSequence();
+
  private:
     lua_State *L;
     Logger &log;
@@ -81,11 +105,11 @@ public:
     const char *outputSource;
     const char *outputProof;
 
-    std::set<Group*> groups;
-    std::set<Tracker*> trackers;
-    std::set<Sound*> sounds;
+    std::set<Group*, ScriptOrder> groups;
+    std::set<Tracker*, ScriptOrder> trackers;
+    std::set<Sound*, ScriptOrder> sounds;
     std::vector<ImageList> imageLists;
-
+    AssetCache cache;
 
     friend class Group;
     friend class Image;
@@ -96,6 +120,13 @@ public:
     bool collect();
     bool collectList(const char* name, int tableStackIndex);
 
+    AssetCache::Key groupKey(Group &group);
+    bool restoreGroup(Group &group, const AssetCache::Key &key, Logger &log);
+    void saveGroup(Group &group, const AssetCache::Key &key);
+    bool optimizeGroup(Group &group, Logger &log);
+
+    class CompileJob;
+
     static bool matchExtension(const char *filename, const char *ext);
 
     // Utilities for foolproof table argument unpacking
@@ -118,6 +149,8 @@ public:
 
 class Group {
 public:
+    typedef std::set<Image*, ScriptOrder> ImageSet;
+
     static const char className[];
     static Lunar<Group>::RegType methods[];
 
@@ -147,14 +180,16 @@ public:
         return mName;
     }
 
-    void addImage(Image *i) {
-        mImages.insert(i);
-    }
+    void addImage(Image *i);
 
-    const std::set<Image*> &getImages() const {
+    const ImageSet &getImages() const {
         return mImages;
     }
 
+    unsigned getSequence() const {
+        return mSequence;
+    }
+
     std::vector<uint8_t> &getLoadstream() {
         return mLoadstream;
     }
@@ -171,8 +206,9 @@ private:
     TilePool pool;
     bool fixed;
     std::string mName;
-    std::set<Image*> mImages;
+    ImageSet mImages;
     std::vector<uint8_t> mLoadstream;
+    unsigned mSequence;
 
     static const uint8_t gf84[];
 };
@@ -226,13 +262,41 @@ public:
         mInList = flag;
     }
 
+    unsigned getSequence() const {
+        return mSequence;
+    }
+
     const char *getClassName() const;
 
     uint16_t encodePinned() const;
     void encodeFlat(std::vector<uint16_t> &data) const;
-    bool encodeDUB(std::vector<uint16_t> &data, Logger &log, std::string &format) const;
+    bool encodeDUB(std::vector<uint16_t> &data, Logger &log, std::string &format,
+                   AssetCache *cache = NULL) const;
+
+    // Can we use DUB compression at all? If so, compressDUB() may run on any thread.
+    bool isCompressible() const;
+    void compressDUB(AssetCache *cache) const;
 
  private:
+    // Result of compressDUB(), reused by every encodeDUB()
+    struct DUBResult {
+        enum Type {
+            TOO_LARGE,
+            NOT_COMPRESSIBLE,
+            COMPRESSED,
+        };
+
+        DUBResult() : valid(false) {}
+
+        bool valid;
+        uint32_t type;
+        uint32_t tileCount;
+        uint32_t words;
+        double ratio;
+        std::vector<uint16_t> data;
+        std::string format;
+    };
+
     Group *mGroup;
     ImageStack mImages;
     TileOptions mTileOpt;
@@ -240,6 +304,8 @@ public:
     std::string mName;
     bool mIsFlat;
     bool mInList;
+    unsigned mSequence;
+    mutable DUBResult mDUB;
 
     void createGrids();
 
@@ -369,6 +435,30 @@ public:
         return mVolume;
     }
 
+    unsigned getSequence() const {
+        return mSequence;
+    }
+
+    /*
+     * Load and compress the audio data. May run on any thread. Results
+     * are valid only if this returns true.
+     */
+    bool encode(Logger &log, AssetCache *cache = NULL);
+
+    const std::vector<uint8_t> &getData() const {
+        return mData;
+    }
+
+    // Actual sample rate, after applying defaults
+    uint32_t getEncodedSampleRate() const {
+        return mEncodedSampleRate;
+    }
+
+    // Length of the uncompressed audio
+    uint32_t getNumSamples() const {
+        return mNumSamples;
+    }
+
 private:
     std::string mName;
     std::string mFile;
@@ -378,6 +468,11 @@ private:
     uint32_t mLoopLength;
     uint16_t mVolume;
     _SYSAudioLoopType mLoopType;
+    unsigned mSequence;
+
+    std::vector<uint8_t> mData;
+    uint32_t mEncodedSampleRate;
+    uint32_t mNumSamples;
 };
 
 class Tracker {
@@ -399,6 +494,10 @@ public:
         return mFile;
     }
 
+    unsigned getSequence() const {
+        return mSequence;
+    }
+
     const _SYSXMSong &getSong() const {
         assert(loader.song.nPatterns);
         return loader.song;
@@ -469,6 +568,7 @@ private:
     XmTrackerLoader loader;
 
     _SYSAudioLoopType loopType;
+    unsigned mSequence;
 };
 
 };  // namespace Stir
@@ -0,0 +1,179 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "threadpool.h"
+
+namespace Stir {
+
+unsigned ThreadPool::defaultSize = 0;
+
+
+ThreadPool &ThreadPool::instance()
+{
+    /*
+     * The pool lives until the process exits. Idle workers are just
+     * blocked on a condition variable, so there's no need to tear them
+     * down explicitly.
+     */
+
+    static ThreadPool *pool = NULL;
+
+    if (!pool) {
+        unsigned threads = defaultSize;
+        if (!threads)
+            threads = tthread::thread::hardware_concurrency();
+        pool = new ThreadPool(std::max(1u, threads));
+    }
+
+    return *pool;
+}
+
+void ThreadPool::setDefaultSize(unsigned threads)
+{
+    defaultSize = threads;
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    for (unsigned i = 1; i < threads; i++)
+        mThreads.push_back(new tthread::thread(threadEntry, this));
+}
+
+void ThreadPool::run(Job &job, unsigned count)
+{
+    if (mThreads.empty() || count < 2) {
+        for (unsigned i = 0; i < count; i++)
+            job.run(i);
+        return;
+    }
+
+    /*
+     * Hand out work in chunks, several per thread, so that a few
+     * slow indices don't leave everyone else idle.
+     */
+
+    Batch batch;
+    batch.job = &job;
+    batch.next = 0;
+    batch.count = count;
+    batch.chunk = std::max(1u, count / (size() * 4));
+    batch.finished = 0;
+
+    {
+        tthread::lock_guard<tthread::mutex> guard(mMutex);
+        mBatches.push_back(&batch);
+        mWake.notify_all();
+    }
+
+    // Help with our own batch, then wait for anything still in progress
+    work(batch);
+
+    tthread::lock_guard<tthread::mutex> guard(mMutex);
+    while (batch.finished < batch.count)
+        mDone.wait(mMutex);
+}
+
+bool ThreadPool::claim(Batch &batch, unsigned &begin, unsigned &end)
+{
+    // Must hold mMutex. Once a batch is fully claimed, it's unlisted.
+
+    if (batch.next >= batch.count)
+        return false;
+
+    begin = batch.next;
+    end = std::min(batch.count, begin + batch.chunk);
+    batch.next = end;
+
+    if (batch.next >= batch.count)
+        mBatches.remove(&batch);
+
+    return true;
+}
+
+void ThreadPool::work(Batch &batch)
+{
+    // The thread that owns a batch runs chunks of it until none are left
+
+    for (;;) {
+        unsigned begin, end;
+
+        {
+            tthread::lock_guard<tthread::mutex> guard(mMutex);
+            if (!claim(batch, begin, end))
+                return;
+        }
+
+        runChunk(batch, begin, end);
+    }
+}
+
+void ThreadPool::runChunk(Batch &batch, unsigned begin, unsigned end)
+{
+    /*
+     * Run one claimed chunk, and report it finished. Unless we own the
+     * Batch, it may go away as soon as we've reported our chunk, so
+     * don't touch it after that.
+     */
+
+    Job *job = batch.job;
+    for (unsigned i = begin; i < end; i++)
+        job->run(i);
+
+    tthread::lock_guard<tthread::mutex> guard(mMutex);
+    batch.finished += end - begin;
+    if (batch.finished == batch.count)
+        mDone.notify_all();
+}
+
+void ThreadPool::threadEntry(void *arg)
+{
+    ThreadPool *self = static_cast<ThreadPool*>(arg);
+
+    for (;;) {
+        Batch *batch;
+        unsigned begin, end;
+
+        {
+            /*
+             * Claim while still holding the lock we found the batch
+             * with. Listed batches always have work left. The most recent
+             * batch is usually the most deeply nested, and finishing it
+             * unblocks whoever is waiting on it.
+             */
+
+            tthread::lock_guard<tthread::mutex> guard(self->mMutex);
+            while (self->mBatches.empty())
+                self->mWake.wait(self->mMutex);
+
+            batch = self->mBatches.back();
+            self->claim(*batch, begin, end);
+        }
+
+        self->runChunk(*batch, begin, end);
+    }
+}
+
+};  // namespace Stir
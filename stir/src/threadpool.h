@@ -0,0 +1,103 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <vector>
+#include <list>
+#include "tinythread.h"
+
+namespace Stir {
+
+
+/*
+ * ThreadPool --
+ *
+ *    A fixed set of worker threads, used to run a Job over a range of
+ *    independent indices. The calling thread participates in the work,
+ *    and run() returns only after every index has been processed.
+ *
+ *    Jobs must not depend on the order in which indices are run. As long
+ *    as each index only writes its own results, the output is the same
+ *    no matter how many threads we have.
+ *
+ *    Jobs may call run() themselves. Nested batches share the same
+ *    workers: any idle thread picks up work from whichever batch has
+ *    some left, so e.g. compiling several asset groups at once can still
+ *    parallelize the tile search inside each group.
+ */
+
+class ThreadPool {
+ public:
+    class Job {
+     public:
+        virtual ~Job() {}
+        virtual void run(unsigned index) = 0;
+    };
+
+    // Shared pool, created on first use
+    static ThreadPool &instance();
+
+    // Override the default (one thread per CPU). Must be called before instance().
+    static void setDefaultSize(unsigned threads);
+
+    unsigned size() const {
+        // Total number of threads, including the caller
+        return mThreads.size() + 1;
+    }
+
+    void run(Job &job, unsigned count);
+
+ private:
+    ThreadPool(unsigned threads);
+
+    // One call to run(), with indices still being handed out or in progress
+    struct Batch {
+        Job *job;
+        unsigned next;
+        unsigned count;
+        unsigned chunk;
+        unsigned finished;
+    };
+
+    static unsigned defaultSize;
+
+    std::vector<tthread::thread*> mThreads;
+    tthread::mutex mMutex;
+    tthread::condition_variable mWake;
+    tthread::condition_variable mDone;
+    std::list<Batch*> mBatches;     // Batches with indices left to hand out
+
+    void work(Batch &batch);
+    bool claim(Batch &batch, unsigned &begin, unsigned &end);
+    void runChunk(Batch &batch, unsigned begin, unsigned end);
+    static void threadEntry(void *arg);
+};
+
+
+};  // namespace Stir
+
+#endif
@@ -34,6 +34,8 @@
 
 #include "tile.h"
 #include "tilecodec.h"
+#include "tilemetric.h"
+#include "threadpool.h"
 
 
 /*
@@ -62,26 +64,41 @@ namespace std {
 namespace Stir {
 
 std::tr1::unordered_map<Tile::Identity, TileRef> Tile::instances;
+static tthread::mutex instancesMutex;
 
 Tile::Tile(const Identity &id)
-    : mHasSobel(false), mHasDec4(false), mID(id)
-    {}
+    : mHasSobel(false), mHasDec4(false), mHasLab(false), mID(id)
+{
+    /*
+     * Tiles are shared by every pool that uses them, and pools may be
+     * optimized concurrently. Build all derived data up front, so that
+     * a Tile is truly read-only once it's been published.
+     */
+
+    constructPalette();
+    prepareErrorMetric();
+}
 
 TileRef Tile::instance(const Identity &id)
 {
     /*
      * Return an existing Tile matching the given identity, or create a new one if necessary.
      */
-     
-    std::tr1::unordered_map<Identity, TileRef>::iterator i = instances.find(id);
-        
-    if (i == instances.end()) {
-        TileRef tr(new Tile(id));
-        instances[id] = tr;
-        return tr;
-    } else {
-        return i->second;
+
+    {
+        tthread::lock_guard<tthread::mutex> guard(instancesMutex);
+        std::tr1::unordered_map<Identity, TileRef>::iterator i = instances.find(id);
+        if (i != instances.end())
+            return i->second;
     }
+
+    // Construct outside the lock. If we raced with another thread, theirs wins.
+    TileRef tr(new Tile(id));
+
+    tthread::lock_guard<tthread::mutex> guard(instancesMutex);
+    std::pair<std::tr1::unordered_map<Identity, TileRef>::iterator, bool> result =
+        instances.insert(std::make_pair(id, tr));
+    return result.first->second;
 }
 
 TileRef Tile::instance(const TileOptions &opt, uint8_t *rgba, size_t stride)
@@ -219,17 +236,20 @@ void Tile::constructSobel()
             float l12 = CIELab(pixelWrap(x  , y+1)).L;
             float l22 = CIELab(pixelWrap(x+1, y+1)).L;
 
-            mSobelGx[i] = -l00 +l20 -l01 -l01 +l21 +l21 -l02 +l22;
-            mSobelGy[i] = -l00 +l02 -l10 -l10 +l12 +l12 -l20 +l22;
+            double gx = -l00 +l20 -l01 -l01 +l21 +l21 -l02 +l22;
+            double gy = -l00 +l02 -l10 -l10 +l12 +l12 -l20 +l22;
+
+            mSobel[0][i] = gx;
+            mSobel[1][i] = gy;
 
-            mSobelTotal += mSobelGx[i] * mSobelGx[i];
-            mSobelTotal += mSobelGy[i] * mSobelGy[i];
+            mSobelTotal += gx * gx;
+            mSobelTotal += gy * gy;
         }
 
 #ifdef DEBUG_SOBEL
     for (i = 0; i < PIXELS; i++) {
-        int x = std::max(0, std::min(255, (int)(128 + mSobelGx[i])));
-        int y = std::max(0, std::min(255, (int)(128 + mSobelGy[i])));
+        int x = std::max(0, std::min(255, (int)(128 + mSobel[0][i])));
+        int y = std::max(0, std::min(255, (int)(128 + mSobel[1][i])));
         mPixels[i] = RGB565(x, y, (x+y)/2);
     }
 #endif
@@ -267,6 +287,22 @@ void Tile::constructDec4()
 #endif
 }
 
+void Tile::constructLab()
+{
+    /*
+     * Unpack every pixel to CIELab, in planar form, for fineMSE().
+     */
+
+    mHasLab = true;
+
+    for (unsigned i = 0; i < PIXELS; i++) {
+        CIELab lab(mID.pixels[i]);
+        mLab[0][i] = lab.L;
+        mLab[1][i] = lab.a;
+        mLab[2][i] = lab.b;
+    }
+}
+
 double Tile::errorMetric(Tile &other, double limit)
 {
     /*
@@ -277,36 +313,49 @@ double Tile::errorMetric(Tile &other, double limit)
      *
      * If we exceed 'limit', the test can exit early. This lets us
      * calculate the easy metrics first, and skip the rest if we're
-     * already over.
+     * already over. Every term is non-negative, so once a partial sum
+     * is over the limit, the final result is too.
      */
 
+    const double scale = 60.0;
+    const double coarseWeight = 0.450;
+    const double fineWeight = 0.025;
+    const double sobelWeight = 5.00;
+
+    // Limit in unscaled units, with a hair of slack for rounding
+    const double bound = limit / scale * (1 + 1e-12);
+
     double error = 0;
 
-    error += 0.450 * coarseMSE(other);
-    if (error > limit)
+    error += coarseWeight * coarseMSE(other);
+    if (error > bound)
         return DBL_MAX;
 
-    error += 0.025 * fineMSE(other);
-    if (error > limit)
+    error += fineWeight * fineMSE(other, (bound - error) / fineWeight);
+    if (error > bound)
         return DBL_MAX;
 
-    error += 5.00 * sobelError(other);
+    error += sobelWeight * sobelError(other);
 
-    return error * 60.0;
+    return error * scale;
 }
 
-double Tile::fineMSE(Tile &other)
+double Tile::fineMSE(Tile &other, double limit)
 {
     /*
      * A normal pixel-wise mean squared error metric.
      */
 
-    double error = 0;
+    if (!mHasLab)
+        constructLab();
+    if (!other.mHasLab)
+        other.constructLab();
 
-    for (unsigned i = 0; i < PIXELS; i++)
-        error += CIELab(mID.pixels[i]).meanSquaredError(CIELab(other.mID.pixels[i]));
+    double error = TileMetric::sumSquaredDiff(&mLab[0][0], &other.mLab[0][0],
+                                              3 * PIXELS, limit * PIXELS);
+    error /= PIXELS;
 
-    return error / PIXELS;
+    return error > limit ? DBL_MAX : error;
 }
 
 double Tile::coarseMSE(Tile &other)
@@ -315,17 +364,12 @@ double Tile::coarseMSE(Tile &other)
      * A reduced scale MSE metric using the 2x2 pixel decimated version of our tile.
      */
 
-    double error = 0;
-
     if (!mHasDec4)
         constructDec4();
     if (!other.mHasDec4)
         other.constructDec4();
 
-    for (unsigned i = 0; i < 4; i++)
-        error += mDec4[i].meanSquaredError(other.mDec4[i]);
-
-    return error / 4;
+    return TileMetric::sumSquaredDiff(&mDec4[0].L, &other.mDec4[0].L, 3 * 4) / 4;
 }
 
 double Tile::sobelError(Tile &other)
@@ -335,20 +379,13 @@ double Tile::sobelError(Tile &other)
      * differences using the Sobel operator.
      */
 
-    double error = 0;
-
     if (!mHasSobel)
         constructSobel();
     if (!other.mHasSobel)
         other.constructSobel();
 
-    for (unsigned i = 0; i < PIXELS; i++) {
-        double gx = mSobelGx[i] - other.mSobelGx[i];
-        double gy = mSobelGy[i] - other.mSobelGy[i];
+    double error = TileMetric::sumSquaredDiff(&mSobel[0][0], &other.mSobel[0][0], 2 * PIXELS);
 
-        error += gx * gx + gy * gy;
-    }
-    
     // Contrast difference over total contrast
     return error / (1 + mSobelTotal + other.mSobelTotal);
 }
@@ -394,7 +431,8 @@ const char *TilePalette::colorModeName(ColorMode m)
 }
 
 TileStack::TileStack()
-    : index(NO_INDEX), mPinned(false), mLossless(false)
+    : index(NO_INDEX), sequence(0), searchPending(false),
+      mPinned(false), mLossless(false)
     {}
 
 void TileStack::add(TileRef t)
@@ -471,32 +509,189 @@ void TileStack::computeMedian()
     }
 }
 
+/*
+ * Work items for the ThreadPool. Each one only writes its own slot in
+ * the output vector, so results don't depend on how work is divided.
+ */
+
+class TilePool::ErrorJob : public ThreadPool::Job {
+ public:
+    ErrorJob(Tile &t, double distance, const std::vector<Tile*> &medians,
+             std::vector<double> &errors)
+        : t(t), distance(distance), medians(medians), errors(errors) {}
+
+    void run(unsigned i) {
+        if (medians[i])
+            errors[i] = medians[i]->errorMetric(t, distance);
+    }
+
+ private:
+    Tile &t;
+    double distance;
+    const std::vector<Tile*> &medians;
+    std::vector<double> &errors;
+};
+
+class TilePool::ClosestJob : public ThreadPool::Job {
+ public:
+    ClosestJob(const TileStackIndex &index, const std::vector<TileRef> &queries,
+               bool escalate, std::vector<TilePool::Match> &results)
+        : index(index), queries(queries), escalate(escalate), results(results) {}
+
+    void run(unsigned i) {
+        Tile &t = *queries[i];
+        Match &m = results[i];
+        std::vector<TileStack*> candidates;
+
+        for (;;) {
+            index.search(t, m.distance, candidates);
+            TilePool::match(m, t, candidates);
+            if (m.stack || !escalate)
+                break;
+            m.distance *= 100;
+        }
+    }
+
+ private:
+    const TileStackIndex &index;
+    const std::vector<TileRef> &queries;
+    bool escalate;
+    std::vector<TilePool::Match> &results;
+};
+
+TileStack *TilePool::newStack()
+{
+    stackList.push_back(TileStack());
+    TileStack *s = &stackList.back();
+    s->sequence = nextSequence++;
+    searchIndex.touch(s);
+    return s;
+}
+
+void TilePool::resetStacks()
+{
+    searchIndex.clear();
+    stackList.clear();
+}
+
+void TilePool::prepareStacks()
+{
+    /*
+     * Get every stack ready for concurrent searches: calculate all
+     * medians, build their error metric data, and index them all.
+     */
+
+    for (std::list<TileStack>::iterator i = stackList.begin(); i != stackList.end(); i++)
+        i->median()->prepareErrorMetric();
+
+    searchIndex.rebuild(stackList);
+}
+
+void TilePool::match(Match &m, Tile &t, const std::vector<TileStack*> &candidates,
+                     const double *errors)
+{
+    /*
+     * Visit candidate stacks in order, keeping the last one with the lowest
+     * error, and stop early on a near-exact match. This is the same choice
+     * a plain scan over stackList would make, since the index only leaves
+     * out stacks that can't be accepted.
+     *
+     * If 'errors' is provided, it has precomputed errorMetric() results,
+     * with a negative value for any stack we still need to calculate here.
+     * Those precomputed with a larger limit are just as good: a stack can
+     * only be accepted if its full error is under the current distance.
+     */
+
+    const double epsilon = 1e-3;
+
+    for (unsigned i = 0; i < candidates.size() && !m.final; i++) {
+        TileStack *s = candidates[i];
+        double err;
+
+        if (errors && errors[i] >= 0)
+            err = errors[i];
+        else
+            err = s->median()->errorMetric(t, m.distance);
+
+        if (err <= m.distance) {
+            m.distance = err;
+            m.stack = s;
+
+            if (err < epsilon) {
+                // Not going to improve on this; early out.
+                m.final = true;
+            }
+        }
+    }
+}
+
 TileStack* TilePool::closest(TileRef t, double distance)
 {
     /*
      * Search for the closest tile set for the provided tile image.
      * Returns the tile stack, if any was found which meets the tile's
      * stated maximum MSE requirement.
+     *
+     * The index narrows this down to a list of candidate stacks. If
+     * there are still a lot of them, calculate errors for the ones with
+     * known medians in parallel. Medians that are out of date get
+     * recomputed lazily by match(), in order, just like before.
      */
 
-    const double epsilon = 1e-3;
-    TileStack *closest = NULL;
+    const unsigned parallelMin = 128;
 
-    for (std::list<TileStack>::iterator i = stackList.begin(); i != stackList.end(); i++) {
-        double err = i->median()->errorMetric(*t, distance);
+    if (searchIndex.isStale())
+        searchIndex.rebuild(stackList);
 
-        if (err <= distance) {
-            distance = err;
-            closest = &*i;
+    t->prepareErrorMetric();
 
-            if (distance < epsilon) {
-                // Not going to improve on this; early out.
-                break;
+    std::vector<TileStack*> candidates;
+    searchIndex.search(*t, distance, candidates);
+
+    Match m = { NULL, distance, false };
+    ThreadPool &pool = ThreadPool::instance();
+
+    if (pool.size() > 1 && candidates.size() >= parallelMin) {
+        std::vector<Tile*> medians(candidates.size());
+        std::vector<double> errors(candidates.size(), -1.0);
+
+        for (unsigned i = 0; i < candidates.size(); i++) {
+            TileStack *s = candidates[i];
+            if (s->cache) {
+                s->cache->prepareErrorMetric();
+                medians[i] = s->cache.get();
             }
         }
+
+        ErrorJob job(*t, distance, medians, errors);
+        pool.run(job, candidates.size());
+        match(m, *t, candidates, &errors[0]);
+
+    } else {
+        match(m, *t, candidates);
     }
 
-    return closest;
+    return m.stack;
+}
+
+void TilePool::closest(const std::vector<TileRef> &queries, std::vector<Match> &results,
+                       bool escalate)
+{
+    /*
+     * Find the closest stacks for many tiles at once, in parallel. Each
+     * result starts out holding the maximum distance for its query. With
+     * 'escalate', we keep increasing that distance until we find something.
+     *
+     * Stacks must not change during the search; call prepareStacks() first.
+     */
+
+    assert(queries.size() == results.size());
+
+    for (unsigned i = 0; i < queries.size(); i++)
+        queries[i]->prepareErrorMetric();
+
+    ClosestJob job(searchIndex, queries, escalate, results);
+    ThreadPool::instance().run(job, queries.size());
 }
 
 TileGrid::TileGrid(TilePool *pool)
@@ -593,13 +788,12 @@ void TilePool::optimizeFixedTiles(Logger &log)
      * All fixed tiles go, in order, into the final data structures.
      */
 
-    stackList.clear();
+    resetStacks();
     stackIndex.resize(numFixed);
     stackArray.resize(numFixed);
 
     for (unsigned i = 0; i < numFixed; ++i) {
-        stackList.push_back(TileStack());
-        TileStack *c = &stackList.back();
+        TileStack *c = newStack();
         c->add(tiles[i]);
         c->index = i;
         stackArray[i] = c;
@@ -612,30 +806,42 @@ void TilePool::optimizeFixedTiles(Logger &log)
 
     log.taskBegin("Matching fixed tiles");
 
-    for (unsigned serial = numFixed; serial < tiles.size(); ++serial) {
+    /*
+     * The fixed stacks never change, so every tile can be matched
+     * independently. Do this in parallel, in batches so we can still
+     * report progress.
+     *
+     * We have no specific upper limit on the error, so we could
+     * just start out by calling closest() with a distance of HUGE_VAL,
+     * but this breaks a lot of the early-out optimizations inside.
+     * It's more efficient if we increase the distance gradually.
+     */
 
-        /*
-         * We have no specific upper limit on the error, so we could
-         * just start out by calling closest() with a distance of HUGE_VAL,
-         * but this breaks a lot of the early-out optimizations inside.
-         * It's more efficient if we increase the distance gradually.
-         */
+    const unsigned batchSize = 256;
+    std::vector<TileRef> queries;
+    std::vector<Match> results;
+
+    prepareStacks();
 
-        double distance = 1.0f;
-        TileStack *c;
-        do {
-            c = closest(tiles[serial], distance);
-            distance *= 100;
-        } while (!c);
+    for (unsigned batch = numFixed; batch < tiles.size(); batch += batchSize) {
+        unsigned batchEnd = std::min<unsigned>(batch + batchSize, tiles.size());
 
-        tiles[serial] = c->median();
-        stackIndex.push_back(c);
+        queries.assign(tiles.begin() + batch, tiles.begin() + batchEnd);
+        Match m = { NULL, 1.0, false };
+        results.assign(queries.size(), m);
 
-        if (serial == tiles.size() - 1 || !(serial % 32)) {
-            log.taskProgress("%u of %u", serial - numFixed + 1, tiles.size() - numFixed);
+        closest(queries, results, true);
+
+        for (unsigned serial = batch; serial < batchEnd; ++serial) {
+            TileStack *c = results[serial - batch].stack;
+            tiles[serial] = c->median();
+            stackIndex.push_back(c);
         }
+
+        log.taskProgress("%u of %u", batchEnd - numFixed, tiles.size() - numFixed);
     }
 
+    searchIndex.clear();
     log.taskEnd();
 }
 
@@ -661,7 +867,7 @@ void TilePool::optimizeTiles(Logger &log)
 
     std::tr1::unordered_set<TileStack *> activeStacks;
 
-    stackList.clear();
+    resetStacks();
     stackIndex.clear();
     stackIndex.resize(tiles.size());
 
@@ -685,7 +891,38 @@ void TilePool::optimizeTilesPass(Logger &log,
     // A single pass from the multi-pass optimizeTiles() algorithm
 
     std::tr1::unordered_map<Tile *, TileStack *> memo;
-    
+    std::tr1::unordered_map<Tile *, Match> frozenMatches;
+    std::vector<TileStack *> freshStacks;
+
+    if (!gather && !pinned) {
+        /*
+         * When we aren't gathering, the only way stacks change during this
+         * pass is by adding fresh stacks for tiles that matched nothing.
+         * So, match every distinct tile against the existing stacks up front,
+         * in parallel. Below, we only need to check each tile against the
+         * fresh stacks that came before it, in order.
+         */
+
+        std::vector<TileRef> queries;
+        std::vector<Match> results;
+
+        for (Serial serial = 0; serial < tiles.size(); serial++) {
+            TileRef tr = tiles[serial];
+            if (tr->options().pinned == pinned && !frozenMatches.count(&*tr)) {
+                Match m = { NULL, tr->options().getMaxMSE(), false };
+                frozenMatches[&*tr] = m;
+                queries.push_back(tr);
+                results.push_back(m);
+            }
+        }
+
+        prepareStacks();
+        closest(queries, results, false);
+
+        for (unsigned i = 0; i < queries.size(); i++)
+            frozenMatches[&*queries[i]] = results[i];
+    }
+
     for (Serial serial = 0; serial < tiles.size(); serial++) {
         TileRef tr = tiles[serial];
 
@@ -716,7 +953,13 @@ void TilePool::optimizeTilesPass(Logger &log,
 
                 std::tr1::unordered_map<Tile *, TileStack *>::iterator i = memo.find(&*tr);
                 if (i == memo.end()) {
-                    c = closest(tr, tr->options().getMaxMSE());
+                    if (gather) {
+                        c = closest(tr, tr->options().getMaxMSE());
+                    } else {
+                        Match m = frozenMatches[&*tr];
+                        match(m, *tr, freshStacks);
+                        c = m.stack;
+                    }
                     memo[&*tr] = c;
                 } else {
                     c = memo[&*tr];
@@ -725,12 +968,13 @@ void TilePool::optimizeTilesPass(Logger &log,
 
             if (!c) {
                 // Need to create a fresh stack
-                stackList.push_back(TileStack());
-                c = &stackList.back();
+                c = newStack();
                 c->add(tr);
+                freshStacks.push_back(c);
             } else if (gather) {
                 // Add to an existing stack
                 c->add(tr);
+                searchIndex.touch(c);
             }
 
             if (!gather || pinned) {
@@ -752,6 +996,7 @@ void TilePool::optimizeTilesPass(Logger &log,
     if (!gather) {
         // Permanently delete unused stacks
 
+        searchIndex.clear();
         std::list<TileStack>::iterator i = stackList.begin();
 
         while (i != stackList.end()) {
@@ -993,5 +1238,108 @@ void TilePool::calculateCRC(std::vector<uint8_t> &crcbuf) const
     }
 }
 
+void TilePool::fingerprint(AssetCache::Key &key) const
+{
+    /*
+     * optimize() is a pure function of our tiles and their options, in
+     * Serial order, plus the number of fixed tiles.
+     */
+
+    key.add(uint32_t(numFixed));
+    key.add(uint32_t(tiles.size()));
+
+    for (unsigned s = 0; s < tiles.size(); s++) {
+        const Tile &t = *tiles[s];
+        const TileOptions &opt = t.options();
+        uint16_t pixels[Tile::PIXELS];
+
+        for (unsigned i = 0; i < Tile::PIXELS; i++)
+            pixels[i] = t.pixel(i).value;
+
+        key.add(pixels, sizeof pixels);
+        key.add(opt.quality);
+        key.add(uint32_t(opt.pinned | (opt.chromaKey << 1)));
+    }
+}
+
+void TilePool::save(AssetCache::Record &rec) const
+{
+    // Every optimized tile image, by Index
+    rec.put(uint32_t(stackArray.size()));
+
+    for (unsigned i = 0; i < stackArray.size(); i++) {
+        const Tile &t = *tile(i);
+        const TileOptions &opt = t.options();
+        std::vector<uint16_t> pixels(Tile::PIXELS);
+
+        for (unsigned j = 0; j < Tile::PIXELS; j++)
+            pixels[j] = t.pixel(j).value;
+
+        rec.put(pixels);
+        rec.put(opt.quality);
+        rec.put(uint32_t(opt.pinned | (opt.chromaKey << 1)));
+    }
+
+    // Index for each Serial
+    std::vector<uint16_t> indices(stackIndex.size());
+    for (unsigned s = 0; s < stackIndex.size(); s++)
+        indices[s] = stackIndex[s]->index;
+    rec.put(indices);
+}
+
+bool TilePool::restore(AssetCache::Record &rec)
+{
+    /*
+     * Rebuild the state optimize() would have left us in, with a
+     * single-tile stack for each optimized tile. Nothing changes
+     * unless the whole record checks out.
+     */
+
+    std::vector<TileRef> images(rec.getU32());
+
+    for (unsigned i = 0; i < images.size(); i++) {
+        Tile::Identity id;
+        std::vector<uint16_t> pixels;
+
+        rec.get(pixels);
+        id.options.quality = rec.getDouble();
+        uint32_t flags = rec.getU32();
+        id.options.pinned = (flags & 1) != 0;
+        id.options.chromaKey = (flags & 2) != 0;
+
+        if (pixels.size() != Tile::PIXELS)
+            return false;
+        for (unsigned j = 0; j < Tile::PIXELS; j++)
+            id.pixels[j] = pixels[j];
+
+        images[i] = Tile::instance(id);
+    }
+
+    std::vector<uint16_t> indices;
+    rec.get(indices);
+
+    if (!rec.isValid() || indices.size() != tiles.size())
+        return false;
+    for (unsigned s = 0; s < indices.size(); s++)
+        if (indices[s] >= images.size())
+            return false;
+
+    resetStacks();
+    stackArray.resize(images.size());
+    stackIndex.resize(indices.size());
+
+    for (unsigned i = 0; i < images.size(); i++) {
+        TileStack *c = newStack();
+        c->add(images[i]);
+        c->index = i;
+        stackArray[i] = c;
+    }
+
+    for (unsigned s = 0; s < indices.size(); s++)
+        stackIndex[s] = stackArray[indices[s]];
+
+    return true;
+}
+
 
 };  // namespace Stir
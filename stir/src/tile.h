@@ -36,6 +36,8 @@
 
 #include "color.h"
 #include "logger.h"
+#include "tileindex.h"
+#include "assetcache.h"
 
 namespace Stir {
 
@@ -185,10 +187,27 @@ class Tile {
 
     double errorMetric(Tile &other, double limit=DBL_MAX);
 
-    double fineMSE(Tile &other); 
+    // fineMSE() returns DBL_MAX as soon as it's sure to be over 'limit'
+    double fineMSE(Tile &other, double limit=DBL_MAX);
     double coarseMSE(Tile &other);
     double sobelError(Tile &other);
 
+    // Build everything errorMetric() would otherwise construct lazily. After
+    // this, comparisons only read from the tile, and can run on any thread.
+    void prepareErrorMetric() {
+        if (!mHasDec4)
+            constructDec4();
+        if (!mHasLab)
+            constructLab();
+        if (!mHasSobel)
+            constructSobel();
+    }
+
+    const CIELab *dec4() const {
+        // Only valid after prepareErrorMetric() or coarseMSE()
+        return mDec4;
+    }
+
     TileRef reduce(ColorReducer &reducer) const;
 
  private:
@@ -199,16 +218,18 @@ class Tile {
     void constructPalette();
     void constructSobel();
     void constructDec4();
+    void constructLab();
 
     friend class TileStack;
     
     bool mHasSobel;
     bool mHasDec4;
+    bool mHasLab;
     TilePalette mPalette;
     Identity mID;
     CIELab mDec4[4];
-    double mSobelGx[PIXELS];
-    double mSobelGy[PIXELS];
+    double mLab[3][PIXELS];     // Planar CIELab pixels: L, a, b
+    double mSobel[2][PIXELS];   // Sobel gradients: Gx, Gy
     double mSobelTotal;
 };
 
@@ -259,10 +280,13 @@ class TileStack {
     static const unsigned NO_INDEX = (unsigned)-1;
 
     friend class TilePool;
+    friend class TileStackIndex;
 
     std::vector<TileRef> tiles;
     TileRef cache;
     unsigned index;
+    unsigned sequence;      // Creation order, same as the order in TilePool::stackList
+    bool searchPending;     // On TileStackIndex's pending list
     bool mPinned;
     bool mLossless;
 
@@ -284,7 +308,7 @@ class TilePool {
     // Current value of SysLFS::TILES_PER_ASSET_SLOT from firmware
     static const unsigned MAX_SIZE = 4096;
 
-    TilePool() : numFixed(0) {}
+    TilePool() : numFixed(0), nextSequence(0) {}
 
     // Normal optimization flow
     void optimize(Logger &log);
@@ -335,13 +359,34 @@ class TilePool {
 
     void calculateCRC(std::vector<uint8_t> &crcbuf) const;
 
+    /*
+     * Reusing optimize() results from an AssetCache. The fingerprint
+     * covers everything optimize() depends on; save() and restore()
+     * capture its results.
+     */
+    void fingerprint(AssetCache::Key &key) const;
+    void save(AssetCache::Record &rec) const;
+    bool restore(AssetCache::Record &rec);
+
  private:
     unsigned numFixed;
+    unsigned nextSequence;
 
     std::list<TileStack> stackList;       // Reorderable list of all stacked tiles
     std::vector<TileStack*> stackArray;   // Vector version of 'stackList', built after indices are known.
     std::vector<TileRef> tiles;           // Current best image for each tile, by Serial
     std::vector<TileStack*> stackIndex;   // Current optimized stack for each tile, by Serial
+    TileStackIndex searchIndex;           // Spatial index over stackList, for closest()
+
+    class ErrorJob;
+    class ClosestJob;
+
+    // Result of a search for the closest stack to one tile
+    struct Match {
+        TileStack *stack;
+        double distance;
+        bool final;     // Took the early-out; no later stack can win
+    };
  
     void optimizeFixedTiles(Logger &log);
     void optimizePalette(Logger &log);
@@ -352,7 +397,16 @@ class TilePool {
                            std::tr1::unordered_set<TileStack *> &activeStacks,
                            bool gather, bool pinned);
 
+    TileStack *newStack();
+    void resetStacks();
+    void prepareStacks();
+
     TileStack *closest(TileRef t, double distance);
+    void closest(const std::vector<TileRef> &queries, std::vector<Match> &results,
+                 bool escalate);
+
+    static void match(Match &m, Tile &t, const std::vector<TileStack*> &candidates,
+                      const double *errors = NULL);
 };
 
 
@@ -0,0 +1,216 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "tileindex.h"
+#include "tile.h"
+
+namespace Stir {
+
+
+TileStackIndex::TileStackIndex() {}
+
+void TileStackIndex::clear()
+{
+    entries.clear();
+    nodes.clear();
+    pending.clear();
+}
+
+void TileStackIndex::touch(TileStack *s)
+{
+    if (!s->searchPending) {
+        s->searchPending = true;
+        pending.push_back(s);
+    }
+}
+
+bool TileStackIndex::isStale() const
+{
+    /*
+     * Only count pending stacks whose median is known. The rest can't
+     * be indexed yet anyway, and the optimizer may never get around to
+     * computing their medians.
+     */
+
+    unsigned settled = 0;
+    for (unsigned i = 0; i < pending.size(); i++)
+        if (pending[i]->cache)
+            settled++;
+
+    return settled >= MIN_STALE + entries.size() / 8;
+}
+
+void TileStackIndex::rebuild(std::list<TileStack> &stacks)
+{
+    clear();
+
+    for (std::list<TileStack>::iterator i = stacks.begin(); i != stacks.end(); i++) {
+        TileStack &s = *i;
+
+        if (s.cache) {
+            Entry e;
+            s.cache->prepareErrorMetric();
+            features(*s.cache, e.f);
+            e.stack = &s;
+            e.tile = s.cache.get();
+            entries.push_back(e);
+            s.searchPending = false;
+        } else {
+            s.searchPending = true;
+            pending.push_back(&s);
+        }
+    }
+
+    if (!entries.empty())
+        build(0, entries.size());
+}
+
+unsigned TileStackIndex::build(unsigned begin, unsigned end)
+{
+    unsigned n = nodes.size();
+    nodes.push_back(Node());
+    nodes[n].begin = begin;
+    nodes[n].end = end;
+    nodes[n].left = 0;
+    nodes[n].right = 0;
+
+    if (end - begin <= LEAF_SIZE)
+        return n;
+
+    // Split on the axis with the greatest spread
+    double minF[DIMENSIONS], maxF[DIMENSIONS];
+    for (unsigned a = 0; a < DIMENSIONS; a++)
+        minF[a] = maxF[a] = entries[begin].f[a];
+
+    for (unsigned i = begin + 1; i < end; i++)
+        for (unsigned a = 0; a < DIMENSIONS; a++) {
+            minF[a] = std::min(minF[a], entries[i].f[a]);
+            maxF[a] = std::max(maxF[a], entries[i].f[a]);
+        }
+
+    unsigned axis = 0;
+    for (unsigned a = 1; a < DIMENSIONS; a++)
+        if (maxF[a] - minF[a] > maxF[axis] - minF[axis])
+            axis = a;
+
+    unsigned mid = (begin + end) / 2;
+    std::nth_element(entries.begin() + begin, entries.begin() + mid,
+                     entries.begin() + end, AxisOrder(axis));
+
+    nodes[n].axis = axis;
+    nodes[n].split = entries[mid].f[axis];
+
+    unsigned left = build(begin, mid);
+    unsigned right = build(mid, end);
+    nodes[n].left = left;
+    nodes[n].right = right;
+
+    return n;
+}
+
+void TileStackIndex::search(const Tile &t, double distance, std::vector<TileStack*> &out) const
+{
+    double q[DIMENSIONS];
+    features(t, q);
+
+    out.clear();
+    if (!nodes.empty())
+        searchNode(0, q, radius2(distance), out);
+
+    // Stacks that changed since the last rebuild are always candidates
+    out.insert(out.end(), pending.begin(), pending.end());
+
+    std::sort(out.begin(), out.end(), earlier);
+}
+
+void TileStackIndex::searchNode(unsigned n, const double *q, double r2,
+                                std::vector<TileStack*> &out) const
+{
+    const Node &node = nodes[n];
+
+    if (!node.left) {
+        for (unsigned i = node.begin; i < node.end; i++) {
+            const Entry &e = entries[i];
+            if (!e.stack->searchPending && distance2(q, e.f) <= r2)
+                out.push_back(e.stack);
+        }
+        return;
+    }
+
+    // Everything on the left is <= split, everything on the right is >= split.
+    double d = q[node.axis] - node.split;
+    unsigned nearer = d < 0 ? node.left : node.right;
+    unsigned farther = d < 0 ? node.right : node.left;
+
+    searchNode(nearer, q, r2, out);
+    if (d * d <= r2)
+        searchNode(farther, q, r2, out);
+}
+
+bool TileStackIndex::earlier(const TileStack *a, const TileStack *b)
+{
+    return a->sequence < b->sequence;
+}
+
+void TileStackIndex::features(const Tile &t, double *f)
+{
+    const CIELab *dec4 = t.dec4();
+
+    for (unsigned i = 0; i < 4; i++)
+        for (unsigned a = 0; a < 3; a++)
+            *(f++) = dec4[i].axis[a];
+}
+
+double TileStackIndex::distance2(const double *a, const double *b)
+{
+    double sum = 0;
+    for (unsigned i = 0; i < DIMENSIONS; i++) {
+        double d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+double TileStackIndex::radius2(double distance)
+{
+    /*
+     * errorMetric() weights coarseMSE() by 0.45 and scales the total by 60.
+     * coarseMSE() is our squared feature distance, divided by the number
+     * of 2x2 samples. Anything farther than this can't be accepted.
+     *
+     * The sums here are done in a different order than coarseMSE(), so
+     * leave a little slack for rounding. Being generous only costs us an
+     * extra errorMetric() call.
+     */
+
+    const double scale = 0.45 * 60.0 / 4;
+    const double slack = 1e-9;
+
+    return (distance * (1 + slack) + slack) / scale;
+}
+
+
+};  // namespace Stir
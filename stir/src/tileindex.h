@@ -0,0 +1,125 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TILEINDEX_H
+#define _TILEINDEX_H
+
+#include <list>
+#include <vector>
+
+namespace Stir {
+
+class Tile;
+class TileStack;
+
+
+/*
+ * TileStackIndex --
+ *
+ *    A k-d tree over the decimated 2x2 CIELab image of each stack's
+ *    median, used by TilePool::closest() to skip stacks that can't
+ *    possibly be within the requested distance.
+ *
+ *    Every term of Tile::errorMetric() is non-negative, and the first
+ *    one is a fixed multiple of the squared distance between these
+ *    12-dimensional feature vectors. So, a range query on the tree gives
+ *    an exact superset of the stacks errorMetric() could accept. The
+ *    actual error still has to be calculated for each candidate.
+ *
+ *    Stacks change while the optimizer is gathering tiles. Rather than
+ *    rebalancing, stacks that were created or modified since the last
+ *    rebuild() are kept on a pending list, and they're always returned
+ *    as candidates. We rebuild once enough of them have settled.
+ */
+
+class TileStackIndex {
+ public:
+    static const unsigned DIMENSIONS = 12;
+
+    TileStackIndex();
+
+    void clear();
+
+    // Index every stack with a current median. Others remain pending.
+    void rebuild(std::list<TileStack> &stacks);
+
+    // A stack was created, or tiles were added to it.
+    void touch(TileStack *s);
+
+    // Would a rebuild() be worthwhile?
+    bool isStale() const;
+
+    /*
+     * Find all stacks which might be within 'distance' of tile 't',
+     * according to errorMetric(). Results are sorted in stack creation
+     * order. Does not modify any tiles or stacks, so it may run
+     * concurrently with other searches, as long as 't' has had
+     * prepareErrorMetric() called on it.
+     */
+    void search(const Tile &t, double distance, std::vector<TileStack*> &out) const;
+
+ private:
+    static const unsigned LEAF_SIZE = 8;
+    static const unsigned MIN_STALE = 32;
+
+    struct Entry {
+        double f[DIMENSIONS];
+        TileStack *stack;
+        const Tile *tile;
+    };
+
+    struct Node {
+        unsigned begin, end;        // Range of entries
+        unsigned left, right;       // Child nodes, or zero for a leaf
+        unsigned axis;
+        double split;
+    };
+
+    struct AxisOrder {
+        unsigned axis;
+        AxisOrder(unsigned axis) : axis(axis) {}
+        bool operator() (const Entry &a, const Entry &b) const {
+            return a.f[axis] < b.f[axis];
+        }
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Node> nodes;
+    std::vector<TileStack*> pending;
+
+    unsigned build(unsigned begin, unsigned end);
+    void searchNode(unsigned n, const double *q, double r2,
+                    std::vector<TileStack*> &out) const;
+
+    static bool earlier(const TileStack *a, const TileStack *b);
+    static void features(const Tile &t, double *f);
+    static double distance2(const double *a, const double *b);
+    static double radius2(double distance);
+};
+
+
+};  // namespace Stir
+
+#endif
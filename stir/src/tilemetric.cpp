@@ -0,0 +1,138 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include "tilemetric.h"
+
+namespace Stir {
+
+#ifdef __SSE2__
+TileMetric::Kernel TileMetric::kernel = TileMetric::sse2Kernel;
+TileMetric::Implementation TileMetric::currentImpl = TileMetric::SSE2;
+#else
+TileMetric::Kernel TileMetric::kernel = TileMetric::scalarKernel;
+TileMetric::Implementation TileMetric::currentImpl = TileMetric::SCALAR;
+#endif
+
+
+bool TileMetric::select(Implementation impl)
+{
+    switch (impl) {
+
+    case SCALAR:
+        kernel = scalarKernel;
+        break;
+
+#ifdef __SSE2__
+    case SSE2:
+        kernel = sse2Kernel;
+        break;
+#endif
+
+    default:
+        return false;
+    }
+
+    currentImpl = impl;
+    return true;
+}
+
+const char *TileMetric::name(Implementation impl)
+{
+    switch (impl) {
+    case SCALAR:    return "scalar";
+    case SSE2:      return "SSE2";
+    default:        return "<invalid>";
+    }
+}
+
+double TileMetric::scalarKernel(const double *a, const double *b,
+                                unsigned count, double limit)
+{
+    assert((count % GRANULARITY) == 0);
+
+    // Four partial sums, arranged just like the SSE2 lanes
+    double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+
+    for (unsigned block = 0; block < count; block += BLOCK_SIZE) {
+        unsigned end = block + BLOCK_SIZE < count ? block + BLOCK_SIZE : count;
+
+        for (unsigned i = block; i < end; i += 4) {
+            double d0 = a[i] - b[i];
+            double d1 = a[i+1] - b[i+1];
+            double d2 = a[i+2] - b[i+2];
+            double d3 = a[i+3] - b[i+3];
+            sum0 += d0 * d0;
+            sum1 += d1 * d1;
+            sum2 += d2 * d2;
+            sum3 += d3 * d3;
+        }
+
+        if (end < count) {
+            double sum = (sum0 + sum2) + (sum1 + sum3);
+            if (sum > limit)
+                return sum;
+        }
+    }
+
+    return (sum0 + sum2) + (sum1 + sum3);
+}
+
+#ifdef __SSE2__
+
+double TileMetric::sse2Kernel(const double *a, const double *b,
+                              unsigned count, double limit)
+{
+    assert((count % GRANULARITY) == 0);
+
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+
+    for (unsigned block = 0; block < count; block += BLOCK_SIZE) {
+        unsigned end = block + BLOCK_SIZE < count ? block + BLOCK_SIZE : count;
+
+        for (unsigned i = block; i < end; i += 4) {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+            __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+        }
+
+        if (end < count) {
+            __m128d acc = _mm_add_pd(acc0, acc1);
+            double sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+            if (sum > limit)
+                return sum;
+        }
+    }
+
+    __m128d acc = _mm_add_pd(acc0, acc1);
+    return _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+}
+
+#endif  // __SSE2__
+
+
+};  // namespace Stir
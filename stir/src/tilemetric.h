@@ -0,0 +1,99 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * STIR -- Sifteo Tiled Image Reducer
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TILEMETRIC_H
+#define _TILEMETRIC_H
+
+#include <float.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Stir {
+
+
+/*
+ * TileMetric --
+ *
+ *    Inner loop for Tile's error metrics. Every metric is a sum of squared
+ *    differences between two arrays of doubles that each Tile keeps
+ *    precomputed: its decimated 2x2 image, its CIELab pixels in planar
+ *    form, and its Sobel gradients.
+ *
+ *    There's a portable scalar implementation, and an SSE2 one that we
+ *    use by default where the compiler supports it. Both can stop early,
+ *    once the sum is over a limit.
+ */
+
+class TileMetric {
+ public:
+    enum Implementation {
+        SCALAR,
+        SSE2,
+        NUM_IMPLEMENTATIONS
+    };
+
+    // Counts must be a multiple of this
+    static const unsigned GRANULARITY = 4;
+
+    /*
+     * Sum of (a[i] - b[i])^2 for 'count' elements. If the sum goes over
+     * 'limit', we may return early with any partial sum that's over it.
+     */
+    static double sumSquaredDiff(const double *a, const double *b,
+                                 unsigned count, double limit = DBL_MAX) {
+        return kernel(a, b, count, limit);
+    }
+
+    // Switch implementations. Returns false if it isn't available.
+    static bool select(Implementation impl);
+
+    static Implementation current() {
+        return currentImpl;
+    }
+
+    static const char *name(Implementation impl);
+
+ private:
+    typedef double (*Kernel)(const double *a, const double *b, unsigned count, double limit);
+
+    // How often to compare against the limit
+    static const unsigned BLOCK_SIZE = 16;
+
+    static Kernel kernel;
+    static Implementation currentImpl;
+
+    static double scalarKernel(const double *a, const double *b, unsigned count, double limit);
+
+#ifdef __SSE2__
+    static double sse2Kernel(const double *a, const double *b, unsigned count, double limit);
+#endif
+};
+
+
+};  // namespace Stir
+
+#endif
@@ -70,7 +70,7 @@ bool XmTrackerLoader::load(const char *pFilename, Logger &pLog)
 
 /*
  */
-void XmTrackerLoader::deduplicate(std::set<Tracker*> trackers, Logger &log)
+void XmTrackerLoader::deduplicate(const std::vector<Tracker*> &trackers, Logger &log)
 {
     log.taskBegin("Deduplicating samples");
     unsigned dups = 0, savings = 0;
@@ -88,8 +88,8 @@ void XmTrackerLoader::deduplicate(std::set<Tracker*> trackers, Logger &log)
                 log.taskProgress("%u duplicates found (saved %5.02f kiB)", ++dups, savings / 1024.0f);
 
                 // Find the module->instrument using this sample and redirect it from j to i
-                for (std::set<Tracker*>::iterator t = trackers.begin(); t != trackers.end(); t++) {
-                    Tracker *tracker = *t;
+                for (unsigned t = 0; t < trackers.size(); t++) {
+                    Tracker *tracker = trackers[t];
                     for (unsigned k = 0; k < tracker->loader.instruments.size(); k++) {
                         _SYSXMInstrument &instrument = tracker->loader.instruments[k];
                         if (instrument.sample.pData == j) instrument.sample.pData = i;
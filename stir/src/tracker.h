@@ -43,7 +43,7 @@ class XmTrackerLoader {
 public:
     XmTrackerLoader() : log(0), size(0) {}
     bool load(const char *filename, Logger &pLog);
-    static void deduplicate(std::set<Tracker*> trackers, Logger &log);
+    static void deduplicate(const std::vector<Tracker*> &trackers, Logger &log);
 
 private:
     friend class Tracker;
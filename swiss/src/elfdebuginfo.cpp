@@ -31,6 +31,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <stdio.h>
 
 
@@ -46,6 +47,8 @@ void ELFDebugInfo::clear()
     mappedFile.unmap();
     sections.clear();
     sectionMap.clear();
+    symbolIndex.clear();
+    symbolIndexValid = false;
 }
 
 bool ELFDebugInfo::copyProgramBytes(uint32_t byteOffset, uint8_t *dest, uint32_t length) const
@@ -189,36 +192,15 @@ bool ELFDebugInfo::findNearestSymbol(uint32_t address,
     // If nothing is found, we still fill in the output buffer and name
     // with "(unknown)" and zeroes, but 'false' is returned.
 
-    const Elf::SectionHeader *SI = findSection(".symtab");
-    if (SI) {
-        Elf::Symbol currentSym;
-        const uint32_t worstOffset = (uint32_t) -1;
-        uint32_t bestOffset = worstOffset;
-
-        for (unsigned index = 0;; index++) {
-            uint32_t tableOffset = index * sizeof currentSym;
-
-            if (tableOffset + sizeof currentSym > SI->sh_size ||
-                !copyProgramBytes(
-                    SI->sh_offset + tableOffset,
-                    (uint8_t*) &currentSym, sizeof currentSym))
-                break;
-
-            // Strip the Thumb bit from function symbols.
-            if ((currentSym.st_info & 0xF) == Elf::STT_FUNC)
-                currentSym.st_value &= ~1;
-
-            uint32_t addrOffset = address - currentSym.st_value;
-            if (addrOffset < currentSym.st_size && addrOffset < bestOffset) {
-                symbol = currentSym;
-                bestOffset = addrOffset;
-            }
-        }
-
-        if (bestOffset != worstOffset) {
-            name = readString(".strtab", symbol.st_name);
-            return true;
+    SymbolEntry *entry = lookupSymbol(address);
+    if (entry) {
+        if (!entry->hasName) {
+            entry->name = readString(".strtab", entry->sym.st_name);
+            entry->hasName = true;
         }
+        symbol = entry->sym;
+        name = entry->name;
+        return true;
     }
 
     memset(&symbol, 0, sizeof symbol);
@@ -226,6 +208,94 @@ bool ELFDebugInfo::findNearestSymbol(uint32_t address,
     return false;
 }
 
+void ELFDebugInfo::buildSymbolIndex() const
+{
+    /*
+     * Read the whole symbol table once, keeping only symbols that cover
+     * some address range. This is the same set of candidates a linear
+     * search would consider. Ties are sorted by table order, so among
+     * symbols at the same address the first one in the table still wins.
+     */
+
+    symbolIndex.clear();
+    symbolIndexValid = true;
+
+    const Elf::SectionHeader *SI = findSection(".symtab");
+    if (!SI)
+        return;
+
+    std::vector<Elf::Symbol> symbols;
+    std::vector<std::pair<uint32_t, uint32_t> > order;   // (Address, table order)
+
+    for (unsigned index = 0;; index++) {
+        Elf::Symbol sym;
+        uint32_t tableOffset = index * sizeof sym;
+
+        if (tableOffset + sizeof sym > SI->sh_size ||
+            !copyProgramBytes(
+                SI->sh_offset + tableOffset,
+                (uint8_t*) &sym, sizeof sym))
+            break;
+
+        if (!sym.st_size)
+            continue;
+
+        // Strip the Thumb bit from function symbols.
+        if ((sym.st_info & 0xF) == Elf::STT_FUNC)
+            sym.st_value &= ~1;
+
+        order.push_back(std::make_pair(sym.st_value, uint32_t(symbols.size())));
+        symbols.push_back(sym);
+    }
+
+    std::sort(order.begin(), order.end());
+
+    SymbolEntry entry;
+    entry.hasName = false;
+    entry.hasDemangledName = false;
+    symbolIndex.reserve(order.size());
+
+    uint64_t coverEnd = 0;
+    for (unsigned i = 0, e = order.size(); i != e; ++i) {
+        entry.sym = symbols[order[i].second];
+        coverEnd = std::max<uint64_t>(coverEnd, uint64_t(entry.sym.st_value) + entry.sym.st_size);
+        entry.coverEnd = coverEnd;
+        symbolIndex.push_back(entry);
+    }
+}
+
+ELFDebugInfo::SymbolEntry *ELFDebugInfo::lookupSymbol(uint32_t address) const
+{
+    /*
+     * Find the symbol containing 'address' with the highest starting
+     * address, i.e. the smallest offset. Returns NULL if there is none.
+     */
+
+    if (!symbolIndexValid)
+        buildSymbolIndex();
+
+    symbolIndex_t::iterator I = std::upper_bound(symbolIndex.begin(),
+        symbolIndex.end(), address, SymbolEntry::addressBefore);
+    SymbolEntry *best = 0;
+
+    while (I != symbolIndex.begin()) {
+        --I;
+
+        // Nothing at or before this point reaches 'address'?
+        if (I->coverEnd <= address)
+            break;
+
+        // Already found the best start address; only look for earlier ties.
+        if (best && I->sym.st_value != best->sym.st_value)
+            break;
+
+        if (address - I->sym.st_value < I->sym.st_size)
+            best = &*I;
+    }
+
+    return best;
+}
+
 
 bool ELFDebugInfo::metadataString(uint16_t key, std::string &s)
 {
@@ -288,12 +358,19 @@ uint8_t* ELFDebugInfo::metadata(uint16_t key, uint32_t &actualSize)
 
 std::string ELFDebugInfo::formatAddress(uint32_t address) const
 {
-    Elf::Symbol symbol;
-    std::string name;
-
-    findNearestSymbol(address, symbol, name);
-    demangle(name);
-    uint32_t offset = address - symbol.st_value;
+    std::string name = "(unknown)";
+    uint32_t offset = address;
+
+    SymbolEntry *entry = lookupSymbol(address);
+    if (entry) {
+        if (!entry->hasDemangledName) {
+            entry->demangledName = readString(".strtab", entry->sym.st_name);
+            demangle(entry->demangledName);
+            entry->hasDemangledName = true;
+        }
+        name = entry->demangledName;
+        offset = address - entry->sym.st_value;
+    }
 
     if (offset != 0) {
         char buf[16];
@@ -35,6 +35,8 @@
 
 class ELFDebugInfo {
 public:
+    ELFDebugInfo() : symbolIndexValid(false) {}
+
     void clear();
     bool init(const char *elfPath);
 
@@ -55,11 +57,36 @@ private:
     sections_t sections;
     sectionMap_t sectionMap;
 
+    /*
+     * Sorted index of every symbol with a nonzero size, built on the first
+     * lookup after init(). Overlapping symbols are allowed; 'coverEnd' lets
+     * a lookup stop scanning backwards as soon as nothing earlier can
+     * contain the address. Names are read and demangled on demand.
+     */
+    struct SymbolEntry {
+        Elf::Symbol sym;
+        uint64_t coverEnd;          // Highest end address of this or any earlier entry
+        std::string name;
+        std::string demangledName;
+        bool hasName;
+        bool hasDemangledName;
+
+        static bool addressBefore(uint32_t address, const SymbolEntry &entry) {
+            return address < entry.sym.st_value;
+        }
+    };
+
+    typedef std::vector<SymbolEntry> symbolIndex_t;
+    mutable symbolIndex_t symbolIndex;
+    mutable bool symbolIndexValid;
+
     static void demangle(std::string &name);
     std::string readString(const Elf::SectionHeader *SI, uint32_t offset) const;
 
     const Elf::FileHeader *getFileHeader() const;
     const Elf::SectionHeader *findSection(const std::string &name) const;
+    void buildSymbolIndex() const;
+    SymbolEntry *lookupSymbol(uint32_t address) const;
     const Elf::ProgramHeader *getProgramHeader(const Elf::FileHeader *fh, unsigned index) const;
 
     const Elf::ProgramHeader *getMetadataSegment() const;
@@ -32,6 +32,7 @@
 #include "delete.h"
 #include "paircube.h"
 #include "usbdevice.h"
+#include "tcpdevice.h"
 #include "reboot.h"
 #include "macros.h"
 #include "backup.h"
@@ -40,6 +41,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <string>
 
 static const Command commands[] = {
     // Keeping this list in alphabetical order, for lack of a better ordering...
@@ -128,6 +130,10 @@ static void usage()
         unsigned pad = maxUsageLen - strlen(commands[i].usage);
         fprintf(stderr, "  %s:%*s%s\n", commands[i].usage, pad, " ", commands[i].description);
     }
+
+    fprintf(stderr, "\nglobal options:\n"
+                    "  --siftulator [HOST:]PORT    talk to Siftulator's virtual USB port instead of hardware\n"
+                    "  --libusb-debug LEVEL        set libusb's debug verbosity\n");
 }
 
 static void version()
@@ -140,7 +146,7 @@ static void version()
 #endif
 }
 
-static int run(int argc, char **argv, UsbDevice &usbdev)
+static int run(int argc, char **argv, IODevice &dev)
 {
     const unsigned numCommands = sizeof(commands) / sizeof(commands[0]);
 
@@ -149,7 +155,7 @@ static int run(int argc, char **argv, UsbDevice &usbdev)
 
     for (unsigned i = 0; i < numCommands; ++i) {
         if (!strcmp(commandName, commands[i].name))
-            return commands[i].run(argc, argv, usbdev);
+            return commands[i].run(argc, argv, dev);
     }
 
     fprintf(stderr, "no command named %s\n", commandName);
@@ -158,7 +164,24 @@ static int run(int argc, char **argv, UsbDevice &usbdev)
     return 1;
 }
 
-static unsigned handleGlobalArgs(int argc, char **argv)
+static void parseHostPort(const char *arg, std::string &host, unsigned &port)
+{
+    /*
+     * Accept either "PORT" or "HOST:PORT". Siftulator only listens on
+     * the loopback interface, so that's the default host.
+     */
+
+    const char *colon = strrchr(arg, ':');
+    if (colon) {
+        host.assign(arg, colon - arg);
+        port = strtoul(colon + 1, NULL, 0);
+    } else {
+        host = "127.0.0.1";
+        port = strtoul(arg, NULL, 0);
+    }
+}
+
+static unsigned handleGlobalArgs(int argc, char **argv, std::string &tcpHost, unsigned &tcpPort)
 {
     /*
      * Handle global args, not specific to any command.
@@ -180,6 +203,15 @@ static unsigned handleGlobalArgs(int argc, char **argv)
             continue;
         }
 
+        if (!strcmp(argv[i], "--siftulator") && i + 1 < argc) {
+
+            parseHostPort(argv[i + 1], tcpHost, tcpPort);
+
+            consumed += 2;
+            i++;
+            continue;
+        }
+
     }
 
     return consumed;
@@ -197,12 +229,11 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    /*
-     * TODO: add support for specifying a TCP connection to siftulator.
-     */
     Usb::init();
 
-    unsigned consumed = handleGlobalArgs(argc, argv);
+    std::string tcpHost;
+    unsigned tcpPort = 0;
+    unsigned consumed = handleGlobalArgs(argc, argv, tcpHost, tcpPort);
     argc -= consumed;
     argv += consumed;
 
@@ -212,12 +243,15 @@ int main(int argc, char **argv)
     }
 
     UsbDevice usbdev;
-    int rv = run(argc, argv, usbdev);
+    TcpDevice tcpdev(tcpHost.c_str(), tcpPort);
+    IODevice &dev = tcpPort ? static_cast<IODevice&>(tcpdev) : usbdev;
+
+    int rv = run(argc, argv, dev);
 
-    if (usbdev.isOpen()) {
-        usbdev.close();
-        while (usbdev.isOpen()) {
-            usbdev.processEvents(1);
+    if (dev.isOpen()) {
+        dev.close();
+        while (dev.isOpen()) {
+            dev.processEvents(1);
         }
     }
 
@@ -0,0 +1,212 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * swiss - your Sifteo utility knife
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#else
+#   include <sys/types.h>
+#   include <sys/socket.h>
+#   include <sys/select.h>
+#   include <netinet/tcp.h>
+#   include <netinet/in.h>
+#   include <netdb.h>
+#   include <unistd.h>
+#   define closesocket(_s) ::close(_s)
+#endif
+
+#include "tcpdevice.h"
+#include <stdio.h>
+#include <string.h>
+
+
+TcpDevice::TcpDevice(const char *host, unsigned port) :
+    mHost(host),
+    mPort(port),
+    mSocket(-1)
+{
+}
+
+bool TcpDevice::open(uint16_t vendorId, uint16_t productId, uint8_t interface)
+{
+    /*
+     * Siftulator only ever presents itself as a running Base. There's
+     * no simulated bootloader to update firmware through.
+     */
+
+    if (productId != BASE_PID) {
+        fprintf(stderr, "device is not available in siftulator\n");
+        return false;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    char portStr[16];
+    snprintf(portStr, sizeof portStr, "%u", mPort);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(mHost.c_str(), portStr, &hints, &res) != 0) {
+        fprintf(stderr, "can't resolve siftulator host %s\n", mHost.c_str());
+        return false;
+    }
+
+    mSocket = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (mSocket >= 0 && connect(mSocket, res->ai_addr, res->ai_addrlen) < 0) {
+        closesocket(mSocket);
+        mSocket = -1;
+    }
+    freeaddrinfo(res);
+
+    if (mSocket < 0) {
+        fprintf(stderr, "can't connect to siftulator at %s:%u\n", mHost.c_str(), mPort);
+        return false;
+    }
+
+    unsigned long arg = 1;
+    setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, (const char *)&arg, sizeof arg);
+    #ifdef SO_NOSIGPIPE
+        setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &arg, sizeof arg);
+    #endif
+
+    mRxBuffer.clear();
+    mBufferedINPackets.clear();
+    return true;
+}
+
+void TcpDevice::close()
+{
+    if (!isOpen())
+        return;
+
+    closesocket(mSocket);
+    mSocket = -1;
+}
+
+bool TcpDevice::isOpen() const
+{
+    return mSocket >= 0;
+}
+
+int TcpDevice::processEvents(unsigned timeoutMillis)
+{
+    /*
+     * Wait up to 'timeoutMillis' for data, then split whatever arrived
+     * into packets. Returns a negative value if the connection is lost.
+     */
+
+    if (!isOpen())
+        return -1;
+
+    fd_set rfds;
+    struct timeval tv = {
+        timeoutMillis / 1000,           // tv_sec
+        (timeoutMillis % 1000) * 1000   // tv_usec
+    };
+
+    FD_ZERO(&rfds);
+    FD_SET(mSocket, &rfds);
+    int sel = select(mSocket + 1, &rfds, NULL, NULL, &tv);
+    if (sel <= 0)
+        return sel;
+
+    uint8_t buf[4096];
+    int ret = recv(mSocket, (char *) buf, sizeof buf, 0);
+    if (ret <= 0) {
+        fprintf(stderr, "siftulator connection closed\n");
+        close();
+        return -1;
+    }
+
+    mRxBuffer.insert(mRxBuffer.end(), buf, buf + ret);
+
+    unsigned offset = 0;
+    while (offset < mRxBuffer.size()) {
+        unsigned len = mRxBuffer[offset];
+        if (offset + 1 + len > mRxBuffer.size())
+            break;
+        mBufferedINPackets.push_back(std::vector<uint8_t>(
+            mRxBuffer.begin() + offset + 1, mRxBuffer.begin() + offset + 1 + len));
+        offset += 1 + len;
+    }
+    mRxBuffer.erase(mRxBuffer.begin(), mRxBuffer.begin() + offset);
+
+    return 0;
+}
+
+int TcpDevice::readPacket(uint8_t *buf, unsigned maxlen, unsigned &rxlen)
+{
+    /*
+     * Dequeue a packet that has already been received.
+     * Returns zero on success, the same as LIBUSB_TRANSFER_COMPLETED.
+     */
+
+    if (mBufferedINPackets.empty())
+        return -1;
+
+    const std::vector<uint8_t> &pkt = mBufferedINPackets.front();
+    rxlen = maxlen < pkt.size() ? maxlen : pkt.size();
+    if (rxlen)
+        memcpy(buf, &pkt[0], rxlen);
+
+    mBufferedINPackets.pop_front();
+    return 0;
+}
+
+int TcpDevice::writePacket(const uint8_t *buf, unsigned len)
+{
+    if (!isOpen())
+        return -1;
+
+    if (len > MAX_EP_SIZE)
+        len = MAX_EP_SIZE;
+
+    uint8_t frame[1 + MAX_EP_SIZE];
+    frame[0] = len;
+    memcpy(frame + 1, buf, len);
+
+    const uint8_t *p = frame;
+    unsigned remaining = len + 1;
+    while (remaining) {
+        int ret = send(mSocket, (const char *) p, remaining, 0);
+        if (ret <= 0) {
+            fprintf(stderr, "siftulator connection closed\n");
+            close();
+            return -1;
+        }
+        p += ret;
+        remaining -= ret;
+    }
+
+    return len;
+}
@@ -0,0 +1,80 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * swiss - your Sifteo utility knife
+ *
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TCP_DEVICE_H_
+#define _TCP_DEVICE_H_
+
+#include "iodevice.h"
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+/*
+ * IODevice backend for Siftulator's virtual USB port (--usb-port).
+ *
+ * Packets travel over a local TCP connection, each framed as one length
+ * byte followed by the packet data. Writes go straight to the socket, so
+ * there are never any pending OUT transfers; back-pressure comes from
+ * the socket blocking when Siftulator's receive queue is full.
+ */
+class TcpDevice : public IODevice {
+public:
+    TcpDevice(const char *host, unsigned port);
+
+    bool open(uint16_t vendorId, uint16_t productId, uint8_t interface = 0);
+    void close();
+    bool isOpen() const;
+    int  processEvents(unsigned timeoutMillis = 0);
+
+    unsigned maxINPacketSize() const {
+        return MAX_EP_SIZE;
+    }
+
+    unsigned maxOUTPacketSize() const {
+        return MAX_EP_SIZE;
+    }
+
+    unsigned numPendingINPackets() const {
+        return mBufferedINPackets.size();
+    }
+    int readPacket(uint8_t *buf, unsigned maxlen, unsigned &rxlen);
+
+    unsigned numPendingOUTPackets() const {
+        return 0;
+    }
+    int writePacket(const uint8_t *buf, unsigned len);
+
+private:
+    std::string mHost;
+    unsigned mPort;
+    int mSocket;
+
+    std::vector<uint8_t> mRxBuffer;
+    std::deque< std::vector<uint8_t> > mBufferedINPackets;
+};
+
+#endif // _TCP_DEVICE_H_
@@ -0,0 +1,344 @@
+/*
+ * Tests and benchmarks for block mixing in AudioChannelSlot::mixAudio.
+ *
+ * This reproduces both versions of the channel's inner loop, including
+ * the AudioSampleData ring they read from and its half-buffer refills:
+ *
+ *   - The original one-frame-at-a-time mixer, with its 32-sample ring.
+ *   - The span mixer, with either a 32-sample or a 64-sample ring.
+ *
+ * All of them must produce exactly the same output. Sample data is PCM
+ * from a looping source, so refills are a plain copy, as they are for
+ * PCM assets on hardware.
+ */
+
+#include "audiomixspan.h"
+#include "macros.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const unsigned BLOCK_FRAMES = 32;        // Same as AudioMixer
+static const unsigned NUM_CHANNELS = 8;
+static const unsigned LOOP_START = 1000;
+static const unsigned LOOP_END = 9000;          // Before first sample
+static const unsigned MAX_RING = 64;
+
+static int16_t source[LOOP_END + MAX_RING];
+
+// Number of spans mixed, for reporting
+static unsigned spanCount;
+
+static uint32_t prngState = 0x12345678;
+
+static uint32_t prng()
+{
+    prngState = prngState * 1103515245 + 12345;
+    return prngState >> 8;
+}
+
+/*
+ * Model of AudioSampleData, for one ring size. Only the buffer logic
+ * differs between sizes; getSample() and getSamplePair() are the
+ * original accessors, getSpan() is the current one.
+ */
+template <unsigned FULL_BUFFER>
+struct TestSampleData {
+    static const unsigned HALF_BUFFER = FULL_BUFFER / 2;
+    static const unsigned FULL_BUFFER_MASK = FULL_BUFFER - 1;
+    static const unsigned HALF_BUFFER_MASK = HALF_BUFFER - 1;
+
+    int16_t samples[FULL_BUFFER + 1];
+    unsigned stateSampleNum;
+
+    void reset()
+    {
+        stateSampleNum = 0;
+    }
+
+    void fetchBlock(unsigned sampleNum)
+    {
+        ASSERT((sampleNum & HALF_BUFFER_MASK) == 0);
+        memcpy(&samples[sampleNum & FULL_BUFFER_MASK], &source[sampleNum],
+            HALF_BUFFER * sizeof(int16_t));
+        samples[FULL_BUFFER] = samples[0];
+        stateSampleNum = sampleNum + HALF_BUFFER;
+    }
+
+    ALWAYS_INLINE int getSample(unsigned sampleNum)
+    {
+        unsigned diff = stateSampleNum - (sampleNum + 1);
+        if (UNLIKELY(diff >= FULL_BUFFER))
+            fetchBlock(sampleNum & ~HALF_BUFFER_MASK);
+
+        return samples[sampleNum & FULL_BUFFER_MASK];
+    }
+
+    ALWAYS_INLINE int getSamplePair(unsigned sampleNum, int &sample)
+    {
+        unsigned nextSample = sampleNum + 1;
+        unsigned diff = stateSampleNum - (nextSample + 1);
+        if (UNLIKELY(diff >= FULL_BUFFER))
+            fetchBlock(nextSample & ~HALF_BUFFER_MASK);
+
+        sample = samples[sampleNum & FULL_BUFFER_MASK];
+        return samples[nextSample & FULL_BUFFER_MASK];
+    }
+
+    ALWAYS_INLINE const int16_t *getSpan(unsigned sampleNum, unsigned &count)
+    {
+        unsigned nextSample = sampleNum + 1;
+
+        if (UNLIKELY(stateSampleNum - (sampleNum + 1) >= FULL_BUFFER))
+            fetchBlock(sampleNum & ~HALF_BUFFER_MASK);
+        if (UNLIKELY(stateSampleNum - (nextSample + 1) >= FULL_BUFFER))
+            fetchBlock(nextSample & ~HALF_BUFFER_MASK);
+
+        unsigned slot = sampleNum & FULL_BUFFER_MASK;
+        count = MIN(stateSampleNum - sampleNum, FULL_BUFFER + 1 - slot);
+        ASSERT(count >= 2);
+
+        return &samples[slot];
+    }
+};
+
+template <unsigned FULL_BUFFER>
+struct TestChannel {
+    TestSampleData<FULL_BUFFER> samples;
+    uint64_t offset;
+    int increment;
+    int volume;
+
+    void init(unsigned pos, int increment, int volume)
+    {
+        samples.reset();
+        this->offset = uint64_t(pos) << SAMPLE_FRAC_SIZE;
+        this->increment = increment;
+        this->volume = volume;
+    }
+};
+
+/*
+ * Per-frame reference: the original AudioChannelSlot::mixAudio loop, for
+ * a looping channel that's producing output.
+ */
+static void mixReference(int *buffer, TestChannel<32> &ch, unsigned numFrames)
+{
+    const int latchedVolume = ch.volume;
+    const int latchedIncrement = ch.increment;
+    uint64_t localOffset = ch.offset;
+
+    do {
+        unsigned index = localOffset >> SAMPLE_FRAC_SIZE;
+        unsigned fractional = localOffset & SAMPLE_FRAC_MASK;
+
+        if (UNLIKELY(index >= LOOP_END)) {
+            localOffset -= (LOOP_END - LOOP_START) << SAMPLE_FRAC_SIZE;
+            index = localOffset >> SAMPLE_FRAC_SIZE;
+        }
+
+        int sample;
+        if (!fractional) {
+            sample = ch.samples.getSample(index);
+        } else {
+            int next;
+            if (LIKELY(index + 1 < LOOP_END)) {
+                next = ch.samples.getSamplePair(index, sample);
+            } else {
+                sample = ch.samples.getSample(index);
+                next = ch.samples.getSample(LOOP_START);
+            }
+            sample += ((next - sample) * int(fractional)) >> SAMPLE_FRAC_SIZE;
+        }
+
+        *(buffer++) += (sample * latchedVolume) >> _SYS_AUDIO_MAX_VOLUME_LOG2;
+        localOffset += latchedIncrement;
+
+    } while (--numFrames);
+
+    ch.offset = localOffset;
+}
+
+/*
+ * Span mixer: the current AudioChannelSlot::mixAudio loop, minus the
+ * simulator-only visualizer copy.
+ */
+template <unsigned FULL_BUFFER>
+static void mixSpans(int *buffer, TestChannel<FULL_BUFFER> &ch, unsigned numFrames)
+{
+    const int latchedVolume = ch.volume;
+    const int latchedIncrement = ch.increment;
+    uint64_t localOffset = ch.offset;
+
+    do {
+        unsigned index = localOffset >> SAMPLE_FRAC_SIZE;
+        unsigned fractional = localOffset & SAMPLE_FRAC_MASK;
+
+        if (UNLIKELY(index >= LOOP_END)) {
+            localOffset -= (LOOP_END - LOOP_START) << SAMPLE_FRAC_SIZE;
+            index = localOffset >> SAMPLE_FRAC_SIZE;
+        }
+
+        if (UNLIKELY(index + 1 >= LOOP_END)) {
+            int sample = ch.samples.getSample(index);
+            if (fractional) {
+                int next = ch.samples.getSample(LOOP_START);
+                sample += ((next - sample) * int(fractional)) >> SAMPLE_FRAC_SIZE;
+            }
+            *(buffer++) += (sample * latchedVolume) >> _SYS_AUDIO_MAX_VOLUME_LOG2;
+            localOffset += latchedIncrement;
+            continue;
+        }
+
+        unsigned avail;
+        const int16_t *src = ch.samples.getSpan(index, avail);
+        avail = MIN(avail, LOOP_END - index);
+
+        uint32_t limit = (avail - 1) << SAMPLE_FRAC_SIZE;
+        unsigned count = numFrames;
+        if (latchedIncrement) {
+            uint32_t reachable = (limit - fractional + latchedIncrement - 1) / latchedIncrement;
+            count = MIN(count, reachable);
+        }
+        ASSERT(count > 0);
+
+        AudioMixSpan::mix(buffer, src, fractional, latchedIncrement, count, latchedVolume);
+        spanCount++;
+
+        buffer += count;
+        localOffset += uint64_t(count) * latchedIncrement;
+        numFrames -= count - 1;
+
+    } while (--numFrames);
+
+    ch.offset = localOffset;
+}
+
+static void verify()
+{
+    static const uint32_t rates[] = { 8000, 11025, 16000, 22050, 32000, 44100, 0 };
+
+    for (unsigned trial = 0; trial < 2000; ++trial) {
+        uint32_t rate = rates[trial % arraysize(rates)];
+        int increment = rate ? (rate << SAMPLE_FRAC_SIZE) / 16000 : prng() & 0x3FFF;
+        int volume = prng() % (_SYS_AUDIO_MAX_VOLUME + 1);
+
+        // Start anywhere, including just before the loop point
+        unsigned pos = (trial & 1) ? LOOP_END - 1 - prng() % 40 : prng() % LOOP_END;
+
+        TestChannel<32> ref, span32;
+        TestChannel<64> span64;
+        ref.init(pos, increment, volume);
+        span32.init(pos, increment, volume);
+        span64.init(pos, increment, volume);
+
+        for (unsigned block = 0; block < 50; ++block) {
+            int refBuffer[BLOCK_FRAMES];
+            int buffer32[BLOCK_FRAMES];
+            int buffer64[BLOCK_FRAMES];
+            for (unsigned i = 0; i < BLOCK_FRAMES; ++i)
+                refBuffer[i] = buffer32[i] = buffer64[i] = int(prng()) - 0x800000;
+
+            unsigned frames = 1 + prng() % BLOCK_FRAMES;
+            mixReference(refBuffer, ref, frames);
+            mixSpans(buffer32, span32, frames);
+            mixSpans(buffer64, span64, frames);
+
+            ASSERT(ref.offset == span32.offset);
+            ASSERT(ref.offset == span64.offset);
+            ASSERT(memcmp(refBuffer, buffer32, sizeof refBuffer) == 0);
+            ASSERT(memcmp(refBuffer, buffer64, sizeof refBuffer) == 0);
+        }
+    }
+}
+
+/*
+ * Time one mixer, in ns per output frame. Each run is long enough to
+ * dwarf clock() granularity, and we keep the best of several runs to
+ * filter out noise from the rest of the host.
+ */
+template <typename Channel>
+static double benchmark(void (*fn)(int*, Channel&, unsigned),
+    unsigned numChannels, uint32_t rate)
+{
+    static const unsigned BLOCKS = 500000;
+    static const unsigned RUNS = 5;
+
+    double best = 0;
+    for (unsigned run = 0; run < RUNS; ++run) {
+        Channel channels[NUM_CHANNELS];
+        for (unsigned c = 0; c < numChannels; ++c)
+            channels[c].init(LOOP_START + c * 997, (rate << SAMPLE_FRAC_SIZE) / 16000,
+                _SYS_AUDIO_DEFAULT_VOLUME);
+
+        int buffer[BLOCK_FRAMES];
+        int sink = 0;
+        clock_t start = clock();
+
+        for (unsigned block = 0; block < BLOCKS; ++block) {
+            memset(buffer, 0, sizeof buffer);
+            for (unsigned c = 0; c < numChannels; ++c)
+                fn(buffer, channels[c], BLOCK_FRAMES);
+            sink += buffer[block % BLOCK_FRAMES];
+        }
+
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+        if (sink == 0x7FFFFFFF)
+            LOG(("(unlikely)\n"));
+
+        double ns = seconds * 1e9 / (double(BLOCKS) * BLOCK_FRAMES);
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+
+    return best;
+}
+
+// Average spans per channel per block, for one ring size
+template <unsigned FULL_BUFFER>
+static double spansPerBlock(uint32_t rate)
+{
+    static const unsigned BLOCKS = 10000;
+
+    TestChannel<FULL_BUFFER> ch;
+    ch.init(LOOP_START, (rate << SAMPLE_FRAC_SIZE) / 16000, _SYS_AUDIO_DEFAULT_VOLUME);
+
+    int buffer[BLOCK_FRAMES];
+    spanCount = 0;
+    for (unsigned block = 0; block < BLOCKS; ++block)
+        mixSpans(buffer, ch, BLOCK_FRAMES);
+
+    return double(spanCount) / BLOCKS;
+}
+
+int main()
+{
+    for (unsigned i = 0; i < arraysize(source); ++i)
+        source[i] = int16_t(prng());
+
+    verify();
+    LOG(("audiomix: Span mixer matches the reference mixer.\n"));
+
+    static const unsigned channelCounts[] = { 1, 4, 8 };
+    static const uint32_t rates[] = { 16000, 22050 };
+
+    for (unsigned r = 0; r < arraysize(rates); ++r) {
+        LOG(("audiomix: %5u Hz, spans per block: ring/32 %.2f, ring/64 %.2f\n",
+            rates[r], spansPerBlock<32>(rates[r]), spansPerBlock<64>(rates[r])));
+
+        for (unsigned c = 0; c < arraysize(channelCounts); ++c) {
+            unsigned n = channelCounts[c];
+            double ref = benchmark(mixReference, n, rates[r]);
+            double span32 = benchmark(mixSpans<32>, n, rates[r]);
+            double span64 = benchmark(mixSpans<64>, n, rates[r]);
+
+            LOG(("audiomix: %5u Hz, %u channel(s): per-frame %6.2f ns/frame, "
+                "span ring/32 %6.2f (%.2fx), ring/64 %6.2f (%.2fx)\n",
+                rates[r], n, ref, span32, ref / span32, span64, ref / span64));
+        }
+    }
+
+    LOG(("audiomix: Success.\n"));
+    return 0;
+}
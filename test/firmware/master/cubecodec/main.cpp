@@ -0,0 +1,660 @@
+/*
+ * Replay benchmark for the CubeCodec VRAM encoder.
+ *
+ * Workloads are sequences of painted frames: which VRAM words changed,
+ * and their new values. These come either from a few built-in synthetic
+ * scenarios, or from a recording made by running Siftulator with
+ * --vram-record (see emulator/src/mc_vramrecorder.h).
+ *
+ * Every packet we encode is fed through a reference decoder, written from
+ * the protocol description in protocol.h, and after each frame the
+ * decoded VRAM must exactly match the master's copy. We report the radio
+ * cost of each workload and the time spent encoding, with both the
+ * greedy encoder and the lookahead encoder (CubeCodec::lookahead).
+ *
+ * usage: cubecodec [recording.vram]
+ */
+
+#include "cubecodec.h"
+#include "vram.h"
+#include "macros.h"
+#include <protocol.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static const uint8_t FRAME_FULL = 1 << 0;   // Same as VRAMRecorder::FULL
+
+struct Frame {
+    uint8_t cube;
+    uint8_t flags;
+    uint32_t lock;
+    std::vector<uint16_t> addrs;
+    std::vector<uint16_t> values;
+
+    void set(uint16_t addr, uint16_t value) {
+        addrs.push_back(addr);
+        values.push_back(value);
+    }
+};
+
+typedef std::vector<Frame> Workload;
+
+enum CodeType {
+    C_COPY, C_DIFF, C_LIT14, C_LIT16, C_RUN, C_RUN_LONG,
+    C_SKIP, C_ADDR, C_ESCAPE, NUM_CODE_TYPES
+};
+
+static const char *codeNames[NUM_CODE_TYPES] = {
+    "copy", "diff", "lit14", "lit16", "run", "run+", "skip", "addr", "esc"
+};
+
+static uint32_t prngState = 0x12345678;
+
+static uint32_t prng()
+{
+    prngState = prngState * 1103515245 + 12345;
+    return prngState >> 8;
+}
+
+
+/*
+ * Reference decoder. This tracks the cube's copy of VRAM, following the
+ * nybble-stream rules in protocol.h, and tallies each kind of code.
+ */
+class RefDecoder {
+public:
+    uint16_t vram[_SYS_VRAM_WORDS];
+    unsigned codes[NUM_CODE_TYPES];
+
+    void init() {
+        memset(vram, 0, sizeof vram);
+        memset(codes, 0, sizeof codes);
+        reset();
+    }
+
+    void packet(const uint8_t *bytes, unsigned len)
+    {
+        for (unsigned i = 0; i != len; ++i) {
+            nybbles.push_back(bytes[i] & 0xF);
+            nybbles.push_back(bytes[i] >> 4);
+        }
+
+        unsigned pos = 0;
+        bool escaped = false;
+        while (pos < nybbles.size() && !escaped) {
+            unsigned used = code(&nybbles[pos], nybbles.size() - pos, escaped);
+            if (!used)
+                break;
+            pos += used;
+        }
+
+        // Escapes consume the rest of the packet as bytes. Otherwise,
+        // keep any partial code for the next packet.
+        if (escaped)
+            nybbles.clear();
+        else
+            nybbles.erase(nybbles.begin(), nybbles.begin() + pos);
+
+        // Anything shorter than a full packet resets the decoder
+        if (len < PacketBuffer::MAX_LEN)
+            reset();
+    }
+
+private:
+    std::vector<uint8_t> nybbles;
+    unsigned ptr;
+    unsigned codeS;
+    unsigned codeD;
+
+    void reset() {
+        nybbles.clear();
+        ptr = 0;
+        codeS = 0;
+        codeD = RF_VRAM_DIFF_BASE;
+    }
+
+    void write(uint16_t word) {
+        vram[ptr] = word;
+        ptr = (ptr + 1) & _SYS_VRAM_WORD_MASK;
+    }
+
+    void writeDeltas(unsigned count)
+    {
+        static const unsigned offsets[] = {
+            RF_VRAM_SAMPLE_0, RF_VRAM_SAMPLE_1, RF_VRAM_SAMPLE_2, RF_VRAM_SAMPLE_3
+        };
+
+        while (count--) {
+            uint16_t sample = vram[(ptr - offsets[codeS]) & _SYS_VRAM_WORD_MASK];
+            unsigned index = _SYS_INVERSE_TILE77(sample) + codeD - RF_VRAM_DIFF_BASE;
+            write(_SYS_TILE77(index & 0x3FFF) | (sample & 0x0101));
+        }
+    }
+
+    void primary(unsigned s, unsigned d) {
+        codeS = s;
+        codeD = d;
+    }
+
+    // Decode one code. Returns the number of nybbles used, or 0 if incomplete.
+    unsigned code(const uint8_t *n, unsigned avail, bool &escaped)
+    {
+        switch (n[0] >> 2) {
+
+        case 1:
+            primary(n[0] & 3, RF_VRAM_DIFF_BASE);
+            writeDeltas(1);
+            codes[C_COPY]++;
+            return 1;
+
+        case 2:
+            if (avail < 2)
+                return 0;
+            if (n[1] == RF_VRAM_DIFF_BASE) {
+                escaped = true;
+                codes[C_ESCAPE]++;
+                return 2;
+            }
+            primary(n[0] & 3, n[1]);
+            writeDeltas(1);
+            codes[C_DIFF]++;
+            return 2;
+
+        case 3:
+            if (avail < 4)
+                return 0;
+            write(_SYS_TILE77(((n[0] & 3) << 12) | n[1] | (n[2] << 4) | (n[3] << 8)));
+            primary(0, RF_VRAM_DIFF_BASE);
+            codes[C_LIT14]++;
+            return 4;
+        }
+
+        // RLE class. A plain run is only complete once we see the next code.
+
+        if (avail < 2)
+            return 0;
+
+        if (n[1] >> 2) {
+            writeDeltas((n[0] & 3) + 1);
+            codes[C_RUN]++;
+            return 1;
+        }
+
+        switch (n[0]) {
+
+        case 0:
+        case 1:
+            ptr = (ptr + ((n[0] & 1) | ((n[1] & 3) << 1)) + 1) & _SYS_VRAM_WORD_MASK;
+            codes[C_SKIP]++;
+            return 2;
+
+        case 2:
+            if (avail < 3)
+                return 0;
+            writeDeltas((((n[1] & 3) << 4) | n[2]) + 5);
+            codes[C_RUN_LONG]++;
+            return 3;
+
+        default:
+            switch (n[1]) {
+
+            case 0:
+            case 1:
+                if (avail < 4)
+                    return 0;
+                ptr = ((n[1] & 1) << 8) | n[2] | (n[3] << 4);
+                codes[C_ADDR]++;
+                return 4;
+
+            case 2:
+                if (avail < 6)
+                    return 0;
+                write(n[2] | (n[3] << 4) | (n[4] << 8) | (n[5] << 12));
+                primary(0, RF_VRAM_DIFF_BASE);
+                codes[C_LIT16]++;
+                return 6;
+
+            default:
+                escaped = true;
+                codes[C_ESCAPE]++;
+                return 2;
+            }
+        }
+    }
+};
+
+
+struct CubeState {
+    _SYSVideoBuffer vbuf;
+    CubeCodec codec;
+    RefDecoder decoder;
+
+    void init() {
+        memset(&vbuf, 0, sizeof vbuf);
+        codec.stateReset();
+        decoder.init();
+    }
+};
+
+struct Stats {
+    unsigned frames;
+    unsigned words;
+    unsigned packets;
+    unsigned bytes;
+    double encodeSeconds;
+    unsigned codes[NUM_CODE_TYPES];
+
+    void init() {
+        memset(this, 0, sizeof *this);
+    }
+};
+
+/*
+ * Apply one frame the way userspace would (lock, write, mark cm1), then
+ * unlock it the way PaintControl does, and flush the whole frame over
+ * the radio. With a decoder, every packet is checked against it.
+ */
+static void sendFrame(CubeState &cs, const Frame &f, Stats &st, bool decode)
+{
+    _SYSVideoBuffer &vb = cs.vbuf;
+
+    vb.lock |= f.lock;
+    for (unsigned i = 0; i != f.addrs.size(); ++i) {
+        uint16_t addr = f.addrs[i];
+        vb.vram.words[addr] = f.values[i];
+        vb.cm1[addr >> 5] |= VRAM::maskCM1(addr);
+        vb.lock |= VRAM::maskCM16(addr);
+    }
+    VRAM::unlock(vb);
+
+    st.frames++;
+    st.words += f.addrs.size();
+
+    for (unsigned count = 0;; ++count) {
+        ASSERT(count < 1000);
+
+        uint8_t bytes[PacketBuffer::MAX_LEN];
+        PacketBuffer buf(bytes);
+
+        cs.codec.encodeVRAM(buf, &vb);
+        cs.codec.endPacket(buf);
+
+        st.packets++;
+        st.bytes += buf.len;
+        if (decode)
+            cs.decoder.packet(bytes, buf.len);
+
+        // Like CubeSlot, keep going only while we're filling packets
+        if (!buf.isFull())
+            break;
+    }
+
+    if (decode) {
+        for (unsigned addr = 0; addr != _SYS_VRAM_WORDS; ++addr)
+            if (cs.decoder.vram[addr] != vb.vram.words[addr]) {
+                LOG(("cubecodec: Mismatch in frame %u at %03x: sent %04x, decoded %04x\n",
+                    st.frames - 1, addr, vb.vram.words[addr], cs.decoder.vram[addr]));
+                ASSERT(0);
+            }
+    }
+}
+
+static void run(const Workload &frames, Stats &st)
+{
+    static CubeState cubes[_SYS_NUM_CUBE_SLOTS];
+
+    // Verified pass
+    st.init();
+    for (unsigned i = 0; i != arraysize(cubes); ++i)
+        cubes[i].init();
+    for (unsigned i = 0; i != frames.size(); ++i)
+        sendFrame(cubes[frames[i].cube], frames[i], st, true);
+    for (unsigned i = 0; i != arraysize(cubes); ++i)
+        for (unsigned c = 0; c != NUM_CODE_TYPES; ++c)
+            st.codes[c] += cubes[i].decoder.codes[c];
+
+    // Timed passes, encoding only. Repeat short workloads for a stable number.
+    Stats timing;
+    timing.init();
+    clock_t start = clock();
+    do {
+        for (unsigned i = 0; i != arraysize(cubes); ++i)
+            cubes[i].init();
+        for (unsigned i = 0; i != frames.size(); ++i)
+            sendFrame(cubes[frames[i].cube], frames[i], timing, false);
+    } while (clock() - start < CLOCKS_PER_SEC / 10);
+    st.encodeSeconds = double(clock() - start) / CLOCKS_PER_SEC * st.packets / timing.packets;
+}
+
+static void report(const char *name, const char *mode, const Stats &st)
+{
+    LOG(("cubecodec: %-12s %-9s %5u frames, %6.1f words/frame, %5.2f packets/frame, "
+        "%6.1f bytes/frame, %5.2f bytes/word, %5.0f ns/packet\n",
+        name, mode, st.frames, double(st.words) / st.frames,
+        double(st.packets) / st.frames, double(st.bytes) / st.frames,
+        double(st.bytes) / st.words, st.encodeSeconds * 1e9 / st.packets));
+
+    char line[256];
+    unsigned len = 0;
+    for (unsigned c = 0; c != NUM_CODE_TYPES; ++c)
+        len += snprintf(line + len, sizeof line - len, " %s=%u", codeNames[c], st.codes[c]);
+    LOG(("cubecodec: %-12s %-9s codes:%s\n", "", "", line));
+}
+
+
+/*
+ * Synthetic workloads. Each starts with a full frame, like a freshly
+ * attached VideoBuffer.
+ */
+
+static void fullFrame(Workload &w, const uint16_t *vram)
+{
+    Frame f;
+    f.cube = 0;
+    f.flags = FRAME_FULL;
+    f.lock = 0xFFFFFFFF;
+    for (unsigned addr = 0; addr != _SYS_VRAM_WORDS; ++addr)
+        f.set(addr, vram[addr]);
+    w.push_back(f);
+}
+
+static Frame emptyFrame()
+{
+    Frame f;
+    f.cube = 0;
+    f.flags = 0;
+    f.lock = 0;
+    return f;
+}
+
+static uint16_t mapTile(unsigned x, unsigned y)
+{
+    // A tiled level map: mostly runs of consecutive tiles, some repeats
+    return _SYS_TILE77(0x100 + (x % 24) + (y % 12) * 24 + ((x / 24 + y / 12) & 1) * 7);
+}
+
+static void bg0Tiles(_SYSVideoRAM &vram, unsigned mapX)
+{
+    for (unsigned y = 0; y != 18; ++y)
+        for (unsigned x = 0; x != 18; ++x)
+            vram.bg0_tiles[x + y * 18] = mapTile(mapX + x, y);
+}
+
+static uint16_t wordAt(const _SYSVideoRAM &vram, const void *field)
+{
+    return ((const uint8_t*) field - vram.bytes) / 2;
+}
+
+// Smooth horizontal scrolling: the pan register every frame, and a new
+// column of tiles every eight pixels, written into the wrapping BG0 buffer.
+static void scenarioPan(Workload &w)
+{
+    _SYSVideoRAM vram;
+    memset(&vram, 0, sizeof vram);
+    vram.mode = _SYS_VM_BG0;
+    vram.num_lines = 128;
+    bg0Tiles(vram, 0);
+    fullFrame(w, vram.words);
+
+    for (unsigned px = 1; px != 400; ++px) {
+        Frame f = emptyFrame();
+        unsigned column = px / 8;
+        if (px % 8 == 0) {
+            for (unsigned y = 0; y != 18; ++y) {
+                unsigned i = (column + 17) % 18 + y * 18;
+                vram.bg0_tiles[i] = mapTile(column + 17, y);
+                f.set(i, vram.bg0_tiles[i]);
+            }
+        }
+        vram.bg0_x = px % 144;
+        uint16_t pan = wordAt(vram, &vram.bg0_x);
+        f.set(pan, vram.words[pan]);
+        w.push_back(f);
+    }
+}
+
+// Redrawing the whole BG0 layer each frame, as a game without
+// hardware panning would.
+static void scenarioRedraw(Workload &w)
+{
+    _SYSVideoRAM vram;
+    memset(&vram, 0, sizeof vram);
+    vram.mode = _SYS_VM_BG0;
+    vram.num_lines = 128;
+    bg0Tiles(vram, 0);
+    fullFrame(w, vram.words);
+
+    for (unsigned frame = 1; frame != 100; ++frame) {
+        Frame f = emptyFrame();
+        bg0Tiles(vram, frame);
+        for (unsigned i = 0; i != arraysize(vram.bg0_tiles); ++i)
+            f.set(i, vram.bg0_tiles[i]);
+        w.push_back(f);
+    }
+}
+
+// Animated tiles scattered through a static map, like water or
+// torches: every third tile changes each frame.
+static void scenarioAnimated(Workload &w)
+{
+    _SYSVideoRAM vram;
+    memset(&vram, 0, sizeof vram);
+    vram.mode = _SYS_VM_BG0;
+    vram.num_lines = 128;
+    bg0Tiles(vram, 0);
+    fullFrame(w, vram.words);
+
+    for (unsigned frame = 1; frame != 200; ++frame) {
+        Frame f = emptyFrame();
+        for (unsigned i = 0; i != arraysize(vram.bg0_tiles); ++i)
+            if ((i % 18 + i / 18) % 3 == 0) {
+                vram.bg0_tiles[i] = _SYS_TILE77(0x600 + (i % 4) * 8 + frame % 8);
+                f.set(i, vram.bg0_tiles[i]);
+            }
+        w.push_back(f);
+    }
+}
+
+// Sprites moving over a static background, with a BG1 status overlay
+// that changes occasionally.
+static void scenarioSprites(Workload &w)
+{
+    _SYSVideoRAM vram;
+    memset(&vram, 0, sizeof vram);
+    vram.mode = _SYS_VM_BG0_SPR_BG1;
+    vram.num_lines = 128;
+    bg0Tiles(vram, 0);
+    for (unsigned i = 0; i != arraysize(vram.spr); ++i) {
+        vram.spr[i].mask_x = vram.spr[i].mask_y = 0xF0;
+        vram.spr[i].tile = _SYS_TILE77(0x400 + i * 4);
+    }
+    vram.bg1_bitmap[0] = 0xFFFF;
+    fullFrame(w, vram.words);
+
+    for (unsigned frame = 1; frame != 400; ++frame) {
+        Frame f = emptyFrame();
+        for (unsigned i = 0; i != arraysize(vram.spr); ++i) {
+            vram.spr[i].pos_x = -(int)(frame * (i + 1) / 2);
+            vram.spr[i].pos_y = -(int)(prng() % 112);
+            vram.spr[i].tile = _SYS_TILE77(0x400 + i * 4 + (frame / 4) % 4);
+            uint16_t first = wordAt(vram, &vram.spr[i]);
+            for (unsigned j = 0; j != sizeof vram.spr[i] / 2; ++j)
+                f.set(first + j, vram.words[first + j]);
+        }
+        if (frame % 30 == 0)
+            for (unsigned i = 0; i != 16; ++i) {
+                vram.bg1_tiles[i] = _SYS_TILE77(0x800 + (frame / 30 + i) % 10);
+                f.set(wordAt(vram, &vram.bg1_tiles[i]), vram.bg1_tiles[i]);
+            }
+        w.push_back(f);
+    }
+}
+
+// Random pixel updates in a 16-color framebuffer, which defeat the
+// delta codes and mostly produce 16-bit literals.
+static void scenarioFramebuffer(Workload &w)
+{
+    _SYSVideoRAM vram;
+    memset(&vram, 0, sizeof vram);
+    vram.mode = _SYS_VM_FB32;
+    vram.num_lines = 128;
+    for (unsigned i = 0; i != arraysize(vram.colormap); ++i)
+        vram.colormap[i] = i * 0x1111;
+    fullFrame(w, vram.words);
+
+    for (unsigned frame = 1; frame != 200; ++frame) {
+        Frame f = emptyFrame();
+        uint16_t first = prng() % 300;
+        for (unsigned i = 0; i != 32; ++i) {
+            uint16_t addr = (first + i) % (sizeof vram.fb / 2);
+            vram.words[addr] = prng();
+            f.set(addr, vram.words[addr]);
+        }
+        w.push_back(f);
+    }
+}
+
+
+/*
+ * Recordings from Siftulator's --vram-record option.
+ */
+
+static bool readVarint(const std::vector<uint8_t> &data, unsigned &pos, uint32_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; pos < data.size() && shift < 32; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= uint32_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static bool loadRecording(const char *filename, Workload &w)
+{
+    static const char magic[] = "TCVRAM01";
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        LOG(("cubecodec: Can't open '%s'\n", filename));
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t block[16384];
+    size_t len;
+    while ((len = fread(block, 1, sizeof block, f)) > 0)
+        data.insert(data.end(), block, block + len);
+    fclose(f);
+
+    if (data.size() < 8 || memcmp(&data[0], magic, 8)) {
+        LOG(("cubecodec: '%s' is not a VRAM recording\n", filename));
+        return false;
+    }
+
+    unsigned pos = 8;
+    while (pos < data.size()) {
+        Frame frame;
+        uint32_t ticks, count;
+
+        if (!readVarint(data, pos, ticks) || pos + 6 > data.size())
+            break;
+        frame.cube = data[pos];
+        frame.flags = data[pos + 1];
+        frame.lock = data[pos + 2] | (data[pos + 3] << 8) |
+            (data[pos + 4] << 16) | (uint32_t(data[pos + 5]) << 24);
+        pos += 6;
+        if (frame.cube >= _SYS_NUM_CUBE_SLOTS || !readVarint(data, pos, count))
+            break;
+
+        uint32_t addr = (uint32_t) -1;
+        while (count--) {
+            uint32_t delta;
+            if (!readVarint(data, pos, delta) || pos + 2 > data.size())
+                break;
+            addr += delta + 1;
+            if (addr >= _SYS_VRAM_WORDS)
+                break;
+            frame.set(addr, data[pos] | (data[pos + 1] << 8));
+            pos += 2;
+        }
+        if (count != (uint32_t) -1) {
+            LOG(("cubecodec: Truncated or corrupted record at offset %u\n", pos));
+            return false;
+        }
+
+        w.push_back(frame);
+    }
+
+    if (pos < data.size()) {
+        LOG(("cubecodec: Truncated or corrupted record at offset %u\n", pos));
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Each workload runs through both the greedy encoder and the lookahead
+ * encoder, so we can compare them directly.
+ */
+static void compare(const char *name, const Workload &w)
+{
+    Stats greedy, lookahead;
+
+    CubeCodec::lookahead = false;
+    run(w, greedy);
+    report(name, "greedy", greedy);
+
+    CubeCodec::lookahead = true;
+    run(w, lookahead);
+    report(name, "lookahead", lookahead);
+
+    LOG(("cubecodec: %-12s lookahead: %+.1f%% bytes, %+.1f%% packets\n", name,
+        100.0 * (double(lookahead.bytes) / greedy.bytes - 1.0),
+        100.0 * (double(lookahead.packets) / greedy.packets - 1.0)));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2) {
+        LOG(("usage: %s [recording.vram]\n", argv[0]));
+        return 1;
+    }
+
+    if (argc == 2) {
+        Workload w;
+        if (!loadRecording(argv[1], w))
+            return 1;
+        if (w.empty()) {
+            LOG(("cubecodec: No frames in '%s'\n", argv[1]));
+            return 1;
+        }
+        compare("recording", w);
+
+    } else {
+        static const struct {
+            const char *name;
+            void (*fn)(Workload &w);
+        } scenarios[] = {
+            { "bg0-pan", scenarioPan },
+            { "bg0-redraw", scenarioRedraw },
+            { "animated", scenarioAnimated },
+            { "sprites", scenarioSprites },
+            { "fb32", scenarioFramebuffer },
+        };
+
+        for (unsigned i = 0; i != arraysize(scenarios); ++i) {
+            Workload w;
+            scenarios[i].fn(w);
+            compare(scenarios[i].name, w);
+        }
+    }
+
+    LOG(("cubecodec: Decoded VRAM matches in every frame.\n"));
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * Benchmark for the compressed RWDATA formats.
+ *
+ * RWDATA is the only segment the loader decompresses, and it does so on
+ * every launch. This compresses the same data with FastLZ level 1 and with
+ * paged LZ, exactly as slinky would, and runs it back through the
+ * firmware's decoders. The output must match the original byte for byte.
+ * We report the compression ratio and decode speed for each format.
+ *
+ * Flash is simulated by a flat buffer. It obeys the same rule as the
+ * real thing, that no mapping crosses a flash block boundary, but it's
+ * free; on hardware, each mapping is also a block cache lookup, and
+ * FastLZ does several times as many of them.
+ *
+ * With no arguments, we use a few synthetic workloads. Otherwise, each
+ * argument is a game ELF, and we test on its actual RWDATA. The segment
+ * may be stored in either compressed format, or uncompressed.
+ *
+ * We also check that the paged LZ decoder stays in bounds on corrupted
+ * input.
+ *
+ * usage: rwdata [game.elf ...]
+ */
+
+#include "svmfastlz.h"
+#include "svmpagedlz.h"
+#include "elfdefs.h"
+#include "macros.h"
+#include "PagedLZ.h"
+#include "fastlz.h"
+#include <sifteo/abi/elf.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Buffer;
+
+
+/*
+ * Simulated flash. Only what the decoders need.
+ */
+
+static Buffer flashImage;
+
+FlashBlock::FlashStats FlashBlock::stats;
+
+bool SvmMemory::mapROData(FlashBlockRef &ref, VirtAddr va,
+    uint32_t &length, PhysAddr &pa)
+{
+    uint32_t offset = va - SEGMENT_0_VA;
+    if (offset >= flashImage.size())
+        return false;
+
+    uint32_t blockRemaining = FlashBlock::BLOCK_SIZE - (offset & FlashBlock::BLOCK_MASK);
+    length = MIN(length, MIN(blockRemaining, flashImage.size() - offset));
+    pa = &flashImage[offset];
+    return true;
+}
+
+bool SvmMemory::copyROData(FlashBlockRef &ref, PhysAddr dest,
+    VirtAddr src, uint32_t length)
+{
+    uint32_t offset = src - SEGMENT_0_VA;
+    if (offset > flashImage.size() || length > flashImage.size() - offset)
+        return false;
+
+    memcpy(dest, &flashImage[offset], length);
+    return true;
+}
+
+// Put compressed data in flash at the given offset, and return its address
+static SvmMemory::VirtAddr storeInFlash(const Buffer &data, unsigned offset)
+{
+    flashImage.assign(offset, 0xFF);
+    flashImage.insert(flashImage.end(), data.begin(), data.end());
+    return SvmMemory::SEGMENT_0_VA + offset;
+}
+
+
+/*
+ * Encoding and decoding, the same way slinky and SvmLoader do.
+ */
+
+enum Format {
+    FASTLZ,
+    PAGEDLZ,
+};
+
+static const char *formatNames[] = { "fastlz", "pagedlz" };
+
+static void compress(Format format, const Buffer &plaintext,
+    unsigned diskOffset, Buffer &out)
+{
+    out.clear();
+
+    if (format == FASTLZ) {
+        Buffer padded = plaintext;
+        while (padded.size() < 16)
+            padded.push_back(0);
+        out.resize(padded.size() * 2);
+        out.resize(fastlz_compress_level(1, &padded[0], padded.size(), &out[0]));
+
+    } else {
+        unsigned blockSize = FlashBlock::BLOCK_SIZE;
+        unsigned firstPage = blockSize - (diskOffset % blockSize);
+        PagedLZ::compress(plaintext.empty() ? 0 : &plaintext[0],
+            plaintext.size(), firstPage, out);
+    }
+}
+
+static bool decompress(Format format, SvmMemory::VirtAddr src, uint32_t srcLen,
+    uint8_t *dest, uint32_t &destLen)
+{
+    FlashBlockRef ref;
+
+    if (format == FASTLZ)
+        return SvmFastLZ::decompressL1(ref, dest, destLen, src, srcLen);
+    else
+        return SvmPagedLZ::decompress(ref, dest, destLen, src, srcLen);
+}
+
+
+static bool run(const char *name, const Buffer &plaintext, unsigned diskOffset)
+{
+    bool success = true;
+
+    for (unsigned f = 0; f != arraysize(formatNames); ++f) {
+        Format format = Format(f);
+        Buffer compressed;
+        compress(format, plaintext, diskOffset, compressed);
+        SvmMemory::VirtAddr src = storeInFlash(compressed, diskOffset);
+
+        // RAM is always at least as large as the plaintext, plus FastLZ padding
+        Buffer ram(MAX(plaintext.size(), 16) + 64);
+
+        // Verified pass
+        uint32_t destLen = ram.size();
+        if (!decompress(format, src, compressed.size(), &ram[0], destLen)
+            || destLen < plaintext.size()
+            || memcmp(&ram[0], &plaintext[0], plaintext.size())) {
+            LOG(("rwdata: %-12s %-8s DECODE MISMATCH\n", name, formatNames[f]));
+            success = false;
+            continue;
+        }
+
+        // Timed passes. Repeat for a stable number.
+        unsigned iterations = 0;
+        clock_t start = clock();
+        do {
+            destLen = ram.size();
+            decompress(format, src, compressed.size(), &ram[0], destLen);
+            iterations++;
+        } while (clock() - start < CLOCKS_PER_SEC / 10);
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC / iterations;
+
+        LOG(("rwdata: %-12s %-8s %6u -> %6u bytes, ratio %5.3f, %7.1f MB/s\n",
+            name, formatNames[f], unsigned(plaintext.size()), unsigned(compressed.size()),
+            double(compressed.size()) / MAX(plaintext.size(), 1),
+            plaintext.size() / seconds / 1e6));
+    }
+
+    return success;
+}
+
+
+/*
+ * Corrupted input. The decoder may fail or produce garbage, but it must
+ * never write outside 'dest' or report more than 'destLen' bytes.
+ */
+
+static uint32_t rngState = 1;
+
+static unsigned rand(unsigned range)
+{
+    rngState = rngState * 1103515245 + 12345;
+    return (rngState >> 8) % range;
+}
+
+static bool fuzz(const char *name, const Buffer &plaintext)
+{
+    static const unsigned GUARD = 64;
+    static const uint8_t GUARD_BYTE = 0xA5;
+    static const unsigned ITERATIONS = 5000;
+
+    Buffer compressed;
+    compress(PAGEDLZ, plaintext, 0, compressed);
+    unsigned failures = 0;
+
+    for (unsigned i = 0; i != ITERATIONS; ++i) {
+        Buffer corrupted = compressed;
+        for (unsigned n = 1 + rand(4); n; --n)
+            corrupted[rand(corrupted.size())] = rand(256);
+        if (rand(4) == 0)
+            corrupted.resize(1 + rand(corrupted.size()));
+
+        // Sometimes misalign the data, which also scrambles the page boundaries
+        unsigned offset = rand(2) ? 0 : rand(FlashBlock::BLOCK_SIZE);
+        SvmMemory::VirtAddr src = storeInFlash(corrupted, offset);
+
+        uint32_t capacity = rand(2) ? plaintext.size() : rand(plaintext.size() + 1);
+        Buffer ram(capacity + GUARD * 2, GUARD_BYTE);
+        uint32_t destLen = capacity;
+        FlashBlockRef ref;
+
+        if (!SvmPagedLZ::decompress(ref, &ram[GUARD], destLen, src, corrupted.size()))
+            failures++;
+
+        for (unsigned j = 0; j != GUARD; ++j)
+            if (ram[j] != GUARD_BYTE || ram[ram.size() - 1 - j] != GUARD_BYTE) {
+                LOG(("rwdata: %-12s fuzz: write out of bounds, iteration %u\n", name, i));
+                return false;
+            }
+
+        if (destLen > capacity) {
+            LOG(("rwdata: %-12s fuzz: bad length %u > %u, iteration %u\n",
+                name, destLen, capacity, i));
+            return false;
+        }
+    }
+
+    LOG(("rwdata: %-12s fuzz: %u corrupted streams, %u rejected\n",
+        name, ITERATIONS, failures));
+    return true;
+}
+
+
+/*
+ * Synthetic workloads, loosely modelled on what games keep in RWDATA.
+ */
+
+static void put32(Buffer &b, uint32_t value)
+{
+    for (unsigned i = 0; i != 4; ++i)
+        b.push_back(value >> (i * 8));
+}
+
+// Arrays of mostly zero-initialized objects, with a few fields set
+static void workloadSparse(Buffer &b)
+{
+    for (unsigned i = 0; i != 400; ++i) {
+        put32(b, i);
+        put32(b, 0);
+        put32(b, 0);
+        put32(b, i % 7 == 0 ? 0x3f800000 : 0);     // 1.0f
+        for (unsigned j = 0; j != 4; ++j)
+            put32(b, 0);
+    }
+}
+
+// Vtable-like tables of code addresses, and lookup tables of small values
+static void workloadTables(Buffer &b)
+{
+    for (unsigned i = 0; i != 600; ++i)
+        put32(b, 0x80010000 + (i * 0x34 + rand(4) * 0x100) * 4);
+    for (unsigned i = 0; i != 2048; ++i)
+        b.push_back((i * i / 37 + rand(3)) & 0xFF);
+}
+
+// Strings: level names, dialogue, and such
+static void workloadText(Buffer &b)
+{
+    static const char *words[] = {
+        "the", "cube", "level", "score", "player", "press", "to", "continue",
+        "you", "found", "a", "key", "door", "is", "locked", "game", "over",
+    };
+
+    for (unsigned i = 0; i != 3000; ++i) {
+        const char *w = words[rand(arraysize(words))];
+        b.insert(b.end(), w, w + strlen(w));
+        b.push_back(rand(8) ? ' ' : 0);
+    }
+}
+
+// Incompressible data, as a worst case
+static void workloadNoise(Buffer &b)
+{
+    for (unsigned i = 0; i != 8192; ++i)
+        b.push_back(rand(256));
+}
+
+
+/*
+ * RWDATA from a real game: decompress whatever compressed RWDATA
+ * segment the ELF already has.
+ */
+
+static bool loadELF(const char *filename, Buffer &plaintext, unsigned &diskOffset)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        perror(filename);
+        return false;
+    }
+
+    Buffer file;
+    uint8_t chunk[4096];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof chunk, f)) > 0)
+        file.insert(file.end(), chunk, chunk + len);
+    fclose(f);
+
+    Elf::FileHeader fh;
+    if (file.size() < sizeof fh) {
+        LOG(("rwdata: %s: not an ELF file\n", filename));
+        return false;
+    }
+    memcpy(&fh, &file[0], sizeof fh);
+
+    for (unsigned i = 0; i != fh.e_phnum; ++i) {
+        Elf::ProgramHeader ph;
+        unsigned offset = fh.e_phoff + i * fh.e_phentsize;
+        if (offset + sizeof ph > file.size())
+            break;
+        memcpy(&ph, &file[offset], sizeof ph);
+
+        if (ph.p_flags != (Elf::PF_Write | Elf::PF_Read) || !ph.p_filesz)
+            continue;
+
+        // The whole file is in flash, block aligned, like a game's payload
+        flashImage = file;
+
+        if (ph.p_type == Elf::PT_LOAD) {
+            // Uncompressed RWDATA, which the loader also accepts
+            if (ph.p_offset + ph.p_filesz > file.size())
+                break;
+            plaintext.assign(file.begin() + ph.p_offset,
+                file.begin() + ph.p_offset + ph.p_filesz);
+            diskOffset = ph.p_offset;
+            return true;
+        }
+
+        Format format;
+        if (ph.p_type == _SYS_ELF_PT_LOAD_FASTLZ)
+            format = FASTLZ;
+        else if (ph.p_type == _SYS_ELF_PT_LOAD_PAGEDLZ)
+            format = PAGEDLZ;
+        else
+            continue;
+
+        plaintext.resize(ph.p_memsz);
+        uint32_t destLen = ph.p_memsz;
+        if (!decompress(format, SvmMemory::SEGMENT_0_VA + ph.p_offset,
+            ph.p_filesz, &plaintext[0], destLen)) {
+            LOG(("rwdata: %s: can't decompress RWDATA\n", filename));
+            return false;
+        }
+
+        plaintext.resize(destLen);
+        diskOffset = ph.p_offset;
+        return true;
+    }
+
+    LOG(("rwdata: %s: no RWDATA segment\n", filename));
+    return false;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool success = true;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            Buffer plaintext;
+            unsigned diskOffset;
+            if (!loadELF(argv[i], plaintext, diskOffset)) {
+                success = false;
+                continue;
+            }
+
+            const char *name = strrchr(argv[i], '/');
+            name = name ? name + 1 : argv[i];
+            success &= run(name, plaintext, diskOffset);
+            success &= fuzz(name, plaintext);
+        }
+
+    } else {
+        static const struct {
+            const char *name;
+            void (*fn)(Buffer &b);
+        } workloads[] = {
+            { "sparse", workloadSparse },
+            { "tables", workloadTables },
+            { "text", workloadText },
+            { "noise", workloadNoise },
+        };
+
+        for (unsigned i = 0; i != arraysize(workloads); ++i) {
+            Buffer plaintext;
+            workloads[i].fn(plaintext);
+
+            // Start partway through a block, as RWDATA usually does
+            unsigned diskOffset = 0x1000 + 0x5c * (i + 1);
+            success &= run(workloads[i].name, plaintext, diskOffset);
+            success &= fuzz(workloads[i].name, plaintext);
+        }
+    }
+
+    if (!success) {
+        LOG(("rwdata: FAILED\n"));
+        return 1;
+    }
+    return 0;
+}
@@ -195,6 +195,38 @@ void createObjects()
     SCRIPT(LUA, player:stop());
 }
 
+void benchmarkObjectReads()
+{
+    /*
+     * Repeatedly read back a set of recently-written objects, as a game
+     * might do when it keeps several save slots. Reports throughput in
+     * simulated time, which is dominated by flash traffic.
+     */
+
+    // Manually allocated keys, well below the ones from StoredObject::allocate()
+    static const unsigned NUM_KEYS = 16;
+    static const unsigned NUM_READS = 2000;
+
+    for (unsigned i = 0; i < NUM_KEYS; ++i) {
+        objBuffer.value = i;
+        StoredObject(i).write(objBuffer);
+        SCRIPT_FMT(LUA, "writeTotal = writeTotal + %d", sizeof objBuffer);
+    }
+
+    SystemTime startTime = SystemTime::now();
+
+    for (unsigned i = 0; i < NUM_READS; ++i) {
+        unsigned k = i % NUM_KEYS;
+        objBuffer.value = -1;
+        StoredObject(k).read(objBuffer);
+        ASSERT(objBuffer.value == int(k));
+    }
+
+    float seconds = SystemTime::now() - startTime;
+    LOG("Object read benchmark: %d reads in %f sec, %f reads/sec\n",
+        NUM_READS, seconds, NUM_READS / seconds);
+}
+
 void testFsInfo()
 {  
     // Short reads
@@ -240,6 +272,9 @@ void main()
     // Now start flooding the FS with object writes
     createObjects();
 
+    // Read throughput, on a filesystem with plenty of history
+    benchmarkObjectReads();
+
     // Run all of the pure Lua tests (no API exercise needed)
     SCRIPT(LUA, testFilesystem());
 
@@ -0,0 +1,179 @@
+/*
+ * Micro-benchmark for stir's tile error metrics.
+ *
+ * Makes a set of pseudo-random tiles that look a bit like real artwork
+ * (smooth gradients, a few hard edges, some noise), checks that every
+ * TileMetric implementation agrees with the scalar one, then reports
+ * throughput for each metric in tile comparisons per second.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "tile.h"
+#include "tilemetric.h"
+
+using namespace Stir;
+
+static const unsigned NUM_TILES = 512;
+static const unsigned NUM_PAIRS = 200000;
+
+static uint32_t rngState = 1;
+
+static unsigned rng(unsigned range)
+{
+    rngState = rngState * 1103515245 + 12345;
+    return (rngState >> 16) % range;
+}
+
+static TileRef makeTile()
+{
+    uint8_t rgba[Tile::PIXELS * 4];
+
+    unsigned base[3] = { rng(256), rng(256), rng(256) };
+    int gradX[3] = { (int)rng(32) - 16, (int)rng(32) - 16, (int)rng(32) - 16 };
+    int gradY[3] = { (int)rng(32) - 16, (int)rng(32) - 16, (int)rng(32) - 16 };
+    unsigned edge = rng(Tile::SIZE * 2);
+    unsigned noise = 1 + rng(24);
+
+    for (unsigned y = 0; y < Tile::SIZE; y++)
+        for (unsigned x = 0; x < Tile::SIZE; x++)
+            for (unsigned c = 0; c < 3; c++) {
+                int v = base[c] + gradX[c] * (int)x + gradY[c] * (int)y + (int)rng(noise);
+                if (x + y > edge)
+                    v = 255 - v;
+                rgba[(x + y * Tile::SIZE) * 4 + c] = std::max(0, std::min(255, v));
+                rgba[(x + y * Tile::SIZE) * 4 + 3] = 0xFF;
+            }
+
+    return Tile::instance(TileOptions(8.0), rgba, Tile::SIZE * 4);
+}
+
+static double now()
+{
+    return clock() / (double)CLOCKS_PER_SEC;
+}
+
+enum Metric {
+    COARSE,
+    FINE,
+    SOBEL,
+    TOTAL,
+    TOTAL_LIMITED,
+    NUM_METRICS
+};
+
+static const char *metricName(Metric m)
+{
+    switch (m) {
+    case COARSE:            return "coarseMSE";
+    case FINE:              return "fineMSE";
+    case SOBEL:             return "sobelError";
+    case TOTAL:             return "errorMetric";
+    case TOTAL_LIMITED:     return "errorMetric (limit)";
+    default:                return "<invalid>";
+    }
+}
+
+static double evaluate(Metric m, Tile &a, Tile &b)
+{
+    switch (m) {
+    case COARSE:            return a.coarseMSE(b);
+    case FINE:              return a.fineMSE(b);
+    case SOBEL:             return a.sobelError(b);
+    case TOTAL:             return a.errorMetric(b);
+    case TOTAL_LIMITED:     return a.errorMetric(b, b.options().getMaxMSE());
+    default:                return 0;
+    }
+}
+
+static bool checkImplementations(std::vector<TileRef> &tiles)
+{
+    // Everything else must agree with the scalar implementation
+
+    bool success = true;
+
+    for (unsigned impl = TileMetric::SCALAR + 1; impl < TileMetric::NUM_IMPLEMENTATIONS; impl++) {
+        for (unsigned i = 0; i < NUM_TILES; i++) {
+            Tile &a = *tiles[i];
+            Tile &b = *tiles[(i * 7 + 1) % NUM_TILES];
+
+            for (unsigned m = 0; m < NUM_METRICS; m++) {
+                TileMetric::select(TileMetric::SCALAR);
+                double expected = evaluate(Metric(m), a, b);
+
+                if (!TileMetric::select(TileMetric::Implementation(impl)))
+                    continue;
+                double actual = evaluate(Metric(m), a, b);
+
+                if (fabs(actual - expected) > 1e-9 * std::max(1.0, fabs(expected))) {
+                    fprintf(stderr, "FAIL: %s %s, tile %u: expected %f, got %f\n",
+                            TileMetric::name(TileMetric::Implementation(impl)),
+                            metricName(Metric(m)), i, expected, actual);
+                    success = false;
+                }
+            }
+        }
+    }
+
+    return success;
+}
+
+static void benchmark(std::vector<TileRef> &tiles)
+{
+    printf("%-22s", "");
+    for (unsigned impl = 0; impl < TileMetric::NUM_IMPLEMENTATIONS; impl++)
+        if (TileMetric::select(TileMetric::Implementation(impl)))
+            printf("%16s", TileMetric::name(TileMetric::Implementation(impl)));
+    printf("\n");
+
+    for (unsigned m = 0; m < NUM_METRICS; m++) {
+        printf("%-22s", metricName(Metric(m)));
+
+        for (unsigned impl = 0; impl < TileMetric::NUM_IMPLEMENTATIONS; impl++) {
+            if (!TileMetric::select(TileMetric::Implementation(impl)))
+                continue;
+
+            double checksum = 0;
+            double start = now();
+
+            for (unsigned i = 0; i < NUM_PAIRS; i++) {
+                Tile &a = *tiles[i % NUM_TILES];
+                Tile &b = *tiles[(i * 7 + 1) % NUM_TILES];
+                checksum += std::min(1.0, evaluate(Metric(m), a, b));
+            }
+
+            double elapsed = std::max(1e-6, now() - start);
+            printf("%11.2f M/s", NUM_PAIRS / elapsed / 1e6);
+
+            // Keep the compiler from dropping the loop
+            if (checksum < 0)
+                printf("!");
+        }
+
+        printf("\n");
+    }
+
+    printf("\n(Million tile comparisons per second)\n");
+}
+
+int main()
+{
+    CIELab::initialize();
+
+    std::vector<TileRef> tiles;
+    for (unsigned i = 0; i < NUM_TILES; i++) {
+        tiles.push_back(makeTile());
+        tiles.back()->prepareErrorMetric();
+    }
+
+    if (!checkImplementations(tiles))
+        return 1;
+
+    benchmark(tiles);
+    return 0;
+}
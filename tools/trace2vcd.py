@@ -0,0 +1,163 @@
+#!/usr/bin/env python
+
+#
+# Convert a binary cube trace (trace.bvcd, written by the Siftulator
+# when run with -R) into a standard VCD file for use with a waveform viewer.
+#
+# Stream format: emulator/src/tracestream.h and emulator/src/vcdwriter.h
+#
+# usage: trace2vcd.py trace.bvcd trace.vcd
+#
+
+import sys, struct
+
+MAGIC = b"TCTRACE1"
+
+
+def fastlzDecompress(data):
+    """
+    Decompress one FastLZ level 1 block (vm/src/fastlz.c)
+    """
+
+    if data[0] >> 5:
+        raise ValueError("unsupported FastLZ level")
+
+    out = bytearray()
+    ctrl = data[0] & 31
+    ip = 1
+
+    while True:
+        if ctrl >= 32:
+            # Back-reference
+            length = (ctrl >> 5) - 1
+            dist = (ctrl & 31) << 8
+            if length == 6:
+                length += data[ip]
+                ip += 1
+            dist += data[ip] + 1
+            ip += 1
+            length += 3
+
+            start = len(out) - dist
+            if dist >= length:
+                out += out[start:start + length]
+            else:
+                for i in range(length):
+                    out.append(out[start + i])
+        else:
+            # Literal run
+            ctrl += 1
+            out += data[ip:ip + ctrl]
+            ip += ctrl
+
+        if ip >= len(data):
+            return out
+        ctrl = data[ip]
+        ip += 1
+
+
+def readBlocks(f):
+    """
+    Generator for the decompressed contents of each block in the file.
+    """
+
+    if f.read(len(MAGIC)) != MAGIC:
+        raise ValueError("not a binary trace file")
+
+    while True:
+        hdr = f.read(8)
+        if len(hdr) < 8:
+            return
+        rawLen, compLen = struct.unpack("<II", hdr)
+        if compLen:
+            data = fastlzDecompress(bytearray(f.read(compLen)))
+        else:
+            data = bytearray(f.read(rawLen))
+        if len(data) != rawLen:
+            raise ValueError("corrupted block")
+        yield data
+
+
+class Reader:
+    """
+    Byte-at-a-time reader over the concatenated block contents.
+    """
+
+    def __init__(self, blocks):
+        self.blocks = blocks
+        self.buf = bytearray()
+        self.pos = 0
+
+    def byte(self):
+        if self.pos == len(self.buf):
+            self.buf = next(self.blocks)
+            self.pos = 0
+        b = self.buf[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not (b & 0x80):
+                return value
+
+    def bytes(self, count):
+        return bytearray(self.byte() for i in range(count))
+
+
+def parseSignals(header):
+    """
+    Return a list of (identifier, numBits) tuples, in signal ID order.
+    """
+
+    signals = []
+    for line in header.splitlines():
+        tokens = line.split()
+        if tokens[:2] == ["$var", "reg"]:
+            signals.append((tokens[3], int(tokens[2])))
+    return signals
+
+
+def convert(inFile, outFile):
+    r = Reader(readBlocks(inFile))
+
+    header = r.bytes(r.varint()).decode("ascii")
+    signals = parseSignals(header)
+    outFile.write(header)
+
+    clock = 0
+    try:
+        while True:
+            clock += r.varint()
+            outFile.write("#%d\n" % clock)
+
+            # Changes within a tick are written in signal ID order
+            changes = []
+            while True:
+                id = r.varint()
+                if not id:
+                    break
+                changes.append((id, r.varint()))
+            changes.sort()
+
+            for id, value in changes:
+                ident, numBits = signals[id - 1]
+                bits = bin(value)[2:].zfill(numBits)
+                if numBits > 1:
+                    bits = "b" + bits
+                outFile.write("%s %s\n" % (bits, ident))
+
+    except StopIteration:
+        pass
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: %s trace.bvcd trace.vcd\n" % sys.argv[0])
+        sys.exit(1)
+
+    convert(open(sys.argv[1], "rb"), open(sys.argv[2], "w"))
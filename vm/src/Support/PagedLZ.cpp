@@ -0,0 +1,271 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo VM (SVM) Target for LLVM
+ *
+ * Micah Elizabeth Scott <micah@misc.name>
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * This is a fairly ordinary LZ77 match finder, with hash chains and one
+ * step of lazy evaluation. Compression happens once per link, and RWDATA
+ * is at most a few tens of kilobytes, so we search a lot harder than a
+ * typical LZ4 encoder would. All of the format-specific work happens in
+ * PageWriter, which splits sequences so they never cross a page.
+ */
+
+#include "PagedLZ.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace {
+
+    // Smallest and largest matches we'll emit
+    const unsigned MIN_MATCH = 4;
+    const unsigned MAX_MATCH = 32768;
+
+    // Matches can reach this far back
+    const unsigned MAX_OFFSET = 0xFFFF;
+
+    const unsigned HASH_BITS = 15;
+    const unsigned MAX_CHAIN = 512;
+    const unsigned NO_POS = (unsigned)-1;
+
+    class PageWriter {
+    public:
+        PageWriter(std::vector<uint8_t> &out, unsigned firstPage)
+            : out(out) {
+            beginPage(firstPage);
+        }
+
+        // Write one sequence. A 'matchLen' of zero means no match.
+        void sequence(const uint8_t *lit, unsigned litLen,
+            unsigned offset, unsigned matchLen);
+
+        // Finish the last page, without padding it
+        void finish() {
+            endPage();
+        }
+
+    private:
+        std::vector<uint8_t> &out;
+        unsigned pageStart;     // Index of the current page's header
+        unsigned pageEnd;       // Index just past the current page
+
+        void beginPage(unsigned size) {
+            pageStart = out.size();
+            pageEnd = pageStart + size;
+            out.push_back(0);
+        }
+
+        void endPage() {
+            out[pageStart] = out.size() - pageStart - 1;
+        }
+
+        void nextPage() {
+            endPage();
+            out.resize(pageEnd, 0);
+            beginPage(PagedLZ::PAGE_SIZE);
+        }
+
+        unsigned room() const {
+            return pageEnd - out.size();
+        }
+
+        static unsigned extBytes(unsigned len) {
+            return len < 15 ? 0 : (len - 15) / 255 + 1;
+        }
+
+        static unsigned cost(unsigned litLen, unsigned matchLen) {
+            unsigned bytes = 1 + extBytes(litLen) + litLen;
+            if (matchLen)
+                bytes += 2 + extBytes(matchLen - MIN_MATCH);
+            return bytes;
+        }
+
+        void writeLength(unsigned len) {
+            if (len >= 15) {
+                for (len -= 15; len >= 255; len -= 255)
+                    out.push_back(255);
+                out.push_back(len);
+            }
+        }
+
+        void write(const uint8_t *lit, unsigned litLen,
+            unsigned offset, unsigned matchLen);
+    };
+}
+
+
+void PageWriter::sequence(const uint8_t *lit, unsigned litLen,
+    unsigned offset, unsigned matchLen)
+{
+    while (cost(litLen, matchLen) > room()) {
+        /*
+         * Doesn't fit. Fill the rest of this page with as many literals as
+         * we can, as a literal-only sequence. That's only legal at the end
+         * of a page, so the rest of the sequence starts a new page.
+         */
+
+        unsigned n = litLen;
+        while (n && cost(n, 0) > room())
+            n--;
+
+        if (n) {
+            write(lit, n, 0, 0);
+            lit += n;
+            litLen -= n;
+        }
+
+        nextPage();
+    }
+
+    if (litLen || matchLen)
+        write(lit, litLen, offset, matchLen);
+}
+
+void PageWriter::write(const uint8_t *lit, unsigned litLen,
+    unsigned offset, unsigned matchLen)
+{
+    unsigned m = matchLen ? matchLen - MIN_MATCH : 0;
+    out.push_back((std::min(litLen, 15u) << 4) | std::min(m, 15u));
+
+    writeLength(litLen);
+    out.insert(out.end(), lit, lit + litLen);
+
+    if (matchLen) {
+        assert(offset >= 1 && offset <= MAX_OFFSET);
+        out.push_back(offset);
+        out.push_back(offset >> 8);
+        writeLength(m);
+    }
+
+    assert(out.size() <= pageEnd);
+}
+
+
+namespace {
+
+    class MatchFinder {
+    public:
+        MatchFinder(const uint8_t *src, unsigned len)
+            : src(src), len(len), head(1 << HASH_BITS, NO_POS), prev(len) {}
+
+        // Add position 'i' to the hash chains
+        void insert(unsigned i) {
+            if (i + MIN_MATCH <= len) {
+                unsigned h = hash(i);
+                prev[i] = head[h];
+                head[h] = i;
+            }
+        }
+
+        // Longest match for position 'i', using only earlier positions
+        unsigned find(unsigned i, unsigned &offset) const;
+
+    private:
+        const uint8_t *src;
+        unsigned len;
+        std::vector<unsigned> head;
+        std::vector<unsigned> prev;
+
+        unsigned hash(unsigned i) const {
+            uint32_t v = src[i] | (src[i+1] << 8) | (src[i+2] << 16) | (src[i+3] << 24);
+            return (v * 2654435761u) >> (32 - HASH_BITS);
+        }
+    };
+}
+
+unsigned MatchFinder::find(unsigned i, unsigned &offset) const
+{
+    if (i + MIN_MATCH > len)
+        return 0;
+
+    unsigned limit = std::min(len - i, MAX_MATCH);
+    unsigned best = 0;
+    unsigned pos = head[hash(i)];
+
+    for (unsigned chain = 0; pos != NO_POS && chain < MAX_CHAIN; ++chain) {
+        if (i - pos > MAX_OFFSET)
+            break;
+
+        // Quick reject: the byte that would make this the new best
+        if (src[pos + best] == src[i + best]) {
+            unsigned n = 0;
+            while (n < limit && src[pos + n] == src[i + n])
+                n++;
+
+            if (n > best) {
+                best = n;
+                offset = i - pos;
+                if (n == limit)
+                    break;
+            }
+        }
+
+        pos = prev[pos];
+    }
+
+    return best >= MIN_MATCH ? best : 0;
+}
+
+
+void PagedLZ::compress(const uint8_t *src, unsigned len,
+    unsigned firstPage, std::vector<uint8_t> &out)
+{
+    assert(firstPage >= 1 && firstPage <= PAGE_SIZE);
+
+    PageWriter writer(out, firstPage);
+    MatchFinder finder(src, len);
+    unsigned anchor = 0;    // Start of pending literals
+    unsigned hashed = 0;    // Positions before this are in the hash chains
+    unsigned i = 0;
+
+    while (i < len) {
+        while (hashed < i)
+            finder.insert(hashed++);
+
+        unsigned offset;
+        unsigned matchLen = finder.find(i, offset);
+        if (!matchLen) {
+            i++;
+            continue;
+        }
+
+        // Lazy evaluation: would we do better starting one byte later?
+        finder.insert(hashed++);
+        unsigned nextOffset;
+        unsigned nextLen = finder.find(i + 1, nextOffset);
+        if (nextLen > matchLen) {
+            i++;
+            matchLen = nextLen;
+            offset = nextOffset;
+        }
+
+        writer.sequence(src + anchor, i - anchor, offset, matchLen);
+        i += matchLen;
+        anchor = i;
+    }
+
+    // Trailing literals
+    writer.sequence(src + anchor, len - anchor, 0, 0);
+    writer.finish();
+}
@@ -0,0 +1,62 @@
+/* -*- mode: C; c-basic-offset: 4; intent-tabs-mode: nil -*-
+ *
+ * Sifteo VM (SVM) Target for LLVM
+ *
+ * Micah Elizabeth Scott <micah@misc.name>
+ * Copyright <c> 2012 Sifteo, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Encoder for the paged LZ format, used to compress RWDATA.
+ *
+ * The format is documented, along with the decoder, in the firmware's
+ * svmpagedlz.h. Briefly: LZ4-style sequences, packed into pages that line
+ * up with flash blocks, so that the loader can decode straight out of the
+ * flash block cache.
+ *
+ * This has no LLVM dependencies, so it can be shared with host-side tools.
+ */
+
+#ifndef SVM_SUPPORT_PAGEDLZ_H
+#define SVM_SUPPORT_PAGEDLZ_H
+
+#include <stdint.h>
+#include <vector>
+
+class PagedLZ {
+public:
+    // Pages are the same size as flash blocks
+    static const unsigned PAGE_SIZE = 256;
+
+    /**
+     * Compress 'len' bytes from 'src', appending the result to 'out'.
+     *
+     * 'firstPage' is the number of bytes between the start of the stream
+     * and the next flash block boundary, from 1 to PAGE_SIZE inclusive.
+     */
+    static void compress(const uint8_t *src, unsigned len,
+        unsigned firstPage, std::vector<uint8_t> &out);
+
+private:
+    PagedLZ();  // Do not implement
+};
+
+#endif
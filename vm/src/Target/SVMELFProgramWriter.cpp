@@ -29,11 +29,15 @@
 #include "SVMTargetMachine.h"
 #include "llvm/Support/CommandLine.h"
 #include "fastlz.h"
+#include "Support/PagedLZ.h"
 using namespace llvm;
 
 cl::opt<bool> ELFDebug("g",
     cl::desc("Include debug information in generated ELF files"));
 
+static cl::opt<bool> RWDataPagedLZ("rwdata-pagedlz",
+    cl::desc("Compress RWDATA with paged LZ (requires newer firmware)"));
+
 SVMELFProgramWriter::SVMELFProgramWriter(raw_ostream &OS)
     : MCObjectWriter(OS, true) {}
 
@@ -159,7 +163,7 @@ void SVMELFProgramWriter::writeProgramHeader(SVMProgramSection S)
 
     case SPS_RW_Z:
         Flags |= ELF::PF_W;
-        Type = SVMELF::PT_LOAD_FASTLZ;
+        Type = RWDataPagedLZ ? SVMELF::PT_LOAD_PAGEDLZ : SVMELF::PT_LOAD_FASTLZ;
         break;
 
     case SPS_META:
@@ -320,13 +324,32 @@ void SVMELFProgramWriter::rwCompress(MCAssembler &Asm, const MCAsmLayout &Layout
         }
     }
 
-    // FastLZ requires a minimum of 16 bytes to compress. Pad our section data.
-    while (plaintext.size() < 16)
-        plaintext.push_back(0);
+    std::vector<uint8_t> compressed;
+
+    if (RWDataPagedLZ) {
+        /*
+         * Paged LZ lines its pages up with flash blocks, so it needs to know
+         * where the data will land. The compressed section is the only
+         * SPS_RW_Z section, and it directly follows SPS_RO, whose size is
+         * already final. So this offset won't change when we re-layout.
+         */
+
+        uint32_t blockSize = SVMTargetMachine::getBlockSize();
+        uint32_t offset = ML.getSectionDiskOffset(SPS_RW_Z);
+        unsigned firstPage = blockSize - (offset % blockSize);
 
-    // Compress using FastLZ level 1
-    std::vector<uint8_t> compressed(plaintext.size() * 2);
-    compressed.resize(fastlz_compress_level(1, &plaintext[0], plaintext.size(), &compressed[0]));
+        PagedLZ::compress(plaintext.empty() ? 0 : &plaintext[0],
+            plaintext.size(), firstPage, compressed);
+
+    } else {
+        // FastLZ requires a minimum of 16 bytes to compress. Pad our section data.
+        while (plaintext.size() < 16)
+            plaintext.push_back(0);
+
+        // Compress using FastLZ level 1
+        compressed.resize(plaintext.size() * 2);
+        compressed.resize(fastlz_compress_level(1, &plaintext[0], plaintext.size(), &compressed[0]));
+    }
 
     // Create the new section
     const MCSectionELF *LZSection =